@@ -0,0 +1,123 @@
+#include "avalanche.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include "keyhash_batch.hpp"
+
+namespace lea {
+
+avalanche_stats::avalanche_stats(size_t input_byte_length)
+    : input_byte_length(input_byte_length),
+      input_bits(input_byte_length * 8),
+      sac(input_bits * 256) {}
+
+void avalanche_stats::add_sample(const limbs256& input) {
+    std::vector<limbs256> inputs(input_bits + 1, input);
+    std::vector<size_t>   lengths(input_bits + 1, input_byte_length);
+    std::vector<limbs256> outputs(input_bits + 1);
+    for (size_t i = 0; i < input_bits; i++) {
+        inputs[i + 1][i / 64] ^= uint64_t{1} << (i % 64);
+    }
+    gen_keyhash_batch(inputs, lengths, outputs);
+
+    const limbs256& base = outputs[0];
+    for (size_t i = 0; i < input_bits; i++) {
+        uint64_t* row   = &sac[i * 256];
+        size_t    count = 0;
+        for (size_t limb = 0; limb < 4; limb++) {
+            uint64_t diff = base[limb] ^ outputs[i + 1][limb];
+            count += __builtin_popcountll(diff);
+            for (; diff != 0; diff &= diff - 1) {
+                row[limb * 64 + __builtin_ctzll(diff)]++;
+            }
+        }
+        flipped[count]++;
+    }
+    samples++;
+}
+
+void avalanche_stats::merge(const avalanche_stats& other) {
+    samples += other.samples;
+    for (size_t n = 0; n < flipped.size(); n++) {
+        flipped[n] += other.flipped[n];
+    }
+    for (size_t i = 0; i < sac.size(); i++) { sac[i] += other.sac[i]; }
+}
+
+avalanche_summary summarize(const avalanche_stats& stats) {
+    avalanche_summary summary;
+    if (stats.samples == 0 || stats.input_bits == 0) { return summary; }
+
+    double trials = static_cast<double>(stats.samples) * stats.input_bits;
+    double sum    = 0;
+    double sum_sq = 0;
+    for (size_t n = 0; n < stats.flipped.size(); n++) {
+        sum    += static_cast<double>(n) * stats.flipped[n];
+        sum_sq += static_cast<double>(n) * n * stats.flipped[n];
+    }
+    summary.mean_flipped   = sum / trials;
+    summary.stddev_flipped = std::sqrt(std::max(
+        sum_sq / trials - summary.mean_flipped * summary.mean_flipped, 0.0));
+
+    double total_bias = 0;
+    std::array<uint64_t, 256> output_flips{};
+    for (size_t i = 0; i < stats.input_bits; i++) {
+        for (size_t o = 0; o < 256; o++) {
+            uint64_t count = stats.sac[i * 256 + o];
+            double   bias  = std::fabs(
+                static_cast<double>(count) / stats.samples - 0.5);
+
+            total_bias      += bias;
+            output_flips[o] += count;
+            if (bias > summary.max_bias) {
+                summary.max_bias     = bias;
+                summary.worst_input  = i;
+                summary.worst_output = o;
+            }
+        }
+    }
+    summary.mean_bias = total_bias / (stats.input_bits * 256.0);
+
+    auto [least, most] = std::minmax_element(output_flips.begin(),
+                                             output_flips.end());
+    summary.min_output_rate = *least / trials;
+    summary.max_output_rate = *most / trials;
+    return summary;
+}
+
+bool write_sac_csv(const avalanche_stats& stats, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) { return false; }
+
+    out << "input_bit";
+    for (size_t o = 0; o < 256; o++) { out << ",out" << o; }
+    out << '\n';
+
+    for (size_t i = 0; i < stats.input_bits; i++) {
+        out << i;
+        for (size_t o = 0; o < 256; o++) {
+            out << ','
+                << (stats.samples ? static_cast<double>(stats.sac[i * 256 + o])
+                                        / stats.samples
+                                  : 0.0);
+        }
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+bool write_histogram_csv(const avalanche_stats& stats,
+                         const std::string&     path) {
+    std::ofstream out(path);
+    if (!out) { return false; }
+
+    out << "bits_flipped,count\n";
+    for (size_t n = 0; n < stats.flipped.size(); n++) {
+        out << n << ',' << stats.flipped[n] << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+}  // namespace lea
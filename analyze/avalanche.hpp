@@ -0,0 +1,61 @@
+#ifndef AVALANCHE_HPP
+#define AVALANCHE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "keyhash_limbs.hpp"
+
+namespace lea {
+
+// avalanche counts over one-bit input changes, kept per thread and merged
+struct avalanche_stats {
+    explicit avalanche_stats(size_t input_byte_length);
+
+    // hashes input and each of its copies with one of the first
+    // input_byte_length bytes' bits flipped, counting the changed outputs
+    void add_sample(const limbs256& input);
+    void merge(const avalanche_stats& other);
+
+    size_t   input_byte_length;
+    size_t   input_bits;
+    uint64_t samples = 0;
+
+    // flipped[n]: one-bit changes that flipped n output bits
+    std::array<uint64_t, 257> flipped{};
+
+    // sac[i * 256 + o]: times flipping input bit i flipped output bit o, the
+    // strict avalanche criterion wants samples / 2 everywhere
+    std::vector<uint64_t> sac;
+};
+
+struct avalanche_summary {
+    double mean_flipped   = 0;
+    double stddev_flipped = 0;
+
+    // |P(output bit o flips | input bit i flips) - 1/2| over all pairs
+    double max_bias     = 0;
+    double mean_bias    = 0;
+    size_t worst_input  = 0;
+    size_t worst_output = 0;
+
+    // flip probability of single output bits over all input bits
+    double min_output_rate = 0;
+    double max_output_rate = 0;
+};
+
+avalanche_summary summarize(const avalanche_stats& stats);
+
+// flip probability matrix, a row per input bit and a column per output bit
+bool write_sac_csv(const avalanche_stats& stats, const std::string& path);
+
+// output bits flipped against how often, one line per count
+bool write_histogram_csv(const avalanche_stats& stats,
+                         const std::string&     path);
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,102 @@
+#include "digest_table.hpp"
+
+#include <algorithm>
+
+namespace lea {
+
+namespace {
+
+const limbs256 EMPTY{};
+
+// digests under test may be anything but uniform, so slots and partitions
+// come from a mix of all four limbs rather than raw digest bits
+uint64_t mix_digest(const limbs256& digest) {
+    uint64_t h = 0;
+    for (uint64_t limb : digest) {
+        h = (h ^ limb) * 0x9E37'79B9'7F4A'7C15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+size_t ceil_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) { p <<= 1; }
+    return p;
+}
+
+}  // namespace
+
+digest_table::digest_table(size_t expected, size_t partition_count) {
+    partition_count = ceil_pow2(std::max<size_t>(partition_count, 1));
+    partition_bits_ = 0;
+    while ((size_t{1} << partition_bits_) < partition_count) {
+        partition_bits_++;
+    }
+
+    size_t capacity = partition_capacity(expected, partition_count);
+    for (size_t i = 0; i < partition_count; i++) {
+        partitions_.push_back(std::make_unique<partition>());
+        partitions_.back()->slots.resize(capacity);
+    }
+}
+
+size_t digest_table::partition_capacity(size_t expected,
+                                        size_t partition_count) {
+    size_t per_partition = (expected + partition_count - 1) / partition_count;
+    return ceil_pow2(std::max<size_t>(per_partition * 4 / 3 + 1, 16));
+}
+
+size_t digest_table::footprint(size_t expected, size_t partition_count) {
+    partition_count = ceil_pow2(std::max<size_t>(partition_count, 1));
+    return partition_count * partition_capacity(expected, partition_count)
+           * sizeof(limbs256);
+}
+
+bool digest_table::insert(const limbs256& digest) {
+    if (digest == EMPTY) {
+        std::lock_guard<std::mutex> lock(zero_mutex_);
+        bool                        fresh = !zero_seen_;
+        zero_seen_                        = true;
+        return fresh;
+    }
+
+    uint64_t   hash = mix_digest(digest);
+    partition& p    = *partitions_[partition_bits_ == 0
+                                       ? 0
+                                       : hash >> (64 - partition_bits_)];
+
+    std::lock_guard<std::mutex> lock(p.mutex);
+    if (!place(p.slots, digest, hash)) { return false; }
+    if (++p.size * 4 > p.slots.size() * 3) { grow(p); }
+    return true;
+}
+
+bool digest_table::place(std::vector<limbs256>& slots,
+                         const limbs256&        digest,
+                         uint64_t               hash) {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        if (slots[i] == EMPTY) {
+            slots[i] = digest;
+            return true;
+        }
+        if (slots[i] == digest) { return false; }
+    }
+}
+
+void digest_table::grow(partition& p) {
+    std::vector<limbs256> slots(p.slots.size() * 2);
+    for (const limbs256& digest : p.slots) {
+        if (digest != EMPTY) { place(slots, digest, mix_digest(digest)); }
+    }
+    p.slots.swap(slots);
+}
+
+size_t digest_table::size() const {
+    size_t total = zero_seen_ ? 1 : 0;
+    for (const auto& p : partitions_) { total += p->size; }
+    return total;
+}
+
+}  // namespace lea
@@ -0,0 +1,52 @@
+#ifndef DIGEST_TABLE_HPP
+#define DIGEST_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "keyhash_limbs.hpp"
+
+namespace lea {
+
+// set of 256-bit digests split into independently locked partitions, each
+// an open-addressing table of bare digests probed linearly. a zeroed slot
+// is empty, the all-zero digest itself is tracked by a flag
+class digest_table {
+  public:
+    // sized so expected digests fill at most 3/4 of every partition, which
+    // double when a skewed hash overfills them
+    digest_table(size_t expected, size_t partition_count);
+
+    // bytes the table allocates for expected digests
+    static size_t footprint(size_t expected, size_t partition_count);
+
+    // false when digest was already inserted
+    bool insert(const limbs256& digest);
+
+    size_t size() const;
+
+  private:
+    struct partition {
+        std::mutex            mutex;
+        std::vector<limbs256> slots;
+        size_t                size = 0;
+    };
+
+    static size_t partition_capacity(size_t expected, size_t partition_count);
+    static bool   place(std::vector<limbs256>& slots,
+                        const limbs256&        digest,
+                        uint64_t               hash);
+    static void   grow(partition& p);
+
+    std::vector<std::unique_ptr<partition>> partitions_;
+    size_t                                  partition_bits_;
+    std::mutex                              zero_mutex_;
+    bool                                    zero_seen_ = false;
+};
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,405 @@
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "avalanche.hpp"
+#include "digest_table.hpp"
+#include "keyhash_batch.hpp"
+#include "keyhash_limbs.hpp"
+#include "spill.hpp"
+
+namespace {
+
+// inputs hashed per batch and per unit of work handed to a thread
+const size_t BLOCK_SIZE        = 4096;
+const size_t AVALANCHE_BLOCK   = 64;
+const size_t PARTITION_COUNT   = 4096;
+const size_t EXAMPLE_LIMIT     = 16;
+const auto   PROGRESS_INTERVAL = std::chrono::seconds(10);
+
+struct options {
+    uint64_t    count       = 10'000'000;
+    uint64_t    avalanche   = 10'000;
+    size_t      input_bytes = 32;
+    size_t      threads     = 0;
+    uint64_t    seed        = 1;
+    uint64_t    memory      = 0;
+    std::string spill_dir;
+    bool        force_spill = false;
+    bool        quiet       = false;
+    std::string sac_csv;
+    std::string histogram_csv;
+};
+
+// splitmix64 finalizer, a bijection on 64-bit words
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58'476D'1CE4'E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D0'49BB'1331'11EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+void keep_bytes(lea::limbs256& limbs, size_t byte_count) {
+    for (size_t i = 0; i < 4; i++) {
+        size_t kept = std::min<size_t>(byte_count - std::min(byte_count, i * 8),
+                                       8);
+        limbs[i] &= kept == 8 ? ~uint64_t{0} : (uint64_t{1} << kept * 8) - 1;
+    }
+}
+
+// input number index of a collision run. the first limb is a bijection of
+// index so inputs never repeat, under 8 bytes inputs simply count up
+lea::limbs256 collision_input(uint64_t seed, uint64_t index, size_t bytes) {
+    if (bytes < 8) { return {index, 0, 0, 0}; }
+
+    lea::limbs256 input;
+    input[0] = mix64(index + seed * 0x9E37'79B9'7F4A'7C15ULL);
+    for (size_t i = 1; i < 4; i++) { input[i] = mix64(input[0] + seed + i); }
+    keep_bytes(input, bytes);
+    return input;
+}
+
+lea::limbs256 avalanche_input(uint64_t seed, uint64_t sample, size_t bytes) {
+    uint64_t      stream = mix64(seed ^ 0xA5A5'A5A5'A5A5'A5A5ULL);
+    lea::limbs256 input;
+    for (size_t i = 0; i < 4; i++) {
+        input[i] = mix64(stream + sample * 4 + i);
+    }
+    keep_bytes(input, bytes);
+    return input;
+}
+
+// decimal count or byte size with an optional K, M, G or T suffix
+bool parse_size(const char* text, uint64_t unit, uint64_t& value) {
+    char*              end;
+    unsigned long long number = std::strtoull(text, &end, 10);
+    if (end == text) { return false; }
+
+    uint64_t scale = 1;
+    switch (*end) {
+        case 'T': scale *= unit; [[fallthrough]];
+        case 'G': scale *= unit; [[fallthrough]];
+        case 'M': scale *= unit; [[fallthrough]];
+        case 'K': scale *= unit; end++; break;
+        default: break;
+    }
+    if (*end != '\0') { return false; }
+    value = number * scale;
+    return true;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                         - start)
+        .count();
+}
+
+// runs work on opts.threads threads while this one reports done / total
+// every PROGRESS_INTERVAL
+template <typename Work>
+void run_threads(const options&               opts,
+                 const char*                  what,
+                 const std::atomic<uint64_t>& done,
+                 uint64_t                     total,
+                 Work                         work) {
+    std::atomic<size_t>      running{opts.threads};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < opts.threads; t++) {
+        threads.emplace_back([&, t] {
+            work(t);
+            running--;
+        });
+    }
+
+    auto start    = std::chrono::steady_clock::now();
+    auto reported = start;
+    while (running > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto now = std::chrono::steady_clock::now();
+        if (!opts.quiet && now - reported >= PROGRESS_INTERVAL) {
+            reported = now;
+            std::cerr << what << ": " << done << " / " << total << " ("
+                      << std::fixed << std::setprecision(1)
+                      << 100.0 * done / total << "%) after "
+                      << std::setprecision(0) << seconds_since(start)
+                      << " s\n"
+                      << std::defaultfloat;
+        }
+    }
+    for (std::thread& t : threads) { t.join(); }
+}
+
+// hashes opts.count distinct inputs and counts repeated digests, in a
+// digest_table when it fits opts.memory and in sorted runs on disk if not
+bool check_collisions(const options& opts) {
+    size_t footprint = lea::digest_table::footprint(opts.count,
+                                                    PARTITION_COUNT);
+    bool   spill     = opts.force_spill || footprint > opts.memory;
+
+    std::unique_ptr<lea::digest_table> table;
+    std::unique_ptr<lea::spill_runs>   runs;
+    if (spill) {
+        runs = std::make_unique<lea::spill_runs>(opts.spill_dir);
+    } else {
+        table = std::make_unique<lea::digest_table>(opts.count,
+                                                    PARTITION_COUNT);
+    }
+    size_t run_size = std::max<uint64_t>(
+        opts.memory / opts.threads / sizeof(lea::limbs256), BLOCK_SIZE);
+
+    std::atomic<uint64_t>      next_block{0};
+    std::atomic<uint64_t>      hashed{0};
+    std::atomic<uint64_t>      collisions{0};
+    std::atomic<bool>          failed{false};
+    std::mutex                 examples_mutex;
+    std::vector<lea::limbs256> examples;
+
+    auto start = std::chrono::steady_clock::now();
+    run_threads(opts, "collisions", hashed, opts.count, [&](size_t) {
+        std::vector<lea::limbs256> inputs(BLOCK_SIZE);
+        std::vector<size_t>        lengths(BLOCK_SIZE, opts.input_bytes);
+        std::vector<lea::limbs256> digests(BLOCK_SIZE);
+        std::vector<lea::limbs256> run;
+        if (spill) { run.reserve(run_size); }
+
+        auto flush = [&] {
+            if (!run.empty() && !runs->write_run(run)
+                && !failed.exchange(true)) {
+                std::cerr << "lea-analyze: " << opts.spill_dir << ": "
+                          << std::strerror(errno) << '\n';
+            }
+            run.clear();
+        };
+
+        for (uint64_t block = next_block++; !failed; block = next_block++) {
+            uint64_t begin = block * BLOCK_SIZE;
+            if (begin >= opts.count) { break; }
+            size_t size = std::min<uint64_t>(BLOCK_SIZE, opts.count - begin);
+
+            for (size_t i = 0; i < size; i++) {
+                inputs[i] = collision_input(opts.seed, begin + i,
+                                            opts.input_bytes);
+            }
+            lea::gen_keyhash_batch(
+                lea::span<const lea::limbs256>(inputs.data(), size),
+                lea::span<const size_t>(lengths.data(), size),
+                lea::span<lea::limbs256>(digests.data(), size));
+
+            for (size_t i = 0; i < size; i++) {
+                if (spill) {
+                    run.push_back(digests[i]);
+                    if (run.size() == run_size) { flush(); }
+                } else if (!table->insert(digests[i])) {
+                    collisions++;
+                    std::lock_guard<std::mutex> lock(examples_mutex);
+                    if (examples.size() < EXAMPLE_LIMIT) {
+                        examples.push_back(digests[i]);
+                    }
+                }
+            }
+            hashed += size;
+        }
+        if (spill) { flush(); }
+    });
+
+    if (spill && !failed) {
+        if (!opts.quiet) { std::cerr << "collisions: merging runs\n"; }
+        lea::merge_result merged = runs->merge(opts.threads, EXAMPLE_LIMIT);
+        if (!merged.ok) {
+            std::cerr << "lea-analyze: cannot map spilled runs: "
+                      << std::strerror(errno) << '\n';
+            failed = true;
+        }
+        collisions = merged.collisions;
+        examples   = merged.examples;
+    }
+    if (failed) { return false; }
+
+    double seconds = seconds_since(start);
+    std::cout << "collisions: " << opts.count << " hashes of "
+              << opts.input_bytes << "-byte inputs, " << collisions
+              << " collisions ("
+              << (spill ? "spilled to " + opts.spill_dir
+                        : std::to_string(footprint >> 20) + " MiB table")
+              << ") in " << std::setprecision(3) << seconds << " s, "
+              << static_cast<uint64_t>(opts.count / seconds) << " hashes/s\n";
+    for (const lea::limbs256& digest : examples) {
+        std::cout << "  repeated digest " << lea::keyhash{digest}.hex_str()
+                  << '\n';
+    }
+    return collisions == 0;
+}
+
+// flips every input bit of opts.avalanche random inputs, each thread
+// counting into its own avalanche_stats
+bool check_avalanche(const options& opts) {
+    std::vector<lea::avalanche_stats> per_thread(
+        opts.threads, lea::avalanche_stats(opts.input_bytes));
+    std::atomic<uint64_t> next_block{0};
+    std::atomic<uint64_t> sampled{0};
+
+    auto start = std::chrono::steady_clock::now();
+    run_threads(opts, "avalanche", sampled, opts.avalanche, [&](size_t t) {
+        for (uint64_t block = next_block++;; block = next_block++) {
+            uint64_t begin = block * AVALANCHE_BLOCK;
+            if (begin >= opts.avalanche) { break; }
+            uint64_t end = std::min(begin + AVALANCHE_BLOCK, opts.avalanche);
+
+            for (uint64_t sample = begin; sample < end; sample++) {
+                per_thread[t].add_sample(
+                    avalanche_input(opts.seed, sample, opts.input_bytes));
+            }
+            sampled += end - begin;
+        }
+    });
+
+    lea::avalanche_stats& stats = per_thread[0];
+    for (size_t t = 1; t < per_thread.size(); t++) {
+        stats.merge(per_thread[t]);
+    }
+    lea::avalanche_summary summary = lea::summarize(stats);
+
+    // mean |p - 1/2| of a fair coin over n samples is about 0.4 / sqrt(n)
+    double noise = 0.3989 / std::sqrt(static_cast<double>(stats.samples));
+    std::cout << std::setprecision(4) << "avalanche: " << stats.samples
+              << " samples x " << stats.input_bits << " input bits in "
+              << seconds_since(start) << " s\n"
+              << "  output bits flipped: mean " << summary.mean_flipped
+              << " (ideal 128), stddev " << summary.stddev_flipped
+              << " (ideal 8)\n"
+              << "  SAC bias: max " << summary.max_bias << " (input bit "
+              << summary.worst_input << " -> output bit "
+              << summary.worst_output << "), mean " << summary.mean_bias
+              << " (sampling noise ~" << noise << ")\n"
+              << "  output bit flip rate: " << summary.min_output_rate
+              << " .. " << summary.max_output_rate << '\n';
+
+    bool ok = true;
+    if (!opts.sac_csv.empty() && !lea::write_sac_csv(stats, opts.sac_csv)) {
+        std::cerr << "lea-analyze: " << opts.sac_csv << ": cannot write\n";
+        ok = false;
+    }
+    if (!opts.histogram_csv.empty()
+        && !lea::write_histogram_csv(stats, opts.histogram_csv)) {
+        std::cerr << "lea-analyze: " << opts.histogram_csv
+                  << ": cannot write\n";
+        ok = false;
+    }
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    options opts;
+    bool    usage_error = false;
+
+    struct option long_options[] = {
+        {        "count", required_argument, 0, 'n'},
+        {    "avalanche", required_argument, 0, 'a'},
+        {  "input-bytes", required_argument, 0, 'l'},
+        {      "threads", required_argument, 0, 'j'},
+        {         "seed", required_argument, 0, 's'},
+        {       "memory", required_argument, 0, 'm'},
+        {    "spill-dir", required_argument, 0, 'd'},
+        {        "spill",       no_argument, 0, 'S'},
+        {      "sac-csv", required_argument, 0, 'c'},
+        {"histogram-csv", required_argument, 0, 'H'},
+        {        "quiet",       no_argument, 0, 'q'},
+        {              0,                 0, 0,   0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(
+                argc, argv, "n:a:l:j:s:m:d:Sc:H:q", long_options, nullptr))
+           != -1) {
+        uint64_t value = 0;
+        switch (opt) {
+            case 'n':
+                usage_error |= !parse_size(optarg, 1000, opts.count);
+                break;
+
+            case 'a':
+                usage_error |= !parse_size(optarg, 1000, opts.avalanche);
+                break;
+
+            case 'l':
+                usage_error |= !parse_size(optarg, 1, value);
+                opts.input_bytes = value;
+                break;
+
+            case 'j':
+                usage_error |= !parse_size(optarg, 1, value);
+                opts.threads = value;
+                break;
+
+            case 's': usage_error |= !parse_size(optarg, 1, opts.seed); break;
+
+            case 'm':
+                usage_error |= !parse_size(optarg, 1024, opts.memory);
+                break;
+
+            case 'd': opts.spill_dir = optarg; break;
+
+            case 'S': opts.force_spill = true; break;
+
+            case 'c': opts.sac_csv = optarg; break;
+
+            case 'H': opts.histogram_csv = optarg; break;
+
+            case 'q': opts.quiet = true; break;
+
+            default: usage_error = true; break;
+        }
+    }
+
+    // inputs shorter than 8 bytes count up, so there are only so many
+    bool too_many = opts.input_bytes < 8
+                    && opts.count > (uint64_t{1} << opts.input_bytes * 8);
+    if (usage_error || optind != argc || opts.input_bytes == 0
+        || opts.input_bytes > 32 || too_many) {
+        std::cerr << "usage: " << argv[0]
+                  << " [-n COUNT] [-a SAMPLES] [-l INPUT_BYTES] [-j THREADS]"
+                     " [-s SEED] [-m MEMORY] [-d SPILL_DIR] [--spill]"
+                     " [--sac-csv FILE] [--histogram-csv FILE] [-q]\n"
+                  << "COUNT and SAMPLES take K/M/G suffixes (powers of 1000),"
+                     " MEMORY takes K/M/G/T (powers of 1024)\n"
+                  << "INPUT_BYTES is 1 to 32, below 8 COUNT is at most"
+                     " 256^INPUT_BYTES\n";
+        return 2;
+    }
+
+    if (opts.threads == 0) {
+        opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if (opts.memory == 0) {
+        opts.memory = static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES))
+                      * sysconf(_SC_PAGE_SIZE) / 2;
+    }
+    if (opts.spill_dir.empty()) {
+        const char* tmpdir = std::getenv("TMPDIR");
+        opts.spill_dir     = tmpdir && *tmpdir ? tmpdir : "/tmp";
+    }
+
+    bool ok = true;
+    if (opts.count > 0) { ok &= check_collisions(opts); }
+    if (opts.avalanche > 0) { ok &= check_avalanche(opts); }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "spill.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <utility>
+
+namespace lea {
+
+namespace {
+
+bool write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// a run as mapped for merging, empty runs have no mapping
+struct mapped_run {
+    const limbs256* digests = nullptr;
+    size_t          count   = 0;
+};
+
+// first digest of a sorted run whose leading limb is at least prefix
+size_t lower_bound(const mapped_run& r, uint64_t prefix) {
+    return std::lower_bound(r.digests,
+                            r.digests + r.count,
+                            prefix,
+                            [](const limbs256& digest, uint64_t p) {
+                                return digest[0] < p;
+                            })
+           - r.digests;
+}
+
+}  // namespace
+
+spill_runs::spill_runs(std::string directory)
+    : directory_(std::move(directory)) {}
+
+spill_runs::~spill_runs() {
+    for (const run& r : runs_) { ::close(r.fd); }
+}
+
+bool spill_runs::write_run(std::vector<limbs256>& digests) {
+    std::sort(digests.begin(), digests.end());
+
+    std::string path = directory_ + "/lea-analyze-XXXXXX";
+    int         fd   = ::mkstemp(path.data());
+    if (fd < 0) { return false; }
+    ::unlink(path.c_str());
+
+    if (!write_all(fd,
+                   reinterpret_cast<const uint8_t*>(digests.data()),
+                   digests.size() * sizeof(limbs256))) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    runs_.push_back({fd, digests.size()});
+    return true;
+}
+
+merge_result spill_runs::merge(size_t thread_count,
+                               size_t example_limit) const {
+    merge_result result;
+
+    std::vector<mapped_run> mapped;
+    for (const run& r : runs_) {
+        if (r.count == 0) { continue; }
+
+        size_t bytes = r.count * sizeof(limbs256);
+        void*  data  = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, r.fd, 0);
+        if (data == MAP_FAILED) {
+            result.ok = false;
+            break;
+        }
+        ::madvise(data, bytes, MADV_SEQUENTIAL);
+        mapped.push_back({static_cast<const limbs256*>(data), r.count});
+    }
+
+    // equal digests share their leading limb, so slices split by it merge
+    // independently
+    thread_count             = std::max<size_t>(thread_count, 1);
+    const size_t SLICE_COUNT = thread_count * 16;
+
+    std::atomic<size_t> next_slice{0};
+    std::mutex          result_mutex;
+
+    auto slice_bound = [&](size_t slice, const mapped_run& r) {
+        if (slice == SLICE_COUNT) { return r.count; }
+        uint64_t prefix = static_cast<uint64_t>(
+            (static_cast<unsigned __int128>(slice) << 64) / SLICE_COUNT);
+        return lower_bound(r, prefix);
+    };
+
+    auto worker = [&] {
+        using cursor = std::pair<const limbs256*, const limbs256*>;
+        auto later   = [](const cursor& a, const cursor& b) {
+            return *b.first < *a.first;
+        };
+
+        for (size_t slice = next_slice++; slice < SLICE_COUNT;
+             slice        = next_slice++) {
+            std::priority_queue<cursor, std::vector<cursor>, decltype(later)>
+                heap(later);
+            for (const mapped_run& r : mapped) {
+                size_t begin = slice_bound(slice, r);
+                size_t end   = slice_bound(slice + 1, r);
+                if (begin < end) {
+                    heap.emplace(r.digests + begin, r.digests + end);
+                }
+            }
+
+            uint64_t              digests    = 0;
+            uint64_t              collisions = 0;
+            std::vector<limbs256> examples;
+            const limbs256*       previous = nullptr;
+            while (!heap.empty()) {
+                cursor top = heap.top();
+                heap.pop();
+
+                if (previous && *previous == *top.first) {
+                    collisions++;
+                    if (examples.size() < example_limit) {
+                        examples.push_back(*top.first);
+                    }
+                }
+                previous = top.first;
+                digests++;
+
+                if (++top.first != top.second) { heap.push(top); }
+            }
+
+            std::lock_guard<std::mutex> lock(result_mutex);
+            result.digests    += digests;
+            result.collisions += collisions;
+            for (const limbs256& digest : examples) {
+                if (result.examples.size() < example_limit) {
+                    result.examples.push_back(digest);
+                }
+            }
+        }
+    };
+
+    if (result.ok) {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_count; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& t : threads) { t.join(); }
+    }
+
+    for (const mapped_run& r : mapped) {
+        ::munmap(const_cast<limbs256*>(r.digests),
+                 r.count * sizeof(limbs256));
+    }
+    return result;
+}
+
+}  // namespace lea
@@ -0,0 +1,54 @@
+#ifndef SPILL_HPP
+#define SPILL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "keyhash_limbs.hpp"
+
+namespace lea {
+
+struct merge_result {
+    bool                  ok         = true;
+    uint64_t              digests    = 0;
+    uint64_t              collisions = 0;
+    std::vector<limbs256> examples;
+};
+
+// digests kept on disk as sorted runs, for sets too big for memory. run
+// files are unlinked as soon as they are created so nothing is left
+// behind, they live until the object is destroyed
+class spill_runs {
+  public:
+    explicit spill_runs(std::string directory);
+    ~spill_runs();
+
+    spill_runs(const spill_runs&)            = delete;
+    spill_runs& operator=(const spill_runs&) = delete;
+
+    // sorts digests and writes them as a new run, false with errno set when
+    // the run cannot be written. safe to call from many threads
+    bool write_run(std::vector<limbs256>& digests);
+
+    // maps every run and merges them on thread_count threads, each taking
+    // a range of digest prefixes, counting every repeat of a digest as one
+    // collision and keeping up to example_limit colliding digests
+    merge_result merge(size_t thread_count, size_t example_limit) const;
+
+  private:
+    struct run {
+        int    fd;
+        size_t count;
+    };
+
+    std::string      directory_;
+    std::mutex       mutex_;
+    std::vector<run> runs_;
+};
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Compare two lea-bench JSON results and flag regressions.
+
+Record a baseline and a candidate with Google Benchmark's JSON output:
+
+    lea-bench --benchmark_out=baseline.json --benchmark_out_format=json
+    lea-bench --benchmark_out=current.json --benchmark_out_format=json
+    bench/compare.py baseline.json current.json --threshold 5
+
+Benchmarks are matched by name. When a run has repetitions, the median
+aggregate is compared instead of the single iterations. The script exits
+with status 1 when any benchmark got slower by more than the threshold.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path, metric):
+    with open(path) as f:
+        runs = json.load(f)["benchmarks"]
+
+    medians = {
+        run["run_name"]: run[metric]
+        for run in runs
+        if run.get("run_type") == "aggregate"
+        and run.get("aggregate_name") == "median"
+    }
+    if medians:
+        return medians
+
+    return {
+        run["name"]: run[metric]
+        for run in runs
+        if run.get("run_type", "iteration") == "iteration"
+        and "error_occurred" not in run
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline", help="JSON output of the reference run")
+    parser.add_argument("current", help="JSON output of the run to check")
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=10.0,
+        help="percent slowdown reported as a regression (default 10)",
+    )
+    parser.add_argument(
+        "--metric",
+        choices=["real_time", "cpu_time"],
+        default="real_time",
+        help="time to compare (default real_time)",
+    )
+    args = parser.parse_args()
+
+    baseline = load(args.baseline, args.metric)
+    current = load(args.current, args.metric)
+
+    regressions = 0
+    width = max((len(name) for name in current), default=0)
+    for name, time in current.items():
+        if name not in baseline:
+            print(f"{name:<{width}}  new")
+            continue
+
+        change = (time - baseline[name]) / baseline[name] * 100
+        if change > args.threshold:
+            status = "REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            status = "improved"
+        else:
+            status = ""
+        print(f"{name:<{width}}  {change:+7.1f}%  {status}")
+
+    for name in baseline:
+        if name not in current:
+            print(f"{name:<{width}}  missing")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) regressed by more than "
+              f"{args.threshold:g}%")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,192 @@
+#include <benchmark/benchmark.h>
+
+#include <bitset>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "echo_hasher.hpp"
+#include "key_cache.hpp"
+#include "keyhash.hpp"
+#include "keyhash_batch.hpp"
+#include "keyhash_limbs.hpp"
+
+namespace {
+
+// a fixed pool of inputs so every run hashes the same data
+std::vector<std::bitset<256>> make_inputs(size_t count) {
+    std::mt19937_64               rng(42);
+    std::vector<std::bitset<256>> inputs(count);
+    for (auto& input : inputs) {
+        for (size_t i = 0; i < 256; i++) { input[i] = rng() & 1; }
+    }
+    return inputs;
+}
+
+const std::vector<std::bitset<256>>& inputs() {
+    static const std::vector<std::bitset<256>> pool = make_inputs(1024);
+    return pool;
+}
+
+void BM_GenKeyhash(benchmark::State& state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            lea::gen_keyhash(inputs()[i++ % inputs().size()], 32));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenKeyhash)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_GenKeyhashLimbs(benchmark::State& state) {
+    std::vector<lea::limbs256> limbs;
+    for (const auto& input : inputs()) {
+        limbs.push_back(lea::to_limbs(input));
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            lea::gen_keyhash(limbs[i++ % limbs.size()], 32));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenKeyhashLimbs)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_GenKeyhashBatch(benchmark::State& state) {
+    size_t                     count = state.range(0);
+    std::vector<lea::limbs256> in, out(count);
+    std::vector<size_t>        lengths(count, 32);
+    for (size_t i = 0; i < count; i++) {
+        in.push_back(lea::to_limbs(inputs()[i % inputs().size()]));
+    }
+
+    for (auto _ : state) {
+        lea::gen_keyhash_batch(in, lengths, out);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_GenKeyhashBatch)->RangeMultiplier(4)->Range(16, 4096);
+
+void BM_EchoHash(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0));
+    std::mt19937_64      rng(42);
+    for (uint8_t& byte : data) { byte = static_cast<uint8_t>(rng()); }
+
+    for (auto _ : state) { benchmark::DoNotOptimize(lea::echo_hash(data)); }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_EchoHash)->RangeMultiplier(64)->Range(64, 1 << 24);
+
+void BM_KeyCacheHit(benchmark::State& state) {
+    static lea::key_cache cache;
+    std::string           password
+        = "password" + std::to_string(state.thread_index() % 16);
+    cache.get_keyhash(password);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.get_keyhash(password));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_KeyCacheHit)->ThreadRange(1, 8)->UseRealTime();
+
+// ECHO stages, the bitset reference next to the limb engine
+
+void BM_BitInterleavingExpand(benchmark::State& state) {
+    const std::bitset<256>& input = inputs()[0];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lea::bit_interleaving_expand(input, 7));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BitInterleavingExpand);
+
+void BM_BitInterleavingExpandLimbs(benchmark::State& state) {
+    lea::limbs256 input = lea::to_limbs(inputs()[0]);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lea::bit_interleaving_expand(input, 7));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BitInterleavingExpandLimbs);
+
+void BM_SequentialBitCompact(benchmark::State& state) {
+    std::bitset<512> input = lea::bit_interleaving_expand(inputs()[0], 32);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lea::sequential_bit_compact(input));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SequentialBitCompact);
+
+void BM_SequentialBitCompactLimbs(benchmark::State& state) {
+    lea::limbs512 input
+        = lea::bit_interleaving_expand(lea::to_limbs(inputs()[0]), 32);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lea::sequential_bit_compact(input));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SequentialBitCompactLimbs);
+
+void BM_ApplySbox(benchmark::State& state) {
+    std::bitset<256> bits = inputs()[0];
+    for (auto _ : state) {
+        lea::apply_sbox(bits);
+        benchmark::DoNotOptimize(bits);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ApplySbox);
+
+void BM_ApplySboxLimbs(benchmark::State& state) {
+    lea::limbs256 limbs = lea::to_limbs(inputs()[0]);
+    for (auto _ : state) {
+        lea::apply_sbox(limbs);
+        benchmark::DoNotOptimize(limbs);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ApplySboxLimbs);
+
+void BM_Mix(benchmark::State& state) {
+    std::bitset<256> bits = inputs()[0];
+    for (auto _ : state) {
+        lea::mix(bits, 3);
+        benchmark::DoNotOptimize(bits);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Mix);
+
+void BM_MixLimbs(benchmark::State& state) {
+    lea::limbs256 limbs = lea::to_limbs(inputs()[0]);
+    for (auto _ : state) {
+        lea::mix(limbs, 3);
+        benchmark::DoNotOptimize(limbs);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MixLimbs);
+
+void BM_RotateLeft(benchmark::State& state) {
+    std::bitset<256> bits = inputs()[0];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lea::rotate_left(bits, 77));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RotateLeft);
+
+void BM_RotateLeftLimbs(benchmark::State& state) {
+    lea::limbs256 limbs = lea::to_limbs(inputs()[0]);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lea::rotate_left(limbs, 77));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RotateLeftLimbs);
+
+}  // namespace
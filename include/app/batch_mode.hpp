@@ -0,0 +1,46 @@
+#ifndef BATCH_MODE_HPP
+#define BATCH_MODE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+struct batch_stats {
+    // files ciphered and files that failed
+    size_t files  = 0;
+    size_t failed = 0;
+
+    size_t bytes_in  = 0;
+    size_t bytes_out = 0;
+    double seconds   = 0;
+};
+
+// encrypts or decrypts every regular file under inputs into output_dir. a
+// file input lands at output_dir/NAME, a directory input is copied as a
+// tree under output_dir/NAME like cp -r. the key is prepared once; files of
+// up to 4 MiB run as one pool task each while larger ones are mapped and
+// split into 4 MiB ranges that idle workers steal, so small and large files
+// keep every thread busy together. a failed file is reported on stderr and
+// the rest still run; returns false if any failed. with progress set a
+// status line goes to stderr every second
+bool process_batch(const std::vector<std::string>& inputs,
+                   const std::string&              output_dir,
+                   const keyhash&                  key,
+                   Mode                            mode,
+                   thread_pool&                    pool,
+                   bool                            progress,
+                   batch_stats&                    stats);
+
+// appends the non-empty lines of path, "-" for stdin, to paths. returns
+// false after printing the failure to stderr
+bool read_path_list(const std::string& path, std::vector<std::string>& paths);
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CONTAINER_MODE_HPP
+#define CONTAINER_MODE_HPP
+
+#include <string>
+
+#include "file_mode.hpp"
+#include "keyhash.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+// encrypts input_path into a LEA container at output_path, see
+// container.hpp. with append set an existing container there grows by the
+// input instead of being replaced, keeping its codec. with compress set a
+// new container compresses its chunks before ciphering them. the output
+// has to be a regular file, input may be a pipe. returns false after
+// printing the failure to stderr
+bool encrypt_container(const std::string& input_path,
+                       const std::string& output_path,
+                       const keyhash&     key,
+                       bool               append,
+                       bool               compress,
+                       thread_pool&       pool,
+                       file_stats&        stats);
+
+// decrypts the container at input_path, which has to be a regular file,
+// into output_path. returns false after printing the failure to stderr
+bool decrypt_container(const std::string& input_path,
+                       const std::string& output_path,
+                       const keyhash&     key,
+                       thread_pool&       pool,
+                       file_stats&        stats);
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef DEDUP_MODE_HPP
+#define DEDUP_MODE_HPP
+
+#include <string>
+
+#include "dedup.hpp"
+#include "file_mode.hpp"
+#include "keyhash.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+// deduplicates input_path into the store directory store_path, created
+// when missing, and writes the recipe restoring it to output_path, see
+// dedup.hpp. only chunks the store lacks are enciphered and written. the
+// output has to be a regular file, input may be a pipe. returns false
+// after printing the failure to stderr
+bool encrypt_dedup(const std::string& input_path,
+                   const std::string& output_path,
+                   const std::string& store_path,
+                   const keyhash&     key,
+                   thread_pool&       pool,
+                   file_stats&        stats,
+                   dedup_stats&       dedup);
+
+// restores the recipe at input_path, a regular file, from the store into
+// output_path. returns false after printing the failure to stderr
+bool decrypt_dedup(const std::string& input_path,
+                   const std::string& output_path,
+                   const std::string& store_path,
+                   const keyhash&     key,
+                   file_stats&        stats);
+
+}  // namespace lea
+
+#endif
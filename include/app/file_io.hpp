@@ -0,0 +1,128 @@
+#ifndef FILE_IO_HPP
+#define FILE_IO_HPP
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "cipher.hpp"
+
+namespace lea {
+
+class thread_pool;
+
+// "lea-app: path: message" on stderr
+void report_error(const std::string& path, const char* message);
+
+// report_error with strerror(errno)
+void report_errno(const std::string& path);
+
+// owns a file descriptor, leaving stdin/stdout open
+class file_handle {
+  public:
+    explicit file_handle(int fd = -1) : fd_(fd) {}
+    ~file_handle() {
+        if (fd_ > STDERR_FILENO) { close(fd_); }
+    }
+
+    file_handle(const file_handle&)            = delete;
+    file_handle& operator=(const file_handle&) = delete;
+
+    int  get() const noexcept { return fd_; }
+    bool valid() const noexcept { return fd_ >= 0; }
+
+    // gives up ownership
+    int release() noexcept {
+        int fd = fd_;
+        fd_    = -1;
+        return fd;
+    }
+
+  private:
+    int fd_;
+};
+
+// unmaps on scope exit
+class mapping {
+  public:
+    mapping(void* address, size_t size) : address_(address), size_(size) {}
+    ~mapping() {
+        if (address_ != MAP_FAILED) { munmap(address_, size_); }
+    }
+
+    mapping(const mapping&)            = delete;
+    mapping& operator=(const mapping&) = delete;
+
+    uint8_t* data() const noexcept { return static_cast<uint8_t*>(address_); }
+    bool     valid() const noexcept { return address_ != MAP_FAILED; }
+
+  private:
+    void*  address_;
+    size_t size_;
+};
+
+// opens path for writing like open(path, flags | O_CREAT, 0644), refusing
+// the file already open as input_fd. O_TRUNC in flags is applied only after
+// that check, since truncating first would destroy an input given again as
+// the output. -1 after reporting the failure
+int open_output(const std::string& path, int flags, int input_fd);
+
+// an input mapped for reading and its preallocated output mapped for
+// writing, ciphered range by range
+struct mapped_files {
+    size_t input_size = 0;
+    size_t capacity   = 0;
+
+    std::unique_ptr<mapping> in;
+    std::unique_ptr<mapping> out;
+};
+
+// checks a ciphertext's size, reserves the output's capacity, the
+// ciphertext or plaintext size input_size can become, and maps both
+// files. input_size must be non-zero; false after reporting the failure
+bool map_files(const std::string& input_path,
+               int                input_fd,
+               size_t             input_size,
+               const std::string& output_path,
+               int                output_fd,
+               Mode               mode,
+               mapped_files&      files);
+
+// ciphers input bytes [offset, offset + size) into the output at offset,
+// on pool when given, and returns the bytes written. offset is a multiple
+// of 32, so only the range ending the input is padded or unpadded; any
+// other range writes exactly size bytes. starts writeback of the output
+// and drops the input pages, which are not read again
+size_t cipher_mapped_range(const mapped_files&   files,
+                           const cipher_context& context,
+                           Mode                  mode,
+                           size_t                offset,
+                           size_t                size,
+                           thread_pool*          pool);
+
+// cuts the output from its reserved capacity down to output_size, false
+// after reporting the failure
+bool finish_mapped(const std::string&  output_path,
+                   int                 output_fd,
+                   const mapped_files& files,
+                   size_t              output_size);
+
+// reads until size bytes or end of input, setting failed on a read error
+size_t read_full(int                fd,
+                 uint8_t*           buffer,
+                 size_t             size,
+                 std::atomic<bool>& failed);
+
+bool write_all(int fd, const uint8_t* buffer, size_t size);
+
+// ciphertext is always whole blocks, reports the path otherwise
+bool check_ciphertext_size(const std::string& path, size_t size);
+
+}  // namespace lea
+
+#endif
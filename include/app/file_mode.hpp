@@ -0,0 +1,41 @@
+#ifndef FILE_MODE_HPP
+#define FILE_MODE_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+// "-" as a path reads stdin or writes stdout
+const std::string STDIO_PATH = "-";
+
+struct file_stats {
+    size_t bytes_in  = 0;
+    size_t bytes_out = 0;
+    double seconds   = 0;
+};
+
+// encrypts or decrypts input_path into output_path. regular files are
+// memory-mapped, anything else streams through a reader -> cipher -> writer
+// pipeline. returns false after printing the failure to stderr
+bool process_file(const std::string& input_path,
+                  const std::string& output_path,
+                  const keyhash&     key,
+                  Mode               mode,
+                  thread_pool&       pool,
+                  file_stats&        stats);
+
+// tree hash of input_path, see tree_hash_file. returns false after printing
+// the failure to stderr
+bool hash_file(const std::string& input_path,
+               thread_pool&       pool,
+               keyhash&           digest,
+               file_stats&        stats);
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef BITSLICE_HPP
+#define BITSLICE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "dispatch.hpp"
+
+namespace lea {
+
+// bit-sliced block permutation kernels, each transposing a slab of blocks
+// into 256 bit-planes so that the permutation becomes plane renaming
+using bitslice_kernel = kernel_isa;
+
+bool bitslice_supported(bitslice_kernel kernel);
+
+// the kernel for active_kernel_isa()
+bitslice_kernel bitslice_best();
+
+// number of blocks the kernel transposes at once
+size_t bitslice_slab_blocks(bitslice_kernel kernel);
+
+// applies the permutation given by source (see block_permutation) to
+// block_count 32-byte blocks, input and output may be the same buffer
+void bitslice_permute(const uint8_t*                  input,
+                      uint8_t*                        output,
+                      size_t                          block_count,
+                      const std::array<uint8_t, 256>& source,
+                      bitslice_kernel                 kernel);
+
+// the gather tables bitslice_permute derives from a source permutation, one
+// per kernel, built once for callers permuting with it over and over
+struct bitslice_plan {
+    std::array<std::array<uint16_t, 256>, 4> gather;
+};
+
+bitslice_plan make_bitslice_plan(const std::array<uint8_t, 256>& source);
+
+// bitslice_permute on a prepared plan, no setup per call
+void bitslice_permute(const uint8_t*       input,
+                      uint8_t*             output,
+                      size_t               block_count,
+                      const bitslice_plan& plan,
+                      bitslice_kernel      kernel);
+
+}  // namespace lea
+
+#endif
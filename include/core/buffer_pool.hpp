@@ -0,0 +1,90 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+
+namespace lea {
+
+struct buffer_pool_options {
+    // freed blocks kept for reuse over all size classes, the rest go back
+    // upstream
+    size_t max_cached_bytes = 64 << 20;
+};
+
+struct buffer_pool_counters {
+    // allocations served from a freed block
+    uint64_t reused = 0;
+
+    // allocations passed on to the upstream resource
+    uint64_t upstream = 0;
+};
+
+// memory_resource recycling freed buffers: sizes from 64 bytes to 16 MiB
+// round up to a power of two and each such class keeps a free list of
+// 64-byte aligned blocks, so a steady stream of similar sized results stops
+// reaching the upstream allocator. larger or more strictly aligned requests
+// go straight upstream. thread-safe, every class has its own lock
+class buffer_pool : public std::pmr::memory_resource {
+  public:
+    explicit buffer_pool(
+        buffer_pool_options         options  = {},
+        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    // returns every cached block upstream; blocks still handed out must not
+    // be freed afterwards
+    ~buffer_pool() override;
+
+    buffer_pool(const buffer_pool&)            = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    buffer_pool_counters counters() const;
+
+    // returns every cached block upstream
+    void release();
+
+  protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const std::pmr::memory_resource& other) const
+        noexcept override;
+
+  private:
+    static constexpr size_t MIN_CLASS_SHIFT = 6;
+    static constexpr size_t MAX_CLASS_SHIFT = 24;
+    static constexpr size_t CLASS_COUNT
+        = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+
+    // log2 of the size class holding bytes
+    static size_t class_shift(size_t bytes);
+
+    struct free_block {
+        free_block* next;
+    };
+
+    struct size_class {
+        std::mutex  mutex;
+        free_block* head = nullptr;
+    };
+
+    buffer_pool_options                 options_;
+    std::pmr::memory_resource*          upstream_;
+    std::array<size_class, CLASS_COUNT> classes_;
+
+    std::atomic<size_t>   cached_bytes_{0};
+    std::atomic<uint64_t> reused_{0};
+    std::atomic<uint64_t> upstream_allocations_{0};
+};
+
+// the calling thread's own buffer_pool, so threads never share its locks.
+// buffers from it may be freed on any thread, but not after the thread
+// that allocated them exits
+std::pmr::memory_resource* thread_buffer_pool();
+
+}  // namespace lea
+
+#endif
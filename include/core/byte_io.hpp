@@ -0,0 +1,34 @@
+#ifndef BYTE_IO_HPP
+#define BYTE_IO_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lea {
+
+// little-endian integers of the on-disk formats
+template <typename T>
+void store_le(uint8_t* out, T value) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        out[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+template <typename T>
+T load_le(const uint8_t* in) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        value |= static_cast<T>(in[i]) << (i * 8);
+    }
+    return value;
+}
+
+// pread until size bytes arrive. a file ending early fails with EBADMSG,
+// since only a damaged file of a format that records its sizes does that
+bool pread_full(int fd, uint8_t* buffer, size_t size, uint64_t offset);
+
+bool pwrite_all(int fd, const uint8_t* buffer, size_t size, uint64_t offset);
+
+}  // namespace lea
+
+#endif
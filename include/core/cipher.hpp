@@ -2,10 +2,14 @@
 #define CIPHER_HPP
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory_resource>
 #include <vector>
 
+#include "bitslice.hpp"
 #include "keyhash.hpp"
+#include "span.hpp"
 
 enum Mode {
     DECRYPT = -1,
@@ -17,22 +21,216 @@ struct operation {
     uint8_t row, rowOffset, col, colOffset;
 };
 
+// a schedule of operations folded into one fixed permutation of the 256
+// block bits, bit k being bit k % 8 of byte k / 8
+struct block_permutation {
+    // source[k] is the input bit that ends up at output bit k
+    std::array<uint8_t, 256> source;
+
+    // table[n * 16 + v] holds the output bits set by input nibble n when it
+    // has value v, so a block is permuted with 64 lookups
+    std::array<std::array<uint64_t, 4>, 64 * 16> table;
+};
+
 namespace lea {
 
+class thread_pool;
+
+// a key's operations and the bit permutations they fold into, prepared once
+// for both directions so repeated calls with one key skip that work
+struct key_schedule {
+    std::array<operation, 16> operations;
+    std::array<operation, 16> reversed_operations;
+
+    // see block_permutation::source
+    std::array<uint8_t, 256> cipher_source;
+    std::array<uint8_t, 256> decipher_source;
+};
+
+key_schedule make_key_schedule(const keyhash& key);
+
+// everything encrypt/decrypt derive from a key, prepared once: the schedule
+// plus the bit-sliced gather tables for both directions, all held inline.
+// calls on a context do no key setup and never allocate, and since it is
+// immutable one context can serve any number of threads at once
+class cipher_context {
+  public:
+    explicit cipher_context(const keyhash& key);
+    explicit cipher_context(const key_schedule& schedule);
+
+    const key_schedule& schedule() const { return schedule_; }
+
+    // same contracts as the span encrypt/decrypt below
+    size_t encrypt(byte_view input, mutable_byte_view output) const;
+    size_t decrypt(byte_view input, mutable_byte_view output) const;
+
+    size_t encrypt(byte_view         input,
+                   mutable_byte_view output,
+                   thread_pool&      pool) const;
+
+    size_t decrypt(byte_view         input,
+                   mutable_byte_view output,
+                   thread_pool&      pool) const;
+
+    // owning results allocated from resource
+    std::pmr::vector<uint8_t> encrypt(
+        byte_view input, std::pmr::memory_resource* resource) const;
+
+    std::pmr::vector<uint8_t> decrypt(
+        byte_view input, std::pmr::memory_resource* resource) const;
+
+    // raw access to the independent 32-byte blocks of a ciphertext, see
+    // decrypt_range/encrypt_range below
+    size_t decrypt_range(byte_view         ciphertext,
+                         size_t            first_block,
+                         size_t            block_count,
+                         mutable_byte_view output) const;
+
+    size_t encrypt_range(mutable_byte_view ciphertext,
+                         size_t            first_block,
+                         byte_view         plaintext) const;
+
+  private:
+    key_schedule  schedule_;
+    bitslice_plan cipher_plan_;
+    bitslice_plan decipher_plan_;
+};
+
 std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data,
                              const keyhash&              key);
 
 std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data,
                              const keyhash&              key);
 
+// parallel encrypt/decrypt, splitting the blocks into cache-sized ranges
+// over the pool; output is byte-identical to the serial versions
+std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data,
+                             const keyhash&              key,
+                             thread_pool&                pool);
+
+std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data,
+                             const keyhash&              key,
+                             thread_pool&                pool);
+
+// encrypt/decrypt with the result allocated from resource, for instance
+// thread_buffer_pool(), rather than the global heap
+std::pmr::vector<uint8_t> encrypt(byte_view                  data,
+                                  const keyhash&             key,
+                                  std::pmr::memory_resource* resource);
+
+std::pmr::vector<uint8_t> decrypt(byte_view                  data,
+                                  const keyhash&             key,
+                                  std::pmr::memory_resource* resource);
+
+// exact ciphertext size encrypt produces for plaintext_size bytes
+size_t encrypted_size(size_t plaintext_size);
+
+// encrypt into caller-owned memory without allocating. returns the bytes
+// written, or 0 when output is shorter than encrypted_size(input.size()).
+// output may start at input for in-place encryption
+size_t encrypt(byte_view input, mutable_byte_view output, const keyhash& key);
+
+// decrypt into caller-owned memory without allocating. returns the
+// plaintext length, or 0 when input is not a multiple of 32 bytes or output
+// is shorter than input. output may start at input for in-place decryption
+size_t decrypt(byte_view input, mutable_byte_view output, const keyhash& key);
+
+size_t encrypt(byte_view         input,
+               mutable_byte_view output,
+               const keyhash&    key,
+               thread_pool&      pool);
+
+size_t decrypt(byte_view         input,
+               mutable_byte_view output,
+               const keyhash&    key,
+               thread_pool&      pool);
+
+// the span API on a prepared schedule
+size_t encrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key);
+
+size_t decrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key);
+
+size_t encrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key,
+               thread_pool&        pool);
+
+size_t decrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key,
+               thread_pool&        pool);
+
+// every block is ciphered on its own, so any block range of a ciphertext
+// can be read or rewritten without touching the rest. decrypt_range
+// deciphers blocks [first_block, first_block + block_count) into output and
+// returns the bytes written, or 0 when ciphertext is not whole blocks, the
+// range runs past its end or output is too short. the final block is
+// returned with its padding still in place
+size_t decrypt_range(byte_view         ciphertext,
+                     size_t            first_block,
+                     size_t            block_count,
+                     mutable_byte_view output,
+                     const keyhash&    key);
+
+std::vector<uint8_t> decrypt_range(byte_view      ciphertext,
+                                   size_t         first_block,
+                                   size_t         block_count,
+                                   const keyhash& key);
+
+// overwrites the blocks of ciphertext from first_block on with plaintext
+// enciphered in place. plaintext must be whole blocks that end within
+// ciphertext; a rewritten final block has to carry valid padding itself.
+// returns the bytes written or 0
+size_t encrypt_range(mutable_byte_view ciphertext,
+                     size_t            first_block,
+                     byte_view         plaintext,
+                     const keyhash&    key);
+
 std::array<uint8_t, 32> cipher_block(const std::array<uint8_t, 32>& block,
-                                     const std::vector<operation>   operations);
+                                     const std::vector<operation>&  operations);
 
-std::array<uint8_t, 32> decipher_block(const std::array<uint8_t, 32>& block,
-                                       const std::vector<operation> operations);
+std::array<uint8_t, 32> decipher_block(
+    const std::array<uint8_t, 32>& block,
+    const std::vector<operation>&  operations);
 
 std::vector<operation> get_operations(const std::bitset<256>& key);
 
+// number of padding bytes encrypt appended to a message whose final
+// deciphered block is last_block, 0 when it carries none
+size_t padding_length(const std::array<uint8_t, 32>& last_block);
+
+// equivalent to cipher_block with the same operations
+block_permutation compile_cipher(const std::vector<operation>& operations);
+
+// equivalent to decipher_block with the same (reversed) operations
+block_permutation compile_decipher(const std::vector<operation>& operations);
+
+std::array<uint8_t, 32> permute_block(const std::array<uint8_t, 32>& block,
+                                      const block_permutation& permutation);
+
+// batched cipher_block over block_count consecutive 32-byte blocks using the
+// bit-sliced kernels, input and output may be the same buffer
+void cipher_blocks(const uint8_t*                input,
+                   uint8_t*                      output,
+                   size_t                        block_count,
+                   const std::vector<operation>& operations);
+
+// batched decipher_block, taking the same (reversed) operations
+void decipher_blocks(const uint8_t*                input,
+                     uint8_t*                      output,
+                     size_t                        block_count,
+                     const std::vector<operation>& operations);
+
+// batched permute_block
+void permute_blocks(const uint8_t*           input,
+                    uint8_t*                 output,
+                    size_t                   block_count,
+                    const block_permutation& permutation);
+
 }  // namespace lea
 
 #endif
\ No newline at end of file
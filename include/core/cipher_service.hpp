@@ -0,0 +1,140 @@
+#ifndef CIPHER_SERVICE_HPP
+#define CIPHER_SERVICE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+
+namespace lea {
+
+struct cipher_service_options {
+    // worker threads, 0 uses std::thread::hardware_concurrency()
+    size_t threads = 0;
+
+    // requests waiting for a worker before submit blocks
+    size_t queue_capacity = 4096;
+
+    // requests with one key and direction ciphered in a single pass
+    size_t max_batch = 64;
+
+    // how long a worker holds the oldest request back for its batch to fill,
+    // never while the queue is full
+    std::chrono::microseconds max_delay{100};
+
+    // prepared cipher_contexts kept, the oldest key is dropped first
+    size_t context_capacity = 256;
+};
+
+// bucket i counts values v with 2^(i - 1) <= v < 2^i, bucket 0 counts
+// zeros and the last bucket everything above
+constexpr size_t SERVICE_HISTOGRAM_BUCKETS = 17;
+
+using service_histogram = std::array<uint64_t, SERVICE_HISTOGRAM_BUCKETS>;
+
+struct cipher_service_stats {
+    uint64_t requests = 0;
+    uint64_t batches  = 0;
+    uint64_t bytes    = 0;
+
+    // requests already queued when one more was submitted
+    service_histogram queue_depth{};
+
+    // requests per batch
+    service_histogram batch_size{};
+};
+
+// asynchronous encrypt/decrypt of many small messages. submitted requests
+// wait in a bounded queue, and workers pull out the ones sharing a key and
+// direction, lay them out block-aligned in one buffer and cipher that with
+// a single bit-sliced pass before completing each request on its own.
+// results equal encrypt() and decrypt() of every message by itself
+class cipher_service {
+  public:
+    using callback = std::function<void(std::vector<uint8_t>)>;
+
+    explicit cipher_service(cipher_service_options options = {});
+
+    // completes every request still queued, then stops the workers
+    ~cipher_service();
+
+    cipher_service(const cipher_service&)            = delete;
+    cipher_service& operator=(const cipher_service&) = delete;
+
+    // ciphers data with key in direction mode, blocking while the queue is
+    // full. the result is empty when mode is UNSET or a ciphertext is not a
+    // multiple of 32 bytes, like decrypt()
+    std::future<std::vector<uint8_t>> submit(Mode                 mode,
+                                             const keyhash&       key,
+                                             std::vector<uint8_t> data);
+
+    // as above, calling done with the result on a worker thread instead.
+    // an exception thrown by done is caught and dropped
+    void submit(Mode                 mode,
+                const keyhash&       key,
+                std::vector<uint8_t> data,
+                callback             done);
+
+    cipher_service_stats stats() const;
+
+  private:
+    struct request {
+        Mode                                  mode;
+        keyhash                               key;
+        std::vector<uint8_t>                  data;
+        callback                              done;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    void enqueue(request r);
+    void worker_loop();
+
+    // pulls the requests batching with the queue's oldest out of it, after
+    // waiting up to max_delay for max_batch of them. empty once stopping
+    // with nothing left
+    std::vector<request> next_batch();
+
+    // staging is the worker's reused block buffer
+    void run_batch(std::vector<request>& batch, std::vector<uint8_t>& staging);
+
+    std::shared_ptr<const cipher_context> context_for(const keyhash& key);
+
+    cipher_service_options options_;
+
+    std::mutex              mutex_;
+    std::condition_variable arrived_;
+    std::condition_variable space_;
+    std::deque<request>     queue_;
+    bool                    stopping_ = false;
+
+    std::mutex contexts_mutex_;
+    std::unordered_map<keyhash, std::shared_ptr<const cipher_context>>
+                        contexts_;
+    std::deque<keyhash> context_order_;
+
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> bytes_{0};
+
+    std::array<std::atomic<uint64_t>, SERVICE_HISTOGRAM_BUCKETS> depths_{};
+    std::array<std::atomic<uint64_t>, SERVICE_HISTOGRAM_BUCKETS> sizes_{};
+
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace lea
+
+#endif
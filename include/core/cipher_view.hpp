@@ -0,0 +1,102 @@
+#ifndef CIPHER_VIEW_HPP
+#define CIPHER_VIEW_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "cipher.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+// the plaintext of a ciphertext held elsewhere, typically a mapped file,
+// deciphered lazily: construction deciphers only the final block to learn
+// the padding and every read deciphers just the blocks it touches. the view
+// borrows both the ciphertext and the context
+class decrypted_view {
+  public:
+    class iterator;
+
+    decrypted_view() = default;
+    decrypted_view(byte_view ciphertext, const cipher_context& context);
+
+    // false when the ciphertext is not whole blocks, reads then return
+    // nothing
+    bool valid() const noexcept { return context_ != nullptr; }
+
+    // plaintext bytes, padding excluded
+    size_t size() const noexcept { return size_; }
+    size_t block_count() const noexcept { return ciphertext_.size() / 32; }
+
+    // deciphered block index < block_count(), the final one still padded
+    std::array<uint8_t, 32> block(size_t index) const;
+
+    // copies plaintext from offset into output, returns the bytes copied:
+    // fewer than output.size() at the end of the plaintext, 0 past it
+    size_t read(size_t offset, mutable_byte_view output) const;
+
+    iterator begin() const;
+    iterator end() const;
+
+  private:
+    byte_view             ciphertext_;
+    const cipher_context* context_ = nullptr;
+    size_t                size_    = 0;
+};
+
+// walks the deciphered blocks in order, deciphering each on dereference
+class decrypted_view::iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type        = std::array<uint8_t, 32>;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const value_type*;
+    using reference         = value_type;
+
+    iterator() = default;
+    iterator(const decrypted_view* view, size_t index)
+        : view_(view), index_(index) {}
+
+    value_type operator*() const { return view_->block(index_); }
+
+    iterator& operator++() {
+        ++index_;
+        return *this;
+    }
+
+    iterator operator++(int) {
+        iterator previous = *this;
+        ++index_;
+        return previous;
+    }
+
+    bool operator==(const iterator& other) const {
+        return view_ == other.view_ && index_ == other.index_;
+    }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+
+    // block index within the view
+    size_t index() const noexcept { return index_; }
+
+  private:
+    const decrypted_view* view_  = nullptr;
+    size_t                index_ = 0;
+};
+
+// overwrites plaintext bytes [offset, offset + data.size()) of ciphertext in
+// place, re-enciphering only the blocks the write touches and deciphering
+// only the partial ones at either end. the write must lie within the
+// plaintext and leave its size alone, so it cannot end an unpadded message
+// in bytes that read as padding; returns data.size(), or 0 with the
+// ciphertext untouched when it breaks either rule or the ciphertext is not
+// whole blocks
+size_t write_plaintext(mutable_byte_view     ciphertext,
+                       size_t                offset,
+                       byte_view             data,
+                       const cipher_context& context);
+
+}  // namespace lea
+
+#endif
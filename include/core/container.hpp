@@ -0,0 +1,190 @@
+#ifndef CONTAINER_HPP
+#define CONTAINER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+class thread_pool;
+
+// the LEA container, all integers little-endian:
+//
+//   header   64 bytes: "LEAC", u16 version, u16 header size, u32 chunk
+//            size, u32 cipher block size, 32-byte key fingerprint, u32
+//            codec, u32 zero, u64 file offset of the footer, zero until
+//            the container is first finished
+//   chunks   the plaintext cut into chunk-size pieces in order, each
+//            encrypted on its own so only the last one is ever padded
+//   index    16 bytes per chunk: u64 file offset of its ciphertext, u32
+//            plaintext bytes, u32 compressed bytes or zero when the chunk
+//            is stored as is
+//   footer   32 bytes: "LEAX", u32 zero, u64 chunk count, u64 plaintext
+//            bytes, u64 file offset of the index
+//
+// every chunk but the last holds exactly chunk size bytes, so a plaintext
+// offset maps to its chunk by division, chunks cipher independently on any
+// number of threads, and appending only writes the last chunk again, the
+// new chunks, the index and the footer. with a codec each chunk is
+// compressed before it is enciphered, unless that saves less than a
+// sixteenth of it. an append writes past the old footer and leaves a gap
+// where the old short chunk and trailer were, so chunks, index and footer
+// need not be back to back
+constexpr uint16_t CONTAINER_VERSION     = 1;
+constexpr size_t   CONTAINER_HEADER_SIZE = 64;
+constexpr size_t   CONTAINER_FOOTER_SIZE = 32;
+constexpr size_t   CONTAINER_INDEX_ENTRY = 16;
+
+enum class container_codec : uint32_t {
+    NONE = 0,
+
+    // lz_compress, see lz.hpp
+    LZ = 1,
+};
+
+struct container_options {
+    // plaintext bytes per chunk, a non-zero multiple of 32
+    uint32_t chunk_size = 1 << 20;
+
+    container_codec codec = container_codec::NONE;
+};
+
+struct container_chunk {
+    // file offset of the chunk's ciphertext
+    uint64_t offset = 0;
+
+    // plaintext bytes
+    uint32_t size = 0;
+
+    // compressed bytes, 0 when the chunk is stored as is
+    uint32_t compressed = 0;
+
+    // bytes enciphered, the ciphertext is encrypted_size(stored()) long
+    uint32_t stored() const noexcept { return compressed ? compressed : size; }
+};
+
+// identifies the key a container was written with without revealing it:
+// the ECHO hash of a format tag followed by the key bytes
+keyhash key_fingerprint(const keyhash& key);
+
+// writes a container through fd with pread/pwrite, so fd has to be a
+// seekable file. every call returns false with errno set when it fails:
+// EINVAL for bad options, EBADMSG when open_append finds no valid
+// container, ENOTSUP for a newer format version or an unknown codec and
+// EKEYREJECTED for a container written with another key. a new container
+// is valid only once finish() returns true; an appended one stays valid
+// throughout, holding either the old contents or, once finish() returns
+// true, the new ones
+class container_writer {
+  public:
+    explicit container_writer(const keyhash& key);
+
+    // starts a new container at the start of fd, which should be empty
+    bool create(int fd, container_options options = {});
+
+    // continues the container in fd with its chunk size and codec: a short
+    // last chunk is read back, to be completed by the next writes, and
+    // everything new goes after the end of the file
+    bool open_append(int fd);
+
+    // buffers data, ciphering and writing every chunk it completes
+    bool write(byte_view data);
+
+    // write with the completed chunks compressed and ciphered in parallel
+    bool write(byte_view data, thread_pool& pool);
+
+    // writes the buffered short chunk, the index and the footer, then
+    // points the header at the footer, which commits an append; after one
+    // it also frees the space the append replaced
+    bool finish();
+
+    uint32_t        chunk_size() const noexcept { return chunk_size_; }
+    container_codec codec() const noexcept { return codec_; }
+
+    // plaintext bytes in the container, buffered ones included
+    uint64_t size() const noexcept { return size_; }
+
+  private:
+    bool append(byte_view data, thread_pool* pool);
+    bool write_chunks(const uint8_t* data, size_t count, thread_pool* pool);
+    bool write_compressed(const uint8_t* data,
+                          size_t         count,
+                          thread_pool*   pool);
+
+    // compresses and enciphers one chunk into out, which has room for
+    // encrypted_size(plain.size()) bytes
+    container_chunk seal_chunk(byte_view plain, uint8_t* out) const;
+
+    cipher_context               context_;
+    keyhash                      fingerprint_;
+    int                          fd_         = -1;
+    uint32_t                     chunk_size_ = 0;
+    container_codec              codec_      = container_codec::NONE;
+    uint64_t                     end_        = 0;
+    uint64_t                     size_       = 0;
+
+    // where an append started writing, 0 for a new container, and the
+    // start of the old bytes it replaces
+    uint64_t append_start_ = 0;
+    uint64_t gap_start_    = 0;
+
+    std::vector<container_chunk> chunks_;
+    std::vector<uint8_t>         pending_;
+    std::vector<uint8_t>         staging_;
+};
+
+// reads a container through fd with pread, so one reader can serve reads
+// from many threads at once. open() fails like container_writer::open_append
+class container_reader {
+  public:
+    explicit container_reader(const keyhash& key);
+
+    bool open(int fd);
+
+    // plaintext bytes
+    uint64_t        size() const noexcept { return size_; }
+    uint32_t        chunk_size() const noexcept { return chunk_size_; }
+    container_codec codec() const noexcept { return codec_; }
+
+    const std::vector<container_chunk>& chunks() const noexcept {
+        return chunks_;
+    }
+
+    // copies plaintext from offset into output and returns the bytes
+    // copied, fewer than output.size() at the end of the plaintext. reads
+    // and deciphers only the blocks that overlap the request, or the whole
+    // chunk when it is compressed. false with errno set when reading fails
+    bool read(uint64_t offset, mutable_byte_view output, size_t& copied) const;
+
+    // read with the chunks spread over the pool
+    bool read(uint64_t          offset,
+              mutable_byte_view output,
+              size_t&           copied,
+              thread_pool&      pool) const;
+
+  private:
+    // plaintext bytes [begin, end) of one chunk into output
+    bool read_chunk(size_t index, size_t begin, size_t end, uint8_t* output)
+        const;
+    bool read_compressed(const container_chunk& chunk,
+                         size_t                 begin,
+                         size_t                 end,
+                         uint8_t*               output) const;
+
+    cipher_context               context_;
+    keyhash                      fingerprint_;
+    int                          fd_         = -1;
+    uint32_t                     chunk_size_ = 0;
+    container_codec              codec_      = container_codec::NONE;
+    uint64_t                     size_       = 0;
+    std::vector<container_chunk> chunks_;
+};
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef DEDUP_HPP
+#define DEDUP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cipher.hpp"
+#include "echo_hasher.hpp"
+#include "keyhash.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+class thread_pool;
+
+struct chunker_options {
+    // chunk bounds in bytes, min_size < avg_size < max_size, avg_size a
+    // power of two. the last chunk of a stream may be shorter than min_size
+    uint32_t min_size = 4 << 10;
+    uint32_t avg_size = 16 << 10;
+    uint32_t max_size = 64 << 10;
+};
+
+bool valid_chunker_options(const chunker_options& options) noexcept;
+
+// content-defined chunking with a gear rolling hash, normalized like
+// FastCDC: a cut is harder to find before avg_size and easier after it. the
+// cut depends only on the bytes before it, so an edit moves the boundaries
+// near it and no others. returns the length of the first chunk of data,
+// which is data.size() when no cut is found in a buffer shorter than
+// max_size
+size_t find_chunk_boundary(byte_view              data,
+                           const chunker_options& options) noexcept;
+
+// identifies a chunk's plaintext under one key: ECHO over a format tag,
+// the key bytes and the chunk. keying it keeps the index from confirming
+// guesses about the plaintext to anyone without the key
+class chunk_fingerprinter {
+  public:
+    explicit chunk_fingerprinter(const keyhash& key) noexcept;
+
+    keyhash operator()(byte_view chunk) const noexcept;
+
+  private:
+    echo_hasher prefix_;
+};
+
+// the dedup index file, all integers little-endian:
+//
+//   header   64 bytes: "LEAD", u16 version, u16 header size, u64 slot
+//            count, u64 used slots, u64 bytes of chunk data, 32-byte key
+//            fingerprint. the two counts are as of the last complete
+//            flush; open() counts the used slots and finds the end of the
+//            data from them, so a flush cut short between writing the slots
+//            and the header loses nothing
+//   slots    48 bytes each, an open-addressing table probed linearly from
+//            the low bits of the chunk fingerprint: 32-byte fingerprint,
+//            u64 offset of the chunk in the data file, u32 plaintext bytes,
+//            u32 1 when used, an unused slot is all zeros
+//
+// the data file holds the encrypted chunks back to back, each padded like
+// encrypt() output
+constexpr uint16_t DEDUP_VERSION     = 1;
+constexpr size_t   DEDUP_HEADER_SIZE = 64;
+constexpr size_t   DEDUP_SLOT_SIZE   = 48;
+
+struct dedup_chunk {
+    keyhash  fingerprint;
+    uint64_t offset = 0;
+    uint32_t size   = 0;
+};
+
+// encrypted chunks stored once each, found by fingerprint. new chunks are
+// enciphered as they come and written in batches; flush() writes the
+// batch and the changed index slots. not safe to share between threads.
+// calls return false with errno set like container_writer: EBADMSG for a
+// damaged index, ENOTSUP for a newer version, EKEYREJECTED for another key
+class dedup_store {
+  public:
+    explicit dedup_store(const keyhash& key);
+
+    // flushes, ignoring failures; call flush() first to see them
+    ~dedup_store();
+
+    dedup_store(const dedup_store&)            = delete;
+    dedup_store& operator=(const dedup_store&) = delete;
+
+    // starts an empty store in two empty files, or opens an existing one
+    bool create(int index_fd, int data_fd);
+    bool open(int index_fd, int data_fd);
+
+    // adds chunk under fingerprint unless the store has it, stored tells
+    // which
+    bool put(const keyhash& fingerprint, byte_view chunk, bool& stored);
+
+    bool find(const keyhash& fingerprint, dedup_chunk& chunk) const;
+
+    // the plaintext of a stored chunk, ENOENT when there is none
+    bool get(const keyhash& fingerprint, std::vector<uint8_t>& chunk) const;
+
+    bool flush();
+
+    uint64_t chunk_count() const noexcept { return used_; }
+
+    // ciphertext bytes in the data file, pending ones included
+    uint64_t data_size() const noexcept { return data_end_; }
+
+    // fingerprints under the store's key
+    const chunk_fingerprinter& fingerprinter() const noexcept {
+        return fingerprinter_;
+    }
+
+  private:
+    struct slot {
+        dedup_chunk chunk;
+        bool        used = false;
+    };
+
+    bool   start(int index_fd, int data_fd, size_t slot_count);
+    size_t probe(const keyhash& fingerprint) const noexcept;
+    void   grow();
+    bool   write_data();
+    bool   write_index();
+    void   encode_header(uint8_t* out) const noexcept;
+
+    cipher_context      context_;
+    chunk_fingerprinter fingerprinter_;
+    keyhash             key_fingerprint_;
+    int                 index_fd_ = -1;
+    int                 data_fd_  = -1;
+    std::vector<slot>   slots_;
+    std::vector<size_t> dirty_slots_;
+    bool                rewrite_index_ = false;
+    uint64_t            used_          = 0;
+
+    // ciphertext of new chunks not yet written, starting at written_end_
+    std::vector<uint8_t> pending_;
+    uint64_t             written_end_ = 0;
+    uint64_t             data_end_    = 0;
+};
+
+// one entry of a stream's recipe: the chunks to concatenate to restore it
+struct dedup_ref {
+    keyhash  fingerprint;
+    uint32_t size = 0;
+};
+
+struct dedup_stats {
+    uint64_t bytes      = 0;
+    uint64_t chunks     = 0;
+    uint64_t new_chunks = 0;
+    uint64_t new_bytes  = 0;
+
+    // plaintext bytes seen per plaintext byte stored
+    double ratio() const noexcept {
+        return new_bytes == 0 ? 0 : static_cast<double>(bytes) / new_bytes;
+    }
+};
+
+// the stage in front of the cipher: cuts a stream into content-defined
+// chunks, fingerprints them and puts them in a store, so only chunks the
+// store lacks are enciphered and written. the recipe lists every chunk in
+// stream order. fails with EINVAL for invalid chunker options
+class dedup_writer {
+  public:
+    explicit dedup_writer(dedup_store& store, chunker_options options = {});
+
+    bool write(byte_view data);
+
+    // write with the chunks fingerprinted in parallel
+    bool write(byte_view data, thread_pool& pool);
+
+    // cuts what is left and flushes the store
+    bool finish();
+
+    const std::vector<dedup_ref>& recipe() const noexcept { return recipe_; }
+    const dedup_stats&            stats() const noexcept { return stats_; }
+
+  private:
+    bool append(byte_view data, thread_pool* pool);
+
+    // stores the chunks of pending_ that are settled, all of them at the
+    // end of the stream
+    bool store_chunks(bool last, thread_pool* pool);
+
+    dedup_store&           store_;
+    chunker_options        options_;
+    std::vector<uint8_t>   pending_;
+    std::vector<size_t>    cuts_;
+    std::vector<keyhash>   fingerprints_;
+    std::vector<dedup_ref> recipe_;
+    dedup_stats            stats_;
+};
+
+// the recipe file: "LEAR", u16 version, u16 zero, u64 entry count, u64
+// plaintext bytes, then per entry the 32-byte fingerprint, u32 plaintext
+// bytes and u32 zero. reading fails like dedup_store::open
+bool write_recipe(int fd, const std::vector<dedup_ref>& recipe);
+bool read_recipe(int fd, std::vector<dedup_ref>& recipe);
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef DISPATCH_HPP
+#define DISPATCH_HPP
+
+#include <string_view>
+
+namespace lea {
+
+// instruction set levels the SIMD kernels are built for, each implying the
+// ones before it. every kernel family (bit-sliced cipher, batched keyhash,
+// limb keyhash) runs its implementation for active_kernel_isa(), or the
+// widest one it has below that. AVX2 and up also require BMI2, which the
+// limb keyhash uses for its bit spreading
+enum class kernel_isa {
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512,
+};
+
+const char* kernel_isa_name(kernel_isa isa);
+
+// accepts the names kernel_isa_name returns, false for anything else
+bool parse_kernel_isa(std::string_view name, kernel_isa& isa);
+
+// whether this CPU can run kernels of that level, from cpuid
+bool kernel_isa_supported(kernel_isa isa);
+kernel_isa best_kernel_isa();
+
+// the level in use: the one forced through force_kernel_isa, else the
+// LEA_KERNEL environment variable (scalar, sse2, avx2 or avx512) when the
+// CPU supports it, else best_kernel_isa()
+kernel_isa active_kernel_isa();
+
+// runs every kernel family at isa from now on, for tests and benchmarks.
+// false, changing nothing, when the CPU does not support it
+bool force_kernel_isa(kernel_isa isa);
+
+// back to LEA_KERNEL or the best level
+void clear_forced_kernel_isa();
+
+}  // namespace lea
+
+#endif
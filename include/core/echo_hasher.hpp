@@ -0,0 +1,47 @@
+#ifndef ECHO_HASHER_HPP
+#define ECHO_HASHER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "keyhash.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+// ECHO over messages of any length. the message is padded with 0x80 and
+// zeros to a multiple of 32 bytes and dealt round-robin to ECHO_LANES
+// chains, block i to chain i % ECHO_LANES, so gen_keyhash_batch advances
+// every chain at once. with P(x) = gen_keyhash(x, 32) each block m moves
+// its chain h to P(P(m) ^ h) ^ h. final() folds the chains pairwise with
+// the same step and appends the byte length
+constexpr size_t ECHO_LANES        = 16;
+constexpr size_t ECHO_STRIPE_BYTES = ECHO_LANES * KEYHASH_BYTES;
+
+class echo_hasher {
+  public:
+    echo_hasher() noexcept;
+
+    void update(byte_view bytes) noexcept;
+
+    // digest of everything passed to update, the hasher then starts over
+    keyhash final() noexcept;
+
+    void reset() noexcept;
+
+  private:
+    void absorb(const uint8_t* stripe) noexcept;
+
+    std::array<limbs256, ECHO_LANES>       chains_;
+    std::array<uint8_t, ECHO_STRIPE_BYTES> buffer_;
+    size_t                                 buffered_ = 0;
+    uint64_t                               length_   = 0;
+};
+
+// echo_hasher over a single buffer
+keyhash echo_hash(byte_view bytes) noexcept;
+
+}    // namespace lea
+
+#endif
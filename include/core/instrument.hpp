@@ -0,0 +1,108 @@
+#ifndef INSTRUMENT_HPP
+#define INSTRUMENT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lea {
+
+// hot-path stages timed by LEA_STAGE
+enum class stage {
+    KEYHASH,
+    EXPAND,
+    COMPACT,
+    ROTATE,
+    MIX,
+    SBOX,
+    FLIP,
+    GET_OPERATIONS,
+    KEY_SCHEDULE,
+    CIPHER_BLOCK,
+    DECIPHER_BLOCK,
+    CIPHER_BULK,
+    DECIPHER_BULK,
+    PAD,
+    UNPAD,
+    ALLOCATE,
+    READ,
+    WRITE,
+    CHUNK,
+    CUT,
+    COMPRESS,
+    DECOMPRESS,
+    COUNT,
+};
+
+constexpr size_t STAGE_COUNT = static_cast<size_t>(stage::COUNT);
+
+const char* stage_name(stage s);
+
+// true when lea-core was built with LEA_INSTRUMENT, otherwise LEA_STAGE
+// expands to nothing and every counter stays at zero
+constexpr bool instrumentation_enabled() {
+#if defined(LEA_INSTRUMENT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+struct stage_stats {
+    uint64_t calls       = 0;
+    uint64_t nanoseconds = 0;
+    uint64_t cycles      = 0;
+};
+
+// totals over every thread, past and present
+using stats_snapshot = std::array<stage_stats, STAGE_COUNT>;
+
+stats_snapshot snapshot_stats();
+void           reset_stats();
+
+// one line per stage that ran, or a JSON object keyed by stage name
+std::string stats_text(const stats_snapshot& stats);
+std::string stats_json(const stats_snapshot& stats);
+
+// records every timed stage as a Chrome trace event (chrome://tracing,
+// Perfetto) between start_trace and stop_trace, at most TRACE_EVENT_LIMIT
+// per thread
+constexpr size_t TRACE_EVENT_LIMIT = 1 << 20;
+
+void start_trace();
+void stop_trace();
+
+// writes the events recorded so far, returns false if path is unwritable
+bool write_chrome_trace(const std::string& path);
+
+// adds the time between construction and destruction to a stage of the
+// calling thread's counters
+class scoped_stage {
+  public:
+    explicit scoped_stage(stage s) noexcept;
+    ~scoped_stage();
+
+    scoped_stage(const scoped_stage&)            = delete;
+    scoped_stage& operator=(const scoped_stage&) = delete;
+
+  private:
+    stage    stage_;
+    uint64_t start_ns_;
+    uint64_t start_cycles_;
+};
+
+}  // namespace lea
+
+#define LEA_STAGE_CONCAT_(a, b) a##b
+#define LEA_STAGE_CONCAT(a, b)  LEA_STAGE_CONCAT_(a, b)
+
+// times the rest of the enclosing scope as stage s
+#if defined(LEA_INSTRUMENT)
+#define LEA_STAGE(s)                                                         \
+    ::lea::scoped_stage LEA_STAGE_CONCAT(lea_stage_, __LINE__)(::lea::stage::s)
+#else
+#define LEA_STAGE(s)
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef KEY_CACHE_HPP
+#define KEY_CACHE_HPP
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+
+namespace lea {
+
+struct key_cache_options {
+    // entries kept per map, rounded up to a multiple of shards
+    size_t capacity = 4096;
+
+    // independently locked partitions, more shards mean less contention
+    size_t shards = 16;
+
+    // overwrite evicted and cleared entries with zeros before reuse
+    bool zero_evicted = false;
+};
+
+struct cache_counters {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+};
+
+// thread-safe, bounded memo of gen_keyhash (password -> keyhash) and of
+// make_key_schedule (keyhash -> key_schedule). each map is split into
+// shards evicting by CLOCK; hits only take a shard's shared lock
+class key_cache {
+  public:
+    explicit key_cache(key_cache_options options = {});
+    ~key_cache();
+
+    key_cache(const key_cache&)            = delete;
+    key_cache& operator=(const key_cache&) = delete;
+
+    // gen_keyhash(input_bits, input_byte_length). a length of 0 is refused
+    // with the all-zero keyhash and nothing is cached
+    keyhash get_keyhash(const std::bitset<256>& input_bits,
+                        size_t                  input_byte_length);
+
+    // keyhash of a password as lea-app derives it, from its first 32 bytes.
+    // an empty password is refused like a length of 0
+    keyhash get_keyhash(const std::string& password);
+
+    // make_key_schedule(key)
+    key_schedule get_schedule(const keyhash& key);
+
+    cache_counters keyhash_counters() const;
+    cache_counters schedule_counters() const;
+
+    // drops every entry, zeroing them when zero_evicted is set
+    void clear();
+
+  private:
+    struct maps;
+    std::unique_ptr<maps> maps_;
+};
+
+}  // namespace lea
+
+#endif
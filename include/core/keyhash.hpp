@@ -1,8 +1,16 @@
 #ifndef KEYHASH_HPP
 #define KEYHASH_HPP
 
+#include <array>
 #include <bitset>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include "span.hpp"
 
 namespace lea {
 
@@ -18,12 +26,49 @@ const size_t EXPAND_COMPACT_ITERATIONS = 4;
 //     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
 //     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x42};
 
+// word-level ECHO state: bit i of the bitset lives in limb i / 64 at bit
+// position i % 64, so byte j of the state is byte j % 8 of limb j / 8
+using limbs256 = std::array<uint64_t, 4>;
+
+const size_t KEYHASH_BYTES      = 32;
+const size_t KEYHASH_HEX_LENGTH = 2 * KEYHASH_BYTES;
+
 struct keyhash {
-    std::bitset<256> bits;
+    limbs256 limbs{};
+
+    keyhash() = default;
+    explicit keyhash(const limbs256& limbs) noexcept : limbs(limbs) {}
+    explicit keyhash(const std::bitset<256>& bits) noexcept;
+
+    std::bitset<256> bits() const noexcept;
+
+    // byte j holds bits 8j to 8j + 7, least significant first, on any host
+    std::array<uint8_t, KEYHASH_BYTES> to_bytes() const noexcept;
+
+    // false, leaving out untouched, unless bytes is exactly 32 bytes long
+    static bool from_bytes(byte_view bytes, keyhash& out) noexcept;
+
+    // the bytes of to_bytes as 64 digits, parsing either case
+    static bool from_hex(std::string_view hex, keyhash& out) noexcept;
 
-    std::string hex_str() const noexcept;
+    // writes the 64 uppercase digits without a terminator, returns 0 when
+    // out is too short
+    size_t to_hex(span<char> out) const noexcept;
+
+    // 64 uppercase digits in the layout lea-app has always printed: limb 3
+    // first, each limb bit-reversed. not the to_hex layout, so from_hex
+    // does not parse it
+    std::string hex_str() const;
+
+    // hex_str allocated from resource
+    std::pmr::string hex_str(std::pmr::memory_resource* resource) const;
 };
 
+// compares every limb whatever the first difference, keeping the time
+// independent of the contents
+bool operator==(const keyhash& a, const keyhash& b) noexcept;
+bool operator!=(const keyhash& a, const keyhash& b) noexcept;
+
 keyhash gen_keyhash(const std::bitset<256>& input_bits,
                     size_t                  input_byte_length);
 
@@ -36,11 +81,27 @@ std::bitset<512> bit_interleaving_expand(const std::bitset<256>& input_bits,
 std::bitset<256> sequential_bit_compact(const std::bitset<512>& input_bits);
 
 std::bitset<256> rotate_left(const std::bitset<256>& bits, size_t shift);
-std::bitset<256> bitify_str(const std::string& str);
+std::bitset<256> bitify_str(std::string_view str);
 void             intermittent_bit_flip(std::bitset<256>& bits);
 void             apply_sbox(std::bitset<256>& bits);
 void             mix(std::bitset<256>& bits, size_t round);
 
 }    // namespace lea
 
-#endif
\ No newline at end of file
+namespace std {
+
+template <>
+struct hash<lea::keyhash> {
+    size_t operator()(const lea::keyhash& key) const noexcept {
+        uint64_t h = 0;
+        for (uint64_t limb : key.limbs) {
+            h = (h ^ limb) * 0x9E37'79B9'7F4A'7C15ULL;
+            h ^= h >> 29;
+        }
+        return static_cast<size_t>(h);
+    }
+};
+
+}    // namespace std
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef KEYHASH_BATCH_HPP
+#define KEYHASH_BATCH_HPP
+
+#include <bitset>
+#include <cstddef>
+
+#include "keyhash.hpp"
+#include "keyhash_limbs.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+// number of inputs hashed side by side by the active_kernel_isa() kernel
+size_t keyhash_batch_lanes();
+
+// outputs[i] = gen_keyhash(inputs[i], lengths[i]) for every input, running
+// the rounds on many inputs at once. returns the number of hashes written,
+// 0 without writing any when the three spans differ in size or a length is
+// 0, which gen_keyhash refuses too
+size_t gen_keyhash_batch(span<const limbs256> inputs,
+                         span<const size_t>   lengths,
+                         span<limbs256>       outputs);
+
+size_t gen_keyhash_batch(span<const std::bitset<256>> inputs,
+                         span<const size_t>           lengths,
+                         span<keyhash>                outputs);
+
+}    // namespace lea
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef KEYHASH_LIMBS_HPP
+#define KEYHASH_LIMBS_HPP
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+#include "keyhash.hpp"
+
+namespace lea {
+
+// expanded state, laid out like limbs256
+using limbs512 = std::array<uint64_t, 8>;
+
+limbs256         to_limbs(const std::bitset<256>& bits);
+std::bitset<256> to_bitset(const limbs256& limbs);
+
+// produces the same keyhash as the bitset gen_keyhash. input_byte_length
+// must be non-zero, 0 is refused with the all-zero keyhash and nothing is
+// hashed
+keyhash gen_keyhash(const limbs256& input_limbs, size_t input_byte_length);
+
+// repeats the first input_byte_length bytes over all 32, as the first
+// expansion does for short inputs. all zeros for a length of 0
+limbs256 wrap_input(const limbs256& input_limbs, size_t input_byte_length);
+
+// Bit-Interleaving Expansion
+limbs512 bit_interleaving_expand(const limbs256& input_limbs,
+                                 size_t          input_byte_length);
+
+// Sequential Bit Compaction
+limbs256 sequential_bit_compact(const limbs512& input_limbs);
+
+// shift must be below 256
+limbs256 rotate_left(const limbs256& limbs, size_t shift);
+void     intermittent_bit_flip(limbs256& limbs);
+void     apply_sbox(limbs256& limbs);
+void     mix(limbs256& limbs, size_t round);
+
+}    // namespace lea
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef LZ_HPP
+#define LZ_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "span.hpp"
+
+namespace lea {
+
+// a fast byte-oriented LZ77 codec writing the LZ4 block format: sequences
+// of a token, literal bytes and a 16-bit back offset, greedy matching
+// through a 4096-entry hash table and skipping ahead faster the longer no
+// match turns up, so incompressible input costs little
+
+// output size that always suffices for lz_compress
+size_t lz_compress_bound(size_t size) noexcept;
+
+// compresses input into output and returns the compressed size, or 0 when
+// it does not fit. a small output makes compression give up early on
+// input that does not shrink enough
+size_t lz_compress(byte_view input, mutable_byte_view output) noexcept;
+
+// decompresses input, which has to expand to exactly output.size() bytes.
+// false for damaged input, never reading or writing out of bounds
+bool lz_decompress(byte_view input, mutable_byte_view output) noexcept;
+
+}  // namespace lea
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef PAGE_STORE_HPP
+#define PAGE_STORE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+struct page_store_options {
+    // bytes per page, a non-zero multiple of 32
+    size_t page_size = 4096;
+
+    // decrypted pages cached, rounded up to a multiple of shards
+    size_t capacity = 1024;
+
+    // independently locked partitions, page i lives in shard i % shards
+    size_t shards = 16;
+};
+
+struct page_store_counters {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+
+    // dirty pages enciphered and written back, and the pwrite calls that
+    // took, fewer when flush() finds runs of adjacent pages
+    uint64_t writebacks = 0;
+    uint64_t writes     = 0;
+};
+
+// a file of encrypted fixed-size pages, page i being the ciphertext bytes
+// [i * page_size, (i + 1) * page_size), read through pread/pwrite with a
+// bounded cache of deciphered pages in front. since every block is
+// ciphered on its own a page deciphers and re-enciphers without touching
+// its neighbours. the cache is split into shards evicting by CLOCK like
+// key_cache; pinned pages are never evicted and dirty ones are written back
+// when evicted or on flush(). bytes past the end of the file read as zeros
+// and writing them back extends it. the store does not order accesses
+// within a page, callers sharing a page for writing must do that. failures
+// return false or an empty page with errno set
+class page_store {
+  public:
+    class page;
+
+    explicit page_store(const keyhash& key, page_store_options options = {});
+
+    // flushes, ignoring failures; call flush() first to see them
+    ~page_store();
+
+    page_store(const page_store&)            = delete;
+    page_store& operator=(const page_store&) = delete;
+
+    // serves pages from fd, which needs O_RDWR for dirty pages to be
+    // written back. EINVAL when the page size is not a multiple of 32 or
+    // the file is not whole blocks
+    bool open(int fd);
+
+    size_t page_size() const noexcept { return page_size_; }
+
+    // pages in the file, counting ones only written back so far
+    uint64_t page_count() const noexcept;
+
+    // pins page index in the cache, reading and deciphering it on a miss.
+    // empty with errno set when that fails, EBUSY when every page of its
+    // shard is pinned
+    page pin(uint64_t index);
+
+    // byte-level access through the cache, spanning pages as needed
+    bool read(uint64_t offset, mutable_byte_view output);
+    bool write(uint64_t offset, byte_view data);
+
+    // enciphers and writes back every dirty page, adjacent pages in one
+    // pwrite. a page modified during the flush has to be marked dirty again
+    bool flush();
+
+    page_store_counters counters() const;
+
+  private:
+    struct frame;
+    struct shard;
+
+    bool claim_frame(shard& s, size_t& slot);
+    bool load(uint64_t index, uint8_t* data);
+    bool write_back(uint64_t first, const uint8_t* plain, size_t count);
+    void note_pages(uint64_t count) noexcept;
+
+    cipher_context                      context_;
+    size_t                              page_size_;
+    int                                 fd_ = -1;
+    std::atomic<uint64_t>               pages_{0};
+    std::vector<std::unique_ptr<shard>> shards_;
+
+    std::atomic<uint64_t> writebacks_{0};
+    std::atomic<uint64_t> writes_{0};
+};
+
+// a pinned, deciphered page. the page stays cached while any handle to it
+// is alive
+class page_store::page {
+  public:
+    page() = default;
+    ~page();
+
+    page(page&& other) noexcept;
+    page& operator=(page&& other) noexcept;
+
+    page(const page&)            = delete;
+    page& operator=(const page&) = delete;
+
+    explicit operator bool() const noexcept { return frame_ != nullptr; }
+
+    uint64_t  index() const noexcept { return index_; }
+    byte_view bytes() const noexcept;
+
+    // the page for writing, marked dirty so it is written back later
+    mutable_byte_view mutable_bytes() noexcept;
+
+  private:
+    friend class page_store;
+    page(frame* f, uint64_t index, size_t size) noexcept
+        : frame_(f), index_(index), size_(size) {}
+
+    frame*   frame_ = nullptr;
+    uint64_t index_ = 0;
+    size_t   size_  = 0;
+};
+
+}  // namespace lea
+
+#endif
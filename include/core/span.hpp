@@ -0,0 +1,64 @@
+#ifndef SPAN_HPP
+#define SPAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace lea {
+
+// allows From elements to be viewed as To, e.g. uint8_t as const uint8_t
+template <typename From, typename To>
+using if_viewable_t
+    = std::enable_if_t<std::is_convertible_v<From (*)[], To (*)[]>>;
+
+// non-owning pointer + length view, a C++17 stand-in for std::span
+template <typename T>
+class span {
+  public:
+    constexpr span() noexcept = default;
+    constexpr span(T* data, size_t size) noexcept : data_(data), size_(size) {}
+
+    // span<const T> from span<T>
+    template <typename U, typename = if_viewable_t<U, T>>
+    constexpr span(const span<U>& other) noexcept
+        : data_(other.data()), size_(other.size()) {}
+
+    // any contiguous container with data() and size(), e.g. std::vector
+    template <typename Container,
+              typename Element = std::remove_pointer_t<
+                  decltype(std::declval<Container&>().data())>,
+              typename = if_viewable_t<Element, T>>
+    constexpr span(Container& container) noexcept
+        : data_(container.data()), size_(container.size()) {}
+
+    constexpr T*     data() const noexcept { return data_; }
+    constexpr size_t size() const noexcept { return size_; }
+    constexpr bool   empty() const noexcept { return size_ == 0; }
+    constexpr T*     begin() const noexcept { return data_; }
+    constexpr T*     end() const noexcept { return data_ + size_; }
+
+    constexpr T& operator[](size_t index) const noexcept {
+        return data_[index];
+    }
+
+    constexpr span subspan(size_t offset, size_t count) const noexcept {
+        return span(data_ + offset, count);
+    }
+
+    constexpr span subspan(size_t offset) const noexcept {
+        return span(data_ + offset, size_ - offset);
+    }
+
+  private:
+    T*     data_ = nullptr;
+    size_t size_ = 0;
+};
+
+using byte_view         = span<const uint8_t>;
+using mutable_byte_view = span<uint8_t>;
+
+}  // namespace lea
+
+#endif
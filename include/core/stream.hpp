@@ -0,0 +1,80 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+// incremental encrypt: update() ciphers every whole block seen so far and
+// holds back at most 31 bytes, finish() pads and ciphers the remainder.
+// concatenated outputs equal encrypt() over the concatenated input
+class encryptor {
+  public:
+    explicit encryptor(const keyhash& key);
+
+    std::vector<uint8_t> update(const uint8_t* data, size_t size);
+    std::vector<uint8_t> update(const std::vector<uint8_t>& data);
+
+    // ends the message, the encryptor can then start a new one
+    std::vector<uint8_t> finish();
+
+    // update/finish with the output allocated from resource
+    std::pmr::vector<uint8_t> update(byte_view                  data,
+                                     std::pmr::memory_resource* resource);
+    std::pmr::vector<uint8_t> finish(std::pmr::memory_resource* resource);
+
+  private:
+    template <typename Bytes>
+    void update_into(Bytes& output, const uint8_t* data, size_t size);
+
+    template <typename Bytes>
+    void finish_into(Bytes& output);
+
+    std::unique_ptr<block_permutation> permutation_;
+    std::array<uint8_t, 32>            carry_;
+    size_t                             carry_len_ = 0;
+};
+
+// incremental decrypt: update() deciphers every whole block except the
+// last one, which finish() deciphers and strips of padding. concatenated
+// outputs equal decrypt() over the concatenated input as long as the
+// ciphertext is a multiple of 32 bytes, otherwise finish() returns nothing
+class decryptor {
+  public:
+    explicit decryptor(const keyhash& key);
+
+    std::vector<uint8_t> update(const uint8_t* data, size_t size);
+    std::vector<uint8_t> update(const std::vector<uint8_t>& data);
+
+    // ends the message, the decryptor can then start a new one
+    std::vector<uint8_t> finish();
+
+    // update/finish with the output allocated from resource
+    std::pmr::vector<uint8_t> update(byte_view                  data,
+                                     std::pmr::memory_resource* resource);
+    std::pmr::vector<uint8_t> finish(std::pmr::memory_resource* resource);
+
+  private:
+    template <typename Bytes>
+    void update_into(Bytes& output, const uint8_t* data, size_t size);
+
+    template <typename Bytes>
+    void finish_into(Bytes& output);
+
+    std::unique_ptr<block_permutation> permutation_;
+    std::array<uint8_t, 32>            carry_;
+    size_t                             carry_len_ = 0;
+};
+
+}  // namespace lea
+
+#endif
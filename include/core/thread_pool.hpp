@@ -0,0 +1,64 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lea {
+
+// reusable work-stealing pool: every worker owns a deque, takes its newest
+// task first and steals the oldest task of another worker when idle
+class thread_pool {
+  public:
+    using task = std::function<void()>;
+
+    // a thread_count of 0 uses std::thread::hardware_concurrency()
+    explicit thread_pool(size_t thread_count = 0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&)            = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    size_t size() const noexcept;
+
+    void submit(task t);
+
+    // runs body(begin, end) over [0, count) in ranges of at most grain and
+    // returns once all ranges are done, the calling thread helps out. when
+    // ranges throw, the first exception is rethrown after all have finished
+    // and the others are dropped
+    void parallel_for(size_t                                     count,
+                      size_t                                     grain,
+                      const std::function<void(size_t, size_t)>& body);
+
+  private:
+    struct worker_queue {
+        std::mutex       mutex;
+        std::deque<task> tasks;
+    };
+
+    void push(size_t queue_index, task t);
+    bool try_pop(size_t queue_index, task& t);
+    bool try_steal(size_t thief_index, task& t);
+    void worker_loop(size_t index);
+
+    std::vector<std::unique_ptr<worker_queue>> queues_;
+    std::vector<std::thread>                   threads_;
+
+    std::mutex              wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t>     pending_{0};
+    std::atomic<size_t>     next_queue_{0};
+    bool                    stopping_ = false;
+};
+
+}  // namespace lea
+
+#endif
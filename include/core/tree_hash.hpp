@@ -0,0 +1,67 @@
+#ifndef TREE_HASH_HPP
+#define TREE_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "keyhash.hpp"
+#include "span.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+// ECHO tree mode: the input is cut into leaf_size leaves, each hashed with
+// echo_hash, and every pair of nodes (a, b) gets the parent
+// P(P(a ^ tag) ^ b) ^ a with P(x) = gen_keyhash(x, 32). an odd node at the
+// end of a level moves up unchanged. the root is the top node absorbing
+// the input size, leaf size and leaf count, so the digest depends on the
+// input and leaf_size alone, never on the thread count
+struct tree_options {
+    size_t leaf_size = 1 << 20;
+};
+
+// a tree that keeps every node, so changing a few leaves only rehashes
+// them and their ancestors
+class hash_tree {
+  public:
+    explicit hash_tree(tree_options options = {});
+
+    // hashes every leaf of data on pool
+    void build(byte_view data, thread_pool& pool);
+
+    // rehashes changed_leaves of data, which may have grown or shrunk since
+    // the last build, along with the leaves its new size touches. returns
+    // the number of leaves hashed
+    size_t rehash(byte_view          data,
+                  span<const size_t> changed_leaves,
+                  thread_pool&       pool);
+
+    keyhash root() const;
+
+    size_t         leaf_count() const;
+    const keyhash& leaf(size_t index) const;
+
+  private:
+    void hash_leaves(byte_view          data,
+                     span<const size_t> leaves,
+                     thread_pool&       pool);
+
+    tree_options                      options_;
+    uint64_t                          size_ = 0;
+    std::vector<std::vector<keyhash>> levels_;
+};
+
+keyhash tree_hash(byte_view data, thread_pool& pool, tree_options options = {});
+
+// tree hash of everything readable from fd. regular files are mapped, other
+// descriptors are read a few leaves per pool thread at a time. false with
+// errno set when reading fails
+bool tree_hash_file(int          fd,
+                    thread_pool& pool,
+                    keyhash&     digest,
+                    tree_options options = {});
+
+}    // namespace lea
+
+#endif
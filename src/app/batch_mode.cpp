@@ -0,0 +1,413 @@
+#include "batch_mode.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "buffer_pool.hpp"
+#include "file_io.hpp"
+#include "file_mode.hpp"
+#include "instrument.hpp"
+#include "span.hpp"
+
+namespace lea {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// files up to one range are read and ciphered whole by a single task,
+// larger ones are split into ranges. a multiple of 32 so only a file's
+// final range is ever padded or unpadded
+constexpr size_t RANGE_SIZE = 4 << 20;
+
+// files submitted but not yet finished, bounding open descriptors, mappings
+// and the pool's queues while the tree is still being walked
+constexpr size_t MAX_IN_FLIGHT = 256;
+
+constexpr std::chrono::seconds PROGRESS_INTERVAL{1};
+
+// shared by every task of one process_batch call, which waits for all of
+// them before returning
+class batch_state {
+  public:
+    batch_state(const keyhash& key, Mode mode, thread_pool& pool)
+        : context(key), mode(mode), pool(pool) {}
+
+    const cipher_context context;
+    const Mode           mode;
+    thread_pool&         pool;
+
+    void start_file() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_++;
+    }
+
+    void finish_file(bool ok, size_t bytes_in, size_t bytes_out) {
+        if (ok) {
+            files_.fetch_add(1, std::memory_order_relaxed);
+            bytes_in_.fetch_add(bytes_in, std::memory_order_relaxed);
+            bytes_out_.fetch_add(bytes_out, std::memory_order_relaxed);
+        } else {
+            failed_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // notified under the lock, the waiter may destroy *this as soon as
+        // it is released
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_--;
+        finished_.notify_all();
+    }
+
+    // failures found before a file reaches the pool
+    void fail() { failed_.fetch_add(1, std::memory_order_relaxed); }
+
+    // blocks until fewer than limit files are in flight, printing progress
+    // meanwhile if asked to
+    void wait_below(size_t limit, bool progress) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!finished_.wait_for(lock, PROGRESS_INTERVAL, [&] {
+            return in_flight_ < limit;
+        })) {
+            if (progress) { print_progress(); }
+        }
+    }
+
+    void print_progress() const {
+        double seconds = elapsed();
+        size_t bytes   = bytes_in_.load(std::memory_order_relaxed);
+        std::cerr << "lea-app: " << files_.load(std::memory_order_relaxed)
+                  << " files, " << (bytes >> 20) << " MiB in " << seconds
+                  << " s ("
+                  << static_cast<uint64_t>(seconds > 0 ? bytes / seconds : 0)
+                  << " bytes/s)\n";
+    }
+
+    double elapsed() const {
+        return std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start_)
+            .count();
+    }
+
+    void read(batch_stats& stats) const {
+        stats.files     = files_.load(std::memory_order_relaxed);
+        stats.failed    = failed_.load(std::memory_order_relaxed);
+        stats.bytes_in  = bytes_in_.load(std::memory_order_relaxed);
+        stats.bytes_out = bytes_out_.load(std::memory_order_relaxed);
+        stats.seconds   = elapsed();
+    }
+
+  private:
+    std::atomic<size_t> files_{0};
+    std::atomic<size_t> failed_{0};
+    std::atomic<size_t> bytes_in_{0};
+    std::atomic<size_t> bytes_out_{0};
+
+    std::mutex              mutex_;
+    std::condition_variable finished_;
+    size_t                  in_flight_ = 0;
+
+    std::chrono::steady_clock::time_point start_
+        = std::chrono::steady_clock::now();
+};
+
+// a large file mapped for its ranges, the last range to finish completes it
+struct mapped_file {
+    std::string input_path;
+    std::string output_path;
+
+    std::unique_ptr<file_handle> output;
+    mapped_files                 files;
+
+    std::atomic<size_t> remaining{0};
+    std::atomic<size_t> output_size{0};
+};
+
+void cipher_range(batch_state&                 state,
+                  std::shared_ptr<mapped_file> file,
+                  size_t                       offset) {
+    size_t input_size = file->files.input_size;
+    size_t size       = std::min(RANGE_SIZE, input_size - offset);
+    size_t written    = cipher_mapped_range(
+        file->files, state.context, state.mode, offset, size, nullptr);
+    if (offset + size == input_size) { file->output_size = offset + written; }
+
+    if (file->remaining.fetch_sub(1) != 1) { return; }
+
+    file->files.in.reset();
+    file->files.out.reset();
+
+    size_t output_size = file->output_size;
+    bool   ok          = finish_mapped(
+        file->output_path, file->output->get(), file->files, output_size);
+    file->output.reset();
+    state.finish_file(ok, input_size, output_size);
+}
+
+// reads a small file whole and ciphers it in place
+bool cipher_whole(batch_state&       state,
+                  const std::string& input_path,
+                  int                input_fd,
+                  size_t             input_size,
+                  const std::string& output_path,
+                  int                output_fd,
+                  size_t&            output_size) {
+    size_t capacity
+        = state.mode == ENCRYPT ? encrypted_size(input_size) : input_size;
+    std::pmr::vector<uint8_t> buffer(capacity, thread_buffer_pool());
+
+    std::atomic<bool> read_failed = false;
+    size_t            size
+        = read_full(input_fd, buffer.data(), input_size, read_failed);
+    if (read_failed) {
+        report_errno(input_path);
+        return false;
+    }
+    // the file shrank since fstat, cipher what was read
+    if (state.mode == DECRYPT && !check_ciphertext_size(input_path, size)) {
+        return false;
+    }
+
+    {
+        LEA_STAGE(CHUNK);
+        byte_view         data(buffer.data(), size);
+        mutable_byte_view blocks(buffer);
+        if (state.mode == ENCRYPT) {
+            output_size = state.context.encrypt(data, blocks);
+        } else {
+            output_size = size == 0 ? 0 : state.context.decrypt(data, blocks);
+        }
+    }
+
+    if (!write_all(output_fd, buffer.data(), output_size)) {
+        report_errno(output_path);
+        return false;
+    }
+    return true;
+}
+
+// opens both files, then either ciphers a small file right away or maps a
+// large one and queues its ranges on this worker, for the others to steal
+void start_file(batch_state& state,
+                std::string  input_path,
+                std::string  output_path) {
+    file_handle input(open(input_path.c_str(), O_RDONLY));
+    if (!input.valid()) {
+        report_errno(input_path);
+        state.finish_file(false, 0, 0);
+        return;
+    }
+    auto output = std::make_unique<file_handle>(
+        open(output_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644));
+    if (!output->valid()) {
+        report_errno(output_path);
+        state.finish_file(false, 0, 0);
+        return;
+    }
+
+    struct stat input_stat;
+    if (fstat(input.get(), &input_stat) != 0) {
+        report_errno(input_path);
+        state.finish_file(false, 0, 0);
+        return;
+    }
+    size_t input_size = static_cast<size_t>(input_stat.st_size);
+
+    if (input_size <= RANGE_SIZE) {
+        size_t output_size = 0;
+        bool   ok          = cipher_whole(state,
+                                input_path,
+                                input.get(),
+                                input_size,
+                                output_path,
+                                output->get(),
+                                output_size);
+        state.finish_file(ok, input_size, output_size);
+        return;
+    }
+
+    auto file         = std::make_shared<mapped_file>();
+    file->input_path  = std::move(input_path);
+    file->output_path = std::move(output_path);
+    if (!map_files(file->input_path,
+                   input.get(),
+                   input_size,
+                   file->output_path,
+                   output->get(),
+                   state.mode,
+                   file->files)) {
+        state.finish_file(false, 0, 0);
+        return;
+    }
+    file->output = std::move(output);
+
+    // the mappings outlive the input descriptor
+    file->remaining = (input_size + RANGE_SIZE - 1) / RANGE_SIZE;
+    for (size_t offset = 0; offset < input_size; offset += RANGE_SIZE) {
+        state.pool.submit(
+            [&state, file, offset] { cipher_range(state, file, offset); });
+    }
+}
+
+// the last component of path, "dir" for "dir/" and "." alike
+fs::path base_name(const fs::path& path) {
+    std::error_code ec;
+    fs::path        full = fs::absolute(path, ec).lexically_normal();
+    if (!full.has_filename()) { full = full.parent_path(); }
+    return full.filename();
+}
+
+// walks inputs on the calling thread, creating output directories and
+// handing each regular file to the pool
+class batch_walker {
+  public:
+    batch_walker(batch_state& state, const fs::path& output_dir, bool progress)
+        : state_(state), output_dir_(output_dir), progress_(progress) {}
+
+    void add(const fs::path& input) {
+        std::error_code ec;
+        fs::file_status status = fs::status(input, ec);
+        if (ec) {
+            report_error(input.string(), ec.message().c_str());
+            state_.fail();
+        } else if (fs::is_directory(status)) {
+            add_tree(input, output_dir_ / base_name(input));
+        } else if (fs::is_regular_file(status)) {
+            add_file(input, output_dir_ / base_name(input));
+        } else {
+            report_error(input.string(), "not a regular file or directory");
+            state_.fail();
+        }
+    }
+
+  private:
+    void add_tree(const fs::path& root, const fs::path& output_root) {
+        if (!make_directory(output_root)) { return; }
+
+        std::error_code               ec;
+        fs::recursive_directory_iterator it(root, ec), end;
+        for (; !ec && it != end; it.increment(ec)) {
+            const fs::directory_entry& entry = *it;
+
+            std::error_code entry_ec;
+            fs::path        output
+                = output_root / entry.path().lexically_relative(root);
+            if (entry.is_directory(entry_ec)) {
+                // never descend into the output of this same run
+                if (fs::equivalent(entry.path(), output_dir_, entry_ec)
+                    || fs::equivalent(entry.path(), output_root, entry_ec)) {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                if (!make_directory(output)) { it.disable_recursion_pending(); }
+            } else if (entry.is_regular_file(entry_ec)) {
+                add_file(entry.path(), output);
+            }
+        }
+        if (ec) {
+            report_error(root.string(), ec.message().c_str());
+            state_.fail();
+        }
+    }
+
+    void add_file(const fs::path& input, const fs::path& output) {
+        // O_TRUNC on the output would destroy the input
+        std::error_code ec;
+        if (fs::equivalent(input, output, ec)) {
+            report_error(input.string(), "input and output are the same file");
+            state_.fail();
+            return;
+        }
+
+        state_.wait_below(MAX_IN_FLIGHT, progress_);
+        state_.start_file();
+
+        batch_state& state = state_;
+        state_.pool.submit(
+            [&state, input = input.string(), output = output.string()] {
+                start_file(state, input, output);
+            });
+    }
+
+    bool make_directory(const fs::path& path) {
+        std::error_code ec;
+        fs::create_directories(path, ec);
+        if (ec) {
+            report_error(path.string(), ec.message().c_str());
+            state_.fail();
+            return false;
+        }
+        return true;
+    }
+
+    batch_state& state_;
+    fs::path     output_dir_;
+    bool         progress_;
+};
+
+}  // namespace
+
+bool process_batch(const std::vector<std::string>& inputs,
+                   const std::string&              output_dir,
+                   const keyhash&                  key,
+                   Mode                            mode,
+                   thread_pool&                    pool,
+                   bool                            progress,
+                   batch_stats&                    stats) {
+    stats = batch_stats{};
+
+    std::error_code ec;
+    fs::create_directories(output_dir, ec);
+    if (ec) {
+        report_error(output_dir, ec.message().c_str());
+        return false;
+    }
+
+    // prepared once, every file and range reuses it
+    batch_state  state(key, mode, pool);
+    batch_walker walker(state, output_dir, progress);
+    for (const std::string& input : inputs) { walker.add(input); }
+    state.wait_below(1, progress);
+
+    state.read(stats);
+    return stats.failed == 0;
+}
+
+bool read_path_list(const std::string& path, std::vector<std::string>& paths) {
+    std::ifstream file;
+    if (path != STDIO_PATH) {
+        file.open(path);
+        if (!file) {
+            report_errno(path);
+            return false;
+        }
+    }
+    std::istream& in = path == STDIO_PATH ? std::cin : file;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty()) { paths.push_back(line); }
+    }
+    if (in.bad()) {
+        report_errno(path);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace lea
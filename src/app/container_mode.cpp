@@ -0,0 +1,179 @@
+#include "container_mode.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "container.hpp"
+#include "file_io.hpp"
+
+namespace lea {
+
+namespace {
+
+// plaintext moved per step, the chunks within it cipher in parallel
+constexpr size_t BATCH_SIZE = 16 << 20;
+
+// errno values container.hpp documents, spelled out for the user
+void report_container_error(const std::string& path) {
+    switch (errno) {
+        case EBADMSG:
+            report_error(path, "not a LEA container, or a damaged one");
+            break;
+        case ENOTSUP:
+            report_error(path, "container format or codec newer than lea-app");
+            break;
+        case EKEYREJECTED:
+            report_error(path, "container was written with another key");
+            break;
+        default: report_errno(path);
+    }
+}
+
+}  // namespace
+
+bool encrypt_container(const std::string& input_path,
+                       const std::string& output_path,
+                       const keyhash&     key,
+                       bool               append,
+                       bool               compress,
+                       thread_pool&       pool,
+                       file_stats&        stats) {
+    auto start = std::chrono::steady_clock::now();
+    stats      = file_stats{};
+
+    file_handle input(input_path == STDIO_PATH
+                          ? STDIN_FILENO
+                          : open(input_path.c_str(), O_RDONLY));
+    if (!input.valid()) {
+        report_errno(input_path);
+        return false;
+    }
+
+    if (output_path == STDIO_PATH) {
+        report_error(output_path, "a container has to be a regular file");
+        return false;
+    }
+    file_handle output(open_output(
+        output_path, O_RDWR | (append ? 0 : O_TRUNC), input.get()));
+    if (!output.valid()) { return false; }
+    struct stat output_stat;
+    if (fstat(output.get(), &output_stat) != 0) {
+        report_errno(output_path);
+        return false;
+    }
+    if (!S_ISREG(output_stat.st_mode)) {
+        report_error(output_path, "a container has to be a regular file");
+        return false;
+    }
+
+    // appending to an empty or missing file starts a new container
+    container_options options;
+    options.codec = compress ? container_codec::LZ : container_codec::NONE;
+
+    container_writer writer(key);
+    bool             opened = append && output_stat.st_size != 0
+                                ? writer.open_append(output.get())
+                                : writer.create(output.get(), options);
+    if (!opened) {
+        report_container_error(output_path);
+        return false;
+    }
+    uint64_t initial_size = writer.size();
+
+    std::vector<uint8_t> buffer(BATCH_SIZE);
+    std::atomic<bool>    read_failed = false;
+    while (true) {
+        size_t size
+            = read_full(input.get(), buffer.data(), buffer.size(), read_failed);
+        if (read_failed) {
+            report_errno(input_path);
+            return false;
+        }
+        if (size != 0 && !writer.write(byte_view(buffer.data(), size), pool)) {
+            report_errno(output_path);
+            return false;
+        }
+        if (size < buffer.size()) { break; }
+    }
+
+    if (!writer.finish()) {
+        report_errno(output_path);
+        return false;
+    }
+    if (fstat(output.get(), &output_stat) == 0) {
+        stats.bytes_out = static_cast<size_t>(output_stat.st_size);
+    }
+    stats.bytes_in = writer.size() - initial_size;
+
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return true;
+}
+
+bool decrypt_container(const std::string& input_path,
+                       const std::string& output_path,
+                       const keyhash&     key,
+                       thread_pool&       pool,
+                       file_stats&        stats) {
+    auto start = std::chrono::steady_clock::now();
+    stats      = file_stats{};
+
+    if (input_path == STDIO_PATH) {
+        report_error(input_path, "a container has to be a regular file");
+        return false;
+    }
+    file_handle input(open(input_path.c_str(), O_RDONLY));
+    if (!input.valid()) {
+        report_errno(input_path);
+        return false;
+    }
+
+    container_reader reader(key);
+    if (!reader.open(input.get())) {
+        report_container_error(input_path);
+        return false;
+    }
+
+    file_handle output(
+        output_path == STDIO_PATH
+            ? STDOUT_FILENO
+            : open_output(output_path, O_WRONLY | O_TRUNC, input.get()));
+    if (!output.valid()) { return false; }
+
+    struct stat input_stat;
+    if (fstat(input.get(), &input_stat) == 0) {
+        stats.bytes_in = static_cast<size_t>(input_stat.st_size);
+    }
+
+    std::vector<uint8_t> buffer(
+        std::min<uint64_t>(BATCH_SIZE, std::max<uint64_t>(reader.size(), 1)));
+    for (uint64_t offset = 0; offset < reader.size();) {
+        size_t copied;
+        if (!reader.read(offset, buffer, copied, pool)) {
+            report_container_error(input_path);
+            return false;
+        }
+        if (!write_all(output.get(), buffer.data(), copied)) {
+            report_errno(output_path);
+            return false;
+        }
+        offset          += copied;
+        stats.bytes_out += copied;
+    }
+
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return true;
+}
+
+}  // namespace lea
@@ -0,0 +1,213 @@
+#include "dedup_mode.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "file_io.hpp"
+
+namespace lea {
+
+namespace {
+
+// plaintext read per step
+constexpr size_t BATCH_SIZE = 16 << 20;
+
+const char INDEX_NAME[] = "/index";
+const char DATA_NAME[]  = "/chunks";
+
+// errno values dedup.hpp documents, spelled out for the user
+void report_dedup_error(const std::string& path) {
+    switch (errno) {
+        case EBADMSG:
+            report_error(path, "not a LEA dedup store or recipe, or damaged");
+            break;
+        case ENOTSUP:
+            report_error(path, "dedup format newer than this lea-app");
+            break;
+        case EKEYREJECTED:
+            report_error(path, "dedup store was written with another key");
+            break;
+        case ENOENT:
+            report_error(path, "recipe names a chunk the store lacks");
+            break;
+        default: report_errno(path);
+    }
+}
+
+}  // namespace
+
+bool encrypt_dedup(const std::string& input_path,
+                   const std::string& output_path,
+                   const std::string& store_path,
+                   const keyhash&     key,
+                   thread_pool&       pool,
+                   file_stats&        stats,
+                   dedup_stats&       dedup) {
+    auto start = std::chrono::steady_clock::now();
+    stats      = file_stats{};
+
+    file_handle input(input_path == STDIO_PATH
+                          ? STDIN_FILENO
+                          : open(input_path.c_str(), O_RDONLY));
+    if (!input.valid()) {
+        report_errno(input_path);
+        return false;
+    }
+
+    if (output_path == STDIO_PATH) {
+        report_error(output_path, "a recipe has to be a regular file");
+        return false;
+    }
+    file_handle output(
+        open_output(output_path, O_RDWR | O_TRUNC, input.get()));
+    if (!output.valid()) { return false; }
+
+    if (mkdir(store_path.c_str(), 0755) != 0 && errno != EEXIST) {
+        report_errno(store_path);
+        return false;
+    }
+    std::string index_path = store_path + INDEX_NAME;
+    std::string data_path  = store_path + DATA_NAME;
+    file_handle index(open(index_path.c_str(), O_RDWR | O_CREAT, 0644));
+    file_handle data(open(data_path.c_str(), O_RDWR | O_CREAT, 0644));
+    struct stat index_stat;
+    if (!index.valid() || fstat(index.get(), &index_stat) != 0) {
+        report_errno(index_path);
+        return false;
+    }
+    if (!data.valid()) {
+        report_errno(data_path);
+        return false;
+    }
+
+    // an empty index starts a new store
+    dedup_store store(key);
+    bool        opened = index_stat.st_size == 0
+                             ? store.create(index.get(), data.get())
+                             : store.open(index.get(), data.get());
+    if (!opened) {
+        report_dedup_error(index_path);
+        return false;
+    }
+    uint64_t initial_size = store.data_size();
+
+    dedup_writer         writer(store);
+    std::vector<uint8_t> buffer(BATCH_SIZE);
+    std::atomic<bool>    read_failed = false;
+    while (true) {
+        size_t size
+            = read_full(input.get(), buffer.data(), buffer.size(), read_failed);
+        if (read_failed) {
+            report_errno(input_path);
+            return false;
+        }
+        if (size != 0 && !writer.write(byte_view(buffer.data(), size), pool)) {
+            report_errno(data_path);
+            return false;
+        }
+        if (size < buffer.size()) { break; }
+    }
+
+    if (!writer.finish()) {
+        report_errno(data_path);
+        return false;
+    }
+    if (!write_recipe(output.get(), writer.recipe())) {
+        report_errno(output_path);
+        return false;
+    }
+
+    struct stat output_stat;
+    if (fstat(output.get(), &output_stat) == 0) {
+        stats.bytes_out = static_cast<size_t>(output_stat.st_size);
+    }
+    stats.bytes_out += store.data_size() - initial_size;
+    stats.bytes_in   = writer.stats().bytes;
+    dedup            = writer.stats();
+
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return true;
+}
+
+bool decrypt_dedup(const std::string& input_path,
+                   const std::string& output_path,
+                   const std::string& store_path,
+                   const keyhash&     key,
+                   file_stats&        stats) {
+    auto start = std::chrono::steady_clock::now();
+    stats      = file_stats{};
+
+    if (input_path == STDIO_PATH) {
+        report_error(input_path, "a recipe has to be a regular file");
+        return false;
+    }
+    file_handle            input(open(input_path.c_str(), O_RDONLY));
+    std::vector<dedup_ref> recipe;
+    if (!input.valid()) {
+        report_errno(input_path);
+        return false;
+    }
+    if (!read_recipe(input.get(), recipe)) {
+        report_dedup_error(input_path);
+        return false;
+    }
+
+    std::string index_path = store_path + INDEX_NAME;
+    std::string data_path  = store_path + DATA_NAME;
+    file_handle index(open(index_path.c_str(), O_RDONLY));
+    file_handle data(open(data_path.c_str(), O_RDONLY));
+    if (!index.valid()) {
+        report_errno(index_path);
+        return false;
+    }
+    if (!data.valid()) {
+        report_errno(data_path);
+        return false;
+    }
+
+    dedup_store store(key);
+    if (!store.open(index.get(), data.get())) {
+        report_dedup_error(index_path);
+        return false;
+    }
+
+    file_handle output(
+        output_path == STDIO_PATH
+            ? STDOUT_FILENO
+            : open_output(output_path, O_WRONLY | O_TRUNC, input.get()));
+    if (!output.valid()) { return false; }
+
+    std::vector<uint8_t> chunk;
+    for (const dedup_ref& ref : recipe) {
+        if (!store.get(ref.fingerprint, chunk)) {
+            report_dedup_error(input_path);
+            return false;
+        }
+        if (chunk.size() != ref.size) {
+            report_error(input_path, "recipe does not match the store");
+            return false;
+        }
+        if (!write_all(output.get(), chunk.data(), chunk.size())) {
+            report_errno(output_path);
+            return false;
+        }
+        stats.bytes_in  += encrypted_size(chunk.size());
+        stats.bytes_out += chunk.size();
+    }
+
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return true;
+}
+
+}  // namespace lea
@@ -0,0 +1,174 @@
+#include "file_io.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "instrument.hpp"
+#include "span.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+void report_error(const std::string& path, const char* message) {
+    std::cerr << "lea-app: " << path << ": " << message << '\n';
+}
+
+void report_errno(const std::string& path) {
+    report_error(path, std::strerror(errno));
+}
+
+int open_output(const std::string& path, int flags, int input_fd) {
+    file_handle output(open(path.c_str(), (flags & ~O_TRUNC) | O_CREAT, 0644));
+    struct stat input_stat, output_stat;
+    if (!output.valid() || fstat(input_fd, &input_stat) != 0
+        || fstat(output.get(), &output_stat) != 0) {
+        report_errno(path);
+        return -1;
+    }
+
+    // only regular files, a terminal can be both stdin and the output
+    bool regular = S_ISREG(output_stat.st_mode);
+    if (regular && input_stat.st_dev == output_stat.st_dev
+        && input_stat.st_ino == output_stat.st_ino) {
+        report_error(path, "input and output are the same file");
+        return -1;
+    }
+    if (regular && (flags & O_TRUNC) != 0 && ftruncate(output.get(), 0) != 0) {
+        report_errno(path);
+        return -1;
+    }
+    return output.release();
+}
+
+bool map_files(const std::string& input_path,
+               int                input_fd,
+               size_t             input_size,
+               const std::string& output_path,
+               int                output_fd,
+               Mode               mode,
+               mapped_files&      files) {
+    if (mode == DECRYPT && !check_ciphertext_size(input_path, input_size)) {
+        return false;
+    }
+    files.input_size = input_size;
+    files.capacity
+        = mode == ENCRYPT ? encrypted_size(input_size) : input_size;
+
+    // reserve the blocks up front, ftruncate where fallocate is unsupported
+    off_t capacity = static_cast<off_t>(files.capacity);
+    if (fallocate(output_fd, 0, 0, capacity) != 0
+        && ftruncate(output_fd, capacity) != 0) {
+        report_errno(output_path);
+        return false;
+    }
+
+    files.in = std::make_unique<mapping>(
+        mmap(nullptr, input_size, PROT_READ, MAP_PRIVATE, input_fd, 0),
+        input_size);
+    if (!files.in->valid()) {
+        report_errno(input_path);
+        return false;
+    }
+    files.out = std::make_unique<mapping>(mmap(nullptr,
+                                               files.capacity,
+                                               PROT_READ | PROT_WRITE,
+                                               MAP_SHARED,
+                                               output_fd,
+                                               0),
+                                          files.capacity);
+    if (!files.out->valid()) {
+        report_errno(output_path);
+        return false;
+    }
+    madvise(files.in->data(), input_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+size_t cipher_mapped_range(const mapped_files&   files,
+                           const cipher_context& context,
+                           Mode                  mode,
+                           size_t                offset,
+                           size_t                size,
+                           thread_pool*          pool) {
+    bool              last = offset + size == files.input_size;
+    byte_view         range_in(files.in->data() + offset, size);
+    mutable_byte_view range_out(files.out->data() + offset,
+                                files.capacity - offset);
+
+    LEA_STAGE(CHUNK);
+    size_t written;
+    if (mode == ENCRYPT) {
+        written = pool != nullptr ? context.encrypt(range_in, range_out, *pool)
+                                  : context.encrypt(range_in, range_out);
+    } else {
+        // every deciphered byte lands in range_out, only the final range's
+        // padding is dropped
+        written = pool != nullptr ? context.decrypt(range_in, range_out, *pool)
+                                  : context.decrypt(range_in, range_out);
+        if (!last) { written = size; }
+    }
+
+    // start writeback now instead of letting dirty pages pile up, and drop
+    // input pages that will not be read again
+    msync(files.out->data() + offset, written, MS_ASYNC);
+    madvise(files.in->data() + offset, size, MADV_DONTNEED);
+    return written;
+}
+
+bool finish_mapped(const std::string&  output_path,
+                   int                 output_fd,
+                   const mapped_files& files,
+                   size_t              output_size) {
+    if (output_size != files.capacity
+        && ftruncate(output_fd, static_cast<off_t>(output_size)) != 0) {
+        report_errno(output_path);
+        return false;
+    }
+    return true;
+}
+
+size_t read_full(int                fd,
+                 uint8_t*           buffer,
+                 size_t             size,
+                 std::atomic<bool>& failed) {
+    LEA_STAGE(READ);
+    size_t filled = 0;
+    while (filled < size) {
+        ssize_t n = read(fd, buffer + filled, size - filled);
+        if (n == 0) { break; }
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            failed = true;
+            break;
+        }
+        filled += static_cast<size_t>(n);
+    }
+    return filled;
+}
+
+bool write_all(int fd, const uint8_t* buffer, size_t size) {
+    LEA_STAGE(WRITE);
+    while (size != 0) {
+        ssize_t n = write(fd, buffer, size);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        buffer += n;
+        size   -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool check_ciphertext_size(const std::string& path, size_t size) {
+    if (size % 32 == 0) { return true; }
+    report_error(path, "not a multiple of 32 bytes, cannot decrypt");
+    return false;
+}
+
+}  // namespace lea
@@ -0,0 +1,316 @@
+#include "file_mode.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file_io.hpp"
+#include "instrument.hpp"
+#include "span.hpp"
+#include "tree_hash.hpp"
+
+namespace lea {
+
+namespace {
+
+// bytes ciphered per step, a multiple of 32 so only the final chunk of a
+// message is ever padded or unpadded
+constexpr size_t CHUNK_SIZE = 4 << 20;
+
+// the reader holds two buffers while it looks ahead for end of input, the
+// cipher stage and the writer one each
+constexpr size_t PIPELINE_BUFFERS = 4;
+
+constexpr std::chrono::milliseconds QUEUE_WAIT{100};
+
+// maps input and a preallocated output, then ciphers chunk by chunk from one
+// mapping into the other
+bool process_mapped(const std::string&    input_path,
+                    int                   input_fd,
+                    size_t                input_size,
+                    const std::string&    output_path,
+                    int                   output_fd,
+                    const cipher_context& context,
+                    Mode                  mode,
+                    thread_pool&          pool,
+                    file_stats&           stats) {
+    stats.bytes_in = input_size;
+    if (input_size == 0) { return true; }
+
+    mapped_files files;
+    if (!map_files(input_path,
+                   input_fd,
+                   input_size,
+                   output_path,
+                   output_fd,
+                   mode,
+                   files)) {
+        return false;
+    }
+
+    size_t output_size = 0;
+    for (size_t offset = 0; offset < input_size; offset += CHUNK_SIZE) {
+        size_t size = std::min(CHUNK_SIZE, input_size - offset);
+        output_size = offset
+                    + cipher_mapped_range(
+                          files, context, mode, offset, size, &pool);
+    }
+
+    if (!finish_mapped(output_path, output_fd, files, output_size)) {
+        return false;
+    }
+
+    stats.bytes_out = output_size;
+    return true;
+}
+
+struct chunk {
+    // room for the padding block encrypt may add
+    std::vector<uint8_t> data = std::vector<uint8_t>(CHUNK_SIZE + 32);
+    size_t               size = 0;
+    bool                 last = false;
+};
+
+// blocking handoff of chunks between pipeline stages
+class chunk_queue {
+  public:
+    void push(chunk* c) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunks_.push_back(c);
+        }
+        ready_.notify_one();
+    }
+
+    chunk* pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!ready_.wait_for(lock, QUEUE_WAIT, [this] {
+            return !chunks_.empty();
+        })) {}
+
+        chunk* c = chunks_.front();
+        chunks_.pop_front();
+        return c;
+    }
+
+  private:
+    std::mutex              mutex_;
+    std::condition_variable ready_;
+    std::deque<chunk*>      chunks_;
+};
+
+// reader -> cipher -> writer over a ring of PIPELINE_BUFFERS chunks, for
+// inputs and outputs that cannot be mapped
+bool process_piped(const std::string&    input_path,
+                   int                   input_fd,
+                   const std::string&    output_path,
+                   int                   output_fd,
+                   const cipher_context& context,
+                   Mode                  mode,
+                   thread_pool&          pool,
+                   file_stats&           stats) {
+    std::array<chunk, PIPELINE_BUFFERS> buffers;
+    chunk_queue                         free_chunks, filled, ciphered;
+    for (chunk& c : buffers) { free_chunks.push(&c); }
+
+    std::atomic<bool> read_failed  = false;
+    std::atomic<bool> write_failed = false;
+
+    // a full chunk is only known to be the last one once the next read
+    // comes back empty, which matters for where decrypt strips padding
+    std::thread reader([&] {
+        chunk* current = free_chunks.pop();
+        current->size  = read_full(input_fd,
+                                  current->data.data(),
+                                  CHUNK_SIZE,
+                                  read_failed);
+
+        while (true) {
+            stats.bytes_in += current->size;
+            if (current->size < CHUNK_SIZE || read_failed) { break; }
+
+            chunk* next = free_chunks.pop();
+            next->size  = read_full(input_fd,
+                                   next->data.data(),
+                                   CHUNK_SIZE,
+                                   read_failed);
+            if (next->size == 0) {
+                free_chunks.push(next);
+                break;
+            }
+
+            current->last = false;
+            filled.push(current);
+            current = next;
+        }
+
+        // errno is per thread, so report it here
+        if (read_failed) { report_errno(input_path); }
+
+        current->last = true;
+        filled.push(current);
+    });
+
+    std::thread writer([&] {
+        while (true) {
+            chunk* c    = ciphered.pop();
+            bool   last = c->last;
+
+            if (!write_failed
+                && !write_all(output_fd, c->data.data(), c->size)) {
+                write_failed = true;
+                report_errno(output_path);
+            }
+            if (!write_failed) { stats.bytes_out += c->size; }
+
+            free_chunks.push(c);
+            if (last) { return; }
+        }
+    });
+
+    bool invalid_size = false;
+    while (true) {
+        chunk* c    = filled.pop();
+        bool   last = c->last;
+
+        LEA_STAGE(CHUNK);
+        if (read_failed || write_failed) {
+            c->size = 0;
+        } else if (mode == ENCRYPT) {
+            c->size = context.encrypt(byte_view(c->data.data(), c->size),
+                                      mutable_byte_view(c->data),
+                                      pool);
+        } else if (c->size % 32 != 0) {
+            invalid_size = true;
+            c->size      = 0;
+        } else {
+            mutable_byte_view blocks(c->data.data(), c->size);
+            size_t            plain_len = context.decrypt(blocks, blocks, pool);
+            if (last) { c->size = plain_len; }
+        }
+
+        ciphered.push(c);
+        if (last) { break; }
+    }
+
+    reader.join();
+    writer.join();
+
+    if (read_failed) { return false; }
+    if (invalid_size) {
+        return check_ciphertext_size(input_path, stats.bytes_in);
+    }
+    return !write_failed;
+}
+
+}  // namespace
+
+bool process_file(const std::string& input_path,
+                  const std::string& output_path,
+                  const keyhash&     key,
+                  Mode               mode,
+                  thread_pool&       pool,
+                  file_stats&        stats) {
+    auto start = std::chrono::steady_clock::now();
+    stats      = file_stats{};
+
+    file_handle input(input_path == STDIO_PATH
+                          ? STDIN_FILENO
+                          : open(input_path.c_str(), O_RDONLY));
+    if (!input.valid()) {
+        report_errno(input_path);
+        return false;
+    }
+
+    file_handle output(
+        output_path == STDIO_PATH
+            ? STDOUT_FILENO
+            : open_output(output_path, O_RDWR | O_TRUNC, input.get()));
+    if (!output.valid()) { return false; }
+
+    struct stat input_stat, output_stat;
+    if (fstat(input.get(), &input_stat) != 0) {
+        report_errno(input_path);
+        return false;
+    }
+    if (fstat(output.get(), &output_stat) != 0) {
+        report_errno(output_path);
+        return false;
+    }
+
+    // prepared once, every chunk reuses it
+    const cipher_context context(key);
+
+    bool ok;
+    if (S_ISREG(input_stat.st_mode) && S_ISREG(output_stat.st_mode)) {
+        ok = process_mapped(input_path,
+                            input.get(),
+                            static_cast<size_t>(input_stat.st_size),
+                            output_path,
+                            output.get(),
+                            context,
+                            mode,
+                            pool,
+                            stats);
+    } else {
+        ok = process_piped(input_path,
+                           input.get(),
+                           output_path,
+                           output.get(),
+                           context,
+                           mode,
+                           pool,
+                           stats);
+    }
+
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return ok;
+}
+
+bool hash_file(const std::string& input_path,
+               thread_pool&       pool,
+               keyhash&           digest,
+               file_stats&        stats) {
+    auto start = std::chrono::steady_clock::now();
+    stats      = file_stats{};
+
+    file_handle input(input_path == STDIO_PATH
+                          ? STDIN_FILENO
+                          : open(input_path.c_str(), O_RDONLY));
+    if (!input.valid()) {
+        report_errno(input_path);
+        return false;
+    }
+
+    struct stat input_stat;
+    if (fstat(input.get(), &input_stat) == 0 && S_ISREG(input_stat.st_mode)) {
+        stats.bytes_in = static_cast<size_t>(input_stat.st_size);
+    }
+    if (!tree_hash_file(input.get(), pool, digest)) {
+        report_errno(input_path);
+        return false;
+    }
+
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return true;
+}
+
+}  // namespace lea
@@ -1,30 +1,58 @@
 #include <getopt.h>
 
-#include <bitset>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <vector>
 
+#include "batch_mode.hpp"
 #include "cipher.hpp"
+#include "container_mode.hpp"
+#include "dedup_mode.hpp"
+#include "dispatch.hpp"
+#include "file_mode.hpp"
+#include "instrument.hpp"
 #include "keyhash.hpp"
+#include "thread_pool.hpp"
 
 int main(int argc, char** argv) {
-    bool        verbose = false;
-    Mode        mode    = UNSET;
-    std::string input_file;
-    std::string output_file;
+    bool        verbose     = false;
+    bool        hash        = false;
+    bool        container   = false;
+    bool        append      = false;
+    bool        compress    = false;
+    Mode        mode        = UNSET;
+    bool        input_set   = false;
+    std::string input_file  = lea::STDIO_PATH;
+    std::string output_file = lea::STDIO_PATH;
+    std::string list_file;
+    std::string store_dir;
     std::string key_str;
+    std::string stats_format;
+    std::string trace_file;
 
     struct option long_options[] = {
-        {"verbose",       no_argument, 0, 'v'},
-        { "output", required_argument, 0, 'o'},
-        {  "input", required_argument, 0, 'i'},
-        {"encrypt",       no_argument, 0, 'e'},
-        {"decrypt",       no_argument, 0, 'd'},
-        {    "key", required_argument, 0, 'k'},
-        {        0,                 0, 0,   0},
+        {  "verbose",       no_argument, 0, 'v'},
+        {   "output", required_argument, 0, 'o'},
+        {    "input", required_argument, 0, 'i'},
+        {  "encrypt",       no_argument, 0, 'e'},
+        {  "decrypt",       no_argument, 0, 'd'},
+        {      "key", required_argument, 0, 'k'},
+        {     "hash",       no_argument, 0, 'H'},
+        {    "stats", optional_argument, 0, 's'},
+        {    "trace", required_argument, 0, 't'},
+        {     "list", required_argument, 0, 'L'},
+        {"container",       no_argument, 0, 'c'},
+        {   "append",       no_argument, 0, 'a'},
+        {    "dedup", required_argument, 0, 'D'},
+        { "compress",       no_argument, 0, 'z'},
+        {          0,                 0, 0,   0},
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "voiedk", long_options, nullptr))
+    while ((opt = getopt_long(
+                argc, argv, "vo:i:edk:Hs::t:L:caD:z", long_options, nullptr))
            != -1) {
         switch (opt) {
             case 'e': mode = ENCRYPT; break;
@@ -33,56 +61,160 @@ int main(int argc, char** argv) {
 
             case 'v': verbose = true; break;
 
-            case 'i': input_file = optarg; break;
+            case 'i':
+                input_file = optarg;
+                input_set  = true;
+                break;
 
             case 'o': output_file = optarg; break;
 
             case 'k': key_str = optarg; break;
+
+            case 'H': hash = true; break;
+
+            case 's': stats_format = optarg ? optarg : "text"; break;
+
+            case 't': trace_file = optarg; break;
+
+            case 'L': list_file = optarg; break;
+
+            case 'c': container = true; break;
+
+            case 'a': append = true; break;
+
+            case 'D': store_dir = optarg; break;
+
+            case 'z': compress = true; break;
         }
     }
 
-    std::bitset<256> original1 = lea::bitify_str("abc");
-    std::bitset<256> original2 = lea::bitify_str("abcd");
-    lea::keyhash     hashed1   = lea::gen_keyhash(original1, 256);
-    lea::keyhash     hashed2   = lea::gen_keyhash(original2, 256);
-    std::bitset<256> diff      = hashed1.bits ^ hashed2.bits;
-    int              flips     = diff.count();
-    // std::bitset<512> expanded = lea::bit_interleaving_expand(original,
-    // 7); std::bitset<256> compacted =
-    // lea::sequential_bit_compact(expanded);
-
-    std::cout << "Original1 bits: \n" << original1 << '\n';
-    std::cout << "Keyhash1 bits: \n" << hashed1.hex_str() << '\n';
-    std::cout << "Original2 bits: \n" << original2 << '\n';
-    std::cout << "Keyhash2 bits: \n" << hashed2.hex_str() << '\n';
-    // std::cout << "Expanded bits: \n" << expanded << '\n';
-    // std::cout << "Compacted bits: \n" << compacted << '\n';
-    std::cout << "Flips: " << flips << '\n';
-
-    std::string text = "Hello World!";
-    std::cout << text << '\n';
-    std::vector<uint8_t> plaintext(text.begin(), text.end());
-    std::vector<uint8_t> ciphertext     = lea::encrypt(plaintext, hashed1);
-    std::vector<uint8_t> uncipheredtext = lea::decrypt(ciphertext, hashed1);
-
-    std::cout << "Plaintext: ";
-    for (auto byte : plaintext) {
-        std::cout << std::hex << static_cast<int>(byte) << " ";
+    // operands or a list select batch mode, which writes into -o as a
+    // directory
+    std::vector<std::string> batch_inputs(argv + optind, argv + argc);
+    bool batch = !batch_inputs.empty() || !list_file.empty();
+    bool dedup = !store_dir.empty();
+
+    if ((hash ? mode != UNSET : mode == UNSET || key_str.empty())
+        || (batch && (hash || input_set || output_file == lea::STDIO_PATH))
+        || (container && (hash || batch)) || (append && mode != ENCRYPT)
+        || (append && !container)
+        || (compress && (!container || mode != ENCRYPT))
+        || (dedup && (hash || batch || container))
+        || (!stats_format.empty() && stats_format != "text"
+            && stats_format != "json")) {
+        std::cerr << "usage: " << argv[0]
+                  << " (-e | -d) -k KEY [-i INPUT] [-o OUTPUT] [-v]"
+                     " [--stats[=text|json]] [--trace FILE]\n"
+                  << "       " << argv[0]
+                  << " (-e | -d) -k KEY -o DIR [-L LIST] [-v] [PATH...]\n"
+                  << "       " << argv[0]
+                  << " (-e [--append] [--compress] | -d) --container -k KEY"
+                     " [-i INPUT] [-o OUTPUT] [-v]\n"
+                  << "       " << argv[0]
+                  << " (-e | -d) --dedup STORE -k KEY [-i INPUT] [-o OUTPUT]"
+                     " [-v]\n"
+                  << "       " << argv[0] << " --hash [-i INPUT] [-v]\n"
+                  << "INPUT and OUTPUT default to - for stdin/stdout. each"
+                     " PATH, and each line of\nLIST (- for stdin), is a file"
+                     " or a directory ciphered recursively into DIR\n";
+        return 2;
     }
 
-    std::cout << std::dec << std::endl;
-
-    std::cout << "Ciphertext: ";
-    for (auto byte : ciphertext) {
-        std::cout << std::hex << static_cast<int>(byte) << " ";
+    if ((!stats_format.empty() || !trace_file.empty())
+        && !lea::instrumentation_enabled()) {
+        std::cerr << "lea-app: built without LEA_INSTRUMENT, "
+                     "--stats and --trace record nothing\n";
     }
+    if (!trace_file.empty()) { lea::start_trace(); }
 
-    std::cout << std::dec << std::endl;
+    if (!list_file.empty() && !lea::read_path_list(list_file, batch_inputs)) {
+        return 1;
+    }
 
-    std::cout << "Uncipheredtext: ";
-    for (auto byte : uncipheredtext) {
-        std::cout << std::hex << static_cast<int>(byte) << " ";
+    lea::thread_pool pool;
+    lea::file_stats  stats;
+    lea::batch_stats batch_stats;
+    lea::dedup_stats dedup_stats;
+    lea::keyhash     digest;
+    bool             ok;
+    if (hash) {
+        ok = lea::hash_file(input_file, pool, digest, stats);
+    } else {
+        // bitify_str only reads the first 32 bytes of the key
+        lea::keyhash key = lea::gen_keyhash(
+            lea::bitify_str(key_str), std::min<size_t>(key_str.size(), 32));
+        if (batch) {
+            ok = lea::process_batch(batch_inputs,
+                                    output_file,
+                                    key,
+                                    mode,
+                                    pool,
+                                    verbose,
+                                    batch_stats);
+            stats.bytes_in  = batch_stats.bytes_in;
+            stats.bytes_out = batch_stats.bytes_out;
+            stats.seconds   = batch_stats.seconds;
+        } else if (container && mode == ENCRYPT) {
+            ok = lea::encrypt_container(
+                input_file, output_file, key, append, compress, pool, stats);
+        } else if (container) {
+            ok = lea::decrypt_container(
+                input_file, output_file, key, pool, stats);
+        } else if (dedup && mode == ENCRYPT) {
+            ok = lea::encrypt_dedup(input_file,
+                                    output_file,
+                                    store_dir,
+                                    key,
+                                    pool,
+                                    stats,
+                                    dedup_stats);
+        } else if (dedup) {
+            ok = lea::decrypt_dedup(
+                input_file, output_file, store_dir, key, stats);
+        } else {
+            ok = lea::process_file(
+                input_file, output_file, key, mode, pool, stats);
+        }
     }
 
-    std::cout << std::dec << std::endl;
+    if (!trace_file.empty()) {
+        lea::stop_trace();
+        if (!lea::write_chrome_trace(trace_file)) {
+            std::cerr << "lea-app: " << trace_file << ": cannot write trace\n";
+        }
+    }
+    if (!stats_format.empty()) {
+        lea::stats_snapshot snapshot = lea::snapshot_stats();
+        std::cerr << (stats_format == "json" ? lea::stats_json(snapshot)
+                                             : lea::stats_text(snapshot));
+    }
+    if (batch && (verbose || !ok)) {
+        std::cerr << "lea-app: " << batch_stats.files << " files ciphered, "
+                  << batch_stats.failed << " failed\n";
+    }
+    if (!ok) { return 1; }
+
+    // the digest goes out like sha256sum prints it
+    if (hash) { std::cout << digest.hex_str() << "  " << input_file << '\n'; }
+
+    if (verbose) {
+        double rate = stats.seconds > 0 ? stats.bytes_in / stats.seconds : 0;
+        if (hash) {
+            std::cerr << "hashed " << stats.bytes_in << " bytes";
+        } else {
+            std::cerr << (mode == ENCRYPT ? "encrypted " : "decrypted ")
+                      << stats.bytes_in << " bytes into " << stats.bytes_out
+                      << " bytes";
+        }
+        std::cerr << " in " << stats.seconds << " s ("
+                  << static_cast<uint64_t>(rate) << " bytes/s, "
+                  << lea::kernel_isa_name(lea::active_kernel_isa())
+                  << " kernels)\n";
+    }
+    if (verbose && dedup && mode == ENCRYPT) {
+        std::cerr << dedup_stats.chunks << " chunks, "
+                  << dedup_stats.new_chunks << " new holding "
+                  << dedup_stats.new_bytes << " bytes, dedup ratio "
+                  << dedup_stats.ratio() << '\n';
+    }
 }
@@ -0,0 +1,276 @@
+#include "bitslice.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEA_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LEA_TARGET(isa)
+#endif
+
+namespace lea {
+
+namespace {
+
+typedef uint64_t u64x2 __attribute__((vector_size(16)));
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+typedef uint64_t u64x8 __attribute__((vector_size(64)));
+
+// the largest slab, two groups of 64 blocks
+constexpr size_t MAX_SLAB_BLOCKS = 128;
+
+template <unsigned J, typename V>
+__attribute__((always_inline)) inline void transpose_stage(V* rows,
+                                                           uint64_t mask) {
+    for (unsigned k = 0; k < 64; k = ((k | J) + 1) & ~J) {
+        V t = ((rows[k] >> J) ^ rows[k | J]) & mask;
+        rows[k | J] ^= t;
+        rows[k]     ^= t << J;
+    }
+}
+
+// transposes LANES independent 64x64 bit matrices held lane-wise in rows,
+// afterwards bit i of rows[j] is bit j of the former rows[i]
+template <typename V>
+__attribute__((always_inline)) inline void transpose(V* rows) {
+    transpose_stage<32>(rows, 0x0000'0000'FFFF'FFFFULL);
+    transpose_stage<16>(rows, 0x0000'FFFF'0000'FFFFULL);
+    transpose_stage<8>(rows, 0x00FF'00FF'00FF'00FFULL);
+    transpose_stage<4>(rows, 0x0F0F'0F0F'0F0F'0F0FULL);
+    transpose_stage<2>(rows, 0x3333'3333'3333'3333ULL);
+    transpose_stage<1>(rows, 0x5555'5555'5555'5555ULL);
+}
+
+// permutes one slab of 64 * max(1, LANES / 4) blocks, where lane g * 4 + l
+// of a row carries limb l of a block from group g; kernels narrower than a
+// block's four limbs take several passes. planes stay in row layout, see
+// make_gather for how the permutation maps onto it
+template <typename V, size_t LANES>
+__attribute__((always_inline)) inline void permute_slab(
+    const uint8_t*  input,
+    uint8_t*        output,
+    const uint16_t* gather) {
+    constexpr size_t GROUPS      = LANES >= 4 ? LANES / 4 : 1;
+    constexpr size_t GROUP_LANES = LANES >= 4 ? 4 : LANES;
+    constexpr size_t PASSES      = 4 / GROUP_LANES;
+
+    // GCC and Clang let vector types alias their element type, so the
+    // transposed rows double as the plane buffers
+    V         in_rows[PASSES * 64];
+    V         out_rows[PASSES * 64];
+    uint64_t* in_planes  = reinterpret_cast<uint64_t*>(in_rows);
+    uint64_t* out_planes = reinterpret_cast<uint64_t*>(out_rows);
+
+    // every input block is read before any output block is written, which
+    // keeps in-place use safe
+    for (size_t pass = 0; pass < PASSES; pass++) {
+        for (size_t i = 0; i < 64; i++) {
+            for (size_t g = 0; g < GROUPS; g++) {
+                std::memcpy(in_planes + (pass * 64 + i) * LANES
+                                + g * GROUP_LANES,
+                            input + (g * 64 + i) * 32 + pass * GROUP_LANES * 8,
+                            GROUP_LANES * 8);
+            }
+        }
+        transpose(in_rows + pass * 64);
+    }
+
+    for (size_t slot = 0; slot < 256; slot++) {
+        size_t base = (slot / GROUP_LANES) * LANES + slot % GROUP_LANES;
+        for (size_t g = 0; g < GROUPS; g++) {
+            out_planes[base + g * GROUP_LANES]
+                = in_planes[gather[slot] + g * GROUP_LANES];
+        }
+    }
+
+    for (size_t pass = 0; pass < PASSES; pass++) {
+        transpose(out_rows + pass * 64);
+        for (size_t i = 0; i < 64; i++) {
+            for (size_t g = 0; g < GROUPS; g++) {
+                std::memcpy(output + (g * 64 + i) * 32 + pass * GROUP_LANES * 8,
+                            out_planes + (pass * 64 + i) * LANES
+                                + g * GROUP_LANES,
+                            GROUP_LANES * 8);
+            }
+        }
+    }
+}
+
+// plane l * 64 + j of group g sits at index
+// ((l / group_lanes) * 64 + j) * lanes + g * group_lanes + l % group_lanes
+// of the plane buffer; gather[slot] is the group 0 index of the source plane
+// for the output plane stored at slot, slots walking the buffer in order
+std::array<uint16_t, 256> make_gather(const std::array<uint8_t, 256>& source,
+                                      size_t                          lanes) {
+    // group lanes are a power of two, shift rather than divide
+    size_t group_lanes = lanes >= 4 ? 4 : lanes;
+    size_t lane_shift  = __builtin_ctzll(group_lanes);
+    size_t lane_mask   = group_lanes - 1;
+
+    std::array<uint16_t, 256> gather;
+    for (size_t slot = 0; slot < 256; slot++) {
+        size_t row  = slot >> lane_shift;
+        size_t limb = ((row >> 6) << lane_shift) + (slot & lane_mask);
+        size_t src  = source[limb * 64 + (row & 63)];
+        size_t src_limb = src >> 6;
+        gather[slot]    = static_cast<uint16_t>(
+            (((src_limb >> lane_shift) << 6) + (src & 63)) * lanes
+            + (src_limb & lane_mask));
+    }
+    return gather;
+}
+
+using slab_fn = void (*)(const uint8_t*, uint8_t*, const uint16_t*);
+
+void permute_scalar(const uint8_t* input,
+                    uint8_t*        output,
+                    const uint16_t* gather) {
+    permute_slab<uint64_t, 1>(input, output, gather);
+}
+
+LEA_TARGET("sse2")
+void permute_sse2(const uint8_t* input,
+                  uint8_t*        output,
+                  const uint16_t* gather) {
+    permute_slab<u64x2, 2>(input, output, gather);
+}
+
+LEA_TARGET("avx2")
+void permute_avx2(const uint8_t* input,
+                  uint8_t*        output,
+                  const uint16_t* gather) {
+    permute_slab<u64x4, 4>(input, output, gather);
+}
+
+LEA_TARGET("avx512f")
+void permute_avx512(const uint8_t* input,
+                    uint8_t*        output,
+                    const uint16_t* gather) {
+    permute_slab<u64x8, 8>(input, output, gather);
+}
+
+slab_fn slab_function(bitslice_kernel kernel) {
+    switch (kernel) {
+        case bitslice_kernel::SSE2: return permute_sse2;
+        case bitslice_kernel::AVX2: return permute_avx2;
+        case bitslice_kernel::AVX512: return permute_avx512;
+        default: return permute_scalar;
+    }
+}
+
+}  // namespace
+
+bool bitslice_supported(bitslice_kernel kernel) {
+    return kernel_isa_supported(kernel);
+}
+
+bitslice_kernel bitslice_best() { return active_kernel_isa(); }
+
+size_t bitslice_slab_blocks(bitslice_kernel kernel) {
+    return kernel == bitslice_kernel::AVX512 ? 128 : 64;
+}
+
+namespace {
+
+size_t lanes_of(bitslice_kernel kernel) {
+    switch (kernel) {
+        case bitslice_kernel::SSE2: return 2;
+        case bitslice_kernel::AVX2: return 4;
+        case bitslice_kernel::AVX512: return 8;
+        default: return 1;
+    }
+}
+
+}  // namespace
+
+namespace {
+
+// runs block_count blocks through the kernel's slabs using its gather table,
+// narrow_gather being the AVX2 table an AVX-512 tail may fall back to
+void permute_slabs(const uint8_t*  input,
+                   uint8_t*        output,
+                   size_t          block_count,
+                   bitslice_kernel kernel,
+                   const uint16_t* gather,
+                   const uint16_t* narrow_gather) {
+    slab_fn permute    = slab_function(kernel);
+    size_t  slab       = bitslice_slab_blocks(kernel);
+    size_t  full_slabs = block_count / slab;
+    size_t  slab_bytes = slab * 32;
+
+    for (size_t i = 0; i < full_slabs; i++) {
+        permute(input + i * slab_bytes, output + i * slab_bytes, gather);
+    }
+
+    // run the remaining blocks through a zero-filled slab, falling back to
+    // the narrower AVX2 slab when the tail fits into it
+    size_t tail = block_count - full_slabs * slab;
+    if (tail != 0) {
+        if (kernel == bitslice_kernel::AVX512 && tail <= 64) {
+            permute = slab_function(bitslice_kernel::AVX2);
+            gather  = narrow_gather;
+            slab    = 64;
+        }
+
+        uint8_t buffer[MAX_SLAB_BLOCKS * 32];
+        std::memcpy(buffer, input + full_slabs * slab_bytes, tail * 32);
+        std::memset(buffer + tail * 32, 0, (slab - tail) * 32);
+        permute(buffer, buffer, gather);
+        std::memcpy(output + full_slabs * slab_bytes, buffer, tail * 32);
+    }
+}
+
+}  // namespace
+
+bitslice_plan make_bitslice_plan(const std::array<uint8_t, 256>& source) {
+    bitslice_plan plan;
+    for (bitslice_kernel kernel : {bitslice_kernel::SCALAR,
+                                   bitslice_kernel::SSE2,
+                                   bitslice_kernel::AVX2,
+                                   bitslice_kernel::AVX512}) {
+        plan.gather[static_cast<size_t>(kernel)]
+            = make_gather(source, lanes_of(kernel));
+    }
+    return plan;
+}
+
+void bitslice_permute(const uint8_t*                  input,
+                      uint8_t*                        output,
+                      size_t                          block_count,
+                      const std::array<uint8_t, 256>& source,
+                      bitslice_kernel                 kernel) {
+    auto gather = make_gather(source, lanes_of(kernel));
+
+    // the AVX2 table is only needed for a short AVX-512 tail
+    std::array<uint16_t, 256> narrow_gather;
+    size_t tail = block_count % bitslice_slab_blocks(kernel);
+    if (kernel == bitslice_kernel::AVX512 && tail != 0 && tail <= 64) {
+        narrow_gather = make_gather(source, lanes_of(bitslice_kernel::AVX2));
+    }
+
+    permute_slabs(input,
+                  output,
+                  block_count,
+                  kernel,
+                  gather.data(),
+                  narrow_gather.data());
+}
+
+void bitslice_permute(const uint8_t*       input,
+                      uint8_t*             output,
+                      size_t               block_count,
+                      const bitslice_plan& plan,
+                      bitslice_kernel      kernel) {
+    permute_slabs(input,
+                  output,
+                  block_count,
+                  kernel,
+                  plan.gather[static_cast<size_t>(kernel)].data(),
+                  plan.gather[static_cast<size_t>(bitslice_kernel::AVX2)]
+                      .data());
+}
+
+}  // namespace lea
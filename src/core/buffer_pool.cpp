@@ -0,0 +1,108 @@
+#include "buffer_pool.hpp"
+
+#include <new>
+
+namespace lea {
+
+namespace {
+
+// pooled blocks are allocated upstream with this alignment, which also
+// suits the widest vector loads
+constexpr size_t BLOCK_ALIGNMENT = 64;
+
+}  // namespace
+
+buffer_pool::buffer_pool(buffer_pool_options        options,
+                         std::pmr::memory_resource* upstream)
+    : options_(options), upstream_(upstream) {}
+
+buffer_pool::~buffer_pool() { release(); }
+
+buffer_pool_counters buffer_pool::counters() const {
+    buffer_pool_counters counters;
+    counters.reused   = reused_.load(std::memory_order_relaxed);
+    counters.upstream = upstream_allocations_.load(std::memory_order_relaxed);
+    return counters;
+}
+
+void buffer_pool::release() {
+    for (size_t i = 0; i < CLASS_COUNT; i++) {
+        size_t      class_bytes = size_t{1} << (MIN_CLASS_SHIFT + i);
+        free_block* head;
+        {
+            std::lock_guard<std::mutex> lock(classes_[i].mutex);
+            head             = classes_[i].head;
+            classes_[i].head = nullptr;
+        }
+
+        while (head != nullptr) {
+            free_block* next = head->next;
+            upstream_->deallocate(head, class_bytes, BLOCK_ALIGNMENT);
+            cached_bytes_.fetch_sub(class_bytes, std::memory_order_relaxed);
+            head = next;
+        }
+    }
+}
+
+size_t buffer_pool::class_shift(size_t bytes) {
+    if (bytes <= size_t{1} << MIN_CLASS_SHIFT) { return MIN_CLASS_SHIFT; }
+    return 64 - __builtin_clzll(bytes - 1);
+}
+
+void* buffer_pool::do_allocate(size_t bytes, size_t alignment) {
+    size_t shift = class_shift(bytes);
+    if (shift > MAX_CLASS_SHIFT || alignment > BLOCK_ALIGNMENT) {
+        upstream_allocations_.fetch_add(1, std::memory_order_relaxed);
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    size_class& c           = classes_[shift - MIN_CLASS_SHIFT];
+    size_t      class_bytes = size_t{1} << shift;
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        if (c.head != nullptr) {
+            free_block* block = c.head;
+            c.head            = block->next;
+            cached_bytes_.fetch_sub(class_bytes, std::memory_order_relaxed);
+            reused_.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+    }
+
+    upstream_allocations_.fetch_add(1, std::memory_order_relaxed);
+    return upstream_->allocate(class_bytes, BLOCK_ALIGNMENT);
+}
+
+void buffer_pool::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    size_t shift = class_shift(bytes);
+    if (shift > MAX_CLASS_SHIFT || alignment > BLOCK_ALIGNMENT) {
+        upstream_->deallocate(p, bytes, alignment);
+        return;
+    }
+
+    // over the cache limit the block goes back upstream instead
+    size_t class_bytes = size_t{1} << shift;
+    if (cached_bytes_.fetch_add(class_bytes, std::memory_order_relaxed)
+            + class_bytes
+        > options_.max_cached_bytes) {
+        cached_bytes_.fetch_sub(class_bytes, std::memory_order_relaxed);
+        upstream_->deallocate(p, class_bytes, BLOCK_ALIGNMENT);
+        return;
+    }
+
+    size_class&                 c = classes_[shift - MIN_CLASS_SHIFT];
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.head = new (p) free_block{c.head};
+}
+
+bool buffer_pool::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+std::pmr::memory_resource* thread_buffer_pool() {
+    thread_local buffer_pool pool;
+    return &pool;
+}
+
+}  // namespace lea
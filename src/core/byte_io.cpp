@@ -0,0 +1,45 @@
+#include "byte_io.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "instrument.hpp"
+
+namespace lea {
+
+bool pread_full(int fd, uint8_t* buffer, size_t size, uint64_t offset) {
+    LEA_STAGE(READ);
+    while (size != 0) {
+        ssize_t n = pread(fd, buffer, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        if (n == 0) {
+            errno = EBADMSG;
+            return false;
+        }
+        buffer += n;
+        size   -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool pwrite_all(int fd, const uint8_t* buffer, size_t size, uint64_t offset) {
+    LEA_STAGE(WRITE);
+    while (size != 0) {
+        ssize_t n = pwrite(fd, buffer, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        buffer += n;
+        size   -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+}  // namespace lea
@@ -4,10 +4,28 @@
 #include <array>
 #include <cstdint>
 
+#include "bitslice.hpp"
+#include "instrument.hpp"
+#include "span.hpp"
+#include "thread_pool.hpp"
+
 namespace lea {
 
-std::vector<operation> get_operations(const std::bitset<256>& key) {
-    std::vector<operation> operations(16);
+namespace {
+
+// below this many blocks a bit-sliced slab costs more than running the
+// operations directly on each block
+constexpr size_t BITSLICE_MIN_BLOCKS = 8;
+
+// blocks per parallel range, 64 KiB keeps a range's input and output in L2
+constexpr size_t PARALLEL_RANGE_BLOCKS = 2048;
+
+// get_operations without the heap allocation
+using schedule = std::array<operation, 16>;
+
+schedule make_schedule(const std::bitset<256>& key) {
+    LEA_STAGE(GET_OPERATIONS);
+    schedule operations;
 
     for (uint8_t i = 0; i < 16; i++) {
         uint8_t start_index = 255 - (i * 16);
@@ -26,36 +44,584 @@ std::vector<operation> get_operations(const std::bitset<256>& key) {
     return operations;
 }
 
+schedule reversed(schedule operations) {
+    std::reverse(operations.begin(), operations.end());
+    return operations;
+}
+
+inline uint16_t rotate_left16(uint16_t value, uint8_t shift) {
+    return static_cast<uint16_t>((value << shift) | (value >> (16 - shift)));
+}
+
+// cipher_block/decipher_block on plain 16-bit rows, input and output may be
+// the same block
+void apply_operations(const uint8_t*   input,
+                      uint8_t*         output,
+                      const schedule&  operations,
+                      Mode             mode) {
+    std::array<uint16_t, 16> grid;
+    for (uint8_t i = 0; i < 16; ++i) {
+        grid[i] = static_cast<uint16_t>(input[i * 2]
+                                        | (input[i * 2 + 1] << 8));
+    }
+
+    for (const operation& op : operations) {
+        uint8_t row_shift = mode == ENCRYPT ? op.rowOffset
+                                            : (16 - op.rowOffset) & 0xF;
+        uint8_t col_shift = mode == ENCRYPT ? op.colOffset
+                                            : (16 - op.colOffset) & 0xF;
+
+        if (mode == ENCRYPT) {
+            grid[op.row] = rotate_left16(grid[op.row], row_shift);
+        }
+
+        uint16_t col = 0;
+        for (uint8_t r = 0; r < 16; ++r) {
+            col |= ((grid[r] >> op.col) & 1) << r;
+        }
+        col = rotate_left16(col, col_shift);
+        for (uint8_t r = 0; r < 16; ++r) {
+            grid[r] = static_cast<uint16_t>((grid[r] & ~(1u << op.col))
+                                            | (((col >> r) & 1) << op.col));
+        }
+
+        if (mode == DECRYPT) {
+            grid[op.row] = rotate_left16(grid[op.row], row_shift);
+        }
+    }
+
+    for (uint8_t i = 0; i < 16; ++i) {
+        output[i * 2]     = grid[i] & 0xFF;
+        output[i * 2 + 1] = grid[i] >> 8;
+    }
+}
+
+// tracks which input bit sits at each grid position, index 16 * row + col
+using bit_labels = std::array<uint8_t, 256>;
+
+void rotate_row(bit_labels& labels, uint8_t row, uint8_t offset) {
+    bit_labels old = labels;
+    for (uint8_t c = 0; c < 16; ++c) {
+        labels[row * 16 + c] = old[row * 16 + ((c - offset) & 0xF)];
+    }
+}
+
+void rotate_col(bit_labels& labels, uint8_t col, uint8_t offset) {
+    bit_labels old = labels;
+    for (uint8_t r = 0; r < 16; ++r) {
+        labels[r * 16 + col] = old[((r - offset) & 0xF) * 16 + col];
+    }
+}
+
+bit_labels cipher_labels(const operation* operations, size_t count) {
+    bit_labels labels;
+    for (uint16_t k = 0; k < 256; ++k) { labels[k] = k; }
+
+    for (const operation& op : span<const operation>(operations, count)) {
+        rotate_row(labels, op.row, op.rowOffset);
+        rotate_col(labels, op.col, op.colOffset);
+    }
+
+    return labels;
+}
+
+bit_labels decipher_labels(const operation* operations, size_t count) {
+    bit_labels labels;
+    for (uint16_t k = 0; k < 256; ++k) { labels[k] = k; }
+
+    // rotating by 16 - offset undoes a rotation by offset
+    for (const operation& op : span<const operation>(operations, count)) {
+        rotate_col(labels, op.col, 16 - op.colOffset);
+        rotate_row(labels, op.row, 16 - op.rowOffset);
+    }
+
+    return labels;
+}
+
+block_permutation build_permutation(const bit_labels& source) {
+    block_permutation permutation;
+    permutation.source = source;
+
+    std::array<uint8_t, 256> destination;
+    for (uint16_t k = 0; k < 256; ++k) { destination[source[k]] = k; }
+
+    for (uint8_t n = 0; n < 64; ++n) {
+        auto* entries = &permutation.table[n * 16];
+        entries[0]    = {};
+        for (uint8_t v = 1; v < 16; ++v) {
+            // extend the entry without the lowest set bit by that bit
+            uint8_t low_bit = __builtin_ctz(v);
+            uint8_t dst     = destination[n * 4 + low_bit];
+            entries[v]      = entries[v & (v - 1)];
+            entries[v][dst / 64] |= uint64_t{1} << (dst % 64);
+        }
+    }
+
+    return permutation;
+}
+
+// a schedule and, when a cipher_context prepared them, its gather tables;
+// without those the bit-sliced path derives them on every call
+struct prepared_key {
+    const key_schedule&  schedule;
+    const bitslice_plan* cipher_plan   = nullptr;
+    const bitslice_plan* decipher_plan = nullptr;
+};
+
+void permute_bulk(const uint8_t*                  input,
+                  uint8_t*                        output,
+                  size_t                          block_count,
+                  const std::array<uint8_t, 256>& source,
+                  const bitslice_plan*            plan) {
+    if (plan != nullptr) {
+        bitslice_permute(input, output, block_count, *plan, bitslice_best());
+    } else {
+        bitslice_permute(input, output, block_count, source, bitslice_best());
+    }
+}
+
+// ciphers the whole blocks of input into output, then the tail block with
+// its padding
+void encrypt_blocks(byte_view           input,
+                    mutable_byte_view   output,
+                    const prepared_key& key,
+                    size_t              first_block,
+                    size_t              block_count) {
+    size_t full_blocks = input.size() / 32;
+    size_t end_block   = first_block + block_count;
+
+    size_t full_end = std::min(end_block, full_blocks);
+    if (full_end > first_block) {
+        size_t count = full_end - first_block;
+        if (count >= BITSLICE_MIN_BLOCKS) {
+            LEA_STAGE(CIPHER_BULK);
+            permute_bulk(input.data() + first_block * 32,
+                         output.data() + first_block * 32,
+                         count,
+                         key.schedule.cipher_source,
+                         key.cipher_plan);
+        } else {
+            for (size_t i = first_block; i < full_end; ++i) {
+                LEA_STAGE(CIPHER_BLOCK);
+                apply_operations(input.data() + i * 32,
+                                 output.data() + i * 32,
+                                 key.schedule.operations,
+                                 ENCRYPT);
+            }
+        }
+    }
+
+    size_t tail_len = input.size() % 32;
+    if (tail_len != 0 && end_block > full_blocks) {
+        std::array<uint8_t, 32> block;
+        {
+            LEA_STAGE(PAD);
+            block.fill(static_cast<uint8_t>(32 - tail_len));
+            std::copy_n(input.data() + full_blocks * 32,
+                        tail_len,
+                        block.begin());
+        }
+
+        LEA_STAGE(CIPHER_BLOCK);
+        apply_operations(block.data(),
+                         output.data() + full_blocks * 32,
+                         key.schedule.operations,
+                         ENCRYPT);
+    }
+}
+
+void decrypt_blocks(byte_view           input,
+                    mutable_byte_view   output,
+                    const prepared_key& key,
+                    size_t              first_block,
+                    size_t              block_count) {
+    if (block_count >= BITSLICE_MIN_BLOCKS) {
+        LEA_STAGE(DECIPHER_BULK);
+        permute_bulk(input.data() + first_block * 32,
+                     output.data() + first_block * 32,
+                     block_count,
+                     key.schedule.decipher_source,
+                     key.decipher_plan);
+        return;
+    }
+
+    for (size_t i = first_block; i < first_block + block_count; ++i) {
+        LEA_STAGE(DECIPHER_BLOCK);
+        apply_operations(input.data() + i * 32,
+                         output.data() + i * 32,
+                         key.schedule.reversed_operations,
+                         DECRYPT);
+    }
+}
+
+// plaintext length once the padding of the final block is stripped
+size_t unpadded_size(const uint8_t* decrypted_data, size_t size) {
+    LEA_STAGE(UNPAD);
+    if (size == 0) { return 0; }
+
+    std::array<uint8_t, 32> last_block;
+    std::copy_n(decrypted_data + size - 32, 32, last_block.begin());
+    return size - padding_length(last_block);
+}
+
+size_t encrypt_span(byte_view           input,
+                    mutable_byte_view   output,
+                    const prepared_key& key) {
+    size_t encrypted_len = encrypted_size(input.size());
+    if (output.size() < encrypted_len) { return 0; }
+
+    encrypt_blocks(input, output, key, 0, encrypted_len / 32);
+    return encrypted_len;
+}
+
+size_t decrypt_span(byte_view           input,
+                    mutable_byte_view   output,
+                    const prepared_key& key) {
+    // invalid ciphertext size
+    if (input.size() % 32 != 0 || output.size() < input.size()) { return 0; }
+
+    decrypt_blocks(input, output, key, 0, input.size() / 32);
+
+    // remove extra padding if present
+    return unpadded_size(output.data(), input.size());
+}
+
+size_t encrypt_span(byte_view           input,
+                    mutable_byte_view   output,
+                    const prepared_key& key,
+                    thread_pool&        pool) {
+    if (input.size() < PARALLEL_RANGE_BLOCKS * 32) {
+        return encrypt_span(input, output, key);
+    }
+
+    size_t encrypted_len = encrypted_size(input.size());
+    if (output.size() < encrypted_len) { return 0; }
+
+    // every range writes straight into its slice of output, only the range
+    // holding the tail block pads it
+    pool.parallel_for(encrypted_len / 32,
+                      PARALLEL_RANGE_BLOCKS,
+                      [&](size_t begin, size_t end) {
+                          encrypt_blocks(
+                              input, output, key, begin, end - begin);
+                      });
+
+    return encrypted_len;
+}
+
+size_t decrypt_span(byte_view           input,
+                    mutable_byte_view   output,
+                    const prepared_key& key,
+                    thread_pool&        pool) {
+    if (input.size() < PARALLEL_RANGE_BLOCKS * 32) {
+        return decrypt_span(input, output, key);
+    }
+
+    // invalid ciphertext size
+    if (input.size() % 32 != 0 || output.size() < input.size()) { return 0; }
+
+    pool.parallel_for(input.size() / 32,
+                      PARALLEL_RANGE_BLOCKS,
+                      [&](size_t begin, size_t end) {
+                          decrypt_blocks(
+                              input, output, key, begin, end - begin);
+                      });
+
+    return unpadded_size(output.data(), input.size());
+}
+
+size_t decrypt_range_span(byte_view           ciphertext,
+                          size_t              first_block,
+                          size_t              block_count,
+                          mutable_byte_view   output,
+                          const prepared_key& key) {
+    size_t blocks = ciphertext.size() / 32;
+    if (ciphertext.size() % 32 != 0 || first_block > blocks
+        || block_count > blocks - first_block
+        || output.size() / 32 < block_count) {
+        return 0;
+    }
+
+    decrypt_blocks(ciphertext.subspan(first_block * 32, block_count * 32),
+                   output,
+                   key,
+                   0,
+                   block_count);
+    return block_count * 32;
+}
+
+size_t encrypt_range_span(mutable_byte_view   ciphertext,
+                          size_t              first_block,
+                          byte_view           plaintext,
+                          const prepared_key& key) {
+    size_t blocks = ciphertext.size() / 32;
+    if (plaintext.size() % 32 != 0 || first_block > blocks
+        || plaintext.size() / 32 > blocks - first_block) {
+        return 0;
+    }
+
+    // whole blocks, so encrypt_blocks never pads
+    encrypt_blocks(plaintext,
+                   ciphertext.subspan(first_block * 32),
+                   key,
+                   0,
+                   plaintext.size() / 32);
+    return plaintext.size();
+}
+
+}  // namespace
+
+std::vector<operation> get_operations(const std::bitset<256>& key) {
+    schedule operations = make_schedule(key);
+    return std::vector<operation>(operations.begin(), operations.end());
+}
+
+key_schedule make_key_schedule(const keyhash& key) {
+    LEA_STAGE(KEY_SCHEDULE);
+    key_schedule prepared;
+    prepared.operations          = make_schedule(key.bits());
+    prepared.reversed_operations = reversed(prepared.operations);
+    prepared.cipher_source
+        = cipher_labels(prepared.operations.data(), prepared.operations.size());
+    prepared.decipher_source
+        = decipher_labels(prepared.reversed_operations.data(),
+                          prepared.reversed_operations.size());
+    return prepared;
+}
+
+cipher_context::cipher_context(const keyhash& key)
+    : cipher_context(make_key_schedule(key)) {}
+
+cipher_context::cipher_context(const key_schedule& schedule)
+    : schedule_(schedule),
+      cipher_plan_(make_bitslice_plan(schedule.cipher_source)),
+      decipher_plan_(make_bitslice_plan(schedule.decipher_source)) {}
+
+size_t cipher_context::encrypt(byte_view         input,
+                               mutable_byte_view output) const {
+    return encrypt_span(
+        input, output, {schedule_, &cipher_plan_, &decipher_plan_});
+}
+
+size_t cipher_context::decrypt(byte_view         input,
+                               mutable_byte_view output) const {
+    return decrypt_span(
+        input, output, {schedule_, &cipher_plan_, &decipher_plan_});
+}
+
+size_t cipher_context::encrypt(byte_view         input,
+                               mutable_byte_view output,
+                               thread_pool&      pool) const {
+    return encrypt_span(
+        input, output, {schedule_, &cipher_plan_, &decipher_plan_}, pool);
+}
+
+size_t cipher_context::decrypt(byte_view         input,
+                               mutable_byte_view output,
+                               thread_pool&      pool) const {
+    return decrypt_span(
+        input, output, {schedule_, &cipher_plan_, &decipher_plan_}, pool);
+}
+
+std::pmr::vector<uint8_t> cipher_context::encrypt(
+    byte_view input, std::pmr::memory_resource* resource) const {
+    std::pmr::vector<uint8_t> encrypted_data(resource);
+    {
+        LEA_STAGE(ALLOCATE);
+        encrypted_data.resize(encrypted_size(input.size()));
+    }
+    encrypt(input, mutable_byte_view(encrypted_data));
+    return encrypted_data;
+}
+
+std::pmr::vector<uint8_t> cipher_context::decrypt(
+    byte_view input, std::pmr::memory_resource* resource) const {
+    std::pmr::vector<uint8_t> decrypted_data(resource);
+    {
+        LEA_STAGE(ALLOCATE);
+        decrypted_data.resize(input.size());
+    }
+    decrypted_data.resize(decrypt(input, mutable_byte_view(decrypted_data)));
+    return decrypted_data;
+}
+
+size_t cipher_context::decrypt_range(byte_view         ciphertext,
+                                     size_t            first_block,
+                                     size_t            block_count,
+                                     mutable_byte_view output) const {
+    return decrypt_range_span(ciphertext,
+                              first_block,
+                              block_count,
+                              output,
+                              {schedule_, &cipher_plan_, &decipher_plan_});
+}
+
+size_t cipher_context::encrypt_range(mutable_byte_view ciphertext,
+                                     size_t            first_block,
+                                     byte_view         plaintext) const {
+    return encrypt_range_span(ciphertext,
+                              first_block,
+                              plaintext,
+                              {schedule_, &cipher_plan_, &decipher_plan_});
+}
+
+size_t decrypt_range(byte_view         ciphertext,
+                     size_t            first_block,
+                     size_t            block_count,
+                     mutable_byte_view output,
+                     const keyhash&    key) {
+    key_schedule schedule = make_key_schedule(key);
+    return decrypt_range_span(
+        ciphertext, first_block, block_count, output, prepared_key{schedule});
+}
+
+std::vector<uint8_t> decrypt_range(byte_view      ciphertext,
+                                   size_t         first_block,
+                                   size_t         block_count,
+                                   const keyhash& key) {
+    std::vector<uint8_t> blocks;
+    {
+        LEA_STAGE(ALLOCATE);
+        // an oversized count fails below, without allocating for it first
+        blocks.resize(std::min(block_count, ciphertext.size() / 32) * 32);
+    }
+    blocks.resize(decrypt_range(
+        ciphertext, first_block, block_count, mutable_byte_view(blocks), key));
+    return blocks;
+}
+
+size_t encrypt_range(mutable_byte_view ciphertext,
+                     size_t            first_block,
+                     byte_view         plaintext,
+                     const keyhash&    key) {
+    key_schedule schedule = make_key_schedule(key);
+    return encrypt_range_span(
+        ciphertext, first_block, plaintext, prepared_key{schedule});
+}
+
+size_t padding_length(const std::array<uint8_t, 32>& last_block) {
+    uint8_t pad_len = last_block.back();
+    if (pad_len > 0 && pad_len <= 32
+        && std::all_of(last_block.end() - pad_len,
+                       last_block.end(),
+                       [pad_len](uint8_t b) { return b == pad_len; })) {
+        return pad_len;
+    }
+    return 0;
+}
+
+size_t encrypted_size(size_t plaintext_size) {
+    return (plaintext_size + 31) / 32 * 32;
+}
+
 std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data,
                              const keyhash&              key) {
     std::vector<uint8_t> encrypted_data;
+    {
+        LEA_STAGE(ALLOCATE);
+        encrypted_data.resize(encrypted_size(data.size()));
+    }
+    encrypt(byte_view(data), mutable_byte_view(encrypted_data), key);
+    return encrypted_data;
+}
 
-    // pad data to a multiple of 32 bytes
-    std::vector<uint8_t> padded_data = data;
-    size_t               pad_len     = 32 - (padded_data.size() % 32);
-    if (pad_len != 32) {
-        padded_data.insert(padded_data.end(),
-                           pad_len,
-                           static_cast<uint8_t>(pad_len));
+std::pmr::vector<uint8_t> encrypt(byte_view                  data,
+                                  const keyhash&             key,
+                                  std::pmr::memory_resource* resource) {
+    std::pmr::vector<uint8_t> encrypted_data(resource);
+    {
+        LEA_STAGE(ALLOCATE);
+        encrypted_data.resize(encrypted_size(data.size()));
+    }
+    encrypt(data, mutable_byte_view(encrypted_data), key);
+    return encrypted_data;
+}
+
+size_t encrypt(byte_view input, mutable_byte_view output, const keyhash& key) {
+    return encrypt(input, output, make_key_schedule(key));
+}
+
+size_t encrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key) {
+    return encrypt_span(input, output, prepared_key{key});
+}
+
+block_permutation compile_cipher(const std::vector<operation>& operations) {
+    return build_permutation(
+        cipher_labels(operations.data(), operations.size()));
+}
+
+block_permutation compile_decipher(const std::vector<operation>& operations) {
+    return build_permutation(
+        decipher_labels(operations.data(), operations.size()));
+}
+
+void cipher_blocks(const uint8_t*                input,
+                   uint8_t*                      output,
+                   size_t                        block_count,
+                   const std::vector<operation>& operations) {
+    LEA_STAGE(CIPHER_BULK);
+    bitslice_permute(input,
+                     output,
+                     block_count,
+                     cipher_labels(operations.data(), operations.size()),
+                     bitslice_best());
+}
+
+void decipher_blocks(const uint8_t*                input,
+                     uint8_t*                      output,
+                     size_t                        block_count,
+                     const std::vector<operation>& operations) {
+    LEA_STAGE(DECIPHER_BULK);
+    bitslice_permute(input,
+                     output,
+                     block_count,
+                     decipher_labels(operations.data(), operations.size()),
+                     bitslice_best());
+}
+
+void permute_blocks(const uint8_t*           input,
+                    uint8_t*                 output,
+                    size_t                   block_count,
+                    const block_permutation& permutation) {
+    // the table beats a bit-sliced slab for a handful of blocks
+    if (block_count < BITSLICE_MIN_BLOCKS) {
+        for (size_t i = 0; i < block_count; ++i) {
+            std::array<uint8_t, 32> block;
+            std::copy_n(input + i * 32, 32, block.begin());
+            auto permuted = permute_block(block, permutation);
+            std::copy(permuted.begin(), permuted.end(), output + i * 32);
+        }
+        return;
     }
 
-    auto operations = get_operations(key.bits);
+    bitslice_permute(input,
+                     output,
+                     block_count,
+                     permutation.source,
+                     bitslice_best());
+}
 
-    // encrypt each
-    for (size_t i = 0; i < padded_data.size(); i += 32) {
-        std::array<uint8_t, 32> block{};
-        std::copy_n(padded_data.begin() + i, 32, block.begin());
-        auto encrypted_block = cipher_block(block, operations);
-        encrypted_data.insert(encrypted_data.end(),
-                              encrypted_block.begin(),
-                              encrypted_block.end());
+std::array<uint8_t, 32> permute_block(const std::array<uint8_t, 32>& block,
+                                      const block_permutation& permutation) {
+    std::array<uint64_t, 4> bits{};
+    for (uint8_t i = 0; i < 32; ++i) {
+        const auto& low  = permutation.table[(i * 2) * 16 + (block[i] & 0xF)];
+        const auto& high = permutation.table[(i * 2 + 1) * 16 + (block[i] >> 4)];
+        for (uint8_t j = 0; j < 4; ++j) { bits[j] |= low[j] | high[j]; }
     }
 
-    return encrypted_data;
+    std::array<uint8_t, 32> result;
+    for (uint8_t i = 0; i < 32; ++i) {
+        result[i] = static_cast<uint8_t>(bits[i / 8] >> ((i % 8) * 8));
+    }
+    return result;
 }
 
 std::array<uint8_t, 32> cipher_block(const std::array<uint8_t, 32>& block,
-                                     const std::vector<operation> operations) {
+                                     const std::vector<operation>& operations) {
+    LEA_STAGE(CIPHER_BLOCK);
     // create bitset grid
     std::array<std::bitset<16>, 16> grid;
     for (uint16_t i = 0; i < block.size(); i += 2) {
@@ -91,40 +657,97 @@ std::array<uint8_t, 32> cipher_block(const std::array<uint8_t, 32>& block,
 std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data,
                              const keyhash&              key) {
     std::vector<uint8_t> decrypted_data;
+    {
+        LEA_STAGE(ALLOCATE);
+        decrypted_data.resize(data.size());
+    }
+    decrypted_data.resize(
+        decrypt(byte_view(data), mutable_byte_view(decrypted_data), key));
+    return decrypted_data;
+}
 
-    // invalid ciphertext size
-    if (data.size() % 32 != 0) { return {}; }
+std::pmr::vector<uint8_t> decrypt(byte_view                  data,
+                                  const keyhash&             key,
+                                  std::pmr::memory_resource* resource) {
+    std::pmr::vector<uint8_t> decrypted_data(resource);
+    {
+        LEA_STAGE(ALLOCATE);
+        decrypted_data.resize(data.size());
+    }
+    decrypted_data.resize(
+        decrypt(data, mutable_byte_view(decrypted_data), key));
+    return decrypted_data;
+}
 
-    auto                   operations   = get_operations(key.bits);
-    std::vector<operation> reversed_ops = operations;
-    std::reverse(reversed_ops.begin(), reversed_ops.end());
+size_t decrypt(byte_view input, mutable_byte_view output, const keyhash& key) {
+    return decrypt(input, output, make_key_schedule(key));
+}
 
-    for (size_t i = 0; i < data.size(); i += 32) {
-        std::array<uint8_t, 32> block{};
-        std::copy_n(data.begin() + i, 32, block.begin());
-        auto decrypted_block = decipher_block(block, reversed_ops);
-        decrypted_data.insert(decrypted_data.end(),
-                              decrypted_block.begin(),
-                              decrypted_block.end());
-    }
+size_t decrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key) {
+    return decrypt_span(input, output, prepared_key{key});
+}
 
-    // remove extra padding if present
-    if (!decrypted_data.empty()) {
-        uint8_t pad_len = decrypted_data.back();
-        if (pad_len > 0 && pad_len <= 32
-            && std::all_of(decrypted_data.end() - pad_len,
-                           decrypted_data.end(),
-                           [pad_len](uint8_t b) { return b == pad_len; })) {
-            decrypted_data.resize(decrypted_data.size() - pad_len);
-        }
+std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data,
+                             const keyhash&              key,
+                             thread_pool&                pool) {
+    std::vector<uint8_t> encrypted_data;
+    {
+        LEA_STAGE(ALLOCATE);
+        encrypted_data.resize(encrypted_size(data.size()));
     }
+    encrypt(byte_view(data), mutable_byte_view(encrypted_data), key, pool);
+    return encrypted_data;
+}
+
+size_t encrypt(byte_view         input,
+               mutable_byte_view output,
+               const keyhash&    key,
+               thread_pool&      pool) {
+    return encrypt(input, output, make_key_schedule(key), pool);
+}
 
+size_t encrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key,
+               thread_pool&        pool) {
+    return encrypt_span(input, output, prepared_key{key}, pool);
+}
+
+std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data,
+                             const keyhash&              key,
+                             thread_pool&                pool) {
+    std::vector<uint8_t> decrypted_data;
+    {
+        LEA_STAGE(ALLOCATE);
+        decrypted_data.resize(data.size());
+    }
+    decrypted_data.resize(decrypt(byte_view(data),
+                                  mutable_byte_view(decrypted_data),
+                                  key,
+                                  pool));
     return decrypted_data;
 }
 
+size_t decrypt(byte_view         input,
+               mutable_byte_view output,
+               const keyhash&    key,
+               thread_pool&      pool) {
+    return decrypt(input, output, make_key_schedule(key), pool);
+}
+
+size_t decrypt(byte_view           input,
+               mutable_byte_view   output,
+               const key_schedule& key,
+               thread_pool&        pool) {
+    return decrypt_span(input, output, prepared_key{key}, pool);
+}
+
 std::array<uint8_t, 32> decipher_block(
     const std::array<uint8_t, 32>& block,
-    const std::vector<operation>   operations) {
+    const std::vector<operation>&  operations) {
+    LEA_STAGE(DECIPHER_BLOCK);
     // create bitset grid
     std::array<std::bitset<16>, 16> grid;
     for (uint16_t i = 0; i < block.size(); i += 2) {
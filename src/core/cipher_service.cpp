@@ -0,0 +1,273 @@
+#include "cipher_service.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace lea {
+
+namespace {
+
+// blocked submitters and idle workers re-check their condition at least
+// this often, timed waits for the same reason as in thread_pool
+constexpr std::chrono::milliseconds IDLE_WAIT{100};
+
+size_t histogram_bucket(uint64_t value) {
+    size_t bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    return std::min(bucket, SERVICE_HISTOGRAM_BUCKETS - 1);
+}
+
+void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.fetch_add(amount, std::memory_order_relaxed);
+}
+
+service_histogram load(
+    const std::array<std::atomic<uint64_t>, SERVICE_HISTOGRAM_BUCKETS>&
+        buckets) {
+    service_histogram histogram;
+    for (size_t i = 0; i < SERVICE_HISTOGRAM_BUCKETS; i++) {
+        histogram[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    return histogram;
+}
+
+}  // namespace
+
+cipher_service::cipher_service(cipher_service_options options)
+    : options_(options) {
+    options_.queue_capacity   = std::max<size_t>(options_.queue_capacity, 1);
+    options_.max_batch        = std::max<size_t>(options_.max_batch, 1);
+    options_.context_capacity = std::max<size_t>(options_.context_capacity, 1);
+
+    size_t thread_count = options_.threads;
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        threads_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+cipher_service::~cipher_service() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    arrived_.notify_all();
+
+    for (std::thread& thread : threads_) { thread.join(); }
+}
+
+std::future<std::vector<uint8_t>> cipher_service::submit(
+    Mode                 mode,
+    const keyhash&       key,
+    std::vector<uint8_t> data) {
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    auto result  = promise->get_future();
+    submit(mode, key, std::move(data), [promise](std::vector<uint8_t> out) {
+        promise->set_value(std::move(out));
+    });
+    return result;
+}
+
+void cipher_service::submit(Mode                 mode,
+                            const keyhash&       key,
+                            std::vector<uint8_t> data,
+                            callback             done) {
+    enqueue({mode,
+             key,
+             std::move(data),
+             std::move(done),
+             std::chrono::steady_clock::now()});
+}
+
+cipher_service_stats cipher_service::stats() const {
+    cipher_service_stats stats;
+    stats.requests    = requests_.load(std::memory_order_relaxed);
+    stats.batches     = batches_.load(std::memory_order_relaxed);
+    stats.bytes       = bytes_.load(std::memory_order_relaxed);
+    stats.queue_depth = load(depths_);
+    stats.batch_size  = load(sizes_);
+    return stats;
+}
+
+void cipher_service::enqueue(request r) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!space_.wait_for(lock, IDLE_WAIT, [this] {
+            return queue_.size() < options_.queue_capacity;
+        })) {}
+
+        add(depths_[histogram_bucket(queue_.size())], 1);
+        queue_.push_back(std::move(r));
+    }
+
+    // a worker holding back a partial batch has to see the arrival too
+    arrived_.notify_all();
+}
+
+void cipher_service::worker_loop() {
+    std::vector<uint8_t> staging;
+    while (true) {
+        std::vector<request> batch = next_batch();
+        if (batch.empty()) { return; }
+        run_batch(batch, staging);
+    }
+}
+
+std::vector<cipher_service::request> cipher_service::next_batch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        if (queue_.empty()) {
+            if (stopping_) { return {}; }
+            arrived_.wait_for(lock, IDLE_WAIT, [this] {
+                return stopping_ || !queue_.empty();
+            });
+            continue;
+        }
+
+        Mode    mode = queue_.front().mode;
+        keyhash key  = queue_.front().key;
+        auto    same = [&](const request& r) {
+            return r.mode == mode && r.key == key;
+        };
+
+        // a stopping service flushes what it has instead of waiting, and so
+        // does a full one: submitters blocked on space_ cannot add to it
+        auto   now      = std::chrono::steady_clock::now();
+        auto   deadline = queue_.front().submitted + options_.max_delay;
+        size_t ready    = std::count_if(queue_.begin(), queue_.end(), same);
+        bool   full     = queue_.size() >= options_.queue_capacity;
+        if (ready < options_.max_batch && !full && !stopping_
+            && now < deadline) {
+            size_t seen = queue_.size();
+            arrived_.wait_for(lock, deadline - now, [&] {
+                return stopping_ || queue_.size() != seen;
+            });
+            continue;
+        }
+
+        std::vector<request> batch;
+        std::deque<request>  rest;
+        for (request& r : queue_) {
+            if (batch.size() < options_.max_batch && same(r)) {
+                batch.push_back(std::move(r));
+            } else {
+                rest.push_back(std::move(r));
+            }
+        }
+        queue_.swap(rest);
+
+        lock.unlock();
+        space_.notify_all();
+        return batch;
+    }
+}
+
+void cipher_service::run_batch(std::vector<request>& batch,
+                               std::vector<uint8_t>& staging) {
+    Mode mode = batch.front().mode;
+
+    add(requests_, batch.size());
+    add(batches_, 1);
+    add(sizes_[histogram_bucket(batch.size())], 1);
+    for (const request& r : batch) { add(bytes_, r.data.size()); }
+
+    // every message gets its own padded blocks in staging, so one pass over
+    // the whole buffer ciphers each exactly as encrypt() would on its own
+    if (mode == ENCRYPT) {
+        size_t total = 0;
+        for (const request& r : batch) {
+            total += encrypted_size(r.data.size());
+        }
+        staging.resize(total);
+
+        size_t offset = 0;
+        for (const request& r : batch) {
+            size_t padded = encrypted_size(r.data.size());
+            std::copy(r.data.begin(), r.data.end(), staging.begin() + offset);
+            std::fill(staging.begin() + offset + r.data.size(),
+                      staging.begin() + offset + padded,
+                      static_cast<uint8_t>(padded - r.data.size()));
+            offset += padded;
+        }
+
+        context_for(batch.front().key)->encrypt(staging, staging);
+
+        offset = 0;
+        for (request& r : batch) {
+            size_t padded = encrypted_size(r.data.size());
+            r.data.assign(staging.begin() + offset,
+                          staging.begin() + offset + padded);
+            offset += padded;
+        }
+    } else if (mode == DECRYPT) {
+        size_t total = 0;
+        for (request& r : batch) {
+            // invalid ciphertext size
+            if (r.data.size() % 32 != 0) { r.data.clear(); }
+            total += r.data.size();
+        }
+        staging.resize(total);
+
+        size_t offset = 0;
+        for (const request& r : batch) {
+            std::copy(r.data.begin(), r.data.end(), staging.begin() + offset);
+            offset += r.data.size();
+        }
+
+        // the padding decrypt strips off the buffer's end is recomputed
+        // for each message below
+        context_for(batch.front().key)->decrypt(staging, staging);
+
+        offset = 0;
+        for (request& r : batch) {
+            size_t size = r.data.size();
+            if (size == 0) { continue; }
+
+            std::array<uint8_t, 32> last_block;
+            std::copy_n(staging.begin() + offset + size - 32,
+                        32,
+                        last_block.begin());
+            r.data.assign(staging.begin() + offset,
+                          staging.begin() + offset + size
+                              - padding_length(last_block));
+            offset += size;
+        }
+    } else {
+        for (request& r : batch) { r.data.clear(); }
+    }
+
+    // an exception from done has nowhere to go on a worker thread, it is
+    // dropped so the rest of the batch and the worker carry on
+    for (request& r : batch) {
+        try {
+            r.done(std::move(r.data));
+        } catch (...) {}
+    }
+}
+
+std::shared_ptr<const cipher_context> cipher_service::context_for(
+    const keyhash& key) {
+    {
+        std::lock_guard<std::mutex> lock(contexts_mutex_);
+        auto                        it = contexts_.find(key);
+        if (it != contexts_.end()) { return it->second; }
+    }
+
+    // built outside the lock, workers racing on a new key each build one
+    // and the first insert wins
+    auto context = std::make_shared<const cipher_context>(key);
+
+    std::lock_guard<std::mutex> lock(contexts_mutex_);
+    auto [it, inserted] = contexts_.emplace(key, context);
+    if (!inserted) { return it->second; }
+
+    context_order_.push_back(key);
+    if (contexts_.size() > options_.context_capacity) {
+        contexts_.erase(context_order_.front());
+        context_order_.pop_front();
+    }
+    return context;
+}
+
+}  // namespace lea
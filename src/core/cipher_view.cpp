@@ -0,0 +1,132 @@
+#include "cipher_view.hpp"
+
+#include <algorithm>
+
+namespace lea {
+
+namespace {
+
+// plaintext length of a whole-block ciphertext, deciphering its last block
+size_t plaintext_size(byte_view ciphertext, const cipher_context& context) {
+    if (ciphertext.empty()) { return 0; }
+
+    std::array<uint8_t, 32> last_block;
+    context.decrypt_range(ciphertext,
+                          ciphertext.size() / 32 - 1,
+                          1,
+                          mutable_byte_view(last_block));
+    return ciphertext.size() - padding_length(last_block);
+}
+
+}  // namespace
+
+decrypted_view::decrypted_view(byte_view             ciphertext,
+                               const cipher_context& context) {
+    if (ciphertext.size() % 32 != 0) { return; }
+
+    ciphertext_ = ciphertext;
+    context_    = &context;
+    size_       = plaintext_size(ciphertext, context);
+}
+
+std::array<uint8_t, 32> decrypted_view::block(size_t index) const {
+    std::array<uint8_t, 32> block{};
+    if (valid()) {
+        context_->decrypt_range(
+            ciphertext_, index, 1, mutable_byte_view(block));
+    }
+    return block;
+}
+
+size_t decrypted_view::read(size_t offset, mutable_byte_view output) const {
+    if (offset >= size_) { return 0; }
+    size_t end = offset + std::min(output.size(), size_ - offset);
+
+    size_t position = offset;
+    while (position < end) {
+        size_t index    = position / 32;
+        size_t in_block = position % 32;
+
+        // aligned whole blocks go straight into output
+        if (in_block == 0 && end - position >= 32) {
+            size_t count = (end - position) / 32;
+            context_->decrypt_range(ciphertext_,
+                                    index,
+                                    count,
+                                    output.subspan(position - offset));
+            position += count * 32;
+            continue;
+        }
+
+        size_t                  n     = std::min(32 - in_block, end - position);
+        std::array<uint8_t, 32> plain = block(index);
+        std::copy_n(plain.begin() + in_block,
+                    n,
+                    output.begin() + (position - offset));
+        position += n;
+    }
+    return end - offset;
+}
+
+decrypted_view::iterator decrypted_view::begin() const {
+    return iterator(this, 0);
+}
+
+decrypted_view::iterator decrypted_view::end() const {
+    return iterator(this, block_count());
+}
+
+size_t write_plaintext(mutable_byte_view     ciphertext,
+                       size_t                offset,
+                       byte_view             data,
+                       const cipher_context& context) {
+    if (ciphertext.size() % 32 != 0) { return 0; }
+    size_t size = plaintext_size(ciphertext, context);
+    if (offset > size || data.size() > size - offset) { return 0; }
+
+    size_t end = offset + data.size();
+
+    // an unpadded message can gain a pad by writing bytes that look like
+    // one, shrinking the plaintext. such a write is refused before any
+    // block changes
+    size_t last = ciphertext.size() - 32;
+    if (end > last) {
+        std::array<uint8_t, 32> plain;
+        context.decrypt_range(
+            ciphertext, last / 32, 1, mutable_byte_view(plain));
+        size_t from = std::max(offset, last);
+        std::copy(data.begin() + (from - offset),
+                  data.end(),
+                  plain.begin() + (from - last));
+        if (ciphertext.size() - padding_length(plain) != size) { return 0; }
+    }
+
+    size_t position = offset;
+    while (position < end) {
+        size_t index    = position / 32;
+        size_t in_block = position % 32;
+
+        if (in_block == 0 && end - position >= 32) {
+            size_t count = (end - position) / 32;
+            context.encrypt_range(
+                ciphertext,
+                index,
+                data.subspan(position - offset, count * 32));
+            position += count * 32;
+            continue;
+        }
+
+        // a partial block keeps the bytes around the write
+        size_t                  n = std::min(32 - in_block, end - position);
+        std::array<uint8_t, 32> plain;
+        context.decrypt_range(ciphertext, index, 1, mutable_byte_view(plain));
+        std::copy_n(data.begin() + (position - offset),
+                    n,
+                    plain.begin() + in_block);
+        context.encrypt_range(ciphertext, index, byte_view(plain));
+        position += n;
+    }
+    return data.size();
+}
+
+}  // namespace lea
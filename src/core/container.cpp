@@ -0,0 +1,569 @@
+#include "container.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory_resource>
+
+#include "buffer_pool.hpp"
+#include "byte_io.hpp"
+#include "echo_hasher.hpp"
+#include "instrument.hpp"
+#include "lz.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+namespace {
+
+constexpr char     HEADER_MAGIC[4] = {'L', 'E', 'A', 'C'};
+constexpr char     FOOTER_MAGIC[4] = {'L', 'E', 'A', 'X'};
+constexpr uint32_t BLOCK_SIZE      = 32;
+
+// domain separation, so the fingerprint never equals a hash of the key
+// used elsewhere
+constexpr char FINGERPRINT_TAG[] = "lea container key fingerprint";
+
+bool fail(int error) {
+    errno = error;
+    return false;
+}
+
+struct container_layout {
+    uint32_t                     chunk_size   = 0;
+    container_codec              codec        = container_codec::NONE;
+    uint64_t                     size         = 0;
+    uint64_t                     index_offset = 0;
+    uint64_t                     file_size    = 0;
+    std::vector<container_chunk> chunks;
+};
+
+// footer_offset is 0 until finish() has written the footer
+bool write_header(int             fd,
+                  uint32_t        chunk_size,
+                  container_codec codec,
+                  const keyhash&  fingerprint,
+                  uint64_t        footer_offset) {
+    std::array<uint8_t, CONTAINER_HEADER_SIZE> header{};
+    std::copy(HEADER_MAGIC, HEADER_MAGIC + 4, header.begin());
+    store_le<uint16_t>(&header[4], CONTAINER_VERSION);
+    store_le<uint16_t>(&header[6], CONTAINER_HEADER_SIZE);
+    store_le<uint32_t>(&header[8], chunk_size);
+    store_le<uint32_t>(&header[12], BLOCK_SIZE);
+    auto bytes = fingerprint.to_bytes();
+    std::copy(bytes.begin(), bytes.end(), header.begin() + 16);
+    store_le<uint32_t>(&header[48], static_cast<uint32_t>(codec));
+    store_le<uint64_t>(&header[56], footer_offset);
+    return pwrite_all(fd, header.data(), header.size(), 0);
+}
+
+// reads and validates the header, footer and index of the container in fd
+bool load_container(int               fd,
+                    const keyhash&    fingerprint,
+                    container_layout& layout) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) { return false; }
+    uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+    if (file_size < CONTAINER_HEADER_SIZE + CONTAINER_FOOTER_SIZE) {
+        return fail(EBADMSG);
+    }
+
+    std::array<uint8_t, CONTAINER_HEADER_SIZE> header;
+    if (!pread_full(fd, header.data(), header.size(), 0)) { return false; }
+    if (!std::equal(header.begin(), header.begin() + 4, HEADER_MAGIC)) {
+        return fail(EBADMSG);
+    }
+
+    uint16_t version       = load_le<uint16_t>(&header[4]);
+    uint16_t header_size   = load_le<uint16_t>(&header[6]);
+    uint32_t chunk_size    = load_le<uint32_t>(&header[8]);
+    uint32_t block_size    = load_le<uint32_t>(&header[12]);
+    uint32_t codec         = load_le<uint32_t>(&header[48]);
+    uint64_t footer_offset = load_le<uint64_t>(&header[56]);
+    if (version > CONTAINER_VERSION
+        || codec > static_cast<uint32_t>(container_codec::LZ)) {
+        return fail(ENOTSUP);
+    }
+
+    // a footer offset of 0 is a container that was never finished
+    if (version == 0 || header_size != CONTAINER_HEADER_SIZE
+        || block_size != BLOCK_SIZE || chunk_size == 0
+        || chunk_size % BLOCK_SIZE != 0
+        || footer_offset < CONTAINER_HEADER_SIZE
+        || footer_offset > file_size - CONTAINER_FOOTER_SIZE) {
+        return fail(EBADMSG);
+    }
+
+    auto stored = fingerprint.to_bytes();
+    if (!std::equal(stored.begin(), stored.end(), header.begin() + 16)) {
+        return fail(EKEYREJECTED);
+    }
+
+    std::array<uint8_t, CONTAINER_FOOTER_SIZE> footer;
+    if (!pread_full(fd, footer.data(), footer.size(), footer_offset)) {
+        return false;
+    }
+    if (!std::equal(footer.begin(), footer.begin() + 4, FOOTER_MAGIC)) {
+        return fail(EBADMSG);
+    }
+
+    uint64_t count        = load_le<uint64_t>(&footer[8]);
+    uint64_t size         = load_le<uint64_t>(&footer[16]);
+    uint64_t index_offset = load_le<uint64_t>(&footer[24]);
+
+    // the index fills the space between the chunks and the footer
+    if (index_offset < CONTAINER_HEADER_SIZE || index_offset > footer_offset
+        || count != (footer_offset - index_offset) / CONTAINER_INDEX_ENTRY
+        || (footer_offset - index_offset) % CONTAINER_INDEX_ENTRY != 0) {
+        return fail(EBADMSG);
+    }
+
+    std::vector<uint8_t> index(count * CONTAINER_INDEX_ENTRY);
+    if (!pread_full(fd, index.data(), index.size(), index_offset)) {
+        return false;
+    }
+
+    layout.chunks.resize(count);
+    uint64_t next  = CONTAINER_HEADER_SIZE;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        container_chunk& chunk = layout.chunks[i];
+        chunk.offset = load_le<uint64_t>(&index[i * CONTAINER_INDEX_ENTRY]);
+        chunk.size = load_le<uint32_t>(&index[i * CONTAINER_INDEX_ENTRY + 8]);
+        chunk.compressed
+            = load_le<uint32_t>(&index[i * CONTAINER_INDEX_ENTRY + 12]);
+
+        // full chunks laid out in order, only the last may be short. appends
+        // leave gaps where the chunks they replaced were
+        bool last = i + 1 == count;
+        if (chunk.offset < next
+            || chunk.size == 0 || chunk.size > chunk_size
+            || (!last && chunk.size != chunk_size)
+            || (chunk.compressed != 0
+                && (codec == 0 || chunk.compressed >= chunk.size))) {
+            return fail(EBADMSG);
+        }
+        next   = chunk.offset + encrypted_size(chunk.stored());
+        total += chunk.size;
+    }
+    if (next > index_offset || total != size) {
+        return fail(EBADMSG);
+    }
+
+    layout.chunk_size   = chunk_size;
+    layout.codec        = static_cast<container_codec>(codec);
+    layout.size         = size;
+    layout.index_offset = index_offset;
+    layout.file_size    = file_size;
+    return true;
+}
+
+}  // namespace
+
+keyhash key_fingerprint(const keyhash& key) {
+    echo_hasher hasher;
+    hasher.update(byte_view(reinterpret_cast<const uint8_t*>(FINGERPRINT_TAG),
+                            sizeof(FINGERPRINT_TAG) - 1));
+    auto bytes = key.to_bytes();
+    hasher.update(bytes);
+    return hasher.final();
+}
+
+container_writer::container_writer(const keyhash& key)
+    : context_(key), fingerprint_(key_fingerprint(key)) {}
+
+bool container_writer::create(int fd, container_options options) {
+    if (options.chunk_size == 0 || options.chunk_size % BLOCK_SIZE != 0
+        || (options.codec != container_codec::NONE
+            && options.codec != container_codec::LZ)) {
+        return fail(EINVAL);
+    }
+
+    if (!write_header(fd, options.chunk_size, options.codec, fingerprint_, 0)) {
+        return false;
+    }
+
+    fd_           = fd;
+    chunk_size_   = options.chunk_size;
+    codec_        = options.codec;
+    end_          = CONTAINER_HEADER_SIZE;
+    size_         = 0;
+    append_start_ = 0;
+    gap_start_    = 0;
+    chunks_.clear();
+    pending_.clear();
+    return true;
+}
+
+bool container_writer::open_append(int fd) {
+    container_layout layout;
+    if (!load_container(fd, fingerprint_, layout)) { return false; }
+
+    pending_.clear();
+
+    // nothing before the end of the file is overwritten. the header points
+    // at the old footer until finish() has written the new one past it, so
+    // an append cut short leaves the container as it was
+    end_          = layout.file_size;
+    append_start_ = layout.file_size;
+    gap_start_    = layout.chunks.empty()
+                        ? CONTAINER_HEADER_SIZE
+                        : layout.chunks.back().offset
+                              + encrypted_size(layout.chunks.back().stored());
+
+    // a short last chunk is written again once more data completes it
+    if (!layout.chunks.empty()
+        && layout.chunks.back().size < layout.chunk_size) {
+        container_chunk last = layout.chunks.back();
+        pending_.resize(encrypted_size(last.stored()));
+        if (!pread_full(fd, pending_.data(), pending_.size(), last.offset)) {
+            return false;
+        }
+        context_.decrypt_range(
+            pending_, 0, pending_.size() / 32, mutable_byte_view(pending_));
+        if (last.compressed != 0) {
+            std::vector<uint8_t> plain(last.size);
+            if (!lz_decompress(byte_view(pending_.data(), last.compressed),
+                               plain)) {
+                return fail(EBADMSG);
+            }
+            pending_ = std::move(plain);
+        }
+        pending_.resize(last.size);
+
+        layout.chunks.pop_back();
+        gap_start_ = last.offset;
+    }
+
+    fd_         = fd;
+    chunk_size_ = layout.chunk_size;
+    codec_      = layout.codec;
+    size_       = layout.size;
+    chunks_     = std::move(layout.chunks);
+    return true;
+}
+
+bool container_writer::write(byte_view data) {
+    return append(data, nullptr);
+}
+
+bool container_writer::write(byte_view data, thread_pool& pool) {
+    return append(data, &pool);
+}
+
+bool container_writer::append(byte_view data, thread_pool* pool) {
+    if (fd_ < 0) { return fail(EBADF); }
+
+    if (!pending_.empty()) {
+        size_t take = std::min(data.size(), chunk_size_ - pending_.size());
+        pending_.insert(pending_.end(), data.begin(), data.begin() + take);
+        size_ += take;
+        data   = data.subspan(take);
+        if (pending_.size() < chunk_size_) { return true; }
+
+        if (!write_chunks(pending_.data(), 1, pool)) { return false; }
+        pending_.clear();
+    }
+
+    size_t full = data.size() / chunk_size_;
+    if (full != 0 && !write_chunks(data.data(), full, pool)) { return false; }
+    pending_.assign(data.begin() + full * chunk_size_, data.end());
+    size_ += data.size();
+    return true;
+}
+
+bool container_writer::write_chunks(const uint8_t* data,
+                                    size_t         count,
+                                    thread_pool*   pool) {
+    if (codec_ != container_codec::NONE) {
+        return write_compressed(data, count, pool);
+    }
+
+    // full chunks are whole blocks, so ciphering them as one run gives each
+    // chunk exactly the ciphertext it would get on its own
+    byte_view plain(data, count * chunk_size_);
+    staging_.resize(plain.size());
+    if (pool != nullptr) {
+        context_.encrypt(plain, mutable_byte_view(staging_), *pool);
+    } else {
+        context_.encrypt(plain, mutable_byte_view(staging_));
+    }
+
+    if (!pwrite_all(fd_, staging_.data(), staging_.size(), end_)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        chunks_.push_back({end_ + i * chunk_size_, chunk_size_});
+    }
+    end_ += staging_.size();
+    return true;
+}
+
+container_chunk container_writer::seal_chunk(byte_view plain,
+                                             uint8_t*  out) const {
+    container_chunk chunk;
+    chunk.size = static_cast<uint32_t>(plain.size());
+
+    // compressed only when that saves a sixteenth, the output bound makes
+    // lz_compress give up early on data that does not shrink
+    if (codec_ == container_codec::LZ) {
+        std::pmr::vector<uint8_t> packed(plain.size() - plain.size() / 16,
+                                         thread_buffer_pool());
+        size_t                    packed_size = lz_compress(plain, packed);
+        if (packed_size != 0 && packed_size < plain.size()) {
+            context_.encrypt(
+                byte_view(packed.data(), packed_size),
+                mutable_byte_view(out, encrypted_size(packed_size)));
+            chunk.compressed = static_cast<uint32_t>(packed_size);
+            return chunk;
+        }
+    }
+
+    context_.encrypt(plain,
+                     mutable_byte_view(out, encrypted_size(plain.size())));
+    return chunk;
+}
+
+bool container_writer::write_compressed(const uint8_t* data,
+                                        size_t         count,
+                                        thread_pool*   pool) {
+    // every chunk is compressed and enciphered in its own slot by one
+    // task, a sealed full chunk is never longer than the chunk size
+    staging_.resize(count * chunk_size_);
+    std::vector<container_chunk> sealed(count);
+    auto seal = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            sealed[i] = seal_chunk(
+                byte_view(data + i * chunk_size_, chunk_size_),
+                staging_.data() + i * chunk_size_);
+        }
+    };
+    if (pool != nullptr) {
+        pool->parallel_for(count, 1, seal);
+    } else {
+        seal(0, count);
+    }
+
+    // the slots are packed back to back for a single write
+    size_t packed = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t bytes = encrypted_size(sealed[i].stored());
+        if (packed != i * chunk_size_) {
+            std::memmove(staging_.data() + packed,
+                         staging_.data() + i * chunk_size_,
+                         bytes);
+        }
+        sealed[i].offset  = end_ + packed;
+        packed           += bytes;
+    }
+
+    if (!pwrite_all(fd_, staging_.data(), packed, end_)) { return false; }
+    chunks_.insert(chunks_.end(), sealed.begin(), sealed.end());
+    end_ += packed;
+    return true;
+}
+
+bool container_writer::finish() {
+    if (fd_ < 0) { return fail(EBADF); }
+
+    if (!pending_.empty()) {
+        staging_.resize(encrypted_size(pending_.size()));
+        container_chunk chunk = seal_chunk(pending_, staging_.data());
+        size_t          bytes = encrypted_size(chunk.stored());
+        if (!pwrite_all(fd_, staging_.data(), bytes, end_)) { return false; }
+        chunk.offset  = end_;
+        end_         += bytes;
+        chunks_.push_back(chunk);
+        pending_.clear();
+    }
+
+    std::vector<uint8_t> trailer(chunks_.size() * CONTAINER_INDEX_ENTRY
+                                 + CONTAINER_FOOTER_SIZE);
+    for (size_t i = 0; i < chunks_.size(); i++) {
+        store_le<uint64_t>(&trailer[i * CONTAINER_INDEX_ENTRY],
+                           chunks_[i].offset);
+        store_le<uint32_t>(&trailer[i * CONTAINER_INDEX_ENTRY + 8],
+                           chunks_[i].size);
+        store_le<uint32_t>(&trailer[i * CONTAINER_INDEX_ENTRY + 12],
+                           chunks_[i].compressed);
+    }
+    uint8_t* footer = trailer.data() + chunks_.size() * CONTAINER_INDEX_ENTRY;
+    std::copy(FOOTER_MAGIC, FOOTER_MAGIC + 4, footer);
+    store_le<uint64_t>(footer + 8, chunks_.size());
+    store_le<uint64_t>(footer + 16, size_);
+    store_le<uint64_t>(footer + 24, end_);
+
+    // create() may have been given a file with stale bytes past the end
+    uint64_t file_size = end_ + trailer.size();
+    if (!pwrite_all(fd_, trailer.data(), trailer.size(), end_)
+        || ftruncate(fd_, static_cast<off_t>(file_size)) != 0) {
+        return false;
+    }
+
+    // pointing the header at the new footer makes the container valid. an
+    // append commits there, so its trailer has to be on disk first, and the
+    // header before the space the old short chunk, index and footer took is
+    // given back; filesystems that cannot punch holes keep it as a gap
+    bool appended = append_start_ != 0;
+    if ((appended && fdatasync(fd_) != 0)
+        || !write_header(fd_,
+                         chunk_size_,
+                         codec_,
+                         fingerprint_,
+                         file_size - CONTAINER_FOOTER_SIZE)
+        || (appended && fdatasync(fd_) != 0)) {
+        return false;
+    }
+    if (appended) {
+        fallocate(fd_,
+                  FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  static_cast<off_t>(gap_start_),
+                  static_cast<off_t>(append_start_ - gap_start_));
+    }
+
+    // the short chunk just written can only be extended by open_append
+    fd_ = -1;
+    return true;
+}
+
+container_reader::container_reader(const keyhash& key)
+    : context_(key), fingerprint_(key_fingerprint(key)) {}
+
+bool container_reader::open(int fd) {
+    container_layout layout;
+    if (!load_container(fd, fingerprint_, layout)) { return false; }
+
+    fd_         = fd;
+    chunk_size_ = layout.chunk_size;
+    codec_      = layout.codec;
+    size_       = layout.size;
+    chunks_     = std::move(layout.chunks);
+    return true;
+}
+
+bool container_reader::read_chunk(size_t   index,
+                                  size_t   begin,
+                                  size_t   end,
+                                  uint8_t* output) const {
+    const container_chunk& chunk = chunks_[index];
+    if (chunk.compressed != 0) {
+        return read_compressed(chunk, begin, end, output);
+    }
+
+    // only the blocks overlapping [begin, end) are read
+    size_t                 first_block = begin / 32;
+    size_t                 end_block   = (end + 31) / 32;
+    size_t                 bytes       = (end_block - first_block) * 32;
+    uint64_t               offset      = chunk.offset + first_block * 32;
+
+    // aligned reads decipher straight in the caller's buffer
+    if (begin % 32 == 0 && end % 32 == 0) {
+        if (!pread_full(fd_, output, bytes, offset)) { return false; }
+        mutable_byte_view blocks(output, bytes);
+        context_.decrypt_range(blocks, 0, bytes / 32, blocks);
+        return true;
+    }
+
+    std::pmr::vector<uint8_t> blocks(bytes, thread_buffer_pool());
+    if (!pread_full(fd_, blocks.data(), bytes, offset)) { return false; }
+    context_.decrypt_range(
+        blocks, 0, bytes / 32, mutable_byte_view(blocks));
+    std::copy_n(blocks.begin() + (begin - first_block * 32),
+                end - begin,
+                output);
+    return true;
+}
+
+bool container_reader::read_compressed(const container_chunk& chunk,
+                                       size_t                 begin,
+                                       size_t                 end,
+                                       uint8_t*               output) const {
+    // the whole chunk is deciphered and expanded whatever the range
+    std::pmr::vector<uint8_t> sealed(encrypted_size(chunk.compressed),
+                                     thread_buffer_pool());
+    if (!pread_full(fd_, sealed.data(), sealed.size(), chunk.offset)) {
+        return false;
+    }
+    context_.decrypt_range(
+        sealed, 0, sealed.size() / 32, mutable_byte_view(sealed));
+    byte_view packed(sealed.data(), chunk.compressed);
+
+    if (begin == 0 && end == chunk.size) {
+        return lz_decompress(packed, mutable_byte_view(output, chunk.size))
+               || fail(EBADMSG);
+    }
+    std::pmr::vector<uint8_t> plain(chunk.size, thread_buffer_pool());
+    if (!lz_decompress(packed, mutable_byte_view(plain))) {
+        return fail(EBADMSG);
+    }
+    std::copy_n(plain.begin() + begin, end - begin, output);
+    return true;
+}
+
+bool container_reader::read(uint64_t          offset,
+                            mutable_byte_view output,
+                            size_t&           copied) const {
+    copied = 0;
+    if (fd_ < 0) { return fail(EBADF); }
+    if (offset >= size_) { return true; }
+    uint64_t end = offset + std::min<uint64_t>(output.size(), size_ - offset);
+
+    for (uint64_t position = offset; position < end;) {
+        size_t index = position / chunk_size_;
+        size_t begin = position - uint64_t{index} * chunk_size_;
+        size_t stop  = std::min<uint64_t>(chunk_size_, end - position + begin);
+        if (!read_chunk(
+                index, begin, stop, output.data() + (position - offset))) {
+            return false;
+        }
+        position += stop - begin;
+    }
+
+    copied = end - offset;
+    return true;
+}
+
+bool container_reader::read(uint64_t          offset,
+                            mutable_byte_view output,
+                            size_t&           copied,
+                            thread_pool&      pool) const {
+    copied = 0;
+    if (fd_ < 0) { return fail(EBADF); }
+    if (offset >= size_) { return true; }
+    uint64_t end = offset + std::min<uint64_t>(output.size(), size_ - offset);
+
+    size_t first_chunk = offset / chunk_size_;
+    size_t end_chunk   = (end + chunk_size_ - 1) / chunk_size_;
+
+    // errno is per thread, the first failure's is carried back
+    std::atomic<int> error{0};
+    pool.parallel_for(
+        end_chunk - first_chunk, 1, [&](size_t range_begin, size_t range_end) {
+            for (size_t i = first_chunk + range_begin;
+                 i < first_chunk + range_end;
+                 i++) {
+                uint64_t chunk_start = uint64_t{i} * chunk_size_;
+                uint64_t from        = std::max(offset, chunk_start);
+                uint64_t to = std::min(end, chunk_start + chunk_size_);
+                if (!read_chunk(i,
+                                from - chunk_start,
+                                to - chunk_start,
+                                output.data() + (from - offset))) {
+                    int expected = 0;
+                    error.compare_exchange_strong(expected, errno);
+                }
+            }
+        });
+    if (error != 0) { return fail(error); }
+
+    copied = end - offset;
+    return true;
+}
+
+}  // namespace lea
@@ -0,0 +1,495 @@
+#include "dedup.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <limits>
+
+#include "byte_io.hpp"
+#include "container.hpp"
+#include "instrument.hpp"
+#include "thread_pool.hpp"
+
+namespace lea {
+
+namespace {
+
+constexpr char INDEX_MAGIC[4]  = {'L', 'E', 'A', 'D'};
+constexpr char RECIPE_MAGIC[4] = {'L', 'E', 'A', 'R'};
+
+constexpr uint16_t RECIPE_VERSION     = 1;
+constexpr size_t   RECIPE_HEADER_SIZE = 24;
+constexpr size_t   RECIPE_ENTRY_SIZE  = 40;
+
+// domain separation from key_fingerprint and plain echo_hash
+constexpr char FINGERPRINT_TAG[] = "lea dedup chunk fingerprint";
+
+// a fresh index, doubled whenever it would pass 70% full
+constexpr size_t INITIAL_SLOTS = 1024;
+
+// new ciphertext collected before the data file is written
+constexpr size_t DATA_BATCH = 4 << 20;
+
+// plaintext cut and fingerprinted per step, the chunks within it spread
+// over the pool
+constexpr size_t CHUNK_BATCH = 4 << 20;
+
+// splitmix64 outputs, one random 64-bit value per byte value
+constexpr std::array<uint64_t, 256> make_gear_table() {
+    std::array<uint64_t, 256> table{};
+    uint64_t                  state = 0x6c65612d67656172;  // "lea-gear"
+    for (size_t i = 0; i < table.size(); i++) {
+        state      += 0x9e3779b97f4a7c15;
+        uint64_t z  = state;
+        z           = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z           = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        table[i]    = z ^ (z >> 31);
+    }
+    return table;
+}
+
+constexpr std::array<uint64_t, 256> GEAR = make_gear_table();
+
+// the gear hash shifts left, so its top bits mix the most recent bytes
+constexpr uint64_t top_bits(unsigned count) {
+    return count == 0 ? 0 : ~uint64_t{0} << (64 - count);
+}
+
+bool fail(int error) {
+    errno = error;
+    return false;
+}
+
+void encode_slot(uint8_t* out, const dedup_chunk& chunk) {
+    auto fingerprint = chunk.fingerprint.to_bytes();
+    std::copy(fingerprint.begin(), fingerprint.end(), out);
+    store_le<uint64_t>(out + 32, chunk.offset);
+    store_le<uint32_t>(out + 40, chunk.size);
+    store_le<uint32_t>(out + 44, 1);
+}
+
+}  // namespace
+
+bool valid_chunker_options(const chunker_options& options) noexcept {
+    uint32_t avg = options.avg_size;
+    return options.min_size != 0 && options.min_size < avg
+           && avg < options.max_size && avg >= 256 && (avg & (avg - 1)) == 0;
+}
+
+size_t find_chunk_boundary(byte_view              data,
+                           const chunker_options& options) noexcept {
+    size_t size = data.size();
+    if (size <= options.min_size) { return size; }
+
+    unsigned bits = 0;
+    while ((uint32_t{1} << bits) < options.avg_size) { bits++; }
+    uint64_t strict = top_bits(bits + 2);
+    uint64_t loose  = top_bits(bits - 2);
+
+    size_t limit  = std::min<size_t>(size, options.max_size);
+    size_t normal = std::min<size_t>(limit, options.avg_size);
+
+    LEA_STAGE(CUT);
+    uint64_t hash = 0;
+    size_t   i    = options.min_size;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + GEAR[data[i]];
+        if ((hash & strict) == 0) { return i + 1; }
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + GEAR[data[i]];
+        if ((hash & loose) == 0) { return i + 1; }
+    }
+    return limit;
+}
+
+chunk_fingerprinter::chunk_fingerprinter(const keyhash& key) noexcept {
+    prefix_.update(byte_view(reinterpret_cast<const uint8_t*>(FINGERPRINT_TAG),
+                             sizeof(FINGERPRINT_TAG) - 1));
+    auto bytes = key.to_bytes();
+    prefix_.update(bytes);
+}
+
+keyhash chunk_fingerprinter::operator()(byte_view chunk) const noexcept {
+    echo_hasher hasher = prefix_;
+    hasher.update(chunk);
+    return hasher.final();
+}
+
+dedup_store::dedup_store(const keyhash& key)
+    : context_(key),
+      fingerprinter_(key),
+      key_fingerprint_(key_fingerprint(key)) {}
+
+dedup_store::~dedup_store() { flush(); }
+
+bool dedup_store::create(int index_fd, int data_fd) {
+    index_fd_    = index_fd;
+    data_fd_     = data_fd;
+    used_        = 0;
+    written_end_ = 0;
+    data_end_    = 0;
+    pending_.clear();
+    dirty_slots_.clear();
+    slots_.assign(INITIAL_SLOTS, slot{});
+    return write_index();
+}
+
+bool dedup_store::open(int index_fd, int data_fd) {
+    struct stat index_stat;
+    struct stat data_stat;
+    if (fstat(index_fd, &index_stat) != 0 || fstat(data_fd, &data_stat) != 0) {
+        return false;
+    }
+    uint64_t index_size = static_cast<uint64_t>(index_stat.st_size);
+    if (index_size < DEDUP_HEADER_SIZE) { return fail(EBADMSG); }
+
+    std::array<uint8_t, DEDUP_HEADER_SIZE> header;
+    if (!pread_full(index_fd, header.data(), header.size(), 0)) {
+        return false;
+    }
+    if (!std::equal(header.begin(), header.begin() + 4, INDEX_MAGIC)) {
+        return fail(EBADMSG);
+    }
+
+    uint16_t version     = load_le<uint16_t>(&header[4]);
+    uint16_t header_size = load_le<uint16_t>(&header[6]);
+    uint64_t slot_count  = load_le<uint64_t>(&header[8]);
+    uint64_t used        = load_le<uint64_t>(&header[16]);
+    uint64_t data_end    = load_le<uint64_t>(&header[24]);
+    uint64_t data_size   = static_cast<uint64_t>(data_stat.st_size);
+    if (version > DEDUP_VERSION) { return fail(ENOTSUP); }
+    if (version == 0 || header_size != DEDUP_HEADER_SIZE || slot_count == 0
+        || (slot_count & (slot_count - 1)) != 0
+        || (index_size - DEDUP_HEADER_SIZE) / DEDUP_SLOT_SIZE != slot_count
+        || (index_size - DEDUP_HEADER_SIZE) % DEDUP_SLOT_SIZE != 0
+        || data_end > data_size) {
+        return fail(EBADMSG);
+    }
+
+    auto stored = key_fingerprint_.to_bytes();
+    if (!std::equal(stored.begin(), stored.end(), header.begin() + 32)) {
+        return fail(EKEYREJECTED);
+    }
+
+    std::vector<uint8_t> table(slot_count * DEDUP_SLOT_SIZE);
+    if (!pread_full(index_fd, table.data(), table.size(), DEDUP_HEADER_SIZE)) {
+        return false;
+    }
+
+    std::vector<slot> slots(slot_count);
+    uint64_t          found = 0;
+    for (size_t i = 0; i < slot_count; i++) {
+        const uint8_t* entry = &table[i * DEDUP_SLOT_SIZE];
+        if (load_le<uint32_t>(entry + 44) == 0) { continue; }
+
+        dedup_chunk& chunk = slots[i].chunk;
+        keyhash::from_bytes(byte_view(entry, KEYHASH_BYTES), chunk.fingerprint);
+        chunk.offset   = load_le<uint64_t>(entry + 32);
+        chunk.size     = load_le<uint32_t>(entry + 40);
+        slots[i].used  = true;
+        found         += 1;
+
+        // flush writes the slots before the header, so slots past an
+        // interrupted flush count too as long as their data made it
+        uint64_t stored_size = encrypted_size(chunk.size);
+        if (chunk.offset > data_size
+            || stored_size > data_size - chunk.offset) {
+            return fail(EBADMSG);
+        }
+        data_end = std::max(data_end, chunk.offset + stored_size);
+    }
+    if (found < used || found == slot_count) { return fail(EBADMSG); }
+
+    index_fd_    = index_fd;
+    data_fd_     = data_fd;
+    slots_       = std::move(slots);
+    used_        = found;
+    written_end_ = data_end;
+    data_end_    = data_end;
+    pending_.clear();
+    dirty_slots_.clear();
+    rewrite_index_ = false;
+    return true;
+}
+
+size_t dedup_store::probe(const keyhash& fingerprint) const noexcept {
+    size_t mask = slots_.size() - 1;
+    size_t i    = static_cast<size_t>(fingerprint.limbs[0]) & mask;
+    while (slots_[i].used && slots_[i].chunk.fingerprint != fingerprint) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void dedup_store::grow() {
+    std::vector<slot> old = std::move(slots_);
+    slots_.assign(old.size() * 2, slot{});
+    for (const slot& s : old) {
+        if (s.used) { slots_[probe(s.chunk.fingerprint)] = s; }
+    }
+
+    // every slot moved, so the whole index is written again
+    dirty_slots_.clear();
+    rewrite_index_ = true;
+}
+
+bool dedup_store::put(const keyhash& fingerprint,
+                      byte_view      chunk,
+                      bool&          stored) {
+    if (index_fd_ < 0) { return fail(EBADF); }
+    if (chunk.size() > std::numeric_limits<uint32_t>::max()) {
+        return fail(EINVAL);
+    }
+
+    size_t i = probe(fingerprint);
+    if (slots_[i].used) {
+        stored = false;
+        return true;
+    }
+    if ((used_ + 1) * 10 > slots_.size() * 7) {
+        grow();
+        i = probe(fingerprint);
+    }
+
+    size_t ciphertext_size = encrypted_size(chunk.size());
+    size_t at              = pending_.size();
+    pending_.resize(at + ciphertext_size);
+    context_.encrypt(chunk,
+                     mutable_byte_view(pending_.data() + at, ciphertext_size));
+
+    dedup_chunk& entry  = slots_[i].chunk;
+    entry.fingerprint   = fingerprint;
+    entry.offset        = data_end_;
+    entry.size          = static_cast<uint32_t>(chunk.size());
+    slots_[i].used      = true;
+    used_              += 1;
+    data_end_          += ciphertext_size;
+    if (!rewrite_index_) { dirty_slots_.push_back(i); }
+
+    stored = true;
+    return pending_.size() < DATA_BATCH || write_data();
+}
+
+bool dedup_store::find(const keyhash& fingerprint, dedup_chunk& chunk) const {
+    if (slots_.empty()) { return false; }
+    const slot& s = slots_[probe(fingerprint)];
+    if (!s.used) { return false; }
+    chunk = s.chunk;
+    return true;
+}
+
+bool dedup_store::get(const keyhash&        fingerprint,
+                      std::vector<uint8_t>& chunk) const {
+    dedup_chunk entry;
+    if (!find(fingerprint, entry)) { return fail(ENOENT); }
+
+    chunk.resize(encrypted_size(entry.size));
+    if (entry.offset >= written_end_) {
+        std::copy_n(pending_.begin() + (entry.offset - written_end_),
+                    chunk.size(),
+                    chunk.begin());
+    } else if (!pread_full(
+                   data_fd_, chunk.data(), chunk.size(), entry.offset)) {
+        return false;
+    }
+
+    // the size is recorded, so the padding is cut rather than parsed
+    context_.decrypt_range(
+        chunk, 0, chunk.size() / 32, mutable_byte_view(chunk));
+    chunk.resize(entry.size);
+    return true;
+}
+
+bool dedup_store::write_data() {
+    if (pending_.empty()) { return true; }
+    if (!pwrite_all(data_fd_, pending_.data(), pending_.size(), written_end_)) {
+        return false;
+    }
+    written_end_ = data_end_;
+    pending_.clear();
+    return true;
+}
+
+void dedup_store::encode_header(uint8_t* out) const noexcept {
+    std::fill(out, out + DEDUP_HEADER_SIZE, 0);
+    std::copy(INDEX_MAGIC, INDEX_MAGIC + 4, out);
+    store_le<uint16_t>(out + 4, DEDUP_VERSION);
+    store_le<uint16_t>(out + 6, DEDUP_HEADER_SIZE);
+    store_le<uint64_t>(out + 8, slots_.size());
+    store_le<uint64_t>(out + 16, used_);
+    store_le<uint64_t>(out + 24, data_end_);
+    auto fingerprint = key_fingerprint_.to_bytes();
+    std::copy(fingerprint.begin(), fingerprint.end(), out + 32);
+}
+
+bool dedup_store::write_index() {
+    std::vector<uint8_t> index(DEDUP_HEADER_SIZE
+                               + slots_.size() * DEDUP_SLOT_SIZE);
+    encode_header(index.data());
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (slots_[i].used) {
+            encode_slot(&index[DEDUP_HEADER_SIZE + i * DEDUP_SLOT_SIZE],
+                        slots_[i].chunk);
+        }
+    }
+    if (!pwrite_all(index_fd_, index.data(), index.size(), 0)) {
+        return false;
+    }
+    rewrite_index_ = false;
+    return true;
+}
+
+bool dedup_store::flush() {
+    if (index_fd_ < 0) { return true; }
+
+    // chunk data first, so the index never points past what was written
+    if (!write_data()) { return false; }
+    if (rewrite_index_) { return write_index(); }
+
+    std::array<uint8_t, DEDUP_SLOT_SIZE> entry;
+    for (size_t i : dirty_slots_) {
+        encode_slot(entry.data(), slots_[i].chunk);
+        if (!pwrite_all(index_fd_,
+                        entry.data(),
+                        entry.size(),
+                        DEDUP_HEADER_SIZE + i * DEDUP_SLOT_SIZE)) {
+            return false;
+        }
+    }
+    dirty_slots_.clear();
+
+    std::array<uint8_t, DEDUP_HEADER_SIZE> header;
+    encode_header(header.data());
+    return pwrite_all(index_fd_, header.data(), header.size(), 0);
+}
+
+dedup_writer::dedup_writer(dedup_store& store, chunker_options options)
+    : store_(store), options_(options) {}
+
+bool dedup_writer::write(byte_view data) { return append(data, nullptr); }
+
+bool dedup_writer::write(byte_view data, thread_pool& pool) {
+    return append(data, &pool);
+}
+
+bool dedup_writer::append(byte_view data, thread_pool* pool) {
+    if (!valid_chunker_options(options_)) { return fail(EINVAL); }
+
+    pending_.insert(pending_.end(), data.begin(), data.end());
+    stats_.bytes += data.size();
+    return pending_.size() < CHUNK_BATCH || store_chunks(false, pool);
+}
+
+bool dedup_writer::finish() {
+    if (!valid_chunker_options(options_)) { return fail(EINVAL); }
+    return store_chunks(true, nullptr) && store_.flush();
+}
+
+bool dedup_writer::store_chunks(bool last, thread_pool* pool) {
+    // a cut needs max_size bytes after the chunk start to be final, short
+    // of the end of the stream
+    cuts_.clear();
+    size_t begin = 0;
+    while (begin < pending_.size()) {
+        size_t rest = pending_.size() - begin;
+        if (!last && rest < options_.max_size) { break; }
+        begin += find_chunk_boundary(byte_view(pending_.data() + begin, rest),
+                                     options_);
+        cuts_.push_back(begin);
+    }
+
+    fingerprints_.resize(cuts_.size());
+    auto fingerprint = [this](size_t first, size_t end) {
+        for (size_t i = first; i < end; i++) {
+            size_t start     = i == 0 ? 0 : cuts_[i - 1];
+            fingerprints_[i] = store_.fingerprinter()(
+                byte_view(pending_.data() + start, cuts_[i] - start));
+        }
+    };
+    if (pool != nullptr && cuts_.size() > 1) {
+        pool->parallel_for(cuts_.size(), 4, fingerprint);
+    } else {
+        fingerprint(0, cuts_.size());
+    }
+
+    // sequential, so a chunk repeated within the batch is stored once
+    for (size_t i = 0; i < cuts_.size(); i++) {
+        size_t    start = i == 0 ? 0 : cuts_[i - 1];
+        byte_view chunk(pending_.data() + start, cuts_[i] - start);
+        bool      stored;
+        if (!store_.put(fingerprints_[i], chunk, stored)) { return false; }
+
+        recipe_.push_back(
+            {fingerprints_[i], static_cast<uint32_t>(chunk.size())});
+        stats_.chunks += 1;
+        if (stored) {
+            stats_.new_chunks += 1;
+            stats_.new_bytes  += chunk.size();
+        }
+    }
+
+    pending_.erase(pending_.begin(), pending_.begin() + begin);
+    return true;
+}
+
+bool write_recipe(int fd, const std::vector<dedup_ref>& recipe) {
+    std::vector<uint8_t> bytes(RECIPE_HEADER_SIZE
+                               + recipe.size() * RECIPE_ENTRY_SIZE);
+    uint64_t             total = 0;
+    for (size_t i = 0; i < recipe.size(); i++) {
+        uint8_t* entry   = &bytes[RECIPE_HEADER_SIZE + i * RECIPE_ENTRY_SIZE];
+        auto fingerprint = recipe[i].fingerprint.to_bytes();
+        std::copy(fingerprint.begin(), fingerprint.end(), entry);
+        store_le<uint32_t>(entry + 32, recipe[i].size);
+        total += recipe[i].size;
+    }
+
+    std::copy(RECIPE_MAGIC, RECIPE_MAGIC + 4, bytes.begin());
+    store_le<uint16_t>(&bytes[4], RECIPE_VERSION);
+    store_le<uint64_t>(&bytes[8], recipe.size());
+    store_le<uint64_t>(&bytes[16], total);
+    return pwrite_all(fd, bytes.data(), bytes.size(), 0);
+}
+
+bool read_recipe(int fd, std::vector<dedup_ref>& recipe) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) { return false; }
+    uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+    if (file_size < RECIPE_HEADER_SIZE) { return fail(EBADMSG); }
+
+    std::vector<uint8_t> bytes(file_size);
+    if (!pread_full(fd, bytes.data(), bytes.size(), 0)) { return false; }
+    if (!std::equal(bytes.begin(), bytes.begin() + 4, RECIPE_MAGIC)) {
+        return fail(EBADMSG);
+    }
+
+    uint16_t version = load_le<uint16_t>(&bytes[4]);
+    uint64_t count   = load_le<uint64_t>(&bytes[8]);
+    uint64_t total   = load_le<uint64_t>(&bytes[16]);
+    if (version > RECIPE_VERSION) { return fail(ENOTSUP); }
+    if (version == 0
+        || (file_size - RECIPE_HEADER_SIZE) / RECIPE_ENTRY_SIZE != count
+        || (file_size - RECIPE_HEADER_SIZE) % RECIPE_ENTRY_SIZE != 0) {
+        return fail(EBADMSG);
+    }
+
+    std::vector<dedup_ref> entries(count);
+    uint64_t               sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* entry
+            = &bytes[RECIPE_HEADER_SIZE + i * RECIPE_ENTRY_SIZE];
+        keyhash::from_bytes(byte_view(entry, KEYHASH_BYTES),
+                            entries[i].fingerprint);
+        entries[i].size  = load_le<uint32_t>(entry + 32);
+        sum             += entries[i].size;
+    }
+    if (sum != total) { return fail(EBADMSG); }
+
+    recipe = std::move(entries);
+    return true;
+}
+
+}  // namespace lea
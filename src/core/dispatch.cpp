@@ -0,0 +1,100 @@
+#include "dispatch.hpp"
+
+#include <atomic>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEA_X86 1
+#endif
+
+namespace lea {
+
+namespace {
+
+constexpr int NOT_FORCED = -1;
+
+std::atomic<int> forced{NOT_FORCED};
+
+// LEA_KERNEL, read once, or the best level when unset or unusable
+kernel_isa default_isa() {
+    static const kernel_isa isa = [] {
+        const char* name = std::getenv("LEA_KERNEL");
+        kernel_isa  requested;
+        if (name && parse_kernel_isa(name, requested)
+            && kernel_isa_supported(requested)) {
+            return requested;
+        }
+        return best_kernel_isa();
+    }();
+    return isa;
+}
+
+}  // namespace
+
+const char* kernel_isa_name(kernel_isa isa) {
+    switch (isa) {
+        case kernel_isa::SCALAR: return "scalar";
+        case kernel_isa::SSE2: return "sse2";
+        case kernel_isa::AVX2: return "avx2";
+        case kernel_isa::AVX512: return "avx512";
+        default: return "unknown";
+    }
+}
+
+bool parse_kernel_isa(std::string_view name, kernel_isa& isa) {
+    for (kernel_isa candidate : {kernel_isa::SCALAR,
+                                 kernel_isa::SSE2,
+                                 kernel_isa::AVX2,
+                                 kernel_isa::AVX512}) {
+        if (name == kernel_isa_name(candidate)) {
+            isa = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool kernel_isa_supported(kernel_isa isa) {
+    switch (isa) {
+        case kernel_isa::SCALAR: return true;
+#if defined(LEA_X86)
+        case kernel_isa::SSE2: return __builtin_cpu_supports("sse2");
+        case kernel_isa::AVX2:
+            return __builtin_cpu_supports("avx2")
+                && __builtin_cpu_supports("bmi2");
+        case kernel_isa::AVX512:
+            return __builtin_cpu_supports("avx512f")
+                && __builtin_cpu_supports("avx512bw")
+                && __builtin_cpu_supports("bmi2");
+#endif
+        default: return false;
+    }
+}
+
+kernel_isa best_kernel_isa() {
+    static const kernel_isa best = [] {
+        for (kernel_isa isa :
+             {kernel_isa::AVX512, kernel_isa::AVX2, kernel_isa::SSE2}) {
+            if (kernel_isa_supported(isa)) { return isa; }
+        }
+        return kernel_isa::SCALAR;
+    }();
+    return best;
+}
+
+kernel_isa active_kernel_isa() {
+    int isa = forced.load(std::memory_order_relaxed);
+    return isa == NOT_FORCED ? default_isa() : static_cast<kernel_isa>(isa);
+}
+
+bool force_kernel_isa(kernel_isa isa) {
+    if (!kernel_isa_supported(isa)) { return false; }
+    forced.store(static_cast<int>(isa), std::memory_order_relaxed);
+    return true;
+}
+
+void clear_forced_kernel_isa() {
+    forced.store(NOT_FORCED, std::memory_order_relaxed);
+}
+
+}  // namespace lea
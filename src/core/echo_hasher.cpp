@@ -0,0 +1,155 @@
+#include "echo_hasher.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "keyhash_batch.hpp"
+
+namespace lea {
+
+namespace {
+
+// "ECHOSTRM", keeps lane seeds and the length block apart from messages
+constexpr uint64_t DOMAIN = 0x4543'484F'5354'524DULL;
+
+constexpr std::array<size_t, ECHO_LANES> FULL_LENGTHS = [] {
+    std::array<size_t, ECHO_LANES> lengths{};
+    for (size_t& length : lengths) { length = KEYHASH_BYTES; }
+    return lengths;
+}();
+
+using lane_array = std::array<limbs256, ECHO_LANES>;
+
+limbs256 load_block(const uint8_t* bytes) {
+    limbs256 block;
+    std::memcpy(block.data(), bytes, KEYHASH_BYTES);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (uint64_t& limb : block) { limb = __builtin_bswap64(limb); }
+#endif
+    return block;
+}
+
+// x = P(x) for the first count entries
+void permute(lane_array& values, size_t count) {
+    gen_keyhash_batch(span<const limbs256>(values.data(), count),
+                      span<const size_t>(FULL_LENGTHS.data(), count),
+                      span<limbs256>(values.data(), count));
+}
+
+// chains[i] = P(P(blocks[i]) ^ chains[i]) ^ chains[i] for i below count,
+// blocks is left holding scratch
+void compress(lane_array& chains, lane_array& blocks, size_t count) {
+    permute(blocks, count);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t limb = 0; limb < 4; limb++) {
+            blocks[i][limb] ^= chains[i][limb];
+        }
+    }
+    permute(blocks, count);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t limb = 0; limb < 4; limb++) {
+            chains[i][limb] ^= blocks[i][limb];
+        }
+    }
+}
+
+// distinct starting chains, so reordering lanes changes the digest
+const lane_array& lane_seeds() {
+    static const lane_array seeds = [] {
+        lane_array values;
+        for (size_t i = 0; i < ECHO_LANES; i++) {
+            values[i] = {i, 0, 0, DOMAIN};
+        }
+        permute(values, ECHO_LANES);
+        return values;
+    }();
+    return seeds;
+}
+
+}  // namespace
+
+echo_hasher::echo_hasher() noexcept { reset(); }
+
+void echo_hasher::reset() noexcept {
+    chains_   = lane_seeds();
+    buffered_ = 0;
+    length_   = 0;
+}
+
+void echo_hasher::absorb(const uint8_t* stripe) noexcept {
+    lane_array blocks;
+    for (size_t i = 0; i < ECHO_LANES; i++) {
+        blocks[i] = load_block(stripe + i * KEYHASH_BYTES);
+    }
+    compress(chains_, blocks, ECHO_LANES);
+}
+
+void echo_hasher::update(byte_view bytes) noexcept {
+    const uint8_t* data = bytes.data();
+    size_t         size = bytes.size();
+    length_            += size;
+
+    if (buffered_ > 0) {
+        size_t taken = std::min(size, ECHO_STRIPE_BYTES - buffered_);
+        std::memcpy(buffer_.data() + buffered_, data, taken);
+        buffered_ += taken;
+        data      += taken;
+        size      -= taken;
+
+        if (buffered_ < ECHO_STRIPE_BYTES) { return; }
+        absorb(buffer_.data());
+        buffered_ = 0;
+    }
+
+    // whole stripes straight from the caller's memory
+    for (; size >= ECHO_STRIPE_BYTES; size -= ECHO_STRIPE_BYTES) {
+        absorb(data);
+        data += ECHO_STRIPE_BYTES;
+    }
+
+    std::memcpy(buffer_.data(), data, size);
+    buffered_ = size;
+}
+
+keyhash echo_hasher::final() noexcept {
+    // a full stripe is absorbed as soon as it fills, so the padding byte
+    // always fits
+    buffer_[buffered_++] = 0x80;
+    size_t block_count   = (buffered_ + KEYHASH_BYTES - 1) / KEYHASH_BYTES;
+    std::fill(buffer_.begin() + buffered_,
+              buffer_.begin() + block_count * KEYHASH_BYTES,
+              0);
+
+    lane_array blocks;
+    for (size_t i = 0; i < block_count; i++) {
+        blocks[i] = load_block(buffer_.data() + i * KEYHASH_BYTES);
+    }
+    compress(chains_, blocks, block_count);
+
+    // chain 2i absorbs chain 2i + 1 until one is left
+    lane_array chains = chains_;
+    for (size_t count = ECHO_LANES / 2; count > 0; count /= 2) {
+        lane_array evens;
+        for (size_t i = 0; i < count; i++) {
+            evens[i]  = chains[2 * i];
+            blocks[i] = chains[2 * i + 1];
+        }
+        compress(evens, blocks, count);
+        chains = evens;
+    }
+
+    blocks[0] = {length_, ECHO_LANES, 0, ~DOMAIN};
+    compress(chains, blocks, 1);
+
+    keyhash digest{chains[0]};
+    reset();
+    return digest;
+}
+
+keyhash echo_hash(byte_view bytes) noexcept {
+    echo_hasher hasher;
+    hasher.update(bytes);
+    return hasher.final();
+}
+
+}  // namespace lea
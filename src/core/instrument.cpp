@@ -0,0 +1,283 @@
+#include "instrument.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace lea {
+
+namespace {
+
+constexpr std::array<const char*, STAGE_COUNT> STAGE_NAMES = {
+    "keyhash",
+    "expand",
+    "compact",
+    "rotate",
+    "mix",
+    "sbox",
+    "flip",
+    "get_operations",
+    "key_schedule",
+    "cipher_block",
+    "decipher_block",
+    "cipher_bulk",
+    "decipher_bulk",
+    "pad",
+    "unpad",
+    "allocate",
+    "read",
+    "write",
+    "chunk",
+    "cut",
+    "compress",
+    "decompress",
+};
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint64_t now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct trace_event {
+    stage    s;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+};
+
+// counters are only written by their own thread, atomics just let
+// snapshot_stats read them while that thread runs
+struct thread_counters {
+    std::array<std::atomic<uint64_t>, STAGE_COUNT> calls{};
+    std::array<std::atomic<uint64_t>, STAGE_COUNT> nanoseconds{};
+    std::array<std::atomic<uint64_t>, STAGE_COUNT> cycles{};
+
+    size_t                   thread_id = 0;
+    std::mutex               events_mutex;
+    std::vector<trace_event> events;
+};
+
+struct registry {
+    std::mutex                                  mutex;
+    std::vector<thread_counters*>               live;
+    stats_snapshot                              retired{};
+    std::vector<std::pair<size_t, trace_event>> retired_events;
+    size_t                                      next_thread_id = 1;
+
+    std::atomic<bool>     tracing{false};
+    std::atomic<uint64_t> trace_origin_ns{0};
+};
+
+// never destroyed, threads may still exit after static destructors ran
+registry& global_registry() {
+    static registry* r = new registry;
+    return *r;
+}
+
+void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount,
+                  std::memory_order_relaxed);
+}
+
+// registers the thread's counters on first use and folds them into the
+// retired totals when the thread exits
+class thread_slot {
+  public:
+    thread_slot() {
+        registry&                   r = global_registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        counters_.thread_id = r.next_thread_id++;
+        r.live.push_back(&counters_);
+    }
+
+    ~thread_slot() {
+        registry&                   r = global_registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            r.retired[i].calls       += counters_.calls[i].load();
+            r.retired[i].nanoseconds += counters_.nanoseconds[i].load();
+            r.retired[i].cycles      += counters_.cycles[i].load();
+        }
+        for (const trace_event& event : counters_.events) {
+            r.retired_events.emplace_back(counters_.thread_id, event);
+        }
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &counters_));
+    }
+
+    thread_counters& counters() { return counters_; }
+
+  private:
+    thread_counters counters_;
+};
+
+thread_counters& local_counters() {
+    thread_local thread_slot slot;
+    return slot.counters();
+}
+
+}  // namespace
+
+const char* stage_name(stage s) {
+    size_t index = static_cast<size_t>(s);
+    return index < STAGE_COUNT ? STAGE_NAMES[index] : "unknown";
+}
+
+scoped_stage::scoped_stage(stage s) noexcept
+    : stage_(s), start_ns_(now_ns()), start_cycles_(now_cycles()) {}
+
+scoped_stage::~scoped_stage() {
+    uint64_t elapsed_cycles = now_cycles() - start_cycles_;
+    uint64_t elapsed_ns     = now_ns() - start_ns_;
+    size_t   index          = static_cast<size_t>(stage_);
+
+    thread_counters& counters = local_counters();
+    add(counters.calls[index], 1);
+    add(counters.nanoseconds[index], elapsed_ns);
+    add(counters.cycles[index], elapsed_cycles);
+
+    if (global_registry().tracing.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(counters.events_mutex);
+        if (counters.events.size() < TRACE_EVENT_LIMIT) {
+            counters.events.push_back({stage_, start_ns_, elapsed_ns});
+        }
+    }
+}
+
+stats_snapshot snapshot_stats() {
+    registry&                   r = global_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    stats_snapshot stats = r.retired;
+    for (const thread_counters* counters : r.live) {
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            stats[i].calls       += counters->calls[i].load();
+            stats[i].nanoseconds += counters->nanoseconds[i].load();
+            stats[i].cycles      += counters->cycles[i].load();
+        }
+    }
+    return stats;
+}
+
+// counters of running threads are cleared by their owners' next add racing
+// this store, so reset between runs rather than during one
+void reset_stats() {
+    registry&                   r = global_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    r.retired = stats_snapshot{};
+    for (thread_counters* counters : r.live) {
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            counters->calls[i].store(0);
+            counters->nanoseconds[i].store(0);
+            counters->cycles[i].store(0);
+        }
+    }
+}
+
+std::string stats_text(const stats_snapshot& stats) {
+    std::ostringstream oss;
+    oss << "stage                 calls        total ns      ns/call"
+           "   cycles/call\n";
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        const stage_stats& s = stats[i];
+        if (s.calls == 0) { continue; }
+
+        char line[128];
+        std::snprintf(line,
+                      sizeof(line),
+                      "%-16s %10llu %15llu %12.1f %13.1f\n",
+                      STAGE_NAMES[i],
+                      static_cast<unsigned long long>(s.calls),
+                      static_cast<unsigned long long>(s.nanoseconds),
+                      static_cast<double>(s.nanoseconds) / s.calls,
+                      static_cast<double>(s.cycles) / s.calls);
+        oss << line;
+    }
+    return oss.str();
+}
+
+std::string stats_json(const stats_snapshot& stats) {
+    std::ostringstream oss;
+    oss << '{';
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        const stage_stats& s = stats[i];
+        oss << (i == 0 ? "" : ",") << "\n  \"" << STAGE_NAMES[i]
+            << "\": {\"calls\": " << s.calls
+            << ", \"nanoseconds\": " << s.nanoseconds
+            << ", \"cycles\": " << s.cycles << '}';
+    }
+    oss << "\n}\n";
+    return oss.str();
+}
+
+void start_trace() {
+    registry& r = global_registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.retired_events.clear();
+        for (thread_counters* counters : r.live) {
+            std::lock_guard<std::mutex> events_lock(counters->events_mutex);
+            counters->events.clear();
+        }
+    }
+    r.trace_origin_ns.store(now_ns());
+    r.tracing.store(true);
+}
+
+void stop_trace() { global_registry().tracing.store(false); }
+
+bool write_chrome_trace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) { return false; }
+
+    registry&                   r = global_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    uint64_t                    origin = r.trace_origin_ns.load();
+
+    // complete ("X") events, timestamps in microseconds; a stage already
+    // running when the trace started is clipped to its start
+    bool first = true;
+    auto write = [&](size_t thread_id, const trace_event& event) {
+        uint64_t start = std::max(event.start_ns, origin) - origin;
+        out << (first ? "\n" : ",\n") << "{\"name\":\""
+            << STAGE_NAMES[static_cast<size_t>(event.s)]
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id
+            << ",\"ts\":" << start / 1000.0
+            << ",\"dur\":" << event.duration_ns / 1000.0 << '}';
+        first = false;
+    };
+
+    out << "{\"traceEvents\":[";
+    for (const auto& [thread_id, event] : r.retired_events) {
+        write(thread_id, event);
+    }
+    for (thread_counters* counters : r.live) {
+        std::lock_guard<std::mutex> events_lock(counters->events_mutex);
+        for (const trace_event& event : counters->events) {
+            write(counters->thread_id, event);
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    return static_cast<bool>(out);
+}
+
+}  // namespace lea
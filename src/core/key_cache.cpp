@@ -0,0 +1,232 @@
+#include "key_cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "keyhash_limbs.hpp"
+
+namespace lea {
+
+namespace {
+
+// keeps the compiler from dropping stores to memory about to be reused
+void secure_zero(void* data, size_t size) {
+    volatile uint8_t* bytes = static_cast<volatile uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) { bytes[i] = 0; }
+}
+
+struct limbs_hash {
+    size_t operator()(const limbs256& limbs) const noexcept {
+        return std::hash<keyhash>{}(keyhash{limbs});
+    }
+};
+
+// one lock-partitioned map evicting by CLOCK: hits set a slot's reference
+// bit under a shared lock, inserts sweep the hand past referenced slots,
+// clearing their bits, and evict the first unreferenced one. the index only
+// holds hashes so keys live in the slots alone and can be wiped there
+template <typename Key, typename Value, typename Hash>
+class clock_map {
+  public:
+    clock_map(size_t capacity, size_t shard_count, bool zero_evicted)
+        : zero_evicted_(zero_evicted) {
+        shard_count      = std::max<size_t>(shard_count, 1);
+        size_t per_shard = std::max<size_t>(
+            (capacity + shard_count - 1) / shard_count, 1);
+
+        for (size_t i = 0; i < shard_count; i++) {
+            shards_.push_back(std::make_unique<shard>(per_shard));
+        }
+    }
+
+    template <typename Compute>
+    Value get(const Key& key, Compute compute) {
+        size_t hash = Hash{}(key);
+        shard& s    = *shards_[((hash >> 32) ^ hash) % shards_.size()];
+
+        Value value;
+        if (find(s, hash, key, value)) {
+            s.hits.fetch_add(1, std::memory_order_relaxed);
+            return value;
+        }
+        s.misses.fetch_add(1, std::memory_order_relaxed);
+
+        // computed outside the lock, a racing miss on the same key computes
+        // it twice and keeps one copy
+        value = compute();
+        insert(s, hash, key, value);
+        return value;
+    }
+
+    cache_counters counters() const {
+        cache_counters total;
+        for (const auto& s : shards_) {
+            total.hits      += s->hits.load(std::memory_order_relaxed);
+            total.misses    += s->misses.load(std::memory_order_relaxed);
+            total.evictions += s->evictions.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    void clear() {
+        for (const auto& s : shards_) {
+            std::unique_lock<std::shared_mutex> lock(s->mutex);
+            for (slot& entry : s->slots) {
+                if (zero_evicted_ && entry.used) { wipe(entry); }
+                entry.used = false;
+                entry.referenced.store(false, std::memory_order_relaxed);
+            }
+            s->index.clear();
+            s->hand = 0;
+        }
+    }
+
+  private:
+    struct slot {
+        Key               key{};
+        Value             value{};
+        std::atomic<bool> referenced{false};
+        bool              used = false;
+    };
+
+    struct shard {
+        explicit shard(size_t capacity) : slots(capacity) {
+            index.reserve(capacity);
+        }
+
+        std::shared_mutex                       mutex;
+        std::vector<slot>                       slots;
+        std::unordered_multimap<size_t, size_t> index;
+        size_t                                  hand = 0;
+
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+
+    // slot holding key, or s.slots.size() when absent
+    static size_t locate(const shard& s, size_t hash, const Key& key) {
+        auto range = s.index.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (s.slots[it->second].key == key) { return it->second; }
+        }
+        return s.slots.size();
+    }
+
+    static void unindex(shard& s, size_t hash, size_t position) {
+        auto range = s.index.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == position) {
+                s.index.erase(it);
+                return;
+            }
+        }
+    }
+
+    static bool find(shard& s, size_t hash, const Key& key, Value& value) {
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+
+        size_t position = locate(s, hash, key);
+        if (position == s.slots.size()) { return false; }
+
+        slot& entry = s.slots[position];
+        entry.referenced.store(true, std::memory_order_relaxed);
+        value = entry.value;
+        return true;
+    }
+
+    void insert(shard& s, size_t hash, const Key& key, const Value& value) {
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        if (locate(s, hash, key) != s.slots.size()) { return; }
+
+        // every slot gets its reference bit cleared within one lap, so the
+        // sweep ends by the second visit to the starting slot
+        while (true) {
+            slot& entry = s.slots[s.hand];
+            if (!entry.used) { break; }
+            if (!entry.referenced.exchange(false, std::memory_order_relaxed)) {
+                unindex(s, Hash{}(entry.key), s.hand);
+                if (zero_evicted_) { wipe(entry); }
+                s.evictions.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            s.hand = (s.hand + 1) % s.slots.size();
+        }
+
+        slot& entry = s.slots[s.hand];
+        entry.key   = key;
+        entry.value = value;
+        entry.used  = true;
+        entry.referenced.store(false, std::memory_order_relaxed);
+        s.index.emplace(hash, s.hand);
+        s.hand = (s.hand + 1) % s.slots.size();
+    }
+
+    static void wipe(slot& entry) {
+        secure_zero(&entry.key, sizeof(entry.key));
+        secure_zero(&entry.value, sizeof(entry.value));
+    }
+
+    std::vector<std::unique_ptr<shard>> shards_;
+    bool                                zero_evicted_;
+};
+
+}  // namespace
+
+struct key_cache::maps {
+    // wrapped input -> keyhash, short inputs are keyed by their wrapped
+    // form since that alone determines the hash
+    clock_map<limbs256, limbs256, limbs_hash> keyhashes;
+    clock_map<keyhash, key_schedule, std::hash<keyhash>> schedules;
+
+    explicit maps(const key_cache_options& options)
+        : keyhashes(options.capacity, options.shards, options.zero_evicted),
+          schedules(options.capacity, options.shards, options.zero_evicted) {}
+};
+
+key_cache::key_cache(key_cache_options options)
+    : maps_(std::make_unique<maps>(options)) {}
+
+key_cache::~key_cache() { clear(); }
+
+keyhash key_cache::get_keyhash(const std::bitset<256>& input_bits,
+                               size_t                  input_byte_length) {
+    // refused like gen_keyhash, without taking a cache entry
+    if (input_byte_length == 0) { return keyhash{}; }
+
+    limbs256 wrapped = wrap_input(to_limbs(input_bits), input_byte_length);
+    limbs256 hashed  = maps_->keyhashes.get(wrapped, [&] {
+        return gen_keyhash(wrapped, 32).limbs;
+    });
+    return keyhash{hashed};
+}
+
+keyhash key_cache::get_keyhash(const std::string& password) {
+    return get_keyhash(bitify_str(password),
+                       std::min<size_t>(password.size(), 32));
+}
+
+key_schedule key_cache::get_schedule(const keyhash& key) {
+    return maps_->schedules.get(key, [&] { return make_key_schedule(key); });
+}
+
+cache_counters key_cache::keyhash_counters() const {
+    return maps_->keyhashes.counters();
+}
+
+cache_counters key_cache::schedule_counters() const {
+    return maps_->schedules.counters();
+}
+
+void key_cache::clear() {
+    maps_->keyhashes.clear();
+    maps_->schedules.clear();
+}
+
+}  // namespace lea
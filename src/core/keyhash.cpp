@@ -1,28 +1,142 @@
 #include "keyhash.hpp"
 
+#include <array>
 #include <bitset>
 #include <cmath>
-#include <iomanip>
-#include <sstream>
 #include <string>
 
+#include "instrument.hpp"
+
 namespace lea {
 
-std::string keyhash::hex_str() const noexcept {
-    std::ostringstream oss;
-    oss << std::hex << std::uppercase << std::setfill('0');
-    for (int i = 3; i >= 0; --i) {
-        uint64_t chunk = 0;
-        for (uint8_t j = 0; j < 64; ++j) {
-            chunk |= static_cast<uint64_t>(bits[i * 64 + j]) << (63 - j);
+namespace {
+
+// "00".."FF", two digits per byte value
+constexpr std::array<char, 512> HEX_PAIRS = [] {
+    const char            DIGITS[] = "0123456789ABCDEF";
+    std::array<char, 512> pairs{};
+    for (size_t i = 0; i < 256; i++) {
+        pairs[2 * i]     = DIGITS[i >> 4];
+        pairs[2 * i + 1] = DIGITS[i & 0xF];
+    }
+    return pairs;
+}();
+
+// digit value of a character, 0xFF for anything but a hex digit
+constexpr std::array<uint8_t, 256> HEX_VALUES = [] {
+    std::array<uint8_t, 256> values{};
+    for (size_t i = 0; i < 256; i++) { values[i] = 0xFF; }
+    for (uint8_t i = 0; i < 10; i++) { values['0' + i] = i; }
+    for (uint8_t i = 0; i < 6; i++) {
+        values['A' + i] = 10 + i;
+        values['a' + i] = 10 + i;
+    }
+    return values;
+}();
+
+// the hex_str layout: limbs from the last, each printed with its bit 0 as
+// the most significant digit bit
+void legacy_hex(const limbs256& limbs, char* out) noexcept {
+    for (size_t i = 0; i < 4; i++) {
+        uint64_t limb     = limbs[3 - i];
+        uint64_t reversed = 0;
+        for (size_t j = 0; j < 64; j++) {
+            reversed = reversed << 1 | (limb >> j & 1);
+        }
+        for (size_t j = 0; j < 8; j++) {
+            uint8_t byte = static_cast<uint8_t>(reversed >> (56 - 8 * j));
+            out[16 * i + 2 * j]     = HEX_PAIRS[2 * byte];
+            out[16 * i + 2 * j + 1] = HEX_PAIRS[2 * byte + 1];
         }
-        oss << std::setw(16) << chunk;
     }
-    return oss.str();
+}
+
+}  // namespace
+
+keyhash::keyhash(const std::bitset<256>& bits) noexcept {
+    const std::bitset<256> low_mask(~0ULL);
+    for (size_t i = 0; i < 4; i++) {
+        limbs[i] = ((bits >> (i * 64)) & low_mask).to_ullong();
+    }
+}
+
+std::bitset<256> keyhash::bits() const noexcept {
+    std::bitset<256> bits;
+    for (size_t i = 4; i-- > 0;) {
+        bits <<= 64;
+        bits  |= std::bitset<256>(limbs[i]);
+    }
+    return bits;
+}
+
+std::array<uint8_t, KEYHASH_BYTES> keyhash::to_bytes() const noexcept {
+    std::array<uint8_t, KEYHASH_BYTES> bytes;
+    for (size_t j = 0; j < KEYHASH_BYTES; j++) {
+        bytes[j] = static_cast<uint8_t>(limbs[j / 8] >> (8 * (j % 8)));
+    }
+    return bytes;
+}
+
+bool keyhash::from_bytes(byte_view bytes, keyhash& out) noexcept {
+    if (bytes.size() != KEYHASH_BYTES) { return false; }
+
+    limbs256 parsed{};
+    for (size_t j = 0; j < KEYHASH_BYTES; j++) {
+        parsed[j / 8] |= static_cast<uint64_t>(bytes[j]) << (8 * (j % 8));
+    }
+    out.limbs = parsed;
+    return true;
+}
+
+bool keyhash::from_hex(std::string_view hex, keyhash& out) noexcept {
+    if (hex.size() != KEYHASH_HEX_LENGTH) { return false; }
+
+    std::array<uint8_t, KEYHASH_BYTES> bytes;
+    for (size_t j = 0; j < KEYHASH_BYTES; j++) {
+        uint8_t high = HEX_VALUES[static_cast<uint8_t>(hex[2 * j])];
+        uint8_t low  = HEX_VALUES[static_cast<uint8_t>(hex[2 * j + 1])];
+        if ((high | low) > 0xF) { return false; }
+        bytes[j] = static_cast<uint8_t>(high << 4 | low);
+    }
+    return from_bytes(bytes, out);
+}
+
+size_t keyhash::to_hex(span<char> out) const noexcept {
+    if (out.size() < KEYHASH_HEX_LENGTH) { return 0; }
+
+    for (size_t j = 0; j < KEYHASH_BYTES; j++) {
+        uint8_t byte   = static_cast<uint8_t>(limbs[j / 8] >> (8 * (j % 8)));
+        out[2 * j]     = HEX_PAIRS[2 * byte];
+        out[2 * j + 1] = HEX_PAIRS[2 * byte + 1];
+    }
+    return KEYHASH_HEX_LENGTH;
+}
+
+std::string keyhash::hex_str() const {
+    std::string hex(KEYHASH_HEX_LENGTH, '0');
+    legacy_hex(limbs, hex.data());
+    return hex;
+}
+
+std::pmr::string keyhash::hex_str(std::pmr::memory_resource* resource) const {
+    std::pmr::string hex(KEYHASH_HEX_LENGTH, '0', resource);
+    legacy_hex(limbs, hex.data());
+    return hex;
+}
+
+bool operator==(const keyhash& a, const keyhash& b) noexcept {
+    uint64_t diff = 0;
+    for (size_t i = 0; i < 4; i++) { diff |= a.limbs[i] ^ b.limbs[i]; }
+    return diff == 0;
+}
+
+bool operator!=(const keyhash& a, const keyhash& b) noexcept {
+    return !(a == b);
 }
 
 keyhash gen_keyhash(const std::bitset<256>& input_bits,
                     size_t                  input_byte_length) {
+    LEA_STAGE(KEYHASH);
     std::bitset<512> expanded_bits
         = bit_interleaving_expand(input_bits, input_byte_length);
 
@@ -53,6 +167,7 @@ keyhash gen_keyhash(const std::bitset<256>& input_bits,
 
 std::bitset<512> bit_interleaving_expand(const std::bitset<256>& input_bits,
                                          size_t input_byte_length) {
+    LEA_STAGE(EXPAND);
     std::bitset<256> padding_bits;
     std::bitset<256> wrapping_input_bits;
 
@@ -91,6 +206,7 @@ std::bitset<512> bit_interleaving_expand(const std::bitset<256>& input_bits,
 }
 
 std::bitset<256> sequential_bit_compact(const std::bitset<512>& input_bits) {
+    LEA_STAGE(COMPACT);
     std::bitset<256> compacted_input;
 
     for (uint16_t i = 0; i < 512; i += 2) {
@@ -101,10 +217,11 @@ std::bitset<256> sequential_bit_compact(const std::bitset<512>& input_bits) {
 }
 
 std::bitset<256> rotate_left(const std::bitset<256>& bits, size_t shift) {
+    LEA_STAGE(ROTATE);
     return (bits << shift) | (bits >> (256 - shift));
 }
 
-std::bitset<256> bitify_str(const std::string& str) {
+std::bitset<256> bitify_str(std::string_view str) {
     std::bitset<256> bits;
 
     for (size_t i = 0; i < str.size() && i * 8 < 256; i++) {
@@ -116,11 +233,13 @@ std::bitset<256> bitify_str(const std::string& str) {
 }
 
 void intermittent_bit_flip(std::bitset<256>& bits) {
+    LEA_STAGE(FLIP);
     for (size_t i = 0; i < 256; i += PRIME2) { bits[i] = bits[i] ^ 1; }
 }
 
 void apply_sbox(std::bitset<256>& bits) {
-    unsigned char* bytes = reinterpret_cast<unsigned char*>(&bits);
+    LEA_STAGE(SBOX);
+    std::array<uint8_t, KEYHASH_BYTES> bytes = keyhash(bits).to_bytes();
     for (uint8_t j = 0; j < 32; j++) {
         uint32_t x      = bytes[j];
         uint32_t result = (x * PRIME1) ^ (x * x);
@@ -131,9 +250,14 @@ void apply_sbox(std::bitset<256>& bits) {
 
         bytes[j] = compacted;
     }
+
+    keyhash transformed;
+    keyhash::from_bytes(bytes, transformed);
+    bits = transformed.bits();
 }
 
 void mix(std::bitset<256>& bits, size_t round) {
+    LEA_STAGE(MIX);
     for (size_t j = 0; j < 256; j++) {
         bits[j] = bits[j] ^ ((j + round * PRIME2) % 2);
     }
@@ -0,0 +1,274 @@
+#include "keyhash_batch.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "dispatch.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEA_X86 1
+#define LEA_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LEA_TARGET(isa)
+#endif
+
+// the vector helpers below are always inlined into their kernels, so the
+// warning about their by-value ABI does not apply
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace lea {
+
+namespace {
+
+typedef uint64_t u64x2 __attribute__((vector_size(16)));
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+typedef uint64_t u64x8 __attribute__((vector_size(64)));
+
+// vectors per kernel call, two independent chains keep the ALUs busy
+constexpr size_t GROUPS = 2;
+
+// enough for GROUPS vectors of the widest kernel
+constexpr size_t MAX_LANES = GROUPS * 8;
+
+constexpr uint64_t EVEN_BITS = 0x5555'5555'5555'5555ULL;
+constexpr uint64_t ODD_BITS  = 0xAAAA'AAAA'AAAA'AAAAULL;
+
+constexpr limbs256 make_flip_mask() {
+    limbs256 mask{};
+    for (size_t i = 0; i < 256; i += PRIME2) {
+        mask[i / 64] |= uint64_t{1} << (i % 64);
+    }
+    return mask;
+}
+
+constexpr limbs256 FLIP_MASK = make_flip_mask();
+
+static_assert(PRIME1 == 17, "the kernels assume PRIME1 == 17");
+
+template <typename V>
+__attribute__((always_inline)) inline V swap_bits(const V& x,
+                                                  unsigned shift,
+                                                  uint64_t mask) {
+    return ((x >> shift) & mask) | ((x & mask) << shift);
+}
+
+template <typename V>
+__attribute__((always_inline)) inline V reverse_bits(const V& value) {
+    V x = swap_bits(value, 1, EVEN_BITS);
+    x = swap_bits(x, 2, 0x3333'3333'3333'3333ULL);
+    x = swap_bits(x, 4, 0x0F0F'0F0F'0F0F'0F0FULL);
+    x = swap_bits(x, 8, 0x00FF'00FF'00FF'00FFULL);
+    x = swap_bits(x, 16, 0x0000'FFFF'0000'FFFFULL);
+    return (x >> 32) | (x << 32);
+}
+
+// byte-wise x * 17 truncated to 8 bits
+template <typename V>
+__attribute__((always_inline)) inline V bytewise_times_prime1(const V& x) {
+    constexpr uint64_t LOW_7_BITS = 0x7F7F'7F7F'7F7F'7F7FULL;
+    constexpr uint64_t HIGH_BITS  = 0x8080'8080'8080'8080ULL;
+
+    V shifted = (x << 4) & ~0x0F0F'0F0F'0F0F'0F0FULL;
+    return ((x & LOW_7_BITS) + (shifted & LOW_7_BITS))
+         ^ ((x ^ shifted) & HIGH_BITS);
+}
+
+template <typename V>
+__attribute__((always_inline)) inline V popcount(const V& value) {
+    V x = value - ((value >> 1) & EVEN_BITS);
+    x = (x & 0x3333'3333'3333'3333ULL)
+      + ((x >> 2) & 0x3333'3333'3333'3333ULL);
+    x = (x + (x >> 4)) & 0x0F0F'0F0F'0F0F'0F0FULL;
+    x = x + (x >> 8);
+    x = x + (x >> 16);
+    return (x + (x >> 32)) & 0x7F;
+}
+
+// SBOX[x] folds the bytes of (x * 17) ^ (x * x), which both fit 16 bits,
+// so every byte is substituted arithmetically in 16-bit lanes
+template <typename V>
+__attribute__((always_inline)) inline V sbox(const V& x) {
+    typedef uint16_t W __attribute__((vector_size(sizeof(V))));
+
+    W words = reinterpret_cast<W>(x);
+    W low   = words & 0xFF;
+    W high  = words >> 8;
+
+    W low_r  = (low * 17) ^ (low * low);
+    W high_r = (high * 17) ^ (high * high);
+    W result = ((low_r ^ (low_r >> 8)) & 0xFF)
+             | (((high_r ^ (high_r >> 8)) & 0xFF) << 8);
+    return reinterpret_cast<V>(result);
+}
+
+// state[g][k] holds limb k of one input per lane. BIE followed by SBC
+// collapses to reverse(W) ^ ~(W * 17) limb by limb, and the rotation
+// picks each lane's source limbs by mask since shifts differ per lane
+template <typename V>
+__attribute__((always_inline)) inline void hash_lanes(V (&state)[GROUPS][4]) {
+    for (size_t round = 0; round < EXPAND_COMPACT_ITERATIONS; round++) {
+        for (size_t g = 0; g < GROUPS; g++) {
+            V* s = state[g];
+
+            V compacted[4];
+            for (size_t k = 0; k < 4; k++) {
+                compacted[k] = reverse_bits(s[3 - k])
+                             ^ ~bytewise_times_prime1(s[k]);
+            }
+
+            V count = popcount(compacted[0]) + popcount(compacted[1])
+                    + popcount(compacted[2]) + popcount(compacted[3]);
+            V shift      = (count * PRIMES[round]) & 0xFF;
+            V limb_shift = shift >> 6;
+            V bit_shift  = shift & 63;
+
+            V select[4];
+            for (size_t j = 0; j < 4; j++) {
+                select[j] = reinterpret_cast<V>(limb_shift == j);
+            }
+
+            uint64_t mix_mask
+                = (((round + 1) * PRIME2) % 2) ? EVEN_BITS : ODD_BITS;
+
+            for (size_t k = 0; k < 4; k++) {
+                V upper{}, lower{};
+                for (size_t j = 0; j < 4; j++) {
+                    upper |= select[j] & compacted[(k - j) & 3];
+                    lower |= select[j] & compacted[(k - j - 1) & 3];
+                }
+                V rotated = (upper << bit_shift)
+                          | ((lower >> 1) >> (63 - bit_shift));
+
+                s[k] = sbox(rotated ^ mix_mask) ^ FLIP_MASK[k];
+            }
+        }
+    }
+}
+
+using batch_fn = void (*)(const limbs256*, limbs256*);
+
+// hashes LANES already-wrapped inputs
+template <typename V>
+__attribute__((always_inline)) inline void hash_batch(const limbs256* inputs,
+                                                      limbs256* outputs) {
+    constexpr size_t WIDTH = sizeof(V) / sizeof(uint64_t);
+
+    V state[GROUPS][4];
+    for (size_t g = 0; g < GROUPS; g++) {
+        for (size_t k = 0; k < 4; k++) {
+            for (size_t l = 0; l < WIDTH; l++) {
+                state[g][k][l] = inputs[g * WIDTH + l][k];
+            }
+        }
+    }
+
+    hash_lanes(state);
+
+    for (size_t g = 0; g < GROUPS; g++) {
+        for (size_t k = 0; k < 4; k++) {
+            for (size_t l = 0; l < WIDTH; l++) {
+                outputs[g * WIDTH + l][k] = state[g][k][l];
+            }
+        }
+    }
+}
+
+void hash_sse2(const limbs256* inputs, limbs256* outputs) {
+    hash_batch<u64x2>(inputs, outputs);
+}
+
+LEA_TARGET("avx2")
+void hash_avx2(const limbs256* inputs, limbs256* outputs) {
+    hash_batch<u64x4>(inputs, outputs);
+}
+
+LEA_TARGET("avx512f,avx512bw")
+void hash_avx512(const limbs256* inputs, limbs256* outputs) {
+    hash_batch<u64x8>(inputs, outputs);
+}
+
+// the scalar kernel is the limb gen_keyhash one input at a time
+void hash_scalar(const limbs256* inputs, limbs256* outputs) {
+    outputs[0] = gen_keyhash(inputs[0], 32).limbs;
+}
+
+struct batch_kernel {
+    batch_fn function;
+    size_t   lanes;
+};
+
+batch_kernel active_kernel() {
+    switch (active_kernel_isa()) {
+#if defined(LEA_X86)
+        case kernel_isa::AVX512: return batch_kernel{hash_avx512, GROUPS * 8};
+        case kernel_isa::AVX2: return batch_kernel{hash_avx2, GROUPS * 4};
+#endif
+        case kernel_isa::SCALAR: return batch_kernel{hash_scalar, 1};
+        default: return batch_kernel{hash_sse2, GROUPS * 2};
+    }
+}
+
+}  // namespace
+
+size_t keyhash_batch_lanes() { return active_kernel().lanes; }
+
+size_t gen_keyhash_batch(span<const limbs256> inputs,
+                         span<const size_t>   lengths,
+                         span<limbs256>       outputs) {
+    if (inputs.size() != lengths.size() || inputs.size() != outputs.size()
+        || std::count(lengths.begin(), lengths.end(), size_t{0}) != 0) {
+        return 0;
+    }
+
+    batch_kernel kernel = active_kernel();
+
+    limbs256 wrapped[MAX_LANES];
+    limbs256 hashed[MAX_LANES];
+    for (size_t begin = 0; begin < inputs.size(); begin += kernel.lanes) {
+        size_t count = std::min(kernel.lanes, inputs.size() - begin);
+
+        // the first expansion wraps short inputs, later ones never do
+        for (size_t i = 0; i < kernel.lanes; i++) {
+            wrapped[i] = i < count
+                           ? wrap_input(inputs[begin + i], lengths[begin + i])
+                           : limbs256{};
+        }
+
+        kernel.function(wrapped, hashed);
+        std::copy_n(hashed, count, outputs.begin() + begin);
+    }
+
+    return inputs.size();
+}
+
+size_t gen_keyhash_batch(span<const std::bitset<256>> inputs,
+                         span<const size_t>           lengths,
+                         span<keyhash>                outputs) {
+    if (inputs.size() != lengths.size() || inputs.size() != outputs.size()
+        || std::count(lengths.begin(), lengths.end(), size_t{0}) != 0) {
+        return 0;
+    }
+
+    // convert one lane group at a time so the limbs stay in cache
+    constexpr size_t STEP = MAX_LANES * 4;
+
+    limbs256 limbs[STEP];
+    for (size_t begin = 0; begin < inputs.size(); begin += STEP) {
+        size_t count = std::min(STEP, inputs.size() - begin);
+        for (size_t i = 0; i < count; i++) {
+            limbs[i] = to_limbs(inputs[begin + i]);
+        }
+
+        gen_keyhash_batch(span<const limbs256>(limbs, count),
+                          lengths.subspan(begin, count),
+                          span<limbs256>(limbs, count));
+
+        for (size_t i = 0; i < count; i++) {
+            outputs[begin + i] = keyhash{limbs[i]};
+        }
+    }
+
+    return inputs.size();
+}
+
+}  // namespace lea
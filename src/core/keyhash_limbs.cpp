@@ -0,0 +1,275 @@
+#include "keyhash_limbs.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+
+#include "dispatch.hpp"
+#include "instrument.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEA_X86 1
+#define LEA_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#else
+#define LEA_TARGET(isa)
+#endif
+
+namespace lea {
+
+namespace {
+
+constexpr uint64_t EVEN_BITS  = 0x5555'5555'5555'5555ULL;
+constexpr uint64_t ODD_BITS   = 0xAAAA'AAAA'AAAA'AAAAULL;
+constexpr uint64_t LOW_7_BITS = 0x7F7F'7F7F'7F7F'7F7FULL;
+constexpr uint64_t HIGH_BITS  = 0x8080'8080'8080'8080ULL;
+constexpr uint64_t LOW_NIBBLE = 0x0F0F'0F0F'0F0F'0F0FULL;
+
+// bits 0, PRIME2, 2 * PRIME2, ... as flipped by intermittent_bit_flip
+constexpr limbs256 make_flip_mask() {
+    limbs256 mask{};
+    for (size_t i = 0; i < 256; i += PRIME2) {
+        mask[i / 64] |= uint64_t{1} << (i % 64);
+    }
+    return mask;
+}
+
+constexpr std::array<uint8_t, 256> make_sbox() {
+    std::array<uint8_t, 256> sbox{};
+    for (uint32_t x = 0; x < 256; x++) {
+        uint32_t result = (x * PRIME1) ^ (x * x);
+        sbox[x]         = static_cast<uint8_t>(
+            (result & 0xFF) ^ ((result >> 8) & 0xFF) ^ ((result >> 16) & 0xFF)
+            ^ ((result >> 24) & 0xFF));
+    }
+    return sbox;
+}
+
+constexpr limbs256                 FLIP_MASK = make_flip_mask();
+constexpr std::array<uint8_t, 256> SBOX      = make_sbox();
+
+// spread_even places the 32 low bits of x at the even bit positions of the
+// result, compact_even gathers the even bit positions back into the low 32
+struct shift_bits {
+    static uint64_t spread_even(uint64_t x) {
+        x &= 0xFFFF'FFFFULL;
+        x  = (x | (x << 16)) & 0x0000'FFFF'0000'FFFFULL;
+        x  = (x | (x << 8)) & 0x00FF'00FF'00FF'00FFULL;
+        x  = (x | (x << 4)) & 0x0F0F'0F0F'0F0F'0F0FULL;
+        x  = (x | (x << 2)) & 0x3333'3333'3333'3333ULL;
+        x  = (x | (x << 1)) & EVEN_BITS;
+        return x;
+    }
+
+    static uint64_t compact_even(uint64_t x) {
+        x &= EVEN_BITS;
+        x  = (x | (x >> 1)) & 0x3333'3333'3333'3333ULL;
+        x  = (x | (x >> 2)) & 0x0F0F'0F0F'0F0F'0F0FULL;
+        x  = (x | (x >> 4)) & 0x00FF'00FF'00FF'00FFULL;
+        x  = (x | (x >> 8)) & 0x0000'FFFF'0000'FFFFULL;
+        x  = (x | (x >> 16)) & 0xFFFF'FFFFULL;
+        return x;
+    }
+};
+
+#if defined(LEA_X86)
+// only inline, GCC refuses always_inline bmi2 code in the templates below;
+// it still inlines these into the bmi2 kernels
+struct pdep_bits {
+    LEA_TARGET("bmi2") static uint64_t spread_even(uint64_t x) {
+        return _pdep_u64(x, EVEN_BITS);
+    }
+
+    LEA_TARGET("bmi2") static uint64_t compact_even(uint64_t x) {
+        return _pext_u64(x, EVEN_BITS);
+    }
+};
+#endif
+
+inline uint64_t reverse_bits(uint64_t x) {
+    x = ((x >> 1) & EVEN_BITS) | ((x & EVEN_BITS) << 1);
+    x = ((x >> 2) & 0x3333'3333'3333'3333ULL)
+      | ((x & 0x3333'3333'3333'3333ULL) << 2);
+    x = ((x >> 4) & LOW_NIBBLE) | ((x & LOW_NIBBLE) << 4);
+    return __builtin_bswap64(x);
+}
+
+// byte-wise x * PRIME1 (x + (x << 4) truncated to 8 bits) without carries
+// crossing byte boundaries
+inline uint64_t bytewise_times_prime1(uint64_t x) {
+    uint64_t shifted = (x << 4) & ~LOW_NIBBLE;
+    return ((x & LOW_7_BITS) + (shifted & LOW_7_BITS))
+         ^ ((x ^ shifted) & HIGH_BITS);
+}
+
+static_assert(PRIME1 == 17, "bytewise_times_prime1 assumes PRIME1 == 17");
+
+// even bits take the input in reverse bit order, odd bits the flipped
+// byte * PRIME1 transform
+template <typename Bits>
+__attribute__((always_inline)) inline limbs512 expand_with(
+    const limbs256& wrapping_input) {
+    limbs512 expanded_input;
+    for (size_t i = 0; i < 4; i++) {
+        uint64_t reversed = reverse_bits(wrapping_input[3 - i]);
+        uint64_t padding  = ~bytewise_times_prime1(wrapping_input[i]);
+
+        expanded_input[2 * i] = Bits::spread_even(reversed)
+                              | (Bits::spread_even(padding) << 1);
+        expanded_input[2 * i + 1] = Bits::spread_even(reversed >> 32)
+                                  | (Bits::spread_even(padding >> 32) << 1);
+    }
+    return expanded_input;
+}
+
+template <typename Bits>
+__attribute__((always_inline)) inline limbs256 compact_with(
+    const limbs512& input_limbs) {
+    limbs256 compacted_input;
+    for (size_t i = 0; i < 4; i++) {
+        uint64_t low  = input_limbs[2 * i] ^ (input_limbs[2 * i] >> 1);
+        uint64_t high = input_limbs[2 * i + 1] ^ (input_limbs[2 * i + 1] >> 1);
+        compacted_input[i] = Bits::compact_even(low)
+                           | (Bits::compact_even(high) << 32);
+    }
+    return compacted_input;
+}
+
+#if defined(LEA_X86)
+LEA_TARGET("bmi2")
+limbs512 expand_bmi2(const limbs256& wrapping_input) {
+    return expand_with<pdep_bits>(wrapping_input);
+}
+
+LEA_TARGET("bmi2")
+limbs256 compact_bmi2(const limbs512& input_limbs) {
+    return compact_with<pdep_bits>(input_limbs);
+}
+
+// the avx2 level and above come with bmi2, see kernel_isa_supported
+bool bmi2_active() { return active_kernel_isa() >= kernel_isa::AVX2; }
+#endif
+
+}  // namespace
+
+limbs256 to_limbs(const std::bitset<256>& bits) {
+    return keyhash(bits).limbs;
+}
+
+std::bitset<256> to_bitset(const limbs256& limbs) {
+    return keyhash(limbs).bits();
+}
+
+keyhash gen_keyhash(const limbs256& input_limbs, size_t input_byte_length) {
+    if (input_byte_length == 0) { return keyhash{}; }
+
+    LEA_STAGE(KEYHASH);
+    limbs512 expanded_limbs
+        = bit_interleaving_expand(input_limbs, input_byte_length);
+
+    limbs256 compacted_limbs = sequential_bit_compact(expanded_limbs);
+
+    for (uint8_t i = 0; i < EXPAND_COMPACT_ITERATIONS; i++) {
+        if (i > 0) {
+            expanded_limbs  = bit_interleaving_expand(compacted_limbs, 32);
+            compacted_limbs = sequential_bit_compact(expanded_limbs);
+        }
+
+        size_t count = 0;
+        for (uint64_t limb : compacted_limbs) {
+            count += __builtin_popcountll(limb);
+        }
+        compacted_limbs
+            = rotate_left(compacted_limbs, (count * PRIMES[i]) % 256);
+
+        mix(compacted_limbs, i + 1);
+        apply_sbox(compacted_limbs);
+        intermittent_bit_flip(compacted_limbs);
+    }
+
+    return keyhash{compacted_limbs};
+}
+
+limbs256 wrap_input(const limbs256& input_limbs, size_t input_byte_length) {
+    // full-length inputs pass straight through, empty ones have nothing to
+    // repeat and would never fill the 32 bytes
+    if (input_byte_length >= 32) { return input_limbs; }
+    if (input_byte_length == 0) { return limbs256{}; }
+
+    std::array<uint8_t, 32> bytes;
+    for (size_t i = 0; i < input_byte_length; i++) {
+        bytes[i] = static_cast<uint8_t>(input_limbs[i / 8] >> (8 * (i % 8)));
+    }
+
+    // a prefix that is a whole number of periods keeps the wrap when copied
+    for (size_t filled = input_byte_length; filled < 32; filled *= 2) {
+        std::copy_n(bytes.begin(),
+                    std::min<size_t>(filled, 32 - filled),
+                    bytes.begin() + filled);
+    }
+
+    limbs256 wrapping_input{};
+    for (size_t i = 0; i < 32; i++) {
+        wrapping_input[i / 8] |= uint64_t{bytes[i]} << (8 * (i % 8));
+    }
+    return wrapping_input;
+}
+
+limbs512 bit_interleaving_expand(const limbs256& input_limbs,
+                                 size_t          input_byte_length) {
+    LEA_STAGE(EXPAND);
+    limbs256 wrapping_input = wrap_input(input_limbs, input_byte_length);
+#if defined(LEA_X86)
+    if (bmi2_active()) { return expand_bmi2(wrapping_input); }
+#endif
+    return expand_with<shift_bits>(wrapping_input);
+}
+
+limbs256 sequential_bit_compact(const limbs512& input_limbs) {
+    LEA_STAGE(COMPACT);
+#if defined(LEA_X86)
+    if (bmi2_active()) { return compact_bmi2(input_limbs); }
+#endif
+    return compact_with<shift_bits>(input_limbs);
+}
+
+limbs256 rotate_left(const limbs256& limbs, size_t shift) {
+    LEA_STAGE(ROTATE);
+    size_t limb_shift = shift / 64;
+    size_t bit_shift  = shift % 64;
+
+    limbs256 rotated;
+    for (size_t i = 0; i < 4; i++) {
+        uint64_t upper = limbs[(i - limb_shift) & 3];
+        uint64_t lower = limbs[(i - limb_shift - 1) & 3];
+        // split the right shift so a zero bit_shift does not shift by 64
+        rotated[i] = (upper << bit_shift) | ((lower >> 1) >> (63 - bit_shift));
+    }
+    return rotated;
+}
+
+void intermittent_bit_flip(limbs256& limbs) {
+    LEA_STAGE(FLIP);
+    for (size_t i = 0; i < 4; i++) { limbs[i] ^= FLIP_MASK[i]; }
+}
+
+void apply_sbox(limbs256& limbs) {
+    LEA_STAGE(SBOX);
+    for (uint64_t& limb : limbs) {
+        uint64_t result = 0;
+        for (size_t j = 0; j < 64; j += 8) {
+            result |= static_cast<uint64_t>(SBOX[(limb >> j) & 0xFF]) << j;
+        }
+        limb = result;
+    }
+}
+
+void mix(limbs256& limbs, size_t round) {
+    LEA_STAGE(MIX);
+    // bit j flips when j + round * PRIME2 is odd
+    uint64_t mask = ((round * PRIME2) % 2) ? EVEN_BITS : ODD_BITS;
+    for (uint64_t& limb : limbs) { limb ^= mask; }
+}
+
+}  // namespace lea
@@ -0,0 +1,195 @@
+#include "lz.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "instrument.hpp"
+
+namespace lea {
+
+namespace {
+
+constexpr size_t MIN_MATCH    = 4;
+constexpr size_t MAX_DISTANCE = 65535;
+
+// the format ends every block in literals: the last match ends 5 bytes and
+// starts 12 bytes before the end at the latest
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT   = 12;
+
+constexpr unsigned HASH_BITS = 12;
+
+// a step grows by one every 64 probes without a match
+constexpr unsigned SKIP_SHIFT = 6;
+
+uint32_t load32(const uint8_t* p) noexcept {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hash4(uint32_t sequence) noexcept {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// a length field continued in bytes of 255 and a final smaller byte
+uint8_t* put_length(uint8_t* op, size_t length) noexcept {
+    for (; length >= 255; length -= 255) { *op++ = 255; }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+}
+
+bool get_length(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (ip == end) { return false; }
+        byte    = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// the worst case of a sequence with these lengths, a bound and not exact
+size_t sequence_bound(size_t literals, size_t match) noexcept {
+    return 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+}
+
+}  // namespace
+
+size_t lz_compress_bound(size_t size) noexcept {
+    return size + size / 255 + 16;
+}
+
+size_t lz_compress(byte_view input, mutable_byte_view output) noexcept {
+    LEA_STAGE(COMPRESS);
+    const uint8_t* in     = input.data();
+    size_t         size   = input.size();
+    uint8_t*       op     = output.data();
+    uint8_t*       op_end = output.data() + output.size();
+    size_t         anchor = 0;
+
+    if (size > MATCH_LIMIT) {
+        std::array<uint32_t, size_t{1} << HASH_BITS> table{};
+        size_t limit    = size - MATCH_LIMIT;
+        size_t position = 1;
+
+        while (position < limit) {
+            // probe forward, faster the longer nothing matches
+            size_t   candidate = 0;
+            unsigned probes    = 1u << SKIP_SHIFT;
+            bool     found     = false;
+            while (position < limit) {
+                uint32_t sequence = load32(in + position);
+                uint32_t h        = hash4(sequence);
+                candidate         = table[h];
+                table[h]          = static_cast<uint32_t>(position);
+                if (position - candidate <= MAX_DISTANCE
+                    && load32(in + candidate) == sequence) {
+                    found = true;
+                    break;
+                }
+                position += probes++ >> SKIP_SHIFT;
+            }
+            if (!found) { break; }
+
+            while (position > anchor && candidate > 0
+                   && in[position - 1] == in[candidate - 1]) {
+                position--;
+                candidate--;
+            }
+            size_t length = MIN_MATCH;
+            while (position + length < size - LAST_LITERALS
+                   && in[position + length] == in[candidate + length]) {
+                length++;
+            }
+
+            size_t literals = position - anchor;
+            if (sequence_bound(literals, length)
+                > static_cast<size_t>(op_end - op)) {
+                return 0;
+            }
+
+            size_t   match_code = length - MIN_MATCH;
+            uint8_t* token      = op++;
+            *token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4
+                                          | std::min<size_t>(match_code, 15));
+            if (literals >= 15) { op = put_length(op, literals - 15); }
+            std::memcpy(op, in + anchor, literals);
+            op += literals;
+
+            size_t distance = position - candidate;
+            *op++           = static_cast<uint8_t>(distance);
+            *op++           = static_cast<uint8_t>(distance >> 8);
+            if (match_code >= 15) { op = put_length(op, match_code - 15); }
+
+            position += length;
+            anchor    = position;
+            if (position < limit) {
+                table[hash4(load32(in + position - 2))]
+                    = static_cast<uint32_t>(position - 2);
+            }
+        }
+    }
+
+    size_t literals = size - anchor;
+    if (sequence_bound(literals, 0) > static_cast<size_t>(op_end - op)) {
+        return 0;
+    }
+    *op++ = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15) { op = put_length(op, literals - 15); }
+    std::memcpy(op, in + anchor, literals);
+    op += literals;
+    return static_cast<size_t>(op - output.data());
+}
+
+bool lz_decompress(byte_view input, mutable_byte_view output) noexcept {
+    LEA_STAGE(DECOMPRESS);
+    const uint8_t* ip     = input.data();
+    const uint8_t* ip_end = input.data() + input.size();
+    uint8_t*       op     = output.data();
+    uint8_t*       op_end = output.data() + output.size();
+
+    while (true) {
+        if (ip == ip_end) { return false; }
+        uint8_t token    = *ip++;
+        size_t  literals = token >> 4;
+        if (literals == 15 && !get_length(ip, ip_end, literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(ip_end - ip)
+            || literals > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+        std::memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        // the block ends after the literals of its last sequence
+        if (ip == ip_end) { return op == op_end; }
+
+        if (ip_end - ip < 2) { return false; }
+        size_t distance  = ip[0] | size_t{ip[1]} << 8;
+        ip              += 2;
+        if (distance == 0
+            || distance > static_cast<size_t>(op - output.data())) {
+            return false;
+        }
+
+        size_t length = token & 15;
+        if (length == 15 && !get_length(ip, ip_end, length)) { return false; }
+        length += MIN_MATCH;
+        if (length > static_cast<size_t>(op_end - op)) { return false; }
+
+        // an overlapping match repeats its last distance bytes
+        const uint8_t* match = op - distance;
+        if (distance >= length) {
+            std::memcpy(op, match, length);
+            op += length;
+        } else {
+            for (size_t i = 0; i < length; i++) { *op++ = match[i]; }
+        }
+    }
+}
+
+}  // namespace lea
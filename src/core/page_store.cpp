@@ -0,0 +1,351 @@
+#include "page_store.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "buffer_pool.hpp"
+#include "instrument.hpp"
+
+namespace lea {
+
+struct page_store::frame {
+    uint8_t*              data = nullptr;
+    uint64_t              index = 0;
+    bool                  used  = false;
+    std::atomic<uint32_t> pins{0};
+    std::atomic<bool>     referenced{false};
+    std::atomic<bool>     dirty{false};
+};
+
+// hits pin a frame under the shared lock, misses take the exclusive lock
+// to pick a victim and do their I/O under it
+struct page_store::shard {
+    shard(size_t capacity, size_t page_size)
+        : frames(capacity), memory(capacity * page_size) {
+        for (size_t i = 0; i < capacity; i++) {
+            frames[i].data = memory.data() + i * page_size;
+        }
+        index.reserve(capacity);
+    }
+
+    std::shared_mutex                    mutex;
+    std::vector<frame>                   frames;
+    std::vector<uint8_t>                 memory;
+    std::unordered_map<uint64_t, size_t> index;
+    size_t                               hand = 0;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+page_store::page_store(const keyhash& key, page_store_options options)
+    : context_(key), page_size_(options.page_size) {
+    size_t shard_count = std::max<size_t>(options.shards, 1);
+    size_t per_shard   = std::max<size_t>(
+        (options.capacity + shard_count - 1) / shard_count, 1);
+
+    for (size_t i = 0; i < shard_count; i++) {
+        shards_.push_back(std::make_unique<shard>(per_shard, page_size_));
+    }
+}
+
+page_store::~page_store() { flush(); }
+
+bool page_store::open(int fd) {
+    struct stat file_stat;
+    if (page_size_ == 0 || page_size_ % 32 != 0) {
+        errno = EINVAL;
+        return false;
+    }
+    if (fstat(fd, &file_stat) != 0) { return false; }
+    uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+    if (file_size % 32 != 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    fd_ = fd;
+    pages_.store((file_size + page_size_ - 1) / page_size_,
+                 std::memory_order_relaxed);
+    return true;
+}
+
+uint64_t page_store::page_count() const noexcept {
+    return pages_.load(std::memory_order_relaxed);
+}
+
+void page_store::note_pages(uint64_t count) noexcept {
+    uint64_t known = pages_.load(std::memory_order_relaxed);
+    while (known < count
+           && !pages_.compare_exchange_weak(
+               known, count, std::memory_order_relaxed)) {}
+}
+
+page_store::page page_store::pin(uint64_t index) {
+    if (fd_ < 0) {
+        errno = EBADF;
+        return {};
+    }
+    shard& s = *shards_[index % shards_.size()];
+
+    {
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        auto                                it = s.index.find(index);
+        if (it != s.index.end()) {
+            frame& f = s.frames[it->second];
+            f.pins.fetch_add(1, std::memory_order_relaxed);
+            f.referenced.store(true, std::memory_order_relaxed);
+            s.hits.fetch_add(1, std::memory_order_relaxed);
+            return page(&f, index, page_size_);
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(s.mutex);
+
+    // another miss on the same page may have loaded it meanwhile
+    auto it = s.index.find(index);
+    if (it != s.index.end()) {
+        frame& f = s.frames[it->second];
+        f.pins.fetch_add(1, std::memory_order_relaxed);
+        f.referenced.store(true, std::memory_order_relaxed);
+        s.hits.fetch_add(1, std::memory_order_relaxed);
+        return page(&f, index, page_size_);
+    }
+    s.misses.fetch_add(1, std::memory_order_relaxed);
+
+    size_t slot;
+    if (!claim_frame(s, slot)) { return {}; }
+
+    frame& f = s.frames[slot];
+    if (!load(index, f.data)) { return {}; }
+
+    f.index = index;
+    f.used  = true;
+    f.dirty.store(false, std::memory_order_relaxed);
+    f.referenced.store(true, std::memory_order_relaxed);
+    f.pins.store(1, std::memory_order_relaxed);
+    s.index.emplace(index, slot);
+    return page(&f, index, page_size_);
+}
+
+bool page_store::claim_frame(shard& s, size_t& slot) {
+    // two laps clear every reference bit, only pins can stop the sweep
+    for (size_t step = 0; step < 2 * s.frames.size(); step++) {
+        size_t position = s.hand;
+        frame& f        = s.frames[position];
+        s.hand          = (s.hand + 1) % s.frames.size();
+
+        if (!f.used) {
+            slot = position;
+            return true;
+        }
+        // acquire pairs with the release of the last unpin, so the page's
+        // bytes are seen as its writers left them
+        if (f.pins.load(std::memory_order_acquire) != 0
+            || f.referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+
+        // unpinned, so nobody is writing the page while it is enciphered
+        if (f.dirty.load(std::memory_order_acquire)) {
+            if (!write_back(f.index, f.data, 1)) { return false; }
+            f.dirty.store(false, std::memory_order_relaxed);
+        }
+        s.index.erase(f.index);
+        f.used = false;
+        s.evictions.fetch_add(1, std::memory_order_relaxed);
+
+        slot = position;
+        return true;
+    }
+
+    errno = EBUSY;
+    return false;
+}
+
+bool page_store::load(uint64_t index, uint8_t* data) {
+    std::pmr::vector<uint8_t> ciphertext(page_size_, thread_buffer_pool());
+
+    LEA_STAGE(READ);
+    size_t filled = 0;
+    while (filled < page_size_) {
+        ssize_t n = pread(fd_,
+                          ciphertext.data() + filled,
+                          page_size_ - filled,
+                          static_cast<off_t>(index * page_size_ + filled));
+        if (n == 0) { break; }
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        filled += static_cast<size_t>(n);
+    }
+
+    // past the end of the file the page is zeros
+    size_t blocks = filled / 32;
+    context_.decrypt_range(byte_view(ciphertext.data(), blocks * 32),
+                           0,
+                           blocks,
+                           mutable_byte_view(data, page_size_));
+    std::fill(data + blocks * 32, data + page_size_, 0);
+    return true;
+}
+
+bool page_store::write_back(uint64_t       first,
+                            const uint8_t* plain,
+                            size_t         count) {
+    size_t                    bytes = count * page_size_;
+    std::pmr::vector<uint8_t> ciphertext(bytes, thread_buffer_pool());
+    context_.encrypt_range(ciphertext, 0, byte_view(plain, bytes));
+
+    LEA_STAGE(WRITE);
+    size_t written = 0;
+    while (written < bytes) {
+        ssize_t n = pwrite(fd_,
+                           ciphertext.data() + written,
+                           bytes - written,
+                           static_cast<off_t>(first * page_size_ + written));
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    writebacks_.fetch_add(count, std::memory_order_relaxed);
+    writes_.fetch_add(1, std::memory_order_relaxed);
+    note_pages(first + count);
+    return true;
+}
+
+bool page_store::read(uint64_t offset, mutable_byte_view output) {
+    size_t done = 0;
+    while (done < output.size()) {
+        uint64_t position = offset + done;
+        size_t   in_page  = position % page_size_;
+        size_t   n = std::min(page_size_ - in_page, output.size() - done);
+
+        page p = pin(position / page_size_);
+        if (!p) { return false; }
+        std::copy_n(p.bytes().data() + in_page, n, output.data() + done);
+        done += n;
+    }
+    return true;
+}
+
+bool page_store::write(uint64_t offset, byte_view data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        uint64_t position = offset + done;
+        size_t   in_page  = position % page_size_;
+        size_t   n = std::min(page_size_ - in_page, data.size() - done);
+
+        page p = pin(position / page_size_);
+        if (!p) { return false; }
+        std::copy_n(data.data() + done, n, p.mutable_bytes().data() + in_page);
+        done += n;
+    }
+    return true;
+}
+
+bool page_store::flush() {
+    if (fd_ < 0) { return true; }
+
+    // shards are always locked in order, and pin never holds two
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (const auto& s : shards_) { locks.emplace_back(s->mutex); }
+
+    std::vector<frame*> dirty;
+    for (const auto& s : shards_) {
+        for (frame& f : s->frames) {
+            if (f.used && f.dirty.load(std::memory_order_acquire)) {
+                dirty.push_back(&f);
+            }
+        }
+    }
+    std::sort(dirty.begin(), dirty.end(), [](const frame* a, const frame* b) {
+        return a->index < b->index;
+    });
+
+    // runs of adjacent pages are gathered and written with one call
+    std::pmr::vector<uint8_t> run(thread_buffer_pool());
+    for (size_t begin = 0; begin < dirty.size();) {
+        size_t end = begin + 1;
+        while (end < dirty.size()
+               && dirty[end]->index == dirty[end - 1]->index + 1) {
+            end++;
+        }
+
+        run.resize((end - begin) * page_size_);
+        for (size_t i = begin; i < end; i++) {
+            dirty[i]->dirty.store(false, std::memory_order_relaxed);
+            std::copy_n(dirty[i]->data,
+                        page_size_,
+                        run.data() + (i - begin) * page_size_);
+        }
+        if (!write_back(dirty[begin]->index, run.data(), end - begin)) {
+            for (size_t i = begin; i < end; i++) {
+                dirty[i]->dirty.store(true, std::memory_order_relaxed);
+            }
+            return false;
+        }
+        begin = end;
+    }
+    return true;
+}
+
+page_store_counters page_store::counters() const {
+    page_store_counters total;
+    for (const auto& s : shards_) {
+        total.hits      += s->hits.load(std::memory_order_relaxed);
+        total.misses    += s->misses.load(std::memory_order_relaxed);
+        total.evictions += s->evictions.load(std::memory_order_relaxed);
+    }
+    total.writebacks = writebacks_.load(std::memory_order_relaxed);
+    total.writes     = writes_.load(std::memory_order_relaxed);
+    return total;
+}
+
+page_store::page::~page() {
+    if (frame_ != nullptr) {
+        frame_->pins.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+page_store::page::page(page&& other) noexcept
+    : frame_(std::exchange(other.frame_, nullptr)),
+      index_(other.index_),
+      size_(other.size_) {}
+
+page_store::page& page_store::page::operator=(page&& other) noexcept {
+    if (this != &other) {
+        if (frame_ != nullptr) {
+            frame_->pins.fetch_sub(1, std::memory_order_release);
+        }
+        frame_ = std::exchange(other.frame_, nullptr);
+        index_ = other.index_;
+        size_  = other.size_;
+    }
+    return *this;
+}
+
+byte_view page_store::page::bytes() const noexcept {
+    return frame_ == nullptr ? byte_view() : byte_view(frame_->data, size_);
+}
+
+mutable_byte_view page_store::page::mutable_bytes() noexcept {
+    if (frame_ == nullptr) { return {}; }
+    frame_->dirty.store(true, std::memory_order_release);
+    return mutable_byte_view(frame_->data, size_);
+}
+
+}  // namespace lea
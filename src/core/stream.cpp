@@ -0,0 +1,189 @@
+#include "stream.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace lea {
+
+namespace {
+
+std::vector<operation> reversed_operations(const keyhash& key) {
+    std::vector<operation> operations = get_operations(key.bits());
+    std::reverse(operations.begin(), operations.end());
+    return operations;
+}
+
+// permutes block_count blocks onto the end of output
+template <typename Bytes>
+void append_blocks(Bytes&                   output,
+                   const uint8_t*           input,
+                   size_t                   block_count,
+                   const block_permutation& permutation) {
+    if (block_count == 0) { return; }
+
+    size_t offset = output.size();
+    output.resize(offset + block_count * 32);
+    permute_blocks(input, output.data() + offset, block_count, permutation);
+}
+
+template <typename Bytes>
+void append_block(Bytes&                         output,
+                  const std::array<uint8_t, 32>& block,
+                  const block_permutation&       permutation) {
+    auto permuted = permute_block(block, permutation);
+    output.insert(output.end(), permuted.begin(), permuted.end());
+}
+
+}  // namespace
+
+encryptor::encryptor(const keyhash& key)
+    : permutation_(std::make_unique<block_permutation>(
+        compile_cipher(get_operations(key.bits())))) {}
+
+std::vector<uint8_t> encryptor::update(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> encrypted_data;
+    update_into(encrypted_data, data, size);
+    return encrypted_data;
+}
+
+std::vector<uint8_t> encryptor::update(const std::vector<uint8_t>& data) {
+    return update(data.data(), data.size());
+}
+
+std::pmr::vector<uint8_t> encryptor::update(
+    byte_view data, std::pmr::memory_resource* resource) {
+    std::pmr::vector<uint8_t> encrypted_data(resource);
+    update_into(encrypted_data, data.data(), data.size());
+    return encrypted_data;
+}
+
+std::vector<uint8_t> encryptor::finish() {
+    std::vector<uint8_t> encrypted_data;
+    finish_into(encrypted_data);
+    return encrypted_data;
+}
+
+std::pmr::vector<uint8_t> encryptor::finish(
+    std::pmr::memory_resource* resource) {
+    std::pmr::vector<uint8_t> encrypted_data(resource);
+    finish_into(encrypted_data);
+    return encrypted_data;
+}
+
+template <typename Bytes>
+void encryptor::update_into(Bytes&         encrypted_data,
+                            const uint8_t* data,
+                            size_t         size) {
+    if (size == 0) { return; }
+    encrypted_data.reserve((carry_len_ + size) / 32 * 32);
+
+    // complete the carried block first
+    if (carry_len_ != 0) {
+        size_t take = std::min(size, 32 - carry_len_);
+        std::memcpy(carry_.data() + carry_len_, data, take);
+        carry_len_ += take;
+        data       += take;
+        size       -= take;
+
+        if (carry_len_ < 32) { return; }
+        append_block(encrypted_data, carry_, *permutation_);
+        carry_len_ = 0;
+    }
+
+    size_t block_count = size / 32;
+    append_blocks(encrypted_data, data, block_count, *permutation_);
+
+    carry_len_ = size % 32;
+    std::memcpy(carry_.data(), data + block_count * 32, carry_len_);
+}
+
+template <typename Bytes>
+void encryptor::finish_into(Bytes& encrypted_data) {
+    if (carry_len_ != 0) {
+        std::fill(carry_.begin() + carry_len_,
+                  carry_.end(),
+                  static_cast<uint8_t>(32 - carry_len_));
+        append_block(encrypted_data, carry_, *permutation_);
+        carry_len_ = 0;
+    }
+}
+
+decryptor::decryptor(const keyhash& key)
+    : permutation_(std::make_unique<block_permutation>(
+        compile_decipher(reversed_operations(key)))) {}
+
+std::vector<uint8_t> decryptor::update(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> decrypted_data;
+    update_into(decrypted_data, data, size);
+    return decrypted_data;
+}
+
+std::vector<uint8_t> decryptor::update(const std::vector<uint8_t>& data) {
+    return update(data.data(), data.size());
+}
+
+std::pmr::vector<uint8_t> decryptor::update(
+    byte_view data, std::pmr::memory_resource* resource) {
+    std::pmr::vector<uint8_t> decrypted_data(resource);
+    update_into(decrypted_data, data.data(), data.size());
+    return decrypted_data;
+}
+
+std::vector<uint8_t> decryptor::finish() {
+    std::vector<uint8_t> decrypted_data;
+    finish_into(decrypted_data);
+    return decrypted_data;
+}
+
+std::pmr::vector<uint8_t> decryptor::finish(
+    std::pmr::memory_resource* resource) {
+    std::pmr::vector<uint8_t> decrypted_data(resource);
+    finish_into(decrypted_data);
+    return decrypted_data;
+}
+
+template <typename Bytes>
+void decryptor::update_into(Bytes&         decrypted_data,
+                            const uint8_t* data,
+                            size_t         size) {
+    if (size == 0) { return; }
+    decrypted_data.reserve((carry_len_ + size - 1) / 32 * 32);
+
+    // between 1 and 32 bytes always stay behind, so the block finish() sees
+    // is the final one
+    if (carry_len_ != 0) {
+        if (carry_len_ + size <= 32) {
+            std::memcpy(carry_.data() + carry_len_, data, size);
+            carry_len_ += size;
+            return;
+        }
+
+        size_t take = 32 - carry_len_;
+        std::memcpy(carry_.data() + carry_len_, data, take);
+        data += take;
+        size -= take;
+        append_block(decrypted_data, carry_, *permutation_);
+    }
+
+    size_t block_count = (size - 1) / 32;
+    append_blocks(decrypted_data, data, block_count, *permutation_);
+
+    carry_len_ = size - block_count * 32;
+    std::memcpy(carry_.data(), data + block_count * 32, carry_len_);
+}
+
+template <typename Bytes>
+void decryptor::finish_into(Bytes& decrypted_data) {
+    // a dangling partial block means the ciphertext was not block aligned
+    if (carry_len_ == 32) {
+        auto last_block = permute_block(carry_, *permutation_);
+        decrypted_data.assign(last_block.begin(),
+                              last_block.end() - padding_length(last_block));
+    }
+
+    carry_len_ = 0;
+}
+
+}  // namespace lea
@@ -0,0 +1,170 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace lea {
+
+namespace {
+
+// idle threads re-check their condition at least this often; timed waits
+// also keep the pool off condition_variable::wait, whose symbol version
+// older libstdc++ runtimes lack
+constexpr std::chrono::milliseconds IDLE_WAIT{100};
+
+// lets tasks submitted from a worker land on that worker's own queue
+thread_local const thread_pool* current_pool  = nullptr;
+thread_local size_t             current_index = 0;
+
+}  // namespace
+
+thread_pool::thread_pool(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        queues_.push_back(std::make_unique<worker_queue>());
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        threads_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for (std::thread& thread : threads_) { thread.join(); }
+}
+
+size_t thread_pool::size() const noexcept { return threads_.size(); }
+
+void thread_pool::submit(task t) {
+    size_t queue_index = current_pool == this
+                           ? current_index
+                           : next_queue_.fetch_add(1) % queues_.size();
+    push(queue_index, std::move(t));
+}
+
+void thread_pool::parallel_for(
+    size_t                                     count,
+    size_t                                     grain,
+    const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) { return; }
+    grain = std::max<size_t>(grain, 1);
+
+    struct completion {
+        std::atomic<size_t>     remaining;
+        std::mutex              mutex;
+        std::condition_variable done;
+
+        // the first exception a range threw, under mutex
+        std::exception_ptr error;
+    };
+
+    auto state       = std::make_shared<completion>();
+    state->remaining = (count + grain - 1) / grain;
+
+    for (size_t begin = 0; begin < count; begin += grain) {
+        size_t end = std::min(count, begin + grain);
+        submit([state, &body, begin, end] {
+            // a throwing range still counts as done, so the caller never
+            // waits on it and body outlives every range
+            try {
+                body(begin, end);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error) { state->error = std::current_exception(); }
+            }
+            if (state->remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->done.notify_all();
+            }
+        });
+    }
+
+    // help with queued work instead of blocking right away
+    size_t thief = current_pool == this ? current_index : queues_.size();
+    while (state->remaining.load() != 0) {
+        task t;
+        if ((current_pool == this && try_pop(current_index, t))
+            || try_steal(thief, t)) {
+            t();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait_for(lock, IDLE_WAIT, [&] {
+            return state->remaining.load() == 0;
+        });
+    }
+
+    if (state->error) { std::rethrow_exception(state->error); }
+}
+
+void thread_pool::push(size_t queue_index, task t) {
+    {
+        std::lock_guard<std::mutex> lock(queues_[queue_index]->mutex);
+        queues_[queue_index]->tasks.push_back(std::move(t));
+    }
+    pending_.fetch_add(1);
+
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_.notify_one();
+}
+
+bool thread_pool::try_pop(size_t queue_index, task& t) {
+    worker_queue&               queue = *queues_[queue_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) { return false; }
+
+    t = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    pending_.fetch_sub(1);
+    return true;
+}
+
+bool thread_pool::try_steal(size_t thief_index, task& t) {
+    for (size_t i = 1; i <= queues_.size(); i++) {
+        worker_queue& queue = *queues_[(thief_index + i) % queues_.size()];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) { continue; }
+
+        t = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        pending_.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void thread_pool::worker_loop(size_t index) {
+    current_pool  = this;
+    current_index = index;
+
+    while (true) {
+        task t;
+        if (try_pop(index, t) || try_steal(index, t)) {
+            t();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_.wait_for(lock, IDLE_WAIT, [this] {
+            return stopping_ || pending_.load() > 0;
+        });
+        if (stopping_ && pending_.load() == 0) { return; }
+    }
+}
+
+}  // namespace lea
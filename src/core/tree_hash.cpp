@@ -0,0 +1,305 @@
+#include "tree_hash.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <numeric>
+#include <utility>
+
+#include "echo_hasher.hpp"
+#include "keyhash_batch.hpp"
+
+namespace lea {
+
+namespace {
+
+// "ECHOTREE" and "ECHOROOT", xored into the left node so parents, the root
+// and plain ECHO never share inputs
+constexpr uint64_t PARENT_TAG = 0x4543'484F'5452'4545ULL;
+constexpr uint64_t ROOT_TAG   = 0x4543'484F'524F'4F54ULL;
+
+// nodes combined per gen_keyhash_batch call
+constexpr size_t NODE_BATCH = 64;
+
+// parents of a level are split into ranges of this many for the pool
+constexpr size_t PARENT_GRAIN = 4096;
+
+constexpr std::array<size_t, NODE_BATCH> FULL_LENGTHS = [] {
+    std::array<size_t, NODE_BATCH> lengths{};
+    for (size_t& length : lengths) { length = KEYHASH_BYTES; }
+    return lengths;
+}();
+
+using levels = std::vector<std::vector<keyhash>>;
+
+void permute(limbs256* values, size_t count) {
+    gen_keyhash_batch(span<const limbs256>(values, count),
+                      span<const size_t>(FULL_LENGTHS.data(), count),
+                      span<limbs256>(values, count));
+}
+
+// parents[i] = P(P(left ^ tag) ^ right) ^ left for the children pair
+// (2i, 2i + 1), i below pairs
+void combine(const keyhash* children,
+             keyhash*       parents,
+             size_t         pairs,
+             uint64_t       tag) {
+    limbs256 work[NODE_BATCH];
+    for (size_t begin = 0; begin < pairs; begin += NODE_BATCH) {
+        size_t count = std::min(NODE_BATCH, pairs - begin);
+
+        for (size_t i = 0; i < count; i++) {
+            work[i]     = children[2 * (begin + i)].limbs;
+            work[i][3] ^= tag;
+        }
+        permute(work, count);
+        for (size_t i = 0; i < count; i++) {
+            const limbs256& right = children[2 * (begin + i) + 1].limbs;
+            for (size_t limb = 0; limb < 4; limb++) {
+                work[i][limb] ^= right[limb];
+            }
+        }
+        permute(work, count);
+        for (size_t i = 0; i < count; i++) {
+            const limbs256& left = children[2 * (begin + i)].limbs;
+            for (size_t limb = 0; limb < 4; limb++) {
+                work[i][limb] ^= left[limb];
+            }
+            parents[begin + i] = keyhash{work[i]};
+        }
+    }
+}
+
+size_t leaf_count_for(uint64_t size, size_t leaf_size) {
+    return size == 0 ? 1 : (size + leaf_size - 1) / leaf_size;
+}
+
+// replaces every level above the leaves
+void build_parents(levels& tree, thread_pool& pool) {
+    tree.resize(1);
+    while (tree.back().size() > 1) {
+        const std::vector<keyhash>& children = tree.back();
+        std::vector<keyhash>        parents((children.size() + 1) / 2);
+
+        pool.parallel_for(
+            children.size() / 2, PARENT_GRAIN, [&](size_t begin, size_t end) {
+                combine(&children[2 * begin],
+                        &parents[begin],
+                        end - begin,
+                        PARENT_TAG);
+            });
+        if (children.size() % 2) { parents.back() = children.back(); }
+
+        tree.push_back(std::move(parents));
+    }
+}
+
+// recomputes the ancestors of dirty, a sorted list of leaf indices
+void update_parents(levels& tree, std::vector<size_t> dirty) {
+    std::vector<keyhash> pairs;
+    std::vector<keyhash> parents;
+    std::vector<size_t>  combined;
+
+    for (size_t level = 0; level + 1 < tree.size(); level++) {
+        const std::vector<keyhash>& children = tree[level];
+        std::vector<keyhash>&       above    = tree[level + 1];
+
+        for (size_t& index : dirty) { index /= 2; }
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+        // gather whole pairs so they combine in batches, promote the rest
+        pairs.clear();
+        combined.clear();
+        for (size_t parent : dirty) {
+            if (2 * parent + 1 < children.size()) {
+                pairs.push_back(children[2 * parent]);
+                pairs.push_back(children[2 * parent + 1]);
+                combined.push_back(parent);
+            } else {
+                above[parent] = children[2 * parent];
+            }
+        }
+
+        parents.resize(combined.size());
+        combine(pairs.data(), parents.data(), combined.size(), PARENT_TAG);
+        for (size_t i = 0; i < combined.size(); i++) {
+            above[combined[i]] = parents[i];
+        }
+    }
+}
+
+keyhash finalize(const levels& tree, uint64_t size, size_t leaf_size) {
+    keyhash nodes[2] = {
+        tree.back()[0],
+        keyhash{limbs256{size, leaf_size, tree[0].size(), ROOT_TAG}},
+    };
+
+    keyhash root;
+    combine(nodes, &root, 1, ROOT_TAG);
+    return root;
+}
+
+byte_view leaf_bytes(byte_view data, size_t index, size_t leaf_size) {
+    size_t offset = std::min(index * leaf_size, data.size());
+    return data.subspan(offset, std::min(leaf_size, data.size() - offset));
+}
+
+// reads until size bytes arrived or the input ended, -1 on error
+ssize_t read_full(int fd, uint8_t* data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t got = ::read(fd, data + total, size - total);
+        if (got < 0) {
+            if (errno == EINTR) { continue; }
+            return -1;
+        }
+        if (got == 0) { break; }
+        total += static_cast<size_t>(got);
+    }
+    return static_cast<ssize_t>(total);
+}
+
+}  // namespace
+
+hash_tree::hash_tree(tree_options options) : options_(options) {
+    options_.leaf_size = std::max<size_t>(options_.leaf_size, 1);
+}
+
+void hash_tree::hash_leaves(byte_view          data,
+                            span<const size_t> leaves,
+                            thread_pool&       pool) {
+    pool.parallel_for(leaves.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            levels_[0][leaves[i]] = echo_hash(
+                leaf_bytes(data, leaves[i], options_.leaf_size));
+        }
+    });
+}
+
+void hash_tree::build(byte_view data, thread_pool& pool) {
+    size_ = data.size();
+
+    std::vector<size_t> leaves(leaf_count_for(size_, options_.leaf_size));
+    std::iota(leaves.begin(), leaves.end(), 0);
+
+    levels_.assign(1, std::vector<keyhash>(leaves.size()));
+    hash_leaves(data, leaves, pool);
+    build_parents(levels_, pool);
+}
+
+size_t hash_tree::rehash(byte_view          data,
+                         span<const size_t> changed_leaves,
+                         thread_pool&       pool) {
+    if (levels_.empty()) {
+        build(data, pool);
+        return leaf_count();
+    }
+
+    size_t old_count = leaf_count();
+    size_t new_count = leaf_count_for(data.size(), options_.leaf_size);
+
+    std::vector<size_t> dirty;
+    for (size_t leaf : changed_leaves) {
+        if (leaf < new_count) { dirty.push_back(leaf); }
+    }
+    // a new size changes the old last leaf and everything after it
+    if (data.size() != size_) {
+        for (size_t leaf = std::min(old_count, new_count) - 1;
+             leaf < new_count;
+             leaf++) {
+            dirty.push_back(leaf);
+        }
+    }
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+    size_ = data.size();
+    levels_[0].resize(new_count);
+    hash_leaves(data, dirty, pool);
+
+    if (new_count != old_count) {
+        build_parents(levels_, pool);
+    } else {
+        update_parents(levels_, dirty);
+    }
+    return dirty.size();
+}
+
+keyhash hash_tree::root() const {
+    if (levels_.empty()) { return keyhash{}; }
+    return finalize(levels_, size_, options_.leaf_size);
+}
+
+size_t hash_tree::leaf_count() const {
+    return levels_.empty() ? 0 : levels_[0].size();
+}
+
+const keyhash& hash_tree::leaf(size_t index) const {
+    return levels_[0][index];
+}
+
+keyhash tree_hash(byte_view data, thread_pool& pool, tree_options options) {
+    hash_tree tree(options);
+    tree.build(data, pool);
+    return tree.root();
+}
+
+bool tree_hash_file(int          fd,
+                    thread_pool& pool,
+                    keyhash&     digest,
+                    tree_options options) {
+    size_t leaf_size = std::max<size_t>(options.leaf_size, 1);
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) { return false; }
+
+    if (S_ISREG(info.st_mode) && info.st_size > 0) {
+        size_t size = static_cast<size_t>(info.st_size);
+        void*  data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) { return false; }
+
+        ::madvise(data, size, MADV_SEQUENTIAL);
+        digest = tree_hash(byte_view(static_cast<const uint8_t*>(data), size),
+                           pool,
+                           options);
+        ::munmap(data, size);
+        return true;
+    }
+
+    // a few leaves per thread in flight keeps every thread hashing while
+    // bounding the buffer
+    size_t               group = std::max<size_t>(pool.size(), 1) * 2;
+    std::vector<uint8_t> buffer(group * leaf_size);
+    levels               tree(1);
+    uint64_t             size = 0;
+
+    while (true) {
+        ssize_t got = read_full(fd, buffer.data(), buffer.size());
+        if (got < 0) { return false; }
+        if (got == 0 && size > 0) { break; }
+
+        byte_view chunk(buffer.data(), static_cast<size_t>(got));
+        size_t    first = tree[0].size();
+        size_t    count = leaf_count_for(chunk.size(), leaf_size);
+        tree[0].resize(first + count);
+
+        pool.parallel_for(count, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                tree[0][first + i] = echo_hash(leaf_bytes(chunk, i, leaf_size));
+            }
+        });
+
+        size += chunk.size();
+        if (chunk.size() < buffer.size()) { break; }
+    }
+
+    build_parents(tree, pool);
+    digest = finalize(tree, size, leaf_size);
+    return true;
+}
+
+}  // namespace lea
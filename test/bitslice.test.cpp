@@ -0,0 +1,110 @@
+#include "bitslice.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+#include "cipher.hpp"
+
+namespace {
+
+lea::keyhash random_key(std::mt19937_64& rng) {
+    std::bitset<256> bits;
+    for (size_t i = 0; i < 256; ++i) { bits[i] = rng() & 1; }
+    return lea::keyhash{bits};
+}
+
+}  // namespace
+
+TEST(BitsliceTest, EveryKernelMatchesCipherBlock) {
+    std::mt19937_64 rng(11);
+    for (lea::bitslice_kernel kernel : {lea::bitslice_kernel::SCALAR,
+                                        lea::bitslice_kernel::SSE2,
+                                        lea::bitslice_kernel::AVX2,
+                                        lea::bitslice_kernel::AVX512}) {
+        if (!lea::bitslice_supported(kernel)) { continue; }
+
+        for (size_t blocks : {1, 64, 127, 128, 300}) {
+            std::vector<uint8_t> data(blocks * 32);
+            for (auto& b : data) { b = static_cast<uint8_t>(rng()); }
+
+            lea::keyhash key         = random_key(rng);
+            auto         ops         = lea::get_operations(key.bits());
+            auto         permutation = lea::compile_cipher(ops);
+
+            std::vector<uint8_t> output(data.size());
+            lea::bitslice_permute(data.data(),
+                                  output.data(),
+                                  blocks,
+                                  permutation.source,
+                                  kernel);
+
+            for (size_t i = 0; i < blocks; ++i) {
+                std::array<uint8_t, 32> block;
+                std::copy_n(data.begin() + i * 32, 32, block.begin());
+                auto expected = lea::cipher_block(block, ops);
+                ASSERT_TRUE(std::equal(expected.begin(),
+                                       expected.end(),
+                                       output.begin() + i * 32))
+                    << "kernel " << static_cast<int>(kernel) << " block "
+                    << i << " of " << blocks;
+            }
+        }
+    }
+}
+
+TEST(BitsliceTest, InPlaceMatchesOutOfPlace) {
+    std::mt19937_64 rng(12);
+    lea::keyhash    key         = random_key(rng);
+    auto            permutation = lea::compile_cipher(lea::get_operations(key.bits()));
+
+    std::vector<uint8_t> data(257 * 32);
+    for (auto& b : data) { b = static_cast<uint8_t>(rng()); }
+
+    std::vector<uint8_t> output(data.size());
+    lea::bitslice_permute(data.data(),
+                          output.data(),
+                          257,
+                          permutation.source,
+                          lea::bitslice_best());
+    lea::bitslice_permute(data.data(),
+                          data.data(),
+                          257,
+                          permutation.source,
+                          lea::bitslice_best());
+    EXPECT_EQ(data, output);
+}
+
+TEST(BitsliceTest, PlanMatchesSource) {
+    std::mt19937_64 rng(13);
+    lea::keyhash    key = random_key(rng);
+    auto permutation    = lea::compile_cipher(lea::get_operations(key.bits()));
+    auto plan           = lea::make_bitslice_plan(permutation.source);
+
+    for (lea::bitslice_kernel kernel : {lea::bitslice_kernel::SCALAR,
+                                        lea::bitslice_kernel::SSE2,
+                                        lea::bitslice_kernel::AVX2,
+                                        lea::bitslice_kernel::AVX512}) {
+        if (!lea::bitslice_supported(kernel)) { continue; }
+
+        for (size_t blocks : {1, 63, 64, 65, 128, 200}) {
+            std::vector<uint8_t> data(blocks * 32);
+            for (auto& b : data) { b = static_cast<uint8_t>(rng()); }
+
+            std::vector<uint8_t> expected(data.size()), output(data.size());
+            lea::bitslice_permute(data.data(),
+                                  expected.data(),
+                                  blocks,
+                                  permutation.source,
+                                  kernel);
+            lea::bitslice_permute(
+                data.data(), output.data(), blocks, plan, kernel);
+            EXPECT_EQ(output, expected)
+                << "kernel " << static_cast<int>(kernel) << " blocks "
+                << blocks;
+        }
+    }
+}
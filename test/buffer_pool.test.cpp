@@ -0,0 +1,102 @@
+#include "buffer_pool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+TEST(BufferPoolTest, ReusesFreedBlocksOfTheSameClass) {
+    lea::buffer_pool pool;
+
+    void* first = pool.allocate(1000);
+    pool.deallocate(first, 1000);
+
+    // 1000 and 1024 bytes share the 1 KiB class
+    void* second = pool.allocate(1024);
+    EXPECT_EQ(second, first);
+    pool.deallocate(second, 1024);
+
+    lea::buffer_pool_counters counters = pool.counters();
+    EXPECT_EQ(counters.upstream, 1u);
+    EXPECT_EQ(counters.reused, 1u);
+}
+
+TEST(BufferPoolTest, BlocksAreAligned) {
+    lea::buffer_pool pool;
+    for (size_t size : {1, 63, 64, 65, 4096, 1 << 20}) {
+        void* p = pool.allocate(size, 8);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 64, 0u) << "size " << size;
+        pool.deallocate(p, size, 8);
+    }
+}
+
+TEST(BufferPoolTest, LargeAndOveralignedRequestsBypassThePool) {
+    lea::buffer_pool pool;
+
+    for (int i = 0; i < 2; i++) {
+        void* large = pool.allocate(size_t{32} << 20);
+        pool.deallocate(large, size_t{32} << 20);
+
+        void* aligned = pool.allocate(256, 4096);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 4096, 0u);
+        pool.deallocate(aligned, 256, 4096);
+    }
+
+    EXPECT_EQ(pool.counters().upstream, 4u);
+    EXPECT_EQ(pool.counters().reused, 0u);
+}
+
+TEST(BufferPoolTest, CacheLimitReturnsBlocksUpstream) {
+    lea::buffer_pool pool({4096});
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 4; i++) { blocks.push_back(pool.allocate(2048)); }
+    for (void* p : blocks) { pool.deallocate(p, 2048); }
+
+    // only two 2 KiB blocks fit under the limit
+    blocks.clear();
+    for (int i = 0; i < 4; i++) { blocks.push_back(pool.allocate(2048)); }
+    for (void* p : blocks) { pool.deallocate(p, 2048); }
+
+    EXPECT_EQ(pool.counters().reused, 2u);
+    EXPECT_EQ(pool.counters().upstream, 6u);
+}
+
+TEST(BufferPoolTest, PmrVectorsRecycleAcrossCalls) {
+    lea::buffer_pool pool;
+    for (int i = 0; i < 100; i++) {
+        std::pmr::vector<uint8_t> buffer(300, static_cast<uint8_t>(i), &pool);
+        EXPECT_EQ(buffer.back(), static_cast<uint8_t>(i));
+    }
+    EXPECT_EQ(pool.counters().upstream, 1u);
+}
+
+TEST(BufferPoolTest, ThreadPoolsAreDistinctPerThread) {
+    std::pmr::memory_resource* mine   = lea::thread_buffer_pool();
+    std::pmr::memory_resource* theirs = nullptr;
+    std::thread([&] { theirs = lea::thread_buffer_pool(); }).join();
+
+    EXPECT_EQ(mine, lea::thread_buffer_pool());
+    EXPECT_NE(mine, theirs);
+}
+
+TEST(BufferPoolTest, SharedPoolUnderConcurrency) {
+    lea::buffer_pool         pool;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&pool, t] {
+            for (int i = 0; i < 1000; i++) {
+                size_t size = 64 << ((t + i) % 8);
+                void*  p    = pool.allocate(size);
+                static_cast<uint8_t*>(p)[size - 1] = 1;
+                pool.deallocate(p, size);
+            }
+        });
+    }
+    for (std::thread& thread : threads) { thread.join(); }
+
+    lea::buffer_pool_counters counters = pool.counters();
+    EXPECT_EQ(counters.reused + counters.upstream, 4000u);
+    EXPECT_LE(counters.upstream, 32u);
+}
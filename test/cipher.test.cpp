@@ -2,23 +2,20 @@
 
 #include <gtest/gtest.h>
 
-#include <bitset>
+#include <memory_resource>
 #include <random>
 
+#include "buffer_pool.hpp"
 #include "cipher.hpp"
+#include "test_util.hpp"
+#include "thread_pool.hpp"
 
 using namespace lea;
-
-keyhash make_key(uint64_t seed = 0) {
-    std::bitset<256> bits;
-    std::mt19937_64  rng(seed);
-    for (size_t i = 0; i < 256; ++i) { bits[i] = rng() & 1; }
-    return keyhash{bits};
-}
+using namespace lea_test;
 
 TEST(CipherTest, EncryptDecryptBasic) {
     std::vector<uint8_t> data = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
-    keyhash              key  = make_key(42);
+    keyhash              key  = seeded_key(42);
 
     auto encrypted = encrypt(data, key);
     auto decrypted = decrypt(encrypted, key);
@@ -28,7 +25,7 @@ TEST(CipherTest, EncryptDecryptBasic) {
 
 TEST(CipherTest, EncryptDecryptEmpty) {
     std::vector<uint8_t> data;
-    keyhash              key = make_key(123);
+    keyhash              key = seeded_key(123);
 
     auto encrypted = encrypt(data, key);
     auto decrypted = decrypt(encrypted, key);
@@ -38,7 +35,7 @@ TEST(CipherTest, EncryptDecryptEmpty) {
 
 TEST(CipherTest, EncryptDecryptExactBlock) {
     std::vector<uint8_t> data(32, 0xAB);
-    keyhash              key = make_key(555);
+    keyhash              key = seeded_key(555);
 
     auto encrypted = encrypt(data, key);
     auto decrypted = decrypt(encrypted, key);
@@ -48,7 +45,7 @@ TEST(CipherTest, EncryptDecryptExactBlock) {
 
 TEST(CipherTest, PaddingIsRemoved) {
     std::vector<uint8_t> data(31, 0x01);  // Will require 1 byte of padding
-    keyhash              key = make_key(777);
+    keyhash              key = seeded_key(777);
 
     auto encrypted = encrypt(data, key);
     ASSERT_EQ(encrypted.size() % 32, 0u);
@@ -59,7 +56,7 @@ TEST(CipherTest, PaddingIsRemoved) {
 
 TEST(CipherTest, DecryptInvalidSizeReturnsEmpty) {
     std::vector<uint8_t> invalid_data(15, 0xFF);  // Not a multiple of 32
-    keyhash              key = make_key(888);
+    keyhash              key = seeded_key(888);
 
     auto decrypted = decrypt(invalid_data, key);
     EXPECT_TRUE(decrypted.empty());
@@ -67,8 +64,8 @@ TEST(CipherTest, DecryptInvalidSizeReturnsEmpty) {
 
 TEST(CipherTest, DifferentKeysProduceDifferentCiphertext) {
     std::vector<uint8_t> data = {10, 20, 30, 40, 50, 60, 70, 80};
-    keyhash              key1 = make_key(1);
-    keyhash              key2 = make_key(2);
+    keyhash              key1 = seeded_key(1);
+    keyhash              key2 = seeded_key(2);
 
     auto encrypted1 = encrypt(data, key1);
     auto encrypted2 = encrypt(data, key2);
@@ -80,8 +77,8 @@ TEST(CipherTest, CipherBlockIsReversible) {
     std::array<uint8_t, 32> block;
     for (size_t i = 0; i < 32; ++i) block[i] = static_cast<uint8_t>(i);
 
-    keyhash key = make_key(999);
-    auto    ops = get_operations(key.bits);
+    keyhash key = seeded_key(999);
+    auto    ops = get_operations(key.bits());
     auto    enc = cipher_block(block, ops);
 
     std::vector<operation> rev_ops = ops;
@@ -101,10 +98,343 @@ TEST(CipherTest, MassEncryptDecryptRandomized) {
         for (size_t j = 0; j < data_size; ++j) {
             data[j] = static_cast<uint8_t>(rng() & 0xFF);
         }
-        keyhash key       = make_key(rng());
+        keyhash key       = seeded_key(rng());
         auto    encrypted = encrypt(data, key);
         auto    decrypted = decrypt(encrypted, key);
         EXPECT_EQ(decrypted, data)
             << "Failed at iteration " << i << " with size " << data_size;
     }
 }
+
+TEST(CipherTest, CompiledPermutationMatchesOperations) {
+    std::mt19937 rng(31);
+    for (int i = 0; i < 100; ++i) {
+        keyhash key = seeded_key(rng());
+        auto    ops = get_operations(key.bits());
+
+        std::vector<operation> rev_ops = ops;
+        std::reverse(rev_ops.begin(), rev_ops.end());
+
+        block_permutation forward = compile_cipher(ops);
+        block_permutation inverse = compile_decipher(rev_ops);
+
+        std::array<uint8_t, 32> block;
+        for (auto& b : block) { b = static_cast<uint8_t>(rng() & 0xFF); }
+
+        auto enc = cipher_block(block, ops);
+        EXPECT_EQ(permute_block(block, forward), enc);
+        EXPECT_EQ(permute_block(enc, inverse), decipher_block(enc, rev_ops));
+        EXPECT_EQ(permute_block(enc, inverse), block);
+    }
+}
+
+TEST(CipherTest, EncryptMatchesBlockwiseCipher) {
+    std::mt19937 rng(57);
+    for (size_t blocks : {1, 3, 16, 17}) {
+        std::vector<uint8_t> data(blocks * 32);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+
+        keyhash key       = seeded_key(rng());
+        auto    ops       = get_operations(key.bits());
+        auto    encrypted = encrypt(data, key);
+        ASSERT_EQ(encrypted.size(), data.size());
+
+        for (size_t i = 0; i < data.size(); i += 32) {
+            std::array<uint8_t, 32> block;
+            std::copy_n(data.begin() + i, 32, block.begin());
+            auto expected = cipher_block(block, ops);
+            EXPECT_TRUE(std::equal(expected.begin(),
+                                   expected.end(),
+                                   encrypted.begin() + i))
+                << "block " << i / 32 << " of " << blocks;
+        }
+    }
+}
+
+TEST(CipherTest, BatchedBlocksMatchCipherBlock) {
+    std::mt19937 rng(73);
+    for (size_t blocks : {1, 63, 64, 65, 200}) {
+        std::vector<uint8_t> data(blocks * 32);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+
+        keyhash key = seeded_key(rng());
+        auto    ops = get_operations(key.bits());
+
+        std::vector<operation> rev_ops = ops;
+        std::reverse(rev_ops.begin(), rev_ops.end());
+
+        std::vector<uint8_t> encrypted(data.size());
+        cipher_blocks(data.data(), encrypted.data(), blocks, ops);
+
+        for (size_t i = 0; i < data.size(); i += 32) {
+            std::array<uint8_t, 32> block;
+            std::copy_n(data.begin() + i, 32, block.begin());
+            auto expected = cipher_block(block, ops);
+            ASSERT_TRUE(std::equal(expected.begin(),
+                                   expected.end(),
+                                   encrypted.begin() + i))
+                << "block " << i / 32 << " of " << blocks;
+        }
+
+        // in place
+        std::vector<uint8_t> decrypted = encrypted;
+        decipher_blocks(decrypted.data(), decrypted.data(), blocks, rev_ops);
+        EXPECT_EQ(decrypted, data);
+    }
+}
+
+TEST(CipherTest, ParallelMatchesSerial) {
+    thread_pool  pool(4);
+    std::mt19937 rng(97);
+    for (size_t size : {0, 100, 64 * 1024 - 1, 64 * 1024, 300'001}) {
+        std::vector<uint8_t> data(size);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+
+        keyhash key       = seeded_key(rng());
+        auto    encrypted = encrypt(data, key, pool);
+        EXPECT_EQ(encrypted, encrypt(data, key)) << "size " << size;
+
+        auto decrypted = decrypt(encrypted, key, pool);
+        EXPECT_EQ(decrypted, decrypt(encrypted, key)) << "size " << size;
+        EXPECT_EQ(decrypted, data) << "size " << size;
+    }
+}
+
+TEST(CipherTest, SpanMatchesVectorApi) {
+    std::mt19937 rng(31);
+    for (size_t size : {0, 1, 31, 32, 33, 255, 256, 1000}) {
+        std::vector<uint8_t> data(size);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+
+        keyhash key      = seeded_key(rng());
+        auto    expected = encrypt(data, key);
+        ASSERT_EQ(encrypted_size(size), expected.size()) << "size " << size;
+
+        std::vector<uint8_t> encrypted(encrypted_size(size));
+        EXPECT_EQ(encrypt(data, encrypted, key), expected.size());
+        EXPECT_EQ(encrypted, expected) << "size " << size;
+
+        std::vector<uint8_t> decrypted(encrypted.size());
+        decrypted.resize(decrypt(encrypted, decrypted, key));
+        EXPECT_EQ(decrypted, data) << "size " << size;
+    }
+}
+
+TEST(CipherTest, SpanInPlace) {
+    std::mt19937 rng(37);
+    for (size_t size : {5, 32, 100, 4096 + 7}) {
+        std::vector<uint8_t> data(size);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+        keyhash key = seeded_key(rng());
+
+        // room for the padding after the plaintext
+        std::vector<uint8_t> buffer(encrypted_size(size));
+        std::copy(data.begin(), data.end(), buffer.begin());
+
+        size_t written = encrypt(byte_view(buffer.data(), size), buffer, key);
+        ASSERT_EQ(written, buffer.size());
+        EXPECT_EQ(buffer, encrypt(data, key)) << "size " << size;
+
+        size_t plain_len = decrypt(buffer, buffer, key);
+        ASSERT_EQ(plain_len, size);
+        buffer.resize(plain_len);
+        EXPECT_EQ(buffer, data) << "size " << size;
+    }
+}
+
+TEST(CipherTest, SpanRejectsShortOutput) {
+    std::vector<uint8_t> data(40, 0x5A);
+    keyhash              key = seeded_key(41);
+
+    std::vector<uint8_t> encrypted(63);
+    EXPECT_EQ(encrypt(data, encrypted, key), 0u);
+
+    encrypted.resize(64);
+    ASSERT_EQ(encrypt(data, encrypted, key), 64u);
+
+    std::vector<uint8_t> decrypted(63);
+    EXPECT_EQ(decrypt(encrypted, decrypted, key), 0u);
+    EXPECT_EQ(decrypt(byte_view(encrypted.data(), 40), encrypted, key), 0u);
+}
+
+TEST(CipherTest, ContextMatchesKeyApi) {
+    thread_pool  pool(4);
+    std::mt19937 rng(43);
+    for (size_t size : {0, 1, 31, 32, 33, 1000, 64 * 1024, 300'001}) {
+        std::vector<uint8_t> data(size);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+
+        keyhash              key = seeded_key(rng());
+        const cipher_context context(key);
+        auto                 expected = encrypt(data, key);
+
+        std::vector<uint8_t> encrypted(encrypted_size(size));
+        EXPECT_EQ(context.encrypt(data, encrypted), expected.size());
+        EXPECT_EQ(encrypted, expected) << "size " << size;
+        std::fill(encrypted.begin(), encrypted.end(), 0);
+        EXPECT_EQ(context.encrypt(data, encrypted, pool), expected.size());
+        EXPECT_EQ(encrypted, expected) << "size " << size;
+
+        std::vector<uint8_t> decrypted(encrypted.size());
+        EXPECT_EQ(context.decrypt(encrypted, decrypted), size);
+        decrypted.resize(size);
+        EXPECT_EQ(decrypted, data) << "size " << size;
+        decrypted.assign(encrypted.size(), 0);
+        EXPECT_EQ(context.decrypt(encrypted, decrypted, pool), size);
+        decrypted.resize(size);
+        EXPECT_EQ(decrypted, data) << "size " << size;
+    }
+}
+
+TEST(CipherTest, ContextFromSchedule) {
+    keyhash              key = seeded_key(47);
+    const cipher_context context(make_key_schedule(key));
+    std::vector<uint8_t> data(500, 0x3C);
+
+    std::vector<uint8_t> encrypted(encrypted_size(data.size()));
+    ASSERT_EQ(context.encrypt(data, encrypted), encrypted.size());
+    EXPECT_EQ(encrypted, encrypt(data, key));
+}
+
+TEST(CipherTest, ContextSharedAcrossThreads) {
+    thread_pool          pool(4);
+    keyhash              key = seeded_key(53);
+    const cipher_context context(key);
+
+    constexpr size_t MESSAGES = 64;
+    std::vector<std::vector<uint8_t>> messages(MESSAGES);
+    std::vector<std::vector<uint8_t>> encrypted(MESSAGES);
+    for (size_t i = 0; i < MESSAGES; ++i) {
+        messages[i].assign(i * 37 + 1, static_cast<uint8_t>(i));
+        encrypted[i].resize(encrypted_size(messages[i].size()));
+    }
+
+    pool.parallel_for(MESSAGES, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            context.encrypt(messages[i], encrypted[i]);
+        }
+    });
+
+    for (size_t i = 0; i < MESSAGES; ++i) {
+        EXPECT_EQ(encrypted[i], encrypt(messages[i], key)) << "message " << i;
+    }
+}
+
+TEST(CipherTest, ContextRejectsInvalidSizes) {
+    const cipher_context context(seeded_key(59));
+    std::vector<uint8_t> data(40, 0x5A);
+
+    std::vector<uint8_t> encrypted(63);
+    EXPECT_EQ(context.encrypt(data, encrypted), 0u);
+
+    std::vector<uint8_t> decrypted(64);
+    EXPECT_EQ(context.decrypt(data, decrypted), 0u);
+}
+
+TEST(CipherTest, ResultsFromResource) {
+    std::mt19937 rng(79);
+    buffer_pool  pool;
+    for (size_t size : {0, 1, 32, 100, 5000}) {
+        std::vector<uint8_t> data(size);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+        keyhash              key = seeded_key(rng());
+        const cipher_context context(key);
+
+        auto encrypted = encrypt(data, key, &pool);
+        EXPECT_EQ(encrypted.get_allocator().resource(), &pool);
+        auto expected = encrypt(data, key);
+        EXPECT_TRUE(std::equal(encrypted.begin(),
+                               encrypted.end(),
+                               expected.begin(),
+                               expected.end()))
+            << "size " << size;
+        EXPECT_EQ(context.encrypt(data, &pool), encrypted) << "size " << size;
+
+        auto decrypted = decrypt(encrypted, key, &pool);
+        EXPECT_TRUE(std::equal(
+            decrypted.begin(), decrypted.end(), data.begin(), data.end()))
+            << "size " << size;
+        EXPECT_EQ(context.decrypt(encrypted, &pool), decrypted)
+            << "size " << size;
+    }
+
+    // every result above was freed before the next of its size class
+    EXPECT_GT(pool.counters().reused, 0u);
+}
+
+TEST(CipherTest, DecryptRangeMatchesWholeMessage) {
+    std::mt19937         rng(83);
+    std::vector<uint8_t> data(1000);
+    for (auto& b : data) { b = static_cast<uint8_t>(rng() & 0xFF); }
+    keyhash              key = seeded_key(83);
+    const cipher_context context(key);
+
+    // the final block comes back padded, as encrypt stored it
+    auto                 encrypted = encrypt(data, key);
+    std::vector<uint8_t> padded(encrypted.size());
+    decrypt_range(encrypted, 0, encrypted.size() / 32, padded, key);
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), padded.begin()));
+
+    for (size_t first : {0, 1, 7, 20, 31}) {
+        for (size_t count : {0, 1, 3, 8, 11}) {
+            if (first + count > encrypted.size() / 32) { continue; }
+            std::vector<uint8_t> expected(padded.begin() + first * 32,
+                                          padded.begin()
+                                              + (first + count) * 32);
+            EXPECT_EQ(decrypt_range(encrypted, first, count, key), expected)
+                << first << "+" << count;
+
+            std::vector<uint8_t> blocks(count * 32);
+            EXPECT_EQ(context.decrypt_range(encrypted, first, count, blocks),
+                      count * 32);
+            EXPECT_EQ(blocks, expected) << first << "+" << count;
+        }
+    }
+}
+
+TEST(CipherTest, EncryptRangeRewritesOnlyItsBlocks) {
+    keyhash              key = seeded_key(89);
+    const cipher_context context(key);
+    std::vector<uint8_t> data(32 * 40, 0x51);
+    auto                 encrypted = encrypt(data, key);
+    auto                 original  = encrypted;
+
+    std::vector<uint8_t> update(32 * 9, 0x22);
+    EXPECT_EQ(context.encrypt_range(encrypted, 12, update), update.size());
+    std::copy(update.begin(), update.end(), data.begin() + 12 * 32);
+    EXPECT_EQ(encrypted, encrypt(data, key));
+    EXPECT_TRUE(std::equal(original.begin(),
+                           original.begin() + 12 * 32,
+                           encrypted.begin()));
+    EXPECT_TRUE(std::equal(original.begin() + 21 * 32,
+                           original.end(),
+                           encrypted.begin() + 21 * 32));
+
+    std::vector<uint8_t> single(32, 0x33);
+    EXPECT_EQ(encrypt_range(encrypted, 0, single, key), 32u);
+    std::copy(single.begin(), single.end(), data.begin());
+    EXPECT_EQ(decrypt(encrypted, key), data);
+}
+
+TEST(CipherTest, RangesRejectOutOfBounds) {
+    const cipher_context context(seeded_key(97));
+    std::vector<uint8_t> ciphertext(32 * 4);
+    std::vector<uint8_t> output(32 * 4);
+
+    EXPECT_EQ(context.decrypt_range(ciphertext, 3, 2, output), 0u);
+    EXPECT_EQ(context.decrypt_range(ciphertext, 5, 0, output), 0u);
+    EXPECT_EQ(context.decrypt_range(ciphertext, 0, SIZE_MAX, output), 0u);
+    EXPECT_EQ(context.decrypt_range(
+                  byte_view(ciphertext.data(), 100), 0, 1, output),
+              0u);
+    EXPECT_EQ(context.decrypt_range(
+                  ciphertext, 0, 2, mutable_byte_view(output.data(), 63)),
+              0u);
+    EXPECT_TRUE(decrypt_range(ciphertext, 2, SIZE_MAX, seeded_key(97)).empty());
+
+    std::vector<uint8_t> plaintext(64);
+    EXPECT_EQ(context.encrypt_range(ciphertext, 3, plaintext), 0u);
+    EXPECT_EQ(context.encrypt_range(
+                  ciphertext, 0, byte_view(plaintext.data(), 40)),
+              0u);
+}
@@ -0,0 +1,182 @@
+#include "cipher_service.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cipher.hpp"
+#include "test_util.hpp"
+
+using namespace lea;
+using namespace lea_test;
+
+TEST(CipherServiceTest, MatchesOneShotApi) {
+    cipher_service service({2});
+    std::mt19937   rng(61);
+
+    std::vector<keyhash>                           keys;
+    std::vector<std::vector<uint8_t>>              messages;
+    std::vector<std::future<std::vector<uint8_t>>> results;
+    for (size_t i = 0; i < 200; ++i) {
+        keys.push_back(seeded_key(i % 3));
+        messages.push_back(random_bytes(rng() % 600, rng()));
+        results.push_back(service.submit(ENCRYPT, keys[i], messages[i]));
+    }
+
+    std::vector<std::future<std::vector<uint8_t>>> decrypted;
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::vector<uint8_t> encrypted = results[i].get();
+        ASSERT_EQ(encrypted, encrypt(messages[i], keys[i])) << "message " << i;
+        decrypted.push_back(service.submit(DECRYPT, keys[i], encrypted));
+    }
+    for (size_t i = 0; i < decrypted.size(); ++i) {
+        EXPECT_EQ(decrypted[i].get(), messages[i]) << "message " << i;
+    }
+
+    cipher_service_stats stats = service.stats();
+    EXPECT_EQ(stats.requests, 400u);
+    EXPECT_LE(stats.batches, stats.requests);
+}
+
+TEST(CipherServiceTest, CoalescesRequestsSharingAKey) {
+    cipher_service_options options;
+    options.threads   = 1;
+    options.max_batch = 16;
+    options.max_delay = std::chrono::seconds(10);
+    cipher_service service(options);
+
+    keyhash                                        key = seeded_key(67);
+    std::vector<std::future<std::vector<uint8_t>>> results;
+    for (size_t i = 0; i < 64; ++i) {
+        results.push_back(
+            service.submit(ENCRYPT, key, std::vector<uint8_t>(100, i)));
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i].get(),
+                  encrypt(std::vector<uint8_t>(100, i), key));
+    }
+
+    // full batches never wait for max_delay
+    cipher_service_stats stats = service.stats();
+    EXPECT_EQ(stats.batches, 4u);
+    EXPECT_EQ(stats.batch_size[5], 4u);
+    EXPECT_EQ(stats.bytes, 6400u);
+
+    uint64_t submitted = 0;
+    for (uint64_t count : stats.queue_depth) { submitted += count; }
+    EXPECT_EQ(submitted, 64u);
+}
+
+TEST(CipherServiceTest, FullQueueDoesNotWaitForABatch) {
+    cipher_service_options options;
+    options.threads        = 1;
+    options.queue_capacity = 4;
+    options.max_batch      = 64;
+    options.max_delay      = std::chrono::seconds(10);
+    cipher_service service(options);
+
+    // the batch can never fill, so waiting would take max_delay per batch
+    auto    start = std::chrono::steady_clock::now();
+    keyhash key   = seeded_key(79);
+
+    std::vector<std::future<std::vector<uint8_t>>> results;
+    for (size_t i = 0; i < 32; ++i) {
+        results.push_back(
+            service.submit(ENCRYPT, key, std::vector<uint8_t>(40, i)));
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i].get(),
+                  encrypt(std::vector<uint8_t>(40, i), key));
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start,
+              std::chrono::seconds(5));
+}
+
+TEST(CipherServiceTest, InvalidRequestsComeBackEmpty) {
+    cipher_service service({1});
+    keyhash        key = seeded_key(71);
+
+    std::vector<uint8_t> unaligned(33, 1), aligned(32, 1);
+    EXPECT_TRUE(service.submit(DECRYPT, key, unaligned).get().empty());
+    EXPECT_TRUE(service.submit(UNSET, key, aligned).get().empty());
+    EXPECT_TRUE(service.submit(DECRYPT, key, {}).get().empty());
+    EXPECT_TRUE(service.submit(ENCRYPT, key, {}).get().empty());
+}
+
+TEST(CipherServiceTest, DestructorCompletesQueuedCallbacks) {
+    std::atomic<size_t> completed{0};
+    {
+        cipher_service_options options;
+        options.threads   = 1;
+        options.max_delay = std::chrono::seconds(10);
+        cipher_service service(options);
+
+        for (size_t i = 0; i < 10; ++i) {
+            service.submit(ENCRYPT,
+                           seeded_key(i),
+                           std::vector<uint8_t>(50, i),
+                           [&](std::vector<uint8_t> result) {
+                               EXPECT_EQ(result.size(), 64u);
+                               completed++;
+                           });
+        }
+    }
+    EXPECT_EQ(completed.load(), 10u);
+}
+
+TEST(CipherServiceTest, ThrowingCallbackSparesTheBatch) {
+    cipher_service_options options;
+    options.threads   = 1;
+    options.max_delay = std::chrono::seconds(10);
+
+    std::atomic<size_t> completed{0};
+    {
+        cipher_service service(options);
+        keyhash        key = seeded_key(83);
+        service.submit(ENCRYPT,
+                       key,
+                       std::vector<uint8_t>(10, 1),
+                       [](std::vector<uint8_t>) {
+                           throw std::runtime_error("callback");
+                       });
+        for (size_t i = 0; i < 4; ++i) {
+            service.submit(ENCRYPT,
+                           key,
+                           std::vector<uint8_t>(10, i),
+                           [&](std::vector<uint8_t>) { completed++; });
+        }
+    }
+    EXPECT_EQ(completed.load(), 4u);
+}
+
+TEST(CipherServiceTest, BoundedQueueUnderManySubmitters) {
+    cipher_service_options options;
+    options.threads        = 2;
+    options.queue_capacity = 4;
+    options.max_batch      = 8;
+    cipher_service service(options);
+
+    keyhash                  key = seeded_key(73);
+    std::atomic<size_t>      mismatches{0};
+    std::vector<std::thread> submitters;
+    for (size_t t = 0; t < 4; ++t) {
+        submitters.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            for (size_t i = 0; i < 50; ++i) {
+                auto message = random_bytes(50 + rng() % 450, rng());
+                auto result  = service.submit(ENCRYPT, key, message).get();
+                if (result != encrypt(message, key)) { mismatches++; }
+            }
+        });
+    }
+    for (std::thread& thread : submitters) { thread.join(); }
+
+    EXPECT_EQ(mismatches.load(), 0u);
+    EXPECT_EQ(service.stats().requests, 200u);
+}
@@ -0,0 +1,133 @@
+#include "cipher_view.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "cipher.hpp"
+#include "test_util.hpp"
+
+using namespace lea;
+using namespace lea_test;
+
+TEST(CipherViewTest, ReadsMatchPlaintext) {
+    std::mt19937 rng(101);
+    for (size_t size : {0, 1, 31, 32, 33, 500, 4096, 10'007}) {
+        auto                 data = random_bytes(size, rng());
+        keyhash              key  = seeded_key(size);
+        const cipher_context context(key);
+        auto                 encrypted = encrypt(data, key);
+
+        decrypted_view view(encrypted, context);
+        ASSERT_TRUE(view.valid());
+        EXPECT_EQ(view.size(), size);
+        EXPECT_EQ(view.block_count(), encrypted.size() / 32);
+
+        for (int i = 0; i < 50; ++i) {
+            size_t offset = rng() % (size + 8);
+            size_t length = rng() % 700;
+
+            std::vector<uint8_t> output(length, 0xEE);
+            size_t               copied   = view.read(offset, output);
+            size_t               expected = offset < size
+                                              ? std::min(length, size - offset)
+                                              : 0;
+            ASSERT_EQ(copied, expected) << offset << "+" << length;
+            EXPECT_TRUE(std::equal(output.begin(),
+                                   output.begin() + copied,
+                                   data.begin() + std::min(offset, size)))
+                << offset << "+" << length;
+        }
+    }
+}
+
+TEST(CipherViewTest, IteratorYieldsBlocks) {
+    std::mt19937         rng(103);
+    auto                 data = random_bytes(300, rng());
+    keyhash              key  = seeded_key(103);
+    const cipher_context context(key);
+    auto                 encrypted = encrypt(data, key);
+
+    decrypted_view       view(encrypted, context);
+    std::vector<uint8_t> joined;
+    for (const std::array<uint8_t, 32>& block : view) {
+        joined.insert(joined.end(), block.begin(), block.end());
+    }
+
+    // the final block keeps its padding
+    ASSERT_EQ(joined.size(), encrypted.size());
+    joined.resize(data.size());
+    EXPECT_EQ(joined, data);
+    EXPECT_EQ(std::distance(view.begin(), view.end()), 10);
+}
+
+TEST(CipherViewTest, WritesTouchOnlyTheirBlocks) {
+    std::mt19937         rng(107);
+    auto                 data = random_bytes(5000, rng());
+    keyhash              key  = seeded_key(107);
+    const cipher_context context(key);
+    auto                 encrypted = encrypt(data, key);
+
+    for (int i = 0; i < 100; ++i) {
+        size_t offset = rng() % data.size();
+        size_t length = rng() % std::min<size_t>(200, data.size() - offset);
+        auto   update = random_bytes(length, rng());
+        auto   before = encrypted;
+
+        ASSERT_EQ(write_plaintext(encrypted, offset, update, context), length);
+        std::copy(update.begin(), update.end(), data.begin() + offset);
+
+        // blocks outside the write keep their exact ciphertext
+        size_t first = offset / 32;
+        size_t last  = length == 0 ? first : (offset + length - 1) / 32 + 1;
+        EXPECT_TRUE(std::equal(before.begin(),
+                               before.begin() + first * 32,
+                               encrypted.begin()));
+        EXPECT_TRUE(std::equal(before.begin() + last * 32,
+                               before.end(),
+                               encrypted.begin() + last * 32));
+    }
+    EXPECT_EQ(decrypt(encrypted, key), data);
+}
+
+TEST(CipherViewTest, RejectsInvalidInput) {
+    const cipher_context context(seeded_key(109));
+    std::vector<uint8_t> unaligned(40);
+
+    decrypted_view view(unaligned, context);
+    EXPECT_FALSE(view.valid());
+    EXPECT_EQ(view.size(), 0u);
+    std::vector<uint8_t> output(8);
+    EXPECT_EQ(view.read(0, output), 0u);
+    EXPECT_EQ(write_plaintext(unaligned, 0, output, context), 0u);
+
+    // writes may not move the padding
+    auto encrypted = encrypt(std::vector<uint8_t>(40, 1), seeded_key(109));
+    EXPECT_EQ(write_plaintext(encrypted, 35, output, context), 0u);
+    EXPECT_EQ(write_plaintext(encrypted, 32, output, context), 8u);
+}
+
+TEST(CipherViewTest, RejectsWritesThatLookLikePadding) {
+    keyhash              key = seeded_key(113);
+    const cipher_context context(key);
+    std::vector<uint8_t> data(64, 0xAA);
+    auto                 encrypted = encrypt(data, key);
+    auto                 before    = encrypted;
+
+    // a message of whole blocks carries no pad, 0x01 last would read as one
+    std::vector<uint8_t> pad{1};
+    EXPECT_EQ(write_plaintext(encrypted, 63, pad, context), 0u);
+    EXPECT_EQ(encrypted, before);
+
+    // so would a write ending in the final block, even starting earlier
+    std::vector<uint8_t> span(40, 2);
+    EXPECT_EQ(write_plaintext(encrypted, 24, span, context), 0u);
+    EXPECT_EQ(encrypted, before);
+
+    std::vector<uint8_t> other{9};
+    EXPECT_EQ(write_plaintext(encrypted, 63, other, context), 1u);
+    data[63] = 9;
+    EXPECT_EQ(decrypted_view(encrypted, context).size(), 64u);
+    EXPECT_EQ(decrypt(encrypted, key), data);
+}
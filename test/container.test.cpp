@@ -0,0 +1,320 @@
+#include "container.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "thread_pool.hpp"
+
+using namespace lea;
+using namespace lea_test;
+
+namespace {
+
+// small chunks so short inputs still span several
+constexpr container_options SMALL_CHUNKS{256};
+
+// log lines differing in a counter, compressing several times over
+std::vector<uint8_t> log_lines(size_t size) {
+    std::string text;
+    for (size_t i = 0; text.size() < size; i++) {
+        text += "{\"seq\":" + std::to_string(i)
+                + ",\"level\":\"info\",\"msg\":\"request served\"}\n";
+    }
+    return std::vector<uint8_t>(text.begin(), text.begin() + size);
+}
+
+std::vector<uint8_t> read_all(const container_reader& reader) {
+    std::vector<uint8_t> data(reader.size());
+    size_t               copied = 0;
+    EXPECT_TRUE(reader.read(0, data, copied));
+    EXPECT_EQ(copied, data.size());
+    return data;
+}
+
+}  // namespace
+
+TEST(ContainerTest, RoundTripsAnySize) {
+    keyhash key = seeded_key(1);
+    for (size_t size : {0, 1, 31, 255, 256, 257, 1000, 4096}) {
+        temp_file file("lea_container_sizes.leac");
+        auto      data = random_bytes(size, size);
+
+        container_writer writer(key);
+        ASSERT_TRUE(writer.create(file.fd(), SMALL_CHUNKS));
+        ASSERT_TRUE(writer.write(data));
+        EXPECT_EQ(writer.size(), size);
+        ASSERT_TRUE(writer.finish());
+
+        container_reader reader(key);
+        ASSERT_TRUE(reader.open(file.fd()));
+        EXPECT_EQ(reader.size(), size);
+        EXPECT_EQ(reader.chunks().size(), (size + 255) / 256);
+        EXPECT_EQ(read_all(reader), data) << "size " << size;
+    }
+}
+
+TEST(ContainerTest, ChunksMatchIndependentEncryption) {
+    keyhash   key  = seeded_key(2);
+    auto      data = random_bytes(700, 2);
+    temp_file file("lea_container_chunks.leac");
+
+    container_writer writer(key);
+    ASSERT_TRUE(writer.create(file.fd(), SMALL_CHUNKS));
+    ASSERT_TRUE(writer.write(data));
+    ASSERT_TRUE(writer.finish());
+
+    container_reader reader(key);
+    ASSERT_TRUE(reader.open(file.fd()));
+    ASSERT_EQ(reader.chunks().size(), 3u);
+    for (size_t i = 0; i < 3; i++) {
+        const container_chunk& chunk = reader.chunks()[i];
+        std::vector<uint8_t>   plain(data.begin() + i * 256,
+                                   data.begin() + i * 256 + chunk.size);
+        std::vector<uint8_t>   stored(encrypted_size(chunk.size));
+        ASSERT_EQ(::pread(file.fd(),
+                          stored.data(),
+                          stored.size(),
+                          static_cast<off_t>(chunk.offset)),
+                  static_cast<ssize_t>(stored.size()));
+        EXPECT_EQ(stored, encrypt(plain, key)) << "chunk " << i;
+    }
+}
+
+TEST(ContainerTest, SeeksAndParallelReads) {
+    keyhash     key  = seeded_key(3);
+    auto        data = random_bytes(10'000, 3);
+    temp_file   file("lea_container_seek.leac");
+    thread_pool pool(4);
+
+    container_writer writer(key);
+    ASSERT_TRUE(writer.create(file.fd(), SMALL_CHUNKS));
+    // uneven pieces exercise the buffered partial chunk
+    for (size_t offset = 0; offset < data.size(); offset += 777) {
+        size_t size = std::min<size_t>(777, data.size() - offset);
+        ASSERT_TRUE(writer.write(byte_view(data.data() + offset, size), pool));
+    }
+    ASSERT_TRUE(writer.finish());
+
+    container_reader reader(key);
+    ASSERT_TRUE(reader.open(file.fd()));
+
+    std::mt19937 rng(3);
+    for (int i = 0; i < 200; i++) {
+        uint64_t offset = rng() % (data.size() + 10);
+        size_t   length = rng() % 2000;
+
+        std::vector<uint8_t> serial(length), parallel(length);
+        size_t               serial_copied, parallel_copied;
+        ASSERT_TRUE(reader.read(offset, serial, serial_copied));
+        ASSERT_TRUE(reader.read(offset, parallel, parallel_copied, pool));
+
+        size_t expected
+            = offset < data.size() ? std::min(length, data.size() - offset) : 0;
+        ASSERT_EQ(serial_copied, expected);
+        ASSERT_EQ(parallel_copied, expected);
+        EXPECT_TRUE(std::equal(serial.begin(),
+                               serial.begin() + expected,
+                               data.begin() + std::min(offset, data.size())));
+        EXPECT_EQ(serial, parallel);
+    }
+}
+
+TEST(ContainerTest, AppendExtendsTheShortChunk) {
+    keyhash   key  = seeded_key(4);
+    auto      data = random_bytes(1500, 4);
+    temp_file file("lea_container_append.leac");
+
+    container_writer writer(key);
+    ASSERT_TRUE(writer.create(file.fd(), SMALL_CHUNKS));
+    ASSERT_TRUE(writer.write(byte_view(data.data(), 300)));
+    ASSERT_TRUE(writer.finish());
+
+    // whole chunks before the short one are left untouched on disk
+    std::vector<uint8_t> first_chunk(256);
+    ASSERT_EQ(
+        ::pread(file.fd(), first_chunk.data(), 256, CONTAINER_HEADER_SIZE),
+        256);
+
+    // ends inside the short chunk, on a chunk boundary and past several
+    size_t written = 300;
+    for (size_t end : {310, 512, 520, 1500}) {
+        container_writer appender(key);
+        ASSERT_TRUE(appender.open_append(file.fd()));
+        EXPECT_EQ(appender.size(), written);
+        ASSERT_TRUE(appender.write(
+            byte_view(data.data() + written, end - written)));
+        ASSERT_TRUE(appender.finish());
+        written = end;
+
+        container_reader reader(key);
+        ASSERT_TRUE(reader.open(file.fd()));
+        EXPECT_EQ(read_all(reader),
+                  std::vector<uint8_t>(data.begin(), data.begin() + end));
+    }
+
+    std::vector<uint8_t> after(256);
+    ASSERT_EQ(::pread(file.fd(), after.data(), 256, CONTAINER_HEADER_SIZE),
+              256);
+    EXPECT_EQ(after, first_chunk);
+}
+
+TEST(ContainerTest, AppendCutShortKeepsTheContainer) {
+    keyhash   key  = seeded_key(9);
+    auto      data = random_bytes(1300, 9);
+    temp_file file("lea_container_cut.leac");
+
+    container_writer writer(key);
+    ASSERT_TRUE(writer.create(file.fd(), SMALL_CHUNKS));
+    ASSERT_TRUE(writer.write(byte_view(data.data(), 300)));
+    ASSERT_TRUE(writer.finish());
+
+    // whole chunks reach the file, the new index and footer never do
+    {
+        container_writer appender(key);
+        ASSERT_TRUE(appender.open_append(file.fd()));
+        ASSERT_TRUE(appender.write(byte_view(data.data() + 300, 1000)));
+    }
+    container_reader reader(key);
+    ASSERT_TRUE(reader.open(file.fd()));
+    EXPECT_EQ(read_all(reader),
+              std::vector<uint8_t>(data.begin(), data.begin() + 300));
+
+    container_writer appender(key);
+    ASSERT_TRUE(appender.open_append(file.fd()));
+    ASSERT_TRUE(appender.write(byte_view(data.data() + 300, 1000)));
+    ASSERT_TRUE(appender.finish());
+    ASSERT_TRUE(reader.open(file.fd()));
+    EXPECT_EQ(read_all(reader), data);
+
+    // committed, the header points at the new footer at the end of the file
+    uint8_t  version = 0;
+    uint64_t pointer = 0;
+    ASSERT_EQ(::pread(file.fd(), &version, 1, 4), 1);
+    ASSERT_EQ(::pread(file.fd(), &pointer, 8, 56), 8);
+    EXPECT_EQ(version, CONTAINER_VERSION);
+    EXPECT_EQ(pointer, file.size() - CONTAINER_FOOTER_SIZE);
+}
+
+TEST(ContainerTest, RejectsWrongKeyAndDamage) {
+    keyhash   key = seeded_key(5);
+    temp_file file("lea_container_reject.leac");
+
+    container_writer writer(key);
+    EXPECT_FALSE(writer.create(file.fd(), {100}));
+    EXPECT_EQ(errno, EINVAL);
+    ASSERT_TRUE(writer.create(file.fd(), SMALL_CHUNKS));
+    auto data = random_bytes(600, 5);
+    ASSERT_TRUE(writer.write(data));
+    ASSERT_TRUE(writer.finish());
+    EXPECT_FALSE(writer.write(data));
+
+    container_reader other(seeded_key(6));
+    EXPECT_FALSE(other.open(file.fd()));
+    EXPECT_EQ(errno, EKEYREJECTED);
+
+    // a newer version is refused outright
+    uint8_t version = CONTAINER_VERSION + 1;
+    ASSERT_EQ(::pwrite(file.fd(), &version, 1, 4), 1);
+    container_reader reader(key);
+    EXPECT_FALSE(reader.open(file.fd()));
+    EXPECT_EQ(errno, ENOTSUP);
+    version = CONTAINER_VERSION;
+    ASSERT_EQ(::pwrite(file.fd(), &version, 1, 4), 1);
+    EXPECT_TRUE(reader.open(file.fd()));
+
+    // a truncated file loses its footer
+    off_t size = ::lseek(file.fd(), 0, SEEK_END);
+    ASSERT_EQ(::ftruncate(file.fd(), size - 1), 0);
+    EXPECT_FALSE(reader.open(file.fd()));
+    EXPECT_EQ(errno, EBADMSG);
+
+    temp_file empty("lea_container_empty.leac");
+    EXPECT_FALSE(reader.open(empty.fd()));
+    EXPECT_EQ(errno, EBADMSG);
+
+    // a container never finished has no footer to point at
+    ASSERT_TRUE(writer.create(empty.fd(), SMALL_CHUNKS));
+    ASSERT_TRUE(writer.write(data));
+    EXPECT_FALSE(reader.open(empty.fd()));
+    EXPECT_EQ(errno, EBADMSG);
+}
+
+TEST(ContainerTest, CompressedChunksRoundTripAndSeek) {
+    keyhash     key  = seeded_key(7);
+    auto        data = log_lines(50'000);
+    temp_file   file("lea_container_lz.leac");
+    thread_pool pool(4);
+
+    container_writer writer(key);
+    ASSERT_TRUE(
+        writer.create(file.fd(), {4096, container_codec::LZ}));
+    ASSERT_TRUE(writer.write(byte_view(data.data(), 30'000), pool));
+    ASSERT_TRUE(writer.finish());
+
+    // appending expands and recompresses the short last chunk
+    container_writer appender(key);
+    ASSERT_TRUE(appender.open_append(file.fd()));
+    EXPECT_EQ(appender.codec(), container_codec::LZ);
+    ASSERT_TRUE(appender.write(byte_view(data.data() + 30'000, 20'000)));
+    ASSERT_TRUE(appender.finish());
+
+    container_reader reader(key);
+    ASSERT_TRUE(reader.open(file.fd()));
+    EXPECT_EQ(reader.codec(), container_codec::LZ);
+    EXPECT_EQ(read_all(reader), data);
+    for (const container_chunk& chunk : reader.chunks()) {
+        EXPECT_NE(chunk.compressed, 0u);
+    }
+    EXPECT_LT(::lseek(file.fd(), 0, SEEK_END), off_t{50'000} / 3);
+
+    std::mt19937 rng(7);
+    for (int i = 0; i < 100; i++) {
+        uint64_t             offset = rng() % data.size();
+        std::vector<uint8_t> serial(rng() % 9000), parallel(serial.size());
+        size_t               serial_copied, parallel_copied;
+        ASSERT_TRUE(reader.read(offset, serial, serial_copied));
+        ASSERT_TRUE(reader.read(offset, parallel, parallel_copied, pool));
+        ASSERT_EQ(serial_copied, std::min(serial.size(), data.size() - offset));
+        EXPECT_TRUE(std::equal(serial.begin(),
+                               serial.begin() + serial_copied,
+                               data.begin() + offset));
+        EXPECT_EQ(serial, parallel);
+    }
+}
+
+TEST(ContainerTest, IncompressibleChunksStayAsIs) {
+    keyhash   key  = seeded_key(8);
+    auto      data = random_bytes(20'000, 8);
+    temp_file plain("lea_container_plain.leac");
+    temp_file packed("lea_container_packed.leac");
+
+    for (auto* file : {&plain, &packed}) {
+        container_codec  codec = file == &plain ? container_codec::NONE
+                                                : container_codec::LZ;
+        container_writer writer(key);
+        ASSERT_TRUE(writer.create(file->fd(), {4096, codec}));
+        ASSERT_TRUE(writer.write(data));
+        ASSERT_TRUE(writer.finish());
+    }
+
+    // only the codec in the header tells them apart
+    EXPECT_EQ(plain.size(), packed.size());
+    uint32_t codec = 0;
+    ASSERT_EQ(::pread(plain.fd(), &codec, 4, 48), 4);
+    EXPECT_EQ(codec, static_cast<uint32_t>(container_codec::NONE));
+    ASSERT_EQ(::pread(packed.fd(), &codec, 4, 48), 4);
+    EXPECT_EQ(codec, static_cast<uint32_t>(container_codec::LZ));
+
+    container_reader reader(key);
+    ASSERT_TRUE(reader.open(packed.fd()));
+    for (const container_chunk& chunk : reader.chunks()) {
+        EXPECT_EQ(chunk.compressed, 0u);
+    }
+    EXPECT_EQ(read_all(reader), data);
+}
@@ -0,0 +1,237 @@
+#include "dedup.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "thread_pool.hpp"
+
+using namespace lea;
+using namespace lea_test;
+
+namespace {
+
+// small chunks so short inputs still cut into many
+constexpr chunker_options SMALL_CHUNKS{256, 1024, 4096};
+
+std::vector<size_t> chunk_sizes(const std::vector<uint8_t>& data) {
+    std::vector<size_t> sizes;
+    for (size_t begin = 0; begin < data.size();) {
+        size_t n = find_chunk_boundary(
+            byte_view(data.data() + begin, data.size() - begin), SMALL_CHUNKS);
+        sizes.push_back(n);
+        begin += n;
+    }
+    return sizes;
+}
+
+std::vector<uint8_t> restore(const dedup_store&            store,
+                             const std::vector<dedup_ref>& recipe) {
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> chunk;
+    for (const dedup_ref& ref : recipe) {
+        EXPECT_TRUE(store.get(ref.fingerprint, chunk));
+        EXPECT_EQ(chunk.size(), ref.size);
+        data.insert(data.end(), chunk.begin(), chunk.end());
+    }
+    return data;
+}
+
+}  // namespace
+
+TEST(DedupTest, ChunkBoundariesFollowContent) {
+    std::vector<uint8_t> data  = random_bytes(64 << 10, 1);
+    std::vector<size_t>  sizes = chunk_sizes(data);
+
+    ASSERT_GT(sizes.size(), 8u);
+    for (size_t i = 0; i + 1 < sizes.size(); i++) {
+        EXPECT_GE(sizes[i], SMALL_CHUNKS.min_size);
+        EXPECT_LE(sizes[i], SMALL_CHUNKS.max_size);
+    }
+
+    // bytes inserted at the front shift the boundaries after them instead
+    // of moving them
+    std::vector<uint8_t> shifted = random_bytes(100, 2);
+    shifted.insert(shifted.end(), data.begin(), data.end());
+    std::vector<size_t> shifted_sizes = chunk_sizes(shifted);
+
+    ASSERT_GT(shifted_sizes.size(), 4u);
+    EXPECT_TRUE(std::equal(
+        sizes.end() - 4, sizes.end(), shifted_sizes.end() - 4));
+}
+
+TEST(DedupTest, FingerprintsDependOnKeyAndContent) {
+    std::vector<uint8_t> chunk = random_bytes(1000, 3);
+    chunk_fingerprinter  first(seeded_key(4));
+    chunk_fingerprinter  second(seeded_key(5));
+
+    keyhash              digest = first(chunk);
+    EXPECT_EQ(chunk_fingerprinter(seeded_key(4))(chunk), digest);
+    EXPECT_NE(second(chunk), digest);
+    EXPECT_NE(echo_hash(chunk), digest);
+
+    chunk[500] ^= 1;
+    EXPECT_NE(first(chunk), digest);
+}
+
+TEST(DedupTest, RepeatedStreamsStoreChunksOnce) {
+    temp_file            index("dedup_repeat.index");
+    temp_file            data("dedup_repeat.data");
+    keyhash              key    = seeded_key(6);
+    std::vector<uint8_t> stream = random_bytes(200 << 10, 7);
+
+    dedup_store store(key);
+    ASSERT_TRUE(store.create(index.fd(), data.fd()));
+
+    dedup_writer first(store, SMALL_CHUNKS);
+    ASSERT_TRUE(first.write(stream));
+    ASSERT_TRUE(first.finish());
+    EXPECT_EQ(first.stats().bytes, stream.size());
+    EXPECT_EQ(first.stats().new_bytes, stream.size());
+    uint64_t stored = store.data_size();
+
+    // a second backup with a small edit adds a chunk or two
+    stream[100 << 10] ^= 0xff;
+    thread_pool  pool(4);
+    dedup_writer second(store, SMALL_CHUNKS);
+    ASSERT_TRUE(second.write(stream, pool));
+    ASSERT_TRUE(second.finish());
+
+    const dedup_stats& stats = second.stats();
+    EXPECT_EQ(stats.bytes, stream.size());
+    EXPECT_GE(stats.new_chunks, 1u);
+    EXPECT_LE(stats.new_chunks, 3u);
+    EXPECT_GT(stats.ratio(), 20.0);
+    EXPECT_LT(store.data_size() - stored, stored / 20);
+
+    EXPECT_EQ(restore(store, second.recipe()), stream);
+}
+
+TEST(DedupTest, StoreAndRecipeSurviveReopening) {
+    temp_file            index("dedup_reopen.index");
+    temp_file            data("dedup_reopen.data");
+    temp_file            recipe_file("dedup_reopen.recipe");
+    keyhash              key    = seeded_key(8);
+    std::vector<uint8_t> stream = random_bytes(1 << 20, 9);
+
+    {
+        dedup_store store(key);
+        ASSERT_TRUE(store.create(index.fd(), data.fd()));
+        dedup_writer writer(store, SMALL_CHUNKS);
+
+        // written in odd pieces, cut as if written at once
+        for (size_t at = 0; at < stream.size(); at += 7777) {
+            size_t n = std::min<size_t>(7777, stream.size() - at);
+            ASSERT_TRUE(writer.write(byte_view(stream.data() + at, n)));
+        }
+        ASSERT_TRUE(writer.finish());
+        ASSERT_TRUE(write_recipe(recipe_file.fd(), writer.recipe()));
+
+        // hundreds of chunks, so the index grew past its first table
+        EXPECT_GT(store.chunk_count(), 1024u * 7 / 10);
+    }
+
+    std::vector<dedup_ref> recipe;
+    ASSERT_TRUE(read_recipe(recipe_file.fd(), recipe));
+
+    dedup_store store(key);
+    ASSERT_TRUE(store.open(index.fd(), data.fd()));
+    EXPECT_EQ(restore(store, recipe), stream);
+
+    // nothing new the second time
+    dedup_writer writer(store, SMALL_CHUNKS);
+    ASSERT_TRUE(writer.write(stream));
+    ASSERT_TRUE(writer.finish());
+    EXPECT_EQ(writer.stats().new_chunks, 0u);
+    EXPECT_EQ(writer.stats().chunks, recipe.size());
+}
+
+TEST(DedupTest, OpensAfterAFlushCutShort) {
+    temp_file            index("dedup_cut.index");
+    temp_file            data("dedup_cut.data");
+    keyhash              key   = seeded_key(14);
+    std::vector<uint8_t> first = random_bytes(100, 15);
+    std::vector<uint8_t> later = random_bytes(200, 16);
+    bool                 stored;
+
+    std::vector<uint8_t> old_header(DEDUP_HEADER_SIZE);
+    {
+        dedup_store store(key);
+        ASSERT_TRUE(store.create(index.fd(), data.fd()));
+        ASSERT_TRUE(store.put(keyhash{}, first, stored));
+        ASSERT_TRUE(store.flush());
+        ASSERT_EQ(pread(index.fd(), old_header.data(), old_header.size(), 0),
+                  static_cast<ssize_t>(old_header.size()));
+
+        keyhash second;
+        second.limbs[0] = 1;
+        ASSERT_TRUE(store.put(second, later, stored));
+    }
+
+    // the second flush wrote the data and the slot, but not the header
+    ASSERT_EQ(pwrite(index.fd(), old_header.data(), old_header.size(), 0),
+              static_cast<ssize_t>(old_header.size()));
+
+    dedup_store store(key);
+    ASSERT_TRUE(store.open(index.fd(), data.fd()));
+    EXPECT_EQ(store.chunk_count(), 2u);
+    EXPECT_EQ(store.data_size(), static_cast<uint64_t>(data.size()));
+
+    keyhash second;
+    second.limbs[0] = 1;
+    std::vector<uint8_t> chunk;
+    ASSERT_TRUE(store.get(second, chunk));
+    EXPECT_EQ(chunk, later);
+
+    // new chunks go after the recovered ones
+    keyhash third;
+    third.limbs[0] = 2;
+    ASSERT_TRUE(store.put(third, first, stored));
+    ASSERT_TRUE(store.flush());
+    ASSERT_TRUE(store.get(second, chunk));
+    EXPECT_EQ(chunk, later);
+}
+
+TEST(DedupTest, RejectsDamageAndWrongKeys) {
+    temp_file index("dedup_reject.index");
+    temp_file data("dedup_reject.data");
+
+    {
+        dedup_store store(seeded_key(10));
+        ASSERT_TRUE(store.create(index.fd(), data.fd()));
+        std::vector<uint8_t> chunk = random_bytes(100, 11);
+        bool                 stored;
+        ASSERT_TRUE(store.put(keyhash{}, chunk, stored));
+        EXPECT_TRUE(stored);
+    }
+
+    dedup_store other(seeded_key(12));
+    errno = 0;
+    EXPECT_FALSE(other.open(index.fd(), data.fd()));
+    EXPECT_EQ(errno, EKEYREJECTED);
+
+    std::vector<uint8_t> chunk;
+    errno = 0;
+    EXPECT_FALSE(other.get(keyhash{}, chunk));
+    EXPECT_EQ(errno, ENOENT);
+
+    // data the index counts on is gone
+    ASSERT_EQ(ftruncate(data.fd(), 0), 0);
+    dedup_store store(seeded_key(10));
+    errno = 0;
+    EXPECT_FALSE(store.open(index.fd(), data.fd()));
+    EXPECT_EQ(errno, EBADMSG);
+
+    dedup_store          fresh(seeded_key(10));
+    dedup_writer         writer(fresh, chunker_options{1024, 1000, 4096});
+    std::vector<uint8_t> bytes = random_bytes(10, 13);
+    errno = 0;
+    EXPECT_FALSE(writer.write(bytes));
+    EXPECT_EQ(errno, EINVAL);
+}
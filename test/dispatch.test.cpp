@@ -0,0 +1,165 @@
+#include "dispatch.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <random>
+#include <vector>
+
+#include "cipher.hpp"
+#include "echo_hasher.hpp"
+#include "keyhash.hpp"
+#include "keyhash_batch.hpp"
+#include "keyhash_limbs.hpp"
+
+namespace {
+
+const lea::kernel_isa ALL_ISAS[] = {lea::kernel_isa::SCALAR,
+                                    lea::kernel_isa::SSE2,
+                                    lea::kernel_isa::AVX2,
+                                    lea::kernel_isa::AVX512};
+
+// every test leaves the dispatch as it found it
+class DispatchTest : public ::testing::Test {
+  protected:
+    void TearDown() override { lea::clear_forced_kernel_isa(); }
+};
+
+std::bitset<256> random_bits(std::mt19937_64& rng) {
+    std::bitset<256> bits;
+    for (size_t i = 0; i < 256; i++) { bits[i] = rng() & 1; }
+    return bits;
+}
+
+}  // namespace
+
+TEST_F(DispatchTest, NamesRoundTrip) {
+    for (lea::kernel_isa isa : ALL_ISAS) {
+        lea::kernel_isa parsed;
+        ASSERT_TRUE(lea::parse_kernel_isa(lea::kernel_isa_name(isa), parsed));
+        EXPECT_EQ(parsed, isa);
+    }
+
+    lea::kernel_isa parsed = lea::kernel_isa::AVX2;
+    EXPECT_FALSE(lea::parse_kernel_isa("avx1024", parsed));
+    EXPECT_EQ(parsed, lea::kernel_isa::AVX2);
+}
+
+TEST_F(DispatchTest, ForceAndClear) {
+    EXPECT_TRUE(lea::kernel_isa_supported(lea::kernel_isa::SCALAR));
+    EXPECT_TRUE(lea::kernel_isa_supported(lea::best_kernel_isa()));
+
+    lea::kernel_isa before = lea::active_kernel_isa();
+    for (lea::kernel_isa isa : ALL_ISAS) {
+        if (lea::force_kernel_isa(isa)) {
+            EXPECT_EQ(lea::active_kernel_isa(), isa);
+        } else {
+            EXPECT_FALSE(lea::kernel_isa_supported(isa));
+        }
+    }
+
+    lea::clear_forced_kernel_isa();
+    EXPECT_EQ(lea::active_kernel_isa(), before);
+}
+
+TEST_F(DispatchTest, EveryKeyhashKernelMatchesReference) {
+    std::mt19937_64 rng(21);
+
+    const size_t                  COUNT = 37;
+    std::vector<std::bitset<256>> inputs(COUNT);
+    std::vector<size_t>           lengths(COUNT);
+    std::vector<lea::keyhash>     expected(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        inputs[i]   = random_bits(rng);
+        lengths[i]  = 1 + rng() % 32;
+        expected[i] = lea::gen_keyhash(inputs[i], lengths[i]);
+    }
+
+    std::vector<uint8_t> message(3000);
+    for (uint8_t& byte : message) { byte = static_cast<uint8_t>(rng()); }
+    lea::keyhash message_digest = lea::echo_hash(message);
+
+    for (lea::kernel_isa isa : ALL_ISAS) {
+        if (!lea::force_kernel_isa(isa)) { continue; }
+
+        std::vector<lea::keyhash> outputs(COUNT);
+        ASSERT_EQ(lea::gen_keyhash_batch(inputs, lengths, outputs), COUNT);
+        for (size_t i = 0; i < COUNT; i++) {
+            ASSERT_EQ(outputs[i], expected[i])
+                << lea::kernel_isa_name(isa) << " input " << i;
+        }
+        EXPECT_EQ(lea::echo_hash(message), message_digest)
+            << lea::kernel_isa_name(isa);
+    }
+}
+
+TEST_F(DispatchTest, EveryLimbKernelMatchesReference) {
+    std::mt19937_64 rng(23);
+
+    const size_t                  COUNT = 50;
+    std::vector<std::bitset<256>> inputs(COUNT);
+    std::vector<size_t>           lengths(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        inputs[i]  = random_bits(rng);
+        lengths[i] = 1 + rng() % 40;
+    }
+
+    for (lea::kernel_isa isa : ALL_ISAS) {
+        if (!lea::force_kernel_isa(isa)) { continue; }
+
+        for (size_t i = 0; i < COUNT; i++) {
+            std::bitset<512> expanded
+                = lea::bit_interleaving_expand(inputs[i], lengths[i]);
+            lea::limbs512 expanded_limbs
+                = lea::bit_interleaving_expand(lea::to_limbs(inputs[i]),
+                                               lengths[i]);
+            for (size_t j = 0; j < 512; j++) {
+                ASSERT_EQ(expanded[j],
+                          (expanded_limbs[j / 64] >> (j % 64)) & 1)
+                    << lea::kernel_isa_name(isa) << " input " << i;
+            }
+
+            ASSERT_EQ(lea::to_bitset(
+                          lea::sequential_bit_compact(expanded_limbs)),
+                      lea::sequential_bit_compact(expanded))
+                << lea::kernel_isa_name(isa) << " input " << i;
+            ASSERT_EQ(
+                lea::gen_keyhash(lea::to_limbs(inputs[i]), lengths[i]),
+                lea::gen_keyhash(inputs[i], lengths[i]))
+                << lea::kernel_isa_name(isa) << " input " << i;
+        }
+    }
+}
+
+TEST_F(DispatchTest, EveryCipherKernelMatchesReference) {
+    std::mt19937_64 rng(22);
+    lea::keyhash    key(random_bits(rng));
+    auto            operations = lea::get_operations(key.bits());
+
+    // several slabs of every kernel plus a tail
+    const size_t         BLOCKS = 301;
+    std::vector<uint8_t> plain(BLOCKS * 32);
+    for (uint8_t& byte : plain) { byte = static_cast<uint8_t>(rng()); }
+
+    std::vector<uint8_t> expected(plain.size());
+    for (size_t i = 0; i < BLOCKS; i++) {
+        std::array<uint8_t, 32> block;
+        std::copy_n(plain.begin() + i * 32, 32, block.begin());
+        block = lea::cipher_block(block, operations);
+        std::copy(block.begin(), block.end(), expected.begin() + i * 32);
+    }
+
+    for (lea::kernel_isa isa : ALL_ISAS) {
+        if (!lea::force_kernel_isa(isa)) { continue; }
+
+        std::vector<uint8_t> output(plain.size());
+        lea::cipher_blocks(plain.data(), output.data(), BLOCKS, operations);
+        EXPECT_EQ(output, expected) << lea::kernel_isa_name(isa);
+
+        std::vector<uint8_t> encrypted = lea::encrypt(plain, key);
+        EXPECT_EQ(lea::decrypt(encrypted, key), plain)
+            << lea::kernel_isa_name(isa);
+    }
+}
@@ -0,0 +1,103 @@
+#include "echo_hasher.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> random_bytes(std::mt19937_64& rng, size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t& byte : bytes) { byte = static_cast<uint8_t>(rng()); }
+    return bytes;
+}
+
+lea::keyhash hash_string(const std::string& text) {
+    return lea::echo_hash(lea::byte_view(
+        reinterpret_cast<const uint8_t*>(text.data()), text.size()));
+}
+
+}  // namespace
+
+TEST(EchoHasherTest, ChunkedUpdatesMatchOneShot) {
+    std::mt19937_64 rng(7);
+    for (size_t size : {0, 1, 31, 32, 33, 511, 512, 513, 1024, 5000}) {
+        std::vector<uint8_t> data     = random_bytes(rng, size);
+        lea::keyhash         expected = lea::echo_hash(data);
+
+        lea::echo_hasher hasher;
+        for (size_t offset = 0; offset < size;) {
+            size_t chunk = std::min<size_t>(size - offset, rng() % 700);
+            hasher.update(lea::byte_view(data.data() + offset, chunk));
+            offset += chunk;
+        }
+        EXPECT_EQ(hasher.final(), expected) << "size " << size;
+    }
+}
+
+TEST(EchoHasherTest, FinalStartsOver) {
+    lea::echo_hasher hasher;
+    std::string      text = "the quick brown fox";
+    lea::byte_view   bytes(reinterpret_cast<const uint8_t*>(text.data()),
+                         text.size());
+
+    hasher.update(bytes);
+    lea::keyhash first = hasher.final();
+    hasher.update(bytes);
+    EXPECT_EQ(hasher.final(), first);
+    EXPECT_EQ(hasher.final(), hash_string(""));
+}
+
+TEST(EchoHasherTest, DistinguishesLengthsAndOrder) {
+    std::mt19937_64      rng(11);
+    std::vector<uint8_t> data = random_bytes(rng, 2048);
+
+    // zero-extended prefixes of each other and the padding byte itself
+    std::set<std::string> digests;
+    std::vector<uint8_t>  zeros(1100, 0);
+    for (size_t size : {0, 1, 2, 31, 32, 33, 512, 513, 1024, 1100}) {
+        digests.insert(
+            lea::echo_hash(lea::byte_view(zeros.data(), size)).hex_str());
+    }
+    digests.insert(hash_string("\x80").hex_str());
+    EXPECT_EQ(digests.size(), 11u);
+
+    // swapping two blocks of one stripe, and two whole stripes
+    std::vector<uint8_t> swapped = data;
+    std::swap_ranges(swapped.begin(), swapped.begin() + 32,
+                     swapped.begin() + 32);
+    EXPECT_NE(lea::echo_hash(swapped), lea::echo_hash(data));
+
+    swapped = data;
+    std::swap_ranges(swapped.begin(), swapped.begin() + 512,
+                     swapped.begin() + 512);
+    EXPECT_NE(lea::echo_hash(swapped), lea::echo_hash(data));
+}
+
+TEST(EchoHasherTest, SingleBitAvalanche) {
+    std::mt19937_64      rng(3);
+    std::vector<uint8_t> data = random_bytes(rng, 4096);
+    lea::keyhash         base = lea::echo_hash(data);
+
+    for (size_t bit : {0, 7, 8 * 511, 8 * 2048 + 3, 8 * 4095 + 7}) {
+        data[bit / 8] ^= 1 << (bit % 8);
+        size_t flips = (lea::echo_hash(data).bits() ^ base.bits()).count();
+        data[bit / 8] ^= 1 << (bit % 8);
+
+        EXPECT_GT(flips, 80u) << "bit " << bit;
+        EXPECT_LT(flips, 176u) << "bit " << bit;
+    }
+}
+
+// pins the construction, any kernel or refactor must keep these digests
+TEST(EchoHasherTest, KnownAnswers) {
+    EXPECT_EQ(hash_string("").hex_str(),
+              "7B960B405168F0026C4DA0FD6868B064"
+              "7D1195E7C187C019493CFB50C54B9EAB");
+    EXPECT_EQ(hash_string("abc").hex_str(),
+              "8EDBB5D367A0E8E701483CDCBC3B89EE"
+              "FBEC860C8F78778D259D7FD88952F7B6");
+}
@@ -0,0 +1,67 @@
+#include "instrument.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// scoped_stage is used directly so these run whether or not lea-core was
+// built with LEA_INSTRUMENT
+
+TEST(InstrumentTest, AggregatesAcrossThreads) {
+    lea::reset_stats();
+
+    { lea::scoped_stage s(lea::stage::PAD); }
+    std::thread worker([] {
+        for (int i = 0; i < 3; i++) { lea::scoped_stage s(lea::stage::PAD); }
+        lea::scoped_stage s(lea::stage::UNPAD);
+    });
+    worker.join();
+
+    lea::stats_snapshot stats = lea::snapshot_stats();
+    EXPECT_EQ(stats[static_cast<size_t>(lea::stage::PAD)].calls, 4u);
+    EXPECT_EQ(stats[static_cast<size_t>(lea::stage::UNPAD)].calls, 1u);
+
+    lea::reset_stats();
+    EXPECT_EQ(lea::snapshot_stats()[static_cast<size_t>(lea::stage::PAD)].calls,
+              0u);
+}
+
+TEST(InstrumentTest, FormatsTextAndJson) {
+    lea::stats_snapshot stats{};
+    auto& mix = stats[static_cast<size_t>(lea::stage::MIX)];
+    mix.calls       = 2;
+    mix.nanoseconds = 50;
+
+    std::string text = lea::stats_text(stats);
+    EXPECT_NE(text.find("mix"), std::string::npos);
+    EXPECT_EQ(text.find("sbox"), std::string::npos);
+
+    std::string json = lea::stats_json(stats);
+    EXPECT_NE(json.find("\"mix\": {\"calls\": 2, \"nanoseconds\": 50"),
+              std::string::npos);
+    EXPECT_NE(json.find("\"sbox\": {\"calls\": 0"), std::string::npos);
+}
+
+TEST(InstrumentTest, WritesChromeTrace) {
+    lea::start_trace();
+    { lea::scoped_stage s(lea::stage::CHUNK); }
+    lea::stop_trace();
+    { lea::scoped_stage s(lea::stage::WRITE); }
+
+    std::string path = ::testing::TempDir() + "lea_trace.json";
+    ASSERT_TRUE(lea::write_chrome_trace(path));
+
+    std::ifstream     in(path);
+    std::stringstream trace;
+    trace << in.rdbuf();
+    std::remove(path.c_str());
+
+    EXPECT_EQ(trace.str().rfind("{\"traceEvents\":[", 0), 0u);
+    EXPECT_NE(trace.str().find("\"name\":\"chunk\",\"ph\":\"X\""),
+              std::string::npos);
+    EXPECT_EQ(trace.str().find("\"write\""), std::string::npos);
+}
@@ -0,0 +1,139 @@
+#include "key_cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cipher.hpp"
+#include "keyhash.hpp"
+
+namespace {
+
+bool same_schedule(const lea::key_schedule& a, const lea::key_schedule& b) {
+    for (size_t i = 0; i < 16; i++) {
+        const operation& x = a.operations[i];
+        const operation& y = b.operations[i];
+        if (x.row != y.row || x.rowOffset != y.rowOffset || x.col != y.col
+            || x.colOffset != y.colOffset) {
+            return false;
+        }
+    }
+    return a.cipher_source == b.cipher_source
+        && a.decipher_source == b.decipher_source;
+}
+
+}  // namespace
+
+TEST(KeyCacheTest, MatchesUncachedResults) {
+    lea::key_cache cache;
+    for (std::string password :
+         {std::string("a"), std::string("hunter2"), std::string(40, 'x')}) {
+        lea::keyhash expected = lea::gen_keyhash(
+            lea::bitify_str(password), std::min<size_t>(password.size(), 32));
+
+        for (int round = 0; round < 2; round++) {
+            lea::keyhash key = cache.get_keyhash(password);
+            EXPECT_EQ(key.bits(), expected.bits()) << password;
+            EXPECT_TRUE(same_schedule(cache.get_schedule(key),
+                                      lea::make_key_schedule(key)))
+                << password;
+        }
+    }
+
+    // bytes past the length do not matter to gen_keyhash, nor to the cache
+    std::bitset<256> bits = lea::bitify_str("hunter2 and more");
+    EXPECT_EQ(cache.get_keyhash(bits, 7).bits(),
+              lea::gen_keyhash(lea::bitify_str("hunter2"), 7).bits());
+
+    lea::cache_counters counters = cache.keyhash_counters();
+    EXPECT_EQ(counters.misses, 3u);
+    EXPECT_EQ(counters.hits, 4u);
+    EXPECT_EQ(cache.schedule_counters().hits, 3u);
+}
+
+TEST(KeyCacheTest, RefusesEmptyPasswords) {
+    lea::key_cache cache;
+    EXPECT_EQ(cache.get_keyhash(""), lea::keyhash{});
+    EXPECT_EQ(cache.get_keyhash(lea::bitify_str("ignored"), 0),
+              lea::keyhash{});
+
+    lea::cache_counters counters = cache.keyhash_counters();
+    EXPECT_EQ(counters.hits + counters.misses, 0u);
+}
+
+TEST(KeyCacheTest, ScheduleEncryptsLikeKey) {
+    lea::key_cache       cache;
+    lea::keyhash         key      = cache.get_keyhash("schedule");
+    lea::key_schedule    schedule = cache.get_schedule(key);
+    std::vector<uint8_t> data(1000, 0x3C);
+
+    std::vector<uint8_t> encrypted(lea::encrypted_size(data.size()));
+    ASSERT_EQ(lea::encrypt(data, encrypted, schedule), encrypted.size());
+    EXPECT_EQ(encrypted, lea::encrypt(data, key));
+
+    std::vector<uint8_t> decrypted(encrypted.size());
+    decrypted.resize(lea::decrypt(encrypted, decrypted, schedule));
+    EXPECT_EQ(decrypted, data);
+}
+
+TEST(KeyCacheTest, StaysWithinCapacity) {
+    lea::key_cache_options options;
+    options.capacity     = 8;
+    options.shards       = 1;
+    options.zero_evicted = true;
+    lea::key_cache cache(options);
+
+    for (int i = 0; i < 20; i++) { cache.get_keyhash(std::to_string(i)); }
+
+    lea::cache_counters counters = cache.keyhash_counters();
+    EXPECT_EQ(counters.misses, 20u);
+    EXPECT_EQ(counters.evictions, 12u);
+
+    // "12" sits under the clock hand, once referenced the hand passes it
+    // and evicts "13" instead
+    cache.get_keyhash("12");
+    cache.get_keyhash("new");
+    cache.get_keyhash("12");
+    cache.get_keyhash("13");
+    counters = cache.keyhash_counters();
+    EXPECT_EQ(counters.hits, 2u);
+    EXPECT_EQ(counters.misses, 22u);
+
+    cache.clear();
+    cache.get_keyhash("12");
+    EXPECT_EQ(cache.keyhash_counters().misses, 23u);
+}
+
+TEST(KeyCacheTest, ConcurrentLookupsAgree) {
+    lea::key_cache cache;
+
+    std::vector<lea::keyhash> expected;
+    for (int i = 0; i < 64; i++) {
+        std::string password = "user" + std::to_string(i);
+        expected.push_back(lea::gen_keyhash(lea::bitify_str(password),
+                                            password.size()));
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<int>         mismatches(4, 0);
+    for (size_t t = 0; t < mismatches.size(); t++) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < 20; round++) {
+                for (int i = 0; i < 64; i++) {
+                    lea::keyhash key
+                        = cache.get_keyhash("user" + std::to_string(i));
+                    mismatches[t] += key.bits() != expected[i].bits();
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) { thread.join(); }
+
+    for (int count : mismatches) { EXPECT_EQ(count, 0); }
+    lea::cache_counters counters = cache.keyhash_counters();
+    EXPECT_EQ(counters.hits + counters.misses, 4u * 20 * 64);
+    EXPECT_EQ(counters.evictions, 0u);
+}
@@ -3,8 +3,14 @@
 #include <gtest/gtest.h>
 
 #include <bitset>
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <memory_resource>
 #include <random>
 #include <ratio>
+#include <sstream>
+#include <string>
 #include <unordered_set>
 #include <vector>
 
@@ -34,7 +40,7 @@ TEST(KeyhashTest, AvalancheEffect) {
     lea::keyhash hash1 = lea::gen_keyhash(input1, s1.size());
     lea::keyhash hash2 = lea::gen_keyhash(input2, s2.size());
 
-    std::bitset<256> diff  = hash1.bits ^ hash2.bits;
+    std::bitset<256> diff  = hash1.bits() ^ hash2.bits();
     size_t           flips = diff.count();
     EXPECT_GE(flips, 100) << "Avalanche effect weak: " << flips
                           << " flips for 'abc' vs 'abd'";
@@ -48,7 +54,7 @@ TEST(KeyhashTest, AvalancheEffect) {
     hash1 = lea::gen_keyhash(input1, s1.size());
     hash2 = lea::gen_keyhash(input2, s2.size());
 
-    diff  = hash1.bits ^ hash2.bits;
+    diff  = hash1.bits() ^ hash2.bits();
     flips = diff.count();
     EXPECT_GE(flips, 100) << "Avalanche effect weak: " << flips
                           << " flips for 'hello world' vs 'hello world!'";
@@ -60,7 +66,7 @@ TEST(KeyhashTest, AvalancheEffect) {
     hash1 = lea::gen_keyhash(input1, s1.size());
     hash2 = lea::gen_keyhash(input2, s2.size());
 
-    diff  = hash1.bits ^ hash2.bits;
+    diff  = hash1.bits() ^ hash2.bits();
     flips = diff.count();
     EXPECT_GE(flips, 100) << "Avalanche effect weak: " << flips
                           << " flips for 254 vs 255";
@@ -74,7 +80,7 @@ TEST(KeyhashTest, AvalancheEffect) {
     hash1 = lea::gen_keyhash(input1, 32);
     hash2 = lea::gen_keyhash(input2, 32);
 
-    diff  = hash1.bits ^ hash2.bits;
+    diff  = hash1.bits() ^ hash2.bits();
     flips = diff.count();
     EXPECT_GE(flips, 100) << "Avalanche effect weak: " << flips
                           << " flips for 'abc' vs 'abcd'";
@@ -87,7 +93,7 @@ TEST(KeyhashTest, FullInputLateBitAvalanche) {
     input2.flip(255);
     lea::keyhash hash1 = lea::gen_keyhash(input1, 32);
     lea::keyhash hash2 = lea::gen_keyhash(input2, 32);
-    size_t       flips = (hash1.bits ^ hash2.bits).count();
+    size_t       flips = (hash1.bits() ^ hash2.bits()).count();
     EXPECT_GE(flips, 100) << "Flips: " << flips;
 }
 
@@ -95,7 +101,7 @@ TEST(KeyhashTest, NoLongSequences) {
     std::string      s     = "hello world";
     std::bitset<256> input = lea::bitify_str(s);
     lea::keyhash     hash  = lea::gen_keyhash(input, s.size());
-    std::bitset<256> bits  = hash.bits;
+    std::bitset<256> bits  = hash.bits();
 
     size_t max_run_0 = 0, max_run_1 = 0;
     size_t current_run_0 = 0, current_run_1 = 0;
@@ -120,8 +126,8 @@ TEST(KeyhashTest, EmptyInput) {
     std::bitset<256> input;
     lea::keyhash     hash = lea::gen_keyhash(input, 256);
 
-    EXPECT_NE(hash.bits.count(), 0) << "Empty input hashes to all zeros";
-    EXPECT_NE(hash.bits.count(), 256) << "Empty input hashes to all ones";
+    EXPECT_NE(hash.bits().count(), 0) << "Empty input hashes to all zeros";
+    EXPECT_NE(hash.bits().count(), 256) << "Empty input hashes to all ones";
 }
 
 TEST(KeyhashTest, CollisionResistance) {
@@ -133,10 +139,10 @@ TEST(KeyhashTest, CollisionResistance) {
     lea::keyhash hash1 = lea::gen_keyhash(input1, s1.size());
     lea::keyhash hash2 = lea::gen_keyhash(input2, s2.size());
 
-    EXPECT_NE(hash1.bits, hash2.bits)
+    EXPECT_NE(hash1.bits(), hash2.bits())
         << "Collision detected: 'foobar' and 'barfoo' hash to same value";
 
-    size_t flips = (hash1.bits ^ hash2.bits).count();
+    size_t flips = (hash1.bits() ^ hash2.bits()).count();
     EXPECT_GE(flips, 50) << "Weak difference: " << flips
                          << " flips for 'foobar' vs 'barfoo'";
 }
@@ -154,10 +160,10 @@ TEST(KeyhashTest, CollisionResistance_LargeRandomInputs) {
     for (size_t i = 0; i < NUM_INPUTS; i++) {
         lea::keyhash hash = lea::gen_keyhash(inputs [i], 32);
 
-        auto [it, inserted] = hash_outputs.insert(hash.bits);
+        auto [it, inserted] = hash_outputs.insert(hash.bits());
 
         EXPECT_TRUE(inserted)
-            << "Collision detected at input " << i << ": hash = " << hash.bits;
+            << "Collision detected at input " << i << ": hash = " << hash.bits();
 
         auto time_current = std::chrono::high_resolution_clock::now();
 
@@ -213,4 +219,93 @@ TEST(KeyhashTest, HashTiming) {
     std::cout << "Average time per hash: " << avg_time_us << " µs\n";
 
     SUCCEED();
-}
\ No newline at end of file
+}
+
+TEST(KeyhashTest, ByteLayoutFollowsBits) {
+    std::bitset<256> bits = generate_random_bitset();
+    lea::keyhash     key(bits);
+
+    auto bytes = key.to_bytes();
+    for (size_t i = 0; i < 256; i++) {
+        ASSERT_EQ((bytes[i / 8] >> (i % 8)) & 1, bits[i]) << "bit " << i;
+    }
+    EXPECT_EQ(key.bits(), bits);
+
+    lea::keyhash parsed;
+    ASSERT_TRUE(lea::keyhash::from_bytes(bytes, parsed));
+    EXPECT_EQ(parsed, key);
+
+    std::vector<uint8_t> short_bytes(31);
+    EXPECT_FALSE(lea::keyhash::from_bytes(short_bytes, parsed));
+    EXPECT_EQ(parsed, key);
+}
+
+TEST(KeyhashTest, HexRoundTrip) {
+    lea::keyhash key(lea::limbs256{0x0123'4567'89AB'CDEFULL, 0, 0, ~0ULL});
+    char         digits[64];
+    ASSERT_EQ(key.to_hex(lea::span<char>(digits, 64)), 64u);
+    std::string hex(digits, 64);
+    EXPECT_EQ(hex,
+              "EFCDAB8967452301" + std::string(32, '0') + "FFFFFFFFFFFFFFFF");
+
+    lea::keyhash parsed;
+    ASSERT_TRUE(lea::keyhash::from_hex(hex, parsed));
+    EXPECT_EQ(parsed, key);
+
+    std::string lower = hex;
+    for (char& c : lower) { c = static_cast<char>(std::tolower(c)); }
+    ASSERT_TRUE(lea::keyhash::from_hex(lower, parsed));
+    EXPECT_EQ(parsed, key);
+
+    EXPECT_FALSE(lea::keyhash::from_hex(hex.substr(1), parsed));
+    EXPECT_FALSE(lea::keyhash::from_hex("G" + hex.substr(1), parsed));
+
+    char buffer[64];
+    EXPECT_EQ(key.to_hex(lea::span<char>(buffer, 63)), 0u);
+    EXPECT_EQ(key.to_hex(lea::span<char>(buffer, 64)), 64u);
+    EXPECT_EQ(std::string(buffer, 64), hex);
+}
+
+TEST(KeyhashTest, HexStrKeepsItsLayout) {
+    lea::keyhash key(lea::limbs256{0x0123'4567'89AB'CDEFULL, 0, 0, ~0ULL});
+    EXPECT_EQ(key.hex_str(),
+              "FFFFFFFFFFFFFFFF" + std::string(32, '0') + "F7B3D591E6A2C480");
+
+    // the layout printed before keyhash held limbs
+    std::bitset<256>   bits = generate_random_bitset();
+    std::ostringstream oss;
+    oss << std::hex << std::uppercase << std::setfill('0');
+    for (int i = 3; i >= 0; --i) {
+        uint64_t chunk = 0;
+        for (uint8_t j = 0; j < 64; ++j) {
+            chunk |= static_cast<uint64_t>(bits[i * 64 + j]) << (63 - j);
+        }
+        oss << std::setw(16) << chunk;
+    }
+    EXPECT_EQ(lea::keyhash(bits).hex_str(), oss.str());
+}
+
+TEST(KeyhashTest, HexStrFromResource) {
+    lea::keyhash key(lea::limbs256{1, 2, 3, 4});
+
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::string                    hex = key.hex_str(&arena);
+    EXPECT_EQ(hex.get_allocator().resource(), &arena);
+    EXPECT_EQ(std::string(hex), key.hex_str());
+}
+
+TEST(KeyhashTest, EqualityAndHashing) {
+    lea::keyhash a = lea::gen_keyhash(lea::bitify_str("abc"), 3);
+    lea::keyhash b = lea::gen_keyhash(lea::bitify_str("abc"), 3);
+    lea::keyhash c = a;
+    c.limbs[3] ^= 1ULL << 63;
+
+    EXPECT_TRUE(a == b);
+    EXPECT_FALSE(a != b);
+    EXPECT_TRUE(a != c);
+    EXPECT_EQ(std::hash<lea::keyhash>{}(a), std::hash<lea::keyhash>{}(b));
+
+    std::unordered_set<lea::keyhash> keys{a, b, c};
+    EXPECT_EQ(keys.size(), 2u);
+    EXPECT_EQ(keys.count(b), 1u);
+}
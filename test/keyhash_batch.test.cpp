@@ -0,0 +1,98 @@
+#include "keyhash_batch.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <bitset>
+#include <random>
+#include <vector>
+
+#include "keyhash.hpp"
+#include "keyhash_limbs.hpp"
+
+namespace {
+
+std::bitset<256> random_bits(std::mt19937_64& rng, size_t byte_length) {
+    std::bitset<256> bits;
+    for (size_t i = 0; i < std::min<size_t>(byte_length, 32) * 8; i++) {
+        bits[i] = rng() & 1;
+    }
+    return bits;
+}
+
+}  // namespace
+
+TEST(KeyhashBatchTest, MatchesScalarKeyhash) {
+    std::mt19937_64 rng(3);
+    size_t          lanes = lea::keyhash_batch_lanes();
+
+    // partial, exact and multiple lane groups
+    for (size_t count : {size_t{1}, lanes - 1, lanes, 3 * lanes + 5}) {
+        std::vector<std::bitset<256>> inputs(count);
+        std::vector<size_t>           lengths(count);
+        for (size_t i = 0; i < count; i++) {
+            lengths[i] = 1 + rng() % 40;
+            inputs[i]  = random_bits(rng, lengths[i]);
+        }
+
+        std::vector<lea::keyhash> outputs(count);
+        ASSERT_EQ(lea::gen_keyhash_batch(inputs, lengths, outputs), count);
+
+        for (size_t i = 0; i < count; i++) {
+            lea::keyhash expected = lea::gen_keyhash(inputs[i], lengths[i]);
+            ASSERT_EQ(outputs[i].bits(), expected.bits())
+                << "input " << i << " of " << count << ", length "
+                << lengths[i];
+        }
+    }
+}
+
+TEST(KeyhashBatchTest, LimbBatchMatchesScalarLimbs) {
+    std::mt19937_64 rng(4);
+    size_t          count = 100;
+
+    std::vector<lea::limbs256> inputs(count);
+    std::vector<size_t>        lengths(count);
+    for (size_t i = 0; i < count; i++) {
+        lengths[i] = 1 + rng() % 32;
+        inputs[i]  = lea::to_limbs(random_bits(rng, lengths[i]));
+    }
+
+    std::vector<lea::limbs256> outputs(count);
+    ASSERT_EQ(lea::gen_keyhash_batch(inputs, lengths, outputs), count);
+
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(lea::to_bitset(outputs[i]),
+                  lea::gen_keyhash(inputs[i], lengths[i]).bits());
+    }
+}
+
+TEST(KeyhashBatchTest, MismatchedSizesHashNothing) {
+    std::vector<lea::limbs256> inputs(4);
+    std::vector<size_t>        lengths(3, 32);
+    std::vector<lea::limbs256> outputs(4);
+    EXPECT_EQ(lea::gen_keyhash_batch(inputs, lengths, outputs), 0u);
+
+    std::vector<lea::limbs256> none;
+    std::vector<size_t>        no_lengths;
+    EXPECT_EQ(lea::gen_keyhash_batch(none, no_lengths, none), 0u);
+}
+
+TEST(KeyhashBatchTest, ZeroLengthHashesNothing) {
+    std::vector<lea::limbs256> inputs(4, lea::limbs256{1, 2, 3, 4});
+    std::vector<size_t>        lengths{32, 5, 0, 32};
+    std::vector<lea::limbs256> outputs(4, lea::limbs256{7, 7, 7, 7});
+    EXPECT_EQ(lea::gen_keyhash_batch(inputs, lengths, outputs), 0u);
+    for (const lea::limbs256& output : outputs) {
+        EXPECT_EQ(output, (lea::limbs256{7, 7, 7, 7}));
+    }
+
+    std::vector<std::bitset<256>> bits(1);
+    std::vector<size_t>           zero(1, 0);
+    std::vector<lea::keyhash>     keys(1);
+    EXPECT_EQ(lea::gen_keyhash_batch(bits, zero, keys), 0u);
+
+    // the scalar entry points refuse it the same way instead of looping
+    EXPECT_EQ(lea::gen_keyhash(inputs[0], 0), lea::keyhash{});
+    EXPECT_EQ(lea::wrap_input(inputs[0], 0), lea::limbs256{});
+}
@@ -0,0 +1,98 @@
+#include "keyhash_limbs.hpp"
+
+#include <gtest/gtest.h>
+
+#include <bitset>
+#include <random>
+#include <string>
+
+#include "keyhash.hpp"
+
+namespace {
+
+std::bitset<256> random_bits(std::mt19937_64& rng) {
+    std::bitset<256> bits;
+    for (size_t i = 0; i < 256; i++) { bits[i] = rng() & 1; }
+    return bits;
+}
+
+}  // namespace
+
+TEST(KeyhashLimbsTest, LimbConversionRoundTrips) {
+    std::mt19937_64 rng(1);
+    for (int i = 0; i < 100; i++) {
+        std::bitset<256> bits = random_bits(rng);
+        lea::limbs256    limbs = lea::to_limbs(bits);
+        for (size_t j = 0; j < 256; j++) {
+            ASSERT_EQ(bits[j], (limbs[j / 64] >> (j % 64)) & 1);
+        }
+        EXPECT_EQ(lea::to_bitset(limbs), bits);
+    }
+}
+
+TEST(KeyhashLimbsTest, StagesMatchBitsetReference) {
+    std::mt19937_64 rng(2);
+    for (int i = 0; i < 200; i++) {
+        std::bitset<256> bits   = random_bits(rng);
+        lea::limbs256    limbs  = lea::to_limbs(bits);
+        size_t           length = 1 + rng() % 40;
+
+        std::bitset<512> expanded = lea::bit_interleaving_expand(bits, length);
+        lea::limbs512    expanded_limbs
+            = lea::bit_interleaving_expand(limbs, length);
+        for (size_t j = 0; j < 512; j++) {
+            ASSERT_EQ(expanded[j], (expanded_limbs[j / 64] >> (j % 64)) & 1)
+                << "expand mismatch at bit " << j << " length " << length;
+        }
+
+        EXPECT_EQ(lea::to_bitset(lea::sequential_bit_compact(expanded_limbs)),
+                  lea::sequential_bit_compact(expanded));
+
+        size_t shift = rng() % 256;
+        EXPECT_EQ(lea::to_bitset(lea::rotate_left(limbs, shift)),
+                  lea::rotate_left(bits, shift))
+            << "rotate mismatch for shift " << shift;
+
+        std::bitset<256> mixed       = bits;
+        lea::limbs256    mixed_limbs = limbs;
+        lea::mix(mixed, i);
+        lea::mix(mixed_limbs, i);
+        EXPECT_EQ(lea::to_bitset(mixed_limbs), mixed);
+
+        std::bitset<256> boxed       = bits;
+        lea::limbs256    boxed_limbs = limbs;
+        lea::apply_sbox(boxed);
+        lea::apply_sbox(boxed_limbs);
+        EXPECT_EQ(lea::to_bitset(boxed_limbs), boxed);
+
+        std::bitset<256> flipped       = bits;
+        lea::limbs256    flipped_limbs = limbs;
+        lea::intermittent_bit_flip(flipped);
+        lea::intermittent_bit_flip(flipped_limbs);
+        EXPECT_EQ(lea::to_bitset(flipped_limbs), flipped);
+    }
+}
+
+TEST(KeyhashLimbsTest, KeyhashMatchesBitsetReference) {
+    const std::string inputs[]
+        = {"a", "abc", "abd", "hello world", "hello world!", "foobar",
+           "barfoo", "0123456789abcdef0123456789abcdef"};
+
+    for (const std::string& s : inputs) {
+        std::bitset<256> bits = lea::bitify_str(s);
+        EXPECT_EQ(lea::gen_keyhash(lea::to_limbs(bits), s.size()).bits(),
+                  lea::gen_keyhash(bits, s.size()).bits())
+            << "mismatch for '" << s << "'";
+        EXPECT_EQ(lea::gen_keyhash(lea::to_limbs(bits), 256).bits(),
+                  lea::gen_keyhash(bits, 256).bits());
+    }
+
+    std::mt19937_64 rng(3);
+    for (int i = 0; i < 1'000; i++) {
+        std::bitset<256> bits   = random_bits(rng);
+        size_t           length = 1 + rng() % 32;
+        ASSERT_EQ(lea::gen_keyhash(lea::to_limbs(bits), length).bits(),
+                  lea::gen_keyhash(bits, length).bits())
+            << "mismatch at iteration " << i << " length " << length;
+    }
+}
@@ -0,0 +1,98 @@
+#include "lz.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+
+using namespace lea;
+using namespace lea_test;
+
+namespace {
+
+// words drawn from a small vocabulary, repetitive like text
+std::vector<uint8_t> text_bytes(size_t size, uint64_t seed) {
+    const char*     words[] = {"cipher ", "block ", "key ", "the ", "lea ",
+                               "stream ", "chunk ", "\n"};
+    std::mt19937_64 rng(seed);
+    std::string     text;
+    while (text.size() < size) { text += words[rng() % 8]; }
+    return std::vector<uint8_t>(text.begin(), text.begin() + size);
+}
+
+std::vector<uint8_t> round_trip(const std::vector<uint8_t>& data,
+                                size_t&                     compressed) {
+    std::vector<uint8_t> packed(lz_compress_bound(data.size()));
+    compressed = lz_compress(data, packed);
+    EXPECT_NE(compressed, 0u);
+
+    std::vector<uint8_t> unpacked(data.size());
+    EXPECT_TRUE(lz_decompress(byte_view(packed.data(), compressed), unpacked));
+    return unpacked;
+}
+
+}  // namespace
+
+TEST(LzTest, RoundTripsAnyInput) {
+    for (size_t size : {0, 1, 12, 13, 100, 4096, 100'000}) {
+        size_t compressed;
+        auto   text = text_bytes(size, size);
+        EXPECT_EQ(round_trip(text, compressed), text) << "size " << size;
+        if (size >= 4096) { EXPECT_LT(compressed, size / 2); }
+
+        auto noise = random_bytes(size, size);
+        EXPECT_EQ(round_trip(noise, compressed), noise) << "size " << size;
+        EXPECT_LE(compressed, lz_compress_bound(size));
+    }
+
+    // runs make matches overlapping their own output
+    size_t               compressed;
+    std::vector<uint8_t> run(70'000, 'a');
+    EXPECT_EQ(round_trip(run, compressed), run);
+    EXPECT_LT(compressed, 400u);
+}
+
+TEST(LzTest, DecodesTheLz4BlockFormat) {
+    // "abc", then 9 bytes from 3 back, then the literals "xyzzy"
+    std::vector<uint8_t> block = {0x35, 'a', 'b', 'c', 3,   0,
+                                  0x50, 'x', 'y', 'z', 'z', 'y'};
+    std::string          expected = "abcabcabcabcxyzzy";
+
+    std::vector<uint8_t> output(expected.size());
+    ASSERT_TRUE(lz_decompress(block, output));
+    EXPECT_EQ(std::string(output.begin(), output.end()), expected);
+}
+
+TEST(LzTest, GivesUpWhenOutputIsTooSmall) {
+    auto                 noise = random_bytes(10'000, 1);
+    std::vector<uint8_t> packed(noise.size() - noise.size() / 16);
+    EXPECT_EQ(lz_compress(noise, packed), 0u);
+
+    auto text = text_bytes(10'000, 2);
+    EXPECT_NE(lz_compress(text, packed), 0u);
+}
+
+TEST(LzTest, RejectsDamagedInput) {
+    auto                 text = text_bytes(5000, 3);
+    std::vector<uint8_t> packed(lz_compress_bound(text.size()));
+    packed.resize(lz_compress(text, packed));
+    std::vector<uint8_t> output(text.size());
+
+    // truncated, expanding to the wrong size, or reaching before the start
+    EXPECT_FALSE(lz_decompress(byte_view(packed.data(), packed.size() - 1),
+                               output));
+    std::vector<uint8_t> short_output(text.size() - 1);
+    EXPECT_FALSE(lz_decompress(packed, short_output));
+    std::vector<uint8_t> bad_offset = {0x10, 'a', 9, 0, 0x00};
+    EXPECT_FALSE(lz_decompress(bad_offset, output));
+    EXPECT_FALSE(lz_decompress(byte_view(), output));
+
+    // arbitrary bytes never write out of bounds
+    for (uint64_t seed = 0; seed < 200; seed++) {
+        auto noise = random_bytes(64, seed);
+        lz_decompress(noise, output);
+    }
+}
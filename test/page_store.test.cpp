@@ -0,0 +1,213 @@
+#include "page_store.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cipher.hpp"
+#include "test_util.hpp"
+
+using namespace lea;
+using namespace lea_test;
+
+namespace {
+
+// eight 64-byte pages over two shards, so eviction is easy to provoke
+constexpr page_store_options SMALL_STORE{64, 8, 2};
+
+}  // namespace
+
+TEST(PageStoreTest, ReadsExistingCiphertext) {
+    temp_file            file("page_store_existing");
+    keyhash              key       = seeded_key(1);
+    std::vector<uint8_t> plaintext = random_bytes(640, 2);
+
+    // whole blocks, so the raw block cipher and the page layout agree
+    std::vector<uint8_t> ciphertext(plaintext.size());
+    cipher_context(key).encrypt_range(ciphertext, 0, plaintext);
+    ASSERT_EQ(pwrite(file.fd(), ciphertext.data(), ciphertext.size(), 0),
+              static_cast<ssize_t>(ciphertext.size()));
+
+    page_store store(key, SMALL_STORE);
+    ASSERT_TRUE(store.open(file.fd()));
+    EXPECT_EQ(store.page_count(), 10u);
+
+    std::vector<uint8_t> read(300);
+    ASSERT_TRUE(store.read(100, read));
+    EXPECT_EQ(read,
+              std::vector<uint8_t>(plaintext.begin() + 100,
+                                   plaintext.begin() + 400));
+
+    // past the end of the file pages read as zeros
+    std::vector<uint8_t> tail(64, 0xff);
+    ASSERT_TRUE(store.read(640, tail));
+    EXPECT_EQ(tail, std::vector<uint8_t>(64, 0));
+}
+
+TEST(PageStoreTest, FlushWritesEncryptedPages) {
+    temp_file            file("page_store_flush");
+    keyhash              key       = seeded_key(3);
+    std::vector<uint8_t> plaintext = random_bytes(256, 4);
+
+    page_store store(key, SMALL_STORE);
+    ASSERT_TRUE(store.open(file.fd()));
+    ASSERT_TRUE(store.write(0, plaintext));
+    EXPECT_EQ(file.contents().size(), 0u);
+
+    ASSERT_TRUE(store.flush());
+    EXPECT_EQ(store.page_count(), 4u);
+
+    // four adjacent dirty pages go out in one write
+    page_store_counters counters = store.counters();
+    EXPECT_EQ(counters.writebacks, 4u);
+    EXPECT_EQ(counters.writes, 1u);
+
+    std::vector<uint8_t> ciphertext = file.contents();
+    ASSERT_EQ(ciphertext.size(), plaintext.size());
+    EXPECT_NE(ciphertext, plaintext);
+
+    std::vector<uint8_t> deciphered(ciphertext.size());
+    cipher_context(key).decrypt_range(ciphertext, 0, 8, deciphered);
+    EXPECT_EQ(deciphered, plaintext);
+
+    // nothing left dirty
+    ASSERT_TRUE(store.flush());
+    EXPECT_EQ(store.counters().writebacks, 4u);
+}
+
+TEST(PageStoreTest, EvictionWritesBackDirtyPages) {
+    temp_file            file("page_store_evict");
+    keyhash              key       = seeded_key(5);
+    std::vector<uint8_t> plaintext = random_bytes(64 * 32, 6);
+
+    {
+        page_store store(key, SMALL_STORE);
+        ASSERT_TRUE(store.open(file.fd()));
+        ASSERT_TRUE(store.write(0, plaintext));
+
+        // 32 pages through 8 frames
+        page_store_counters counters = store.counters();
+        EXPECT_EQ(counters.misses, 32u);
+        EXPECT_EQ(counters.evictions, 24u);
+        EXPECT_EQ(counters.writebacks, 24u);
+
+        std::vector<uint8_t> read(plaintext.size());
+        ASSERT_TRUE(store.read(0, read));
+        EXPECT_EQ(read, plaintext);
+    }
+
+    // the destructor flushed what was still cached
+    page_store reopened(key, SMALL_STORE);
+    ASSERT_TRUE(reopened.open(file.fd()));
+    EXPECT_EQ(reopened.page_count(), 32u);
+
+    std::vector<uint8_t> read(plaintext.size());
+    ASSERT_TRUE(reopened.read(0, read));
+    EXPECT_EQ(read, plaintext);
+}
+
+TEST(PageStoreTest, PinnedPagesStayCached) {
+    temp_file file("page_store_pin");
+    page_store store(seeded_key(7), SMALL_STORE);
+    ASSERT_TRUE(store.open(file.fd()));
+
+    // pages 0, 2, 4 and 6 fill shard 0
+    std::vector<page_store::page> pinned;
+    for (uint64_t index = 0; index < 8; index += 2) {
+        pinned.push_back(store.pin(index));
+        ASSERT_TRUE(pinned.back());
+        pinned.back().mutable_bytes()[0] = static_cast<uint8_t>(index + 1);
+    }
+
+    errno = 0;
+    EXPECT_FALSE(store.pin(8));
+    EXPECT_EQ(errno, EBUSY);
+
+    // the other shard is unaffected
+    EXPECT_TRUE(store.pin(1));
+
+    pinned.pop_back();
+    page_store::page page = store.pin(8);
+    ASSERT_TRUE(page);
+    EXPECT_EQ(page.index(), 8u);
+
+    for (const page_store::page& p : pinned) {
+        EXPECT_EQ(p.bytes()[0], p.index() + 1);
+    }
+    EXPECT_EQ(store.counters().evictions, 1u);
+}
+
+TEST(PageStoreTest, CountsHitsAndMisses) {
+    temp_file file("page_store_counters");
+    page_store store(seeded_key(8), SMALL_STORE);
+    ASSERT_TRUE(store.open(file.fd()));
+
+    for (int round = 0; round < 3; round++) {
+        for (uint64_t index = 0; index < 4; index++) {
+            EXPECT_TRUE(store.pin(index));
+        }
+    }
+
+    page_store_counters counters = store.counters();
+    EXPECT_EQ(counters.misses, 4u);
+    EXPECT_EQ(counters.hits, 8u);
+    EXPECT_EQ(counters.evictions, 0u);
+    EXPECT_EQ(counters.writebacks, 0u);
+}
+
+TEST(PageStoreTest, ConcurrentWritersToDistinctPages) {
+    temp_file file("page_store_threads");
+    keyhash   key = seeded_key(9);
+    page_store store(key, SMALL_STORE);
+    ASSERT_TRUE(store.open(file.fd()));
+
+    constexpr size_t THREADS = 4;
+    constexpr size_t PAGES   = 16;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t] {
+            std::vector<uint8_t> data(64, static_cast<uint8_t>(t + 1));
+            for (size_t round = 0; round < 20; round++) {
+                for (size_t page = t; page < PAGES; page += THREADS) {
+                    EXPECT_TRUE(store.write(page * 64, data));
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) { thread.join(); }
+    ASSERT_TRUE(store.flush());
+
+    page_store reopened(key, SMALL_STORE);
+    ASSERT_TRUE(reopened.open(file.fd()));
+    for (size_t page = 0; page < PAGES; page++) {
+        std::vector<uint8_t> read(64);
+        ASSERT_TRUE(reopened.read(page * 64, read));
+        EXPECT_EQ(read,
+                  std::vector<uint8_t>(
+                      64, static_cast<uint8_t>(page % THREADS + 1)));
+    }
+}
+
+TEST(PageStoreTest, RejectsBadPageSizesAndFiles) {
+    temp_file file("page_store_invalid");
+
+    page_store odd(seeded_key(10), page_store_options{100, 8, 2});
+    errno = 0;
+    EXPECT_FALSE(odd.open(file.fd()));
+    EXPECT_EQ(errno, EINVAL);
+
+    uint8_t byte = 0;
+    ASSERT_EQ(pwrite(file.fd(), &byte, 1, 0), 1);
+    page_store store(seeded_key(10), SMALL_STORE);
+    errno = 0;
+    EXPECT_FALSE(store.open(file.fd()));
+    EXPECT_EQ(errno, EINVAL);
+
+    errno = 0;
+    EXPECT_FALSE(store.pin(0));
+    EXPECT_EQ(errno, EBADF);
+}
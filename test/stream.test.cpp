@@ -0,0 +1,118 @@
+#include "stream.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory_resource>
+#include <random>
+#include <vector>
+
+#include "cipher.hpp"
+
+namespace {
+
+lea::keyhash random_key(std::mt19937_64& rng) {
+    std::bitset<256> bits;
+    for (size_t i = 0; i < 256; ++i) { bits[i] = rng() & 1; }
+    return lea::keyhash{bits};
+}
+
+// feeds data in randomly sized chunks and concatenates the outputs
+template <typename Stream>
+std::vector<uint8_t> run_chunked(Stream&                     stream,
+                                 const std::vector<uint8_t>& data,
+                                 std::mt19937_64&            rng,
+                                 size_t                      max_chunk) {
+    std::vector<uint8_t> output;
+    size_t               offset = 0;
+    while (offset < data.size()) {
+        size_t chunk = std::min(data.size() - offset, rng() % (max_chunk + 1));
+        auto   part  = stream.update(data.data() + offset, chunk);
+        output.insert(output.end(), part.begin(), part.end());
+        offset += chunk;
+    }
+    auto last = stream.finish();
+    output.insert(output.end(), last.begin(), last.end());
+    return output;
+}
+
+}  // namespace
+
+TEST(StreamTest, ChunkedMatchesOneShot) {
+    std::mt19937_64 rng(5);
+    for (int i = 0; i < 300; ++i) {
+        std::vector<uint8_t> data(rng() % 2'000);
+        for (auto& b : data) { b = static_cast<uint8_t>(rng()); }
+        lea::keyhash key       = random_key(rng);
+        size_t       max_chunk = 1 + rng() % 700;
+
+        lea::encryptor enc(key);
+        auto           encrypted = run_chunked(enc, data, rng, max_chunk);
+        ASSERT_EQ(encrypted, lea::encrypt(data, key))
+            << "size " << data.size() << " max chunk " << max_chunk;
+
+        lea::decryptor dec(key);
+        auto           decrypted = run_chunked(dec, encrypted, rng, max_chunk);
+        ASSERT_EQ(decrypted, data)
+            << "size " << data.size() << " max chunk " << max_chunk;
+    }
+}
+
+TEST(StreamTest, EncryptorOnlyHoldsPartialBlock) {
+    std::mt19937_64 rng(6);
+    lea::encryptor  enc(random_key(rng));
+
+    EXPECT_TRUE(enc.update(std::vector<uint8_t>(31, 1)).empty());
+    EXPECT_EQ(enc.update(std::vector<uint8_t>(1, 1)).size(), 32u);
+    EXPECT_EQ(enc.update(std::vector<uint8_t>(70, 1)).size(), 64u);
+    EXPECT_EQ(enc.finish().size(), 32u);
+    EXPECT_TRUE(enc.finish().empty());
+}
+
+TEST(StreamTest, DecryptorHoldsBackLastBlock) {
+    std::mt19937_64 rng(7);
+    lea::keyhash    key = random_key(rng);
+
+    std::vector<uint8_t> data(31, 9);
+    auto                 encrypted = lea::encrypt(data, key);
+
+    lea::decryptor dec(key);
+    EXPECT_TRUE(dec.update(encrypted).empty());
+    EXPECT_EQ(dec.finish(), data);
+}
+
+TEST(StreamTest, DecryptorRejectsUnalignedTail) {
+    std::mt19937_64 rng(8);
+    lea::decryptor  dec(random_key(rng));
+
+    EXPECT_TRUE(dec.update(std::vector<uint8_t>(15, 0xFF)).empty());
+    EXPECT_TRUE(dec.finish().empty());
+}
+
+TEST(StreamTest, OutputFromResourceMatches) {
+    std::mt19937_64 rng(9);
+    lea::keyhash    key = random_key(rng);
+
+    std::vector<uint8_t> data(1'000);
+    for (auto& b : data) { b = static_cast<uint8_t>(rng()); }
+
+    std::pmr::monotonic_buffer_resource arena;
+    lea::encryptor                      enc(key);
+    std::vector<uint8_t>                encrypted;
+    for (size_t offset = 0; offset < data.size(); offset += 300) {
+        size_t size = std::min<size_t>(300, data.size() - offset);
+        auto   part = enc.update(lea::byte_view(data.data() + offset, size),
+                               &arena);
+        EXPECT_EQ(part.get_allocator().resource(), &arena);
+        encrypted.insert(encrypted.end(), part.begin(), part.end());
+    }
+    auto last = enc.finish(&arena);
+    encrypted.insert(encrypted.end(), last.begin(), last.end());
+    ASSERT_EQ(encrypted, lea::encrypt(data, key));
+
+    lea::decryptor dec(key);
+    auto           decrypted = dec.update(encrypted, &arena);
+    auto           tail      = dec.finish(&arena);
+    decrypted.insert(decrypted.end(), tail.begin(), tail.end());
+    EXPECT_TRUE(std::equal(
+        decrypted.begin(), decrypted.end(), data.begin(), data.end()));
+}
@@ -0,0 +1,67 @@
+#ifndef TEST_UTIL_HPP
+#define TEST_UTIL_HPP
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <bitset>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "keyhash.hpp"
+
+// fixtures shared by the test files
+namespace lea_test {
+
+// a key with every bit drawn from the seed
+inline lea::keyhash seeded_key(uint64_t seed = 0) {
+    std::bitset<256> bits;
+    std::mt19937_64  rng(seed);
+    for (size_t i = 0; i < 256; ++i) { bits[i] = rng() & 1; }
+    return lea::keyhash{bits};
+}
+
+inline std::vector<uint8_t> random_bytes(size_t size, uint64_t seed) {
+    std::mt19937_64      rng(seed);
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t& byte : bytes) { byte = static_cast<uint8_t>(rng()); }
+    return bytes;
+}
+
+// a fresh empty file, removed again when the test ends
+class temp_file {
+  public:
+    explicit temp_file(const std::string& name)
+        : path_(::testing::TempDir() + name),
+          fd_(::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)) {}
+    ~temp_file() {
+        ::close(fd_);
+        std::remove(path_.c_str());
+    }
+
+    temp_file(const temp_file&)            = delete;
+    temp_file& operator=(const temp_file&) = delete;
+
+    int fd() const { return fd_; }
+
+    off_t size() const { return lseek(fd_, 0, SEEK_END); }
+
+    std::vector<uint8_t> contents() const {
+        std::vector<uint8_t> data(static_cast<size_t>(size()));
+        EXPECT_EQ(pread(fd_, data.data(), data.size(), 0),
+                  static_cast<ssize_t>(data.size()));
+        return data;
+    }
+
+  private:
+    std::string path_;
+    int         fd_;
+};
+
+}  // namespace lea_test
+
+#endif
@@ -0,0 +1,72 @@
+#include "thread_pool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+TEST(ThreadPoolTest, ParallelForCoversEveryIndexOnce) {
+    lea::thread_pool pool(4);
+    EXPECT_EQ(pool.size(), 4u);
+
+    std::vector<std::atomic<int>> hits(10'000);
+    pool.parallel_for(hits.size(), 37, [&](size_t begin, size_t end) {
+        EXPECT_LE(end - begin, 37u);
+        for (size_t i = begin; i < end; i++) { hits[i]++; }
+    });
+
+    for (size_t i = 0; i < hits.size(); i++) {
+        ASSERT_EQ(hits[i].load(), 1) << "index " << i;
+    }
+}
+
+TEST(ThreadPoolTest, NestedParallelForCompletes) {
+    lea::thread_pool pool(2);
+
+    std::atomic<size_t> total{0};
+    pool.parallel_for(8, 1, [&](size_t, size_t) {
+        pool.parallel_for(100, 10, [&](size_t begin, size_t end) {
+            total += end - begin;
+        });
+    });
+
+    EXPECT_EQ(total.load(), 800u);
+}
+
+TEST(ThreadPoolTest, ParallelForRethrowsAfterEveryRange) {
+    lea::thread_pool pool(4);
+
+    // every range throws but the one holding index 0, and all still run
+    std::atomic<size_t> ranges{0};
+    EXPECT_THROW(pool.parallel_for(1000, 10,
+                                   [&](size_t begin, size_t) {
+                                       ranges++;
+                                       if (begin != 0) {
+                                           throw std::runtime_error("range");
+                                       }
+                                   }),
+                 std::runtime_error);
+    EXPECT_EQ(ranges.load(), 100u);
+
+    // the pool is still usable afterwards
+    std::atomic<size_t> total{0};
+    pool.parallel_for(100, 10, [&](size_t begin, size_t end) {
+        total += end - begin;
+    });
+    EXPECT_EQ(total.load(), 100u);
+}
+
+TEST(ThreadPoolTest, SubmitRunsTasks) {
+    lea::thread_pool pool(3);
+
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 50; i++) {
+        auto promise = std::make_shared<std::promise<int>>();
+        results.push_back(promise->get_future());
+        pool.submit([promise, i] { promise->set_value(i * i); });
+    }
+
+    for (int i = 0; i < 50; i++) { EXPECT_EQ(results[i].get(), i * i); }
+}
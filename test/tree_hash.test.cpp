@@ -0,0 +1,112 @@
+#include "tree_hash.hpp"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "echo_hasher.hpp"
+#include "test_util.hpp"
+
+using lea_test::random_bytes;
+
+namespace {
+
+const lea::tree_options SMALL_LEAVES{1000};
+
+}  // namespace
+
+TEST(TreeHashTest, IndependentOfThreadCount) {
+    std::vector<uint8_t> data = random_bytes(37'123, 1);
+
+    lea::thread_pool one(1);
+    lea::thread_pool four(4);
+    lea::keyhash     expected = lea::tree_hash(data, one, SMALL_LEAVES);
+    EXPECT_EQ(lea::tree_hash(data, four, SMALL_LEAVES), expected);
+
+    // leaf size is part of the digest
+    EXPECT_NE(lea::tree_hash(data, one, lea::tree_options{1024}), expected);
+}
+
+TEST(TreeHashTest, LeavesAreEchoHashes) {
+    std::vector<uint8_t> data = random_bytes(2'500, 2);
+    lea::thread_pool     pool(2);
+    lea::hash_tree       tree(SMALL_LEAVES);
+    tree.build(data, pool);
+
+    ASSERT_EQ(tree.leaf_count(), 3u);
+    EXPECT_EQ(tree.leaf(0), lea::echo_hash(lea::byte_view(data.data(), 1000)));
+    EXPECT_EQ(tree.leaf(2),
+              lea::echo_hash(lea::byte_view(data.data() + 2000, 500)));
+
+    // the root is neither a leaf nor plain ECHO of the input
+    lea::tree_options whole{4096};
+    lea::keyhash      single = lea::tree_hash(data, pool, whole);
+    EXPECT_NE(single, lea::echo_hash(data));
+
+    std::vector<uint8_t> empty;
+    EXPECT_NE(lea::tree_hash(empty, pool), lea::tree_hash(data, pool));
+}
+
+TEST(TreeHashTest, RehashMatchesRebuild) {
+    std::vector<uint8_t> data = random_bytes(64'000, 3);
+    lea::thread_pool     pool(3);
+    lea::hash_tree       tree(SMALL_LEAVES);
+    tree.build(data, pool);
+
+    // same size, a few leaves changed
+    data[5]      ^= 1;
+    data[40'500] ^= 0x80;
+    std::vector<size_t> changed{0, 40};
+    EXPECT_EQ(tree.rehash(data, changed, pool), 2u);
+    EXPECT_EQ(tree.root(), lea::tree_hash(data, pool, SMALL_LEAVES));
+
+    // grown and shrunk, only the touched tail is hashed again
+    data.resize(65'500, 7);
+    EXPECT_EQ(tree.rehash(data, {}, pool), 3u);
+    EXPECT_EQ(tree.root(), lea::tree_hash(data, pool, SMALL_LEAVES));
+
+    data.resize(10'001);
+    EXPECT_EQ(tree.rehash(data, {}, pool), 1u);
+    EXPECT_EQ(tree.root(), lea::tree_hash(data, pool, SMALL_LEAVES));
+}
+
+TEST(TreeHashTest, FilesAndPipesMatchMemory) {
+    std::vector<uint8_t> data = random_bytes(123'457, 4);
+    lea::thread_pool     pool(2);
+    lea::keyhash         expected = lea::tree_hash(data, pool, SMALL_LEAVES);
+
+    std::string path = ::testing::TempDir() + "lea_tree_hash.bin";
+    FILE*       file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    std::fwrite(data.data(), 1, data.size(), file);
+    std::fclose(file);
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    lea::keyhash mapped;
+    EXPECT_TRUE(lea::tree_hash_file(fd, pool, mapped, SMALL_LEAVES));
+    EXPECT_EQ(mapped, expected);
+    ::close(fd);
+    std::remove(path.c_str());
+
+    int pipe_fds[2];
+    ASSERT_EQ(::pipe(pipe_fds), 0);
+    std::thread writer([&] {
+        for (size_t offset = 0; offset < data.size(); offset += 4096) {
+            size_t size = std::min<size_t>(4096, data.size() - offset);
+            ASSERT_EQ(::write(pipe_fds[1], data.data() + offset, size),
+                      static_cast<ssize_t>(size));
+        }
+        ::close(pipe_fds[1]);
+    });
+    lea::keyhash streamed;
+    EXPECT_TRUE(lea::tree_hash_file(pipe_fds[0], pool, streamed, SMALL_LEAVES));
+    writer.join();
+    ::close(pipe_fds[0]);
+    EXPECT_EQ(streamed, expected);
+}